@@ -0,0 +1,65 @@
+/*******************************************
+
+	CFixedTimestep.cpp
+
+	Fixed timestep scheduler class implementation
+
+********************************************/
+
+#include "CFixedTimestep.h"
+
+namespace gen
+{
+
+//////////////////////////////
+// Constructors/Destructors
+
+// Constructor sets the step time and the most steps run in one frame
+CFixedTimestep::CFixedTimestep( TFloat32 stepTime /*= 1.0f / 60.0f*/, TUInt32 maxSteps /*= 4*/ )
+{
+	m_StepTime = stepTime;
+	m_MaxSteps = maxSteps;
+	m_Deterministic = false;
+	m_Accumulator = 0.0f;
+	m_DroppedTime = 0.0f;
+}
+
+
+//////////////////////////////
+// Update
+
+// Add the time passed since the last frame, returns the number of steps to run this frame
+TUInt32 CFixedTimestep::Update( TFloat32 frameTime )
+{
+	if (m_Deterministic) return 1;
+
+	// Take as many whole steps as possible from the accumulated time
+	m_Accumulator += frameTime;
+	TUInt32 numSteps = static_cast<TUInt32>(m_Accumulator / m_StepTime);
+	m_Accumulator -= numSteps * m_StepTime;
+	if (m_Accumulator < 0.0f) m_Accumulator = 0.0f; // Rounding
+
+	// Drop the steps beyond the limit rather than letting the simulation fall further behind
+	if (numSteps > m_MaxSteps)
+	{
+		m_DroppedTime += (numSteps - m_MaxSteps) * m_StepTime;
+		numSteps = m_MaxSteps;
+	}
+	return numSteps;
+}
+
+// Fraction of a step that has passed since the last step ended, from 0 to 1
+TFloat32 CFixedTimestep::GetInterpolation()
+{
+	if (m_Deterministic) return 1.0f;
+	return m_Accumulator / m_StepTime;
+}
+
+// Clear the accumulated time, e.g. when a simulation is started or unpaused
+void CFixedTimestep::Reset()
+{
+	m_Accumulator = 0.0f;
+}
+
+
+} // namespace gen
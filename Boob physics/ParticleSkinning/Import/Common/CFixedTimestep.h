@@ -0,0 +1,113 @@
+/*******************************************
+
+	CFixedTimestep.h
+
+	Fixed timestep scheduler class declarations
+
+********************************************/
+
+#pragma once
+
+#include "GenDefines.h"
+
+namespace gen
+{
+
+// Runs a simulation in steps of a fixed size whatever the frame rate, so its results don't depend
+// on the frame rate and a slow frame can't give it a huge step. Each frame, the frame time is added
+// to an accumulator and whole steps are taken from it - Update returns the number of steps to run.
+// Time left over (less than a step) carries over to the next frame. It is also given as an
+// interpolation value, so rendering can blend the last two simulation states and move smoothly
+// when the step time doesn't match the frame time.
+//
+// If the simulation falls behind (a very slow frame, or the window was dragged), the steps in one
+// frame are capped and the excess time is dropped. Otherwise the extra steps would make the next
+// frame slower still, needing even more steps (the "spiral of death").
+//
+// In deterministic mode the frame time is ignored and each frame runs exactly one step. The
+// simulation then depends only on its inputs, not on timing, so it can be recorded and replayed
+class CFixedTimestep
+{
+/////////////////////////////////////
+//	Constructors/Destructors
+public:
+	// Constructor sets the step time and the most steps run in one frame
+	CFixedTimestep( TFloat32 stepTime = 1.0f / 60.0f, TUInt32 maxSteps = 4 );
+
+
+/////////////////////////////////////
+//	Public interface
+public:
+
+	/////////////////////////////////////
+	// Getters / setters
+
+	TFloat32 GetStepTime()
+	{
+		return m_StepTime;
+	}
+	void SetStepTime( TFloat32 stepTime )
+	{
+		m_StepTime = stepTime;
+	}
+
+	// Most steps run in one frame, time beyond that is dropped
+	TUInt32 GetMaxSteps()
+	{
+		return m_MaxSteps;
+	}
+	void SetMaxSteps( TUInt32 maxSteps )
+	{
+		m_MaxSteps = maxSteps;
+	}
+
+	// Deterministic mode runs one step per frame, ignoring the frame time
+	bool IsDeterministic()
+	{
+		return m_Deterministic;
+	}
+	void SetDeterministic( bool deterministic )
+	{
+		m_Deterministic = deterministic;
+		m_Accumulator = 0.0f;
+	}
+
+	// Total time dropped so far because a frame needed more than the maximum steps
+	TFloat32 GetDroppedTime()
+	{
+		return m_DroppedTime;
+	}
+
+
+	/////////////////////////////////////
+	// Update
+
+	// Add the time passed since the last frame, returns the number of steps to run this frame
+	TUInt32 Update( TFloat32 frameTime );
+
+	// Fraction of a step that has passed since the last step ended, from 0 to 1. Render each object
+	// at this fraction of the way between its state before and after the last step. Always 1 in
+	// deterministic mode (render the latest state)
+	TFloat32 GetInterpolation();
+
+	// Clear the accumulated time, e.g. when a simulation is started or unpaused
+	void Reset();
+
+
+/////////////////////////////////////
+//	Private interface
+private:
+
+	/////////////////////////////////////
+	// Data
+
+	TFloat32 m_StepTime;
+	TUInt32  m_MaxSteps;
+	bool     m_Deterministic;
+
+	TFloat32 m_Accumulator; // Time passed that hasn't been simulated yet, less than a step after Update
+	TFloat32 m_DroppedTime;
+};
+
+
+} // namespace gen
@@ -0,0 +1,132 @@
+/*******************************************
+
+	CThreadPool.cpp
+
+	Thread pool class implementation
+
+********************************************/
+
+#include "CThreadPool.h"
+
+namespace gen
+{
+
+//////////////////////////////
+// Constructors/Destructors
+
+// Constructor creates the given number of worker threads. Pass 0 to use one less than the
+// number of hardware threads (the thread calling Run also does work)
+CThreadPool::CThreadPool( TUInt32 numThreads /*= 0*/ )
+{
+	m_Task = 0;
+	m_NumTasks = 0;
+	m_NextTask = 0;
+	m_WorkID = 0;
+	m_ActiveWorkers = 0;
+	m_Quit = false;
+
+	if (numThreads == 0)
+	{
+		TUInt32 hardwareThreads = thread::hardware_concurrency();
+		numThreads = (hardwareThreads > 1) ? hardwareThreads - 1 : 0;
+	}
+	for (TUInt32 worker = 0; worker < numThreads; ++worker)
+	{
+		m_Threads.push_back( thread( &CThreadPool::WorkerThread, this ) );
+	}
+}
+
+// Destructor waits for the worker threads to finish
+CThreadPool::~CThreadPool()
+{
+	{
+		lock_guard<mutex> lock( m_Mutex );
+		m_Quit = true;
+	}
+	m_WorkReady.notify_all();
+	for (TUInt32 worker = 0; worker < m_Threads.size(); ++worker)
+	{
+		m_Threads[worker].join();
+	}
+}
+
+
+//////////////////////////////
+// Running tasks
+
+// Call task( index ) for every index from 0 to numTasks - 1, spread across the pool threads.
+// Returns when all tasks are complete. Should only be called from one thread at a time
+void CThreadPool::Run( TUInt32 numTasks, const TTask& task )
+{
+	// Not worth waking the workers for a single task
+	if (m_Threads.empty() || numTasks <= 1)
+	{
+		for (TUInt32 index = 0; index < numTasks; ++index)
+		{
+			task( index );
+		}
+		return;
+	}
+
+	// Publish the work and wake the workers
+	{
+		lock_guard<mutex> lock( m_Mutex );
+		m_Task = &task;
+		m_NumTasks = numTasks;
+		m_NextTask = 0;
+		m_ActiveWorkers = static_cast<TUInt32>(m_Threads.size());
+		++m_WorkID;
+	}
+	m_WorkReady.notify_all();
+
+	// Help with the tasks, then wait for every worker to finish with this work before returning
+	// (so no worker is still reading the task when the next call to Run replaces it)
+	DoTasks();
+	unique_lock<mutex> lock( m_Mutex );
+	while (m_ActiveWorkers > 0)
+	{
+		m_WorkDone.wait( lock );
+	}
+	m_Task = 0;
+}
+
+
+// Main function of each worker thread - waits for work from Run until the pool is destroyed
+void CThreadPool::WorkerThread()
+{
+	TUInt32 lastWorkID = 0;
+	while (true)
+	{
+		{
+			unique_lock<mutex> lock( m_Mutex );
+			while (!m_Quit && m_WorkID == lastWorkID)
+			{
+				m_WorkReady.wait( lock );
+			}
+			if (m_Quit) return;
+			lastWorkID = m_WorkID;
+		}
+
+		DoTasks();
+
+		lock_guard<mutex> lock( m_Mutex );
+		if (--m_ActiveWorkers == 0)
+		{
+			m_WorkDone.notify_one();
+		}
+	}
+}
+
+// Take and run tasks from the current call to Run until there are none left
+void CThreadPool::DoTasks()
+{
+	TUInt32 index = m_NextTask++;
+	while (index < m_NumTasks)
+	{
+		(*m_Task)( index );
+		index = m_NextTask++;
+	}
+}
+
+
+} // namespace gen
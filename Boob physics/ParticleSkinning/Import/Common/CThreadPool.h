@@ -0,0 +1,106 @@
+/*******************************************
+
+	CThreadPool.h
+
+	Thread pool class declarations
+
+********************************************/
+
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+using namespace std;
+
+#include "GenDefines.h"
+
+namespace gen
+{
+
+// A fixed set of worker threads used to run a number of independent tasks in parallel. Each call
+// to Run spreads its tasks over the worker threads and the calling thread, then waits for all of
+// them to finish. Tasks must not touch shared data that other tasks write (e.g. the D3D device)
+class CThreadPool
+{
+/////////////////////////////////////
+//	Constructors/Destructors
+public:
+	// Constructor creates the given number of worker threads. Pass 0 to use one less than the
+	// number of hardware threads (the thread calling Run also does work)
+	CThreadPool( TUInt32 numThreads = 0 );
+
+	// Destructor waits for the worker threads to finish
+	~CThreadPool();
+
+private:
+	// Prevent use of copy constructor and assignment operator (private and not defined)
+	CThreadPool( const CThreadPool& );
+	CThreadPool& operator=( const CThreadPool& );
+
+
+/////////////////////////////////////
+//	Public interface
+public:
+
+	/////////////////////////////////////
+	// Types
+
+	// A task is called with an index from 0 to the number of tasks - 1
+	typedef function<void( TUInt32 )> TTask;
+
+
+	/////////////////////////////////////
+	// Getters
+
+	// Number of threads used to run tasks, including the thread calling Run
+	TUInt32 GetNumThreads()
+	{
+		return static_cast<TUInt32>(m_Threads.size()) + 1;
+	}
+
+
+	/////////////////////////////////////
+	// Running tasks
+
+	// Call task( index ) for every index from 0 to numTasks - 1, spread across the pool threads.
+	// Returns when all tasks are complete. Should only be called from one thread at a time
+	void Run( TUInt32 numTasks, const TTask& task );
+
+
+/////////////////////////////////////
+//	Private interface
+private:
+
+	/////////////////////////////////////
+	// Support functions
+
+	// Main function of each worker thread - waits for work from Run until the pool is destroyed
+	void WorkerThread();
+
+	// Take and run tasks from the current call to Run until there are none left
+	void DoTasks();
+
+
+	/////////////////////////////////////
+	// Data
+
+	vector<thread>     m_Threads;
+
+	// Current work - protected by the mutex, except the next task index which is atomic
+	mutex              m_Mutex;
+	condition_variable m_WorkReady;     // Signalled when Run has work or the pool is destroyed
+	condition_variable m_WorkDone;      // Signalled when the last worker finishes its tasks
+	const TTask*       m_Task;
+	TUInt32            m_NumTasks;
+	atomic<TUInt32>    m_NextTask;
+	TUInt32            m_WorkID;        // Incremented for each call to Run
+	TUInt32            m_ActiveWorkers; // Workers yet to finish the current call to Run
+	bool               m_Quit;
+};
+
+
+} // namespace gen
@@ -9,18 +9,18 @@
 
 #include "Particle.h"
 #include "Spring.h"
+#include "SpringSystem.h"
 
 
 /////////////////////////////
 // Static Data / Constants
 
-// Damping used for particle motion 
-// Tweak depending on system
-const float DAMPING = 0.5f;
-
 // UID for load/save - each particle has a UID which is saved in place of its pointer
 unsigned int CParticle::m_CurrentUID = 0;
 
+// Spring system holding the simulation data for all particles
+extern CSpringSystem SpringSystem;
+
 	
 /////////////////////////////
 // Constructor / Destructor
@@ -28,9 +28,8 @@ unsigned int CParticle::m_CurrentUID = 0;
 // Constructor
 CParticle::CParticle( CVector3 position, float mass /*= 1.0f*/, bool pinned /*= false*/, unsigned int UID /*= DEFAULT_UID*/ )
 {
-	m_ModelPosition = m_WorldPosition = m_SimPosition = position;
-	m_Mass = mass;
-	m_Pinned = pinned;
+	m_ModelPosition = m_WorldPosition = position;
+	m_Index = SpringSystem.AddParticle( position, mass, pinned, this );
 
 	// Set UID for spring. If constructor passed DEFAULT_UID, then create a new UID
 	if (UID == DEFAULT_UID)
@@ -58,6 +57,53 @@ CParticle::~CParticle()
 		if ((*itSpring)->GetParticle2() == this) (*itSpring)->SetParticle2( NULL );
 		itSpring++;
 	}
+
+	// Remove from spring system, the last particle in the system is moved to this particle's index
+	SpringSystem.RemoveParticle( m_Index );
+	if (m_Index < SpringSystem.GetNumParticles())
+	{
+		SpringSystem.GetParticleView( m_Index )->m_Index = m_Index;
+	}
+}
+
+
+////////////////////////////////////
+// Properties, getters and setters
+
+CVector3 CParticle::GetSimPosition()
+{
+	return SpringSystem.Position( m_Index );
+}
+
+// Position part way through the last simulation step (0 = start, 1 = end), used to render between steps
+CVector3 CParticle::GetSimPosition( float interpolation )
+{
+	return SpringSystem.GetInterpolatedPosition( m_Index, interpolation );
+}
+
+float CParticle::GetMass()
+{
+	return SpringSystem.GetMass( m_Index );
+}
+
+bool CParticle::IsPinned()
+{
+	return SpringSystem.IsPinned( m_Index );
+}
+
+void CParticle::SetSimPosition( CVector3& position )
+{
+	SpringSystem.Position( m_Index ) = position;
+}
+
+void CParticle::SetMass( float mass )
+{
+	SpringSystem.SetMass( m_Index, mass );
+}
+
+void CParticle::Pin( bool isPinned )
+{
+	SpringSystem.Pin( m_Index, isPinned );
 }
 
 
@@ -95,14 +141,13 @@ void CParticle::RemoveSpring( CSpring* spring )
 //   true world matrix for each particle, allowing particles to work as bones in the skinning code
 //*************************************************************************************************//
 
-// Initialise all particle data at simulation start. Pass initial world matrix of model that system is attached to
+// Initialise particle position at simulation start. Pass initial world matrix of model that system is attached to
+// The spring system's InitSimulation should be called after all particles are initialised
 void CParticle::Initialise( CMatrix4x4 worldMatrix )
 {
 	// Use given matrix to set position of particle in world space to match the model's position
 	m_WorldPosition = worldMatrix.TransformPoint( m_ModelPosition );
-	m_SimPosition = m_WorldPosition;
-	m_PrevPosition = m_SimPosition;
-	m_Acceleration = CVector3::kZero;
+	SpringSystem.Position( m_Index ) = m_WorldPosition;
 }
 
 // Calculate new positions for particles given world matrix of model that system is attached to
@@ -111,9 +156,9 @@ void CParticle::Transform( CMatrix4x4 worldMatrix )
 	m_WorldPosition = worldMatrix.TransformPoint( m_ModelPosition );
 	
 	// Only move pinned particles directly to this new world space position (see comment above)
-	if (m_Pinned)
+	if (SpringSystem.IsPinned( m_Index ))
 	{
-		m_SimPosition = m_WorldPosition;
+		SpringSystem.Position( m_Index ) = m_WorldPosition;
 	}
 }
 
@@ -128,57 +173,25 @@ CVector3 ChooseNonAlignedVector( CVector3 src, CVector3 v1, CVector3 v2 )
 // Ideally, we would be able to specify which spring(s) define the facing of the matrix to give the best rotational behaviour for the model. 
 //
 // Having a full matrix per-particle will allow use the standard skinning algorithm when rendering - each particle representing a bone.
-// In practice there are two versions of this matrix - the initial matrix (as modelled), and the current matrix in the simulation
-CMatrix4x4 CParticle::GetMatrix( CMatrix4x4 modelMatrix, bool getSimulationMatrix )
+// In practice there are two versions of this matrix - the initial matrix (as modelled), and the current matrix in the simulation.
+// The simulation matrix can be taken part way through the last simulation step (interpolation from 0 to 1), to render between steps
+CMatrix4x4 CParticle::GetMatrix( CMatrix4x4 modelMatrix, bool getSimulationMatrix, float interpolation /*= 1.0f*/ )
 {
 	// No springs, return world axis aligned matrix with correct position
 	if (m_Springs.size() == 0) 
 	{
-		return CMatrix4x4( (getSimulationMatrix ? m_SimPosition : m_ModelPosition) );
+		return CMatrix4x4( (getSimulationMatrix ? GetSimPosition( interpolation ) : m_ModelPosition) );
 	}
 
 	// At least one spring, matrix Z-axis faces down spring, use cross products with world axes for remainder of matrix
 	list<CSpring*>::iterator itSpring = m_Springs.begin();
 
 	// Get direction of spring from this particle, either as originally modelled or at current time in simulation (need to check which end this particle on)
-	CVector3 springDir = getSimulationMatrix ? ((*itSpring)->GetParticle1()->GetSimPosition() - (*itSpring)->GetParticle2()->GetSimPosition()) :
+	CVector3 springDir = getSimulationMatrix ? ((*itSpring)->GetParticle1()->GetSimPosition( interpolation ) - (*itSpring)->GetParticle2()->GetSimPosition( interpolation )) :
 		                                       ((*itSpring)->GetParticle1()->GetModelPosition() - (*itSpring)->GetParticle2()->GetModelPosition());
 	if ((*itSpring)->GetParticle1() == this) springDir = -springDir;
 
 	// Use facing matrix helper from matrix class. Spring direction is first axis for matrix, use model X-axis to determine second axis (with cross products)
-	return MatrixFaceDirection( (getSimulationMatrix ? m_SimPosition : m_ModelPosition), springDir, modelMatrix.XAxis() );
+	return MatrixFaceDirection( (getSimulationMatrix ? GetSimPosition( interpolation ) : m_ModelPosition), springDir, modelMatrix.XAxis() );
 }
 
-
-////////////////////////////////////
-// Simulation
-
-// Update position & velocity of particle based on external forces plus forces from all attached springs
-// Look at the Spring.h & Particle.h files to see the available member data and methods
-void CParticle::ApplyForces( float frameTime, CVector3 externalForces )
-{
-	// Do nothing if particle is pinned
-	if (m_Pinned) return;
-
-	// Iterate through list of attached springs and get force exerted by each - accumulate into a total force
-	// Also add external forces to the total
-	CVector3 force = externalForces;
-	list<CSpring*>::iterator itSpring = m_Springs.begin();
-	while (itSpring != m_Springs.end())
-	{
-		CVector3 springForce = (*itSpring)->CalculateForce( this );
-		force += springForce;
-		itSpring++;
-	}
-
- 	// Reduce force with damping - proportional to the velocity
-	force -=  DAMPING * (m_SimPosition - m_PrevPosition) / frameTime;
-
-	// Get acceleration from force
-	m_Acceleration = force / m_Mass;
-	
-	// Update position using verlet method
-	CVector3 newPosition = 2 * m_SimPosition - m_PrevPosition + m_Acceleration * frameTime * frameTime;
-	m_PrevPosition = m_SimPosition;
-	m_SimPosition = newPosition;
-}
\ No newline at end of file
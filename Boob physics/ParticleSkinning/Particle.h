@@ -34,17 +34,19 @@ public:
 	// Properties, getters and setters
 
 	CVector3   GetModelPosition() { return m_ModelPosition; }
-	CVector3   GetSimPosition()   { return m_SimPosition; }
-	CMatrix4x4 GetMatrix( CMatrix4x4 modelMatrix, bool getSimulationMatrix ); // Get a full matrix for the particle, deriving axes from attached springs (see cpp file)
-
-	float    GetMass()    { return m_Mass; }
-	bool     IsPinned()   { return m_Pinned; }
-	unsigned int GetUID() { return m_UID; }
+	CVector3   GetSimPosition();
+	CVector3   GetSimPosition( float interpolation ); // Position part way through the last simulation step (0 = start, 1 = end)
+	CMatrix4x4 GetMatrix( CMatrix4x4 modelMatrix, bool getSimulationMatrix, float interpolation = 1.0f ); // Get a full matrix for the particle, deriving axes from attached springs (see cpp file)
+
+	float    GetMass();
+	bool     IsPinned();
+	unsigned int GetUID()   { return m_UID; }
+	unsigned int GetIndex() { return m_Index; } // Index of the particle in the spring system
 	
-	void SetSimPosition( CVector3& position )   { m_SimPosition = position; }
+	void SetSimPosition( CVector3& position );
 	
-	void SetMass( float mass ) { m_Mass = mass; }
-	void Pin( bool isPinned )  { m_Pinned = isPinned; } 
+	void SetMass( float mass );
+	void Pin( bool isPinned );
 
 
 	////////////////////////////////////
@@ -62,12 +64,6 @@ public:
 	void Transform( CMatrix4x4 matrix );
 
 
-	////////////////////////////////////
-	// Simulation
-
-	void ApplyForces( float updateTime, CVector3 externalForces );
-
-
 private:
 
 	////////////////////////////////////
@@ -78,18 +74,12 @@ private:
 	//**************************************************************************************************************************//
 	CVector3 m_ModelPosition; // Original particle position as designed (model space)
 	CVector3 m_WorldPosition; // Original particle position transformed to world space (to follow model), but with no simulation
-	CVector3 m_SimPosition;   // Particle position in world space with simulation applied
 
-	// Other Static data
-	float    m_Mass;
-	bool     m_Pinned; // A pinned particle cannot be moved
+	// Position with simulation applied (in world space), mass and other simulation data are held in the spring system (see SpringSystem.h)
+	unsigned int m_Index;
 	
 	list<CSpring*> m_Springs; // All the springs attached to this particle
 
-	// Simulation data
-	CVector3 m_Acceleration;
-	CVector3 m_PrevPosition;
-
 	// UID for load/save - each particle has a UID which is saved in place of its pointer
 	static const unsigned int DEFAULT_UID = 0xffffffff; // Special UID passed to constructor
 	static unsigned int       m_CurrentUID;             // UID used for next new particle
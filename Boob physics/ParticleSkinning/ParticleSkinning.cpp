@@ -24,6 +24,10 @@ using namespace std;
 using namespace gen;
 
 // Particle physics
+#include "CThreadPool.h"
+#include "CFixedTimestep.h"
+#include "SpringSystem.h"
+#include "PhysicsRecording.h"
 #include "Particle.h"
 #include "Spring.h"
 
@@ -140,13 +144,41 @@ LRESULT CALLBACK WndProc( HWND, UINT, WPARAM, LPARAM );
 // Particle Physics Data
 //******************************************************************************//
 // Same spring & particle lists as the TL-Engine example. This application only manages a single
-// particle-physics system, a more advanced app would encapsulate (and optimise) this data further
+// particle-physics system. The simulation data for the particles and springs is held in the spring
+// system, the particle and spring objects in the lists are views onto it
 
+CSpringSystem    SpringSystem;
 list<CParticle*> Particles;
 list<CSpring*>   Springs;
 
+// Threads used to solve the constraints
+CThreadPool* ThreadPool = 0;
+
+// The physics is stepped at a fixed rate whatever the frame rate, the model is skinned between steps.
+// Slow frames run at most MAX_PHYSICS_STEPS steps, the simulation slows down rather than falling behind
+const float PHYSICS_RATE = 120.0f; // Steps per second
+const int MAX_PHYSICS_STEPS = 8;
+CFixedTimestep PhysicsTimestep( 1 / PHYSICS_RATE, MAX_PHYSICS_STEPS );
+
+// The physics is recorded from the start and saved on exit, so a session that goes wrong can be
+// replayed exactly (with the PhysicsReplay program)
+const string RECORDING_FILE = "LastSession.phr";
+CPhysicsRecording PhysicsRecording;
+
 const CVector3 GRAVITY = CVector3(0, -98.0f, 0);
 
+// Damping used for particle motion and global springiness (a simple tweak to the springiness of
+// everything in the system). Tweak depending on system
+const float DAMPING = 0.5f;
+const float GLOBAL_SPRINGINESS = 0.5f;
+
+// Times the rods and strings are solved each frame - more keeps long chains from stretching
+const int SOLVER_ITERATIONS = 4;
+
+// Parts of the model that come to rest (kinetic energy per unit mass below this) stop being simulated
+// until the model moves again - moving the pinned particles in TransformPhysicsSystem wakes them
+const float SLEEP_THRESHOLD = 0.5f;
+
 // Only interested in unpinned particles for skinning (pinned particles just follow model so don't affect skinning)
 // Store lists of their original (model-space) positions to generate vertex influences and weights for skinning. 
 // Model vertices are affected by nearby particles, weighted by distance. The second list is the list of particle
@@ -302,15 +334,18 @@ void GetSkinningParticlePositions( CVector3* positions )
 // to model vertices. However, if we get the particle matrix in its initial position (relative to the model), and its matrix in at the current state
 // in the simulation, then the transformation between these two matrices is the amount of movement & rotation applied to the particle relative to the
 // model. I.e. this transform represents the world matrix for the particle and can be applied to model matrices. 
+// The current matrices are taken between the last two physics steps, at the time left over from the fixed steps
 void GetSkinningParticleMatrices( CMatrix4x4* matrices, CMatrix4x4 worldMatrix )
 {
+	float interpolation = PhysicsTimestep.GetInterpolation();
+
 	int particle = 0;
 	list<CParticle*>::iterator itParticle = Particles.begin();
 	while (itParticle != Particles.end())
 	{
 		// Read comment at top. The transform between matrices A & B is equal to Inverse(A) * B. Do that with the particle matrices as described above
 		// to give us a particle world matrix, usable for skinning
-		matrices[particle] = Inverse( (*itParticle)->GetMatrix( CMatrix4x4::kIdentity, false ) ) * (*itParticle)->GetMatrix( worldMatrix, true );
+		matrices[particle] = Inverse( (*itParticle)->GetMatrix( CMatrix4x4::kIdentity, false ) ) * (*itParticle)->GetMatrix( worldMatrix, true, interpolation );
 		particle++;
 		++itParticle;
 	}
@@ -341,6 +376,14 @@ void InitPhysicsSystem( CModel* model, float scale )
 		(*itSpring)->SetInertialLength( (*itSpring)->GetInertialLength() * scale );
 		++itSpring;
 	}
+
+	SpringSystem.SetDamping( DAMPING );
+	SpringSystem.SetSpringiness( GLOBAL_SPRINGINESS );
+	SpringSystem.SetNumIterations( SOLVER_ITERATIONS );
+	SpringSystem.SetSleepThreshold( SLEEP_THRESHOLD );
+	SpringSystem.InitSimulation();
+	PhysicsTimestep.Reset();
+	PhysicsRecording.Start( SpringSystem, PhysicsTimestep );
 }
 
 // Transform particles in system to follow world matrix of given model. Only pinned particles will follow directly. Free particles
@@ -360,25 +403,19 @@ void TransformPhysicsSystem( CModel* model )
 	}
 }
 
-// Update the particle physics system - same as last week
+// Update the particle physics system - same as last week, but in as many fixed steps as fit in the frame time
 void UpdatePhysicsSystem( float frameTime )
 {
-	// Update particle positions based on forces from springs and external forces (e.g. gravity)
-	list<CParticle*>::iterator itParticle = Particles.begin();
-	while (itParticle != Particles.end())
+	// Update particle positions based on forces from springs and external forces (e.g. gravity), then adjust
+	// them based on any constraints (e.g. rods cannot change length)
+	// The pinned particles moved by TransformPhysicsSystem are recorded as inputs to the frame
+	PhysicsRecording.RecordInputs( SpringSystem, frameTime, GRAVITY );
+	unsigned int numSteps = PhysicsTimestep.Update( frameTime );
+	for (unsigned int step = 0; step < numSteps; ++step)
 	{
-		CVector3 externalForces = (*itParticle)->GetMass() * GRAVITY;
-		(*itParticle)->ApplyForces( frameTime, externalForces );
-		++itParticle;
-	}
-
-	// Adjust springs (and their attached particles) based on any constraints (e.g. rods cannot change length)
-	list<CSpring*>::iterator itSpring = Springs.begin();
-	while (itSpring != Springs.end())
-	{
-		(*itSpring)->ApplyConstraints();
-		++itSpring;
+		SpringSystem.Step( PhysicsTimestep.GetStepTime(), GRAVITY );
 	}
+	PhysicsRecording.RecordResult( SpringSystem );
 }
 
 
@@ -470,6 +507,10 @@ void ReleaseResources()
 	delete SoftModel;
 	delete MainCamera;
 
+	PhysicsRecording.Save( RECORDING_FILE );
+	SpringSystem.SetThreadPool( 0 );
+	delete ThreadPool;
+
 	delete[] SkinningPositions;
 	delete[] SkinningMatrices;
 
@@ -561,6 +602,10 @@ bool InitScene()
 	//*******************************************************//
 	SoftModel = new CModel;
 
+	// Solve constraints across all cores
+	ThreadPool = new CThreadPool();
+	SpringSystem.SetThreadPool( ThreadPool );
+
 //	LoadParticlePhysics( "Rope.ptf" );
 //	LoadParticlePhysics( "Woman.ptf" );
 
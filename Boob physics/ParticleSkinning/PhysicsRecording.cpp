@@ -0,0 +1,475 @@
+//-----------------------------------------------------
+// PhysicsRecording.cpp
+//   Binary recording of the inputs to a spring system
+//   simulation, for bit-exact replay
+//-----------------------------------------------------
+
+#include <fstream>
+using namespace std;
+
+#include "PhysicsRecording.h"
+
+
+/////////////////////////////
+// Constructor
+
+CPhysicsRecording::CPhysicsRecording()
+{
+	memset( &m_Header, 0, sizeof(m_Header) );
+	m_Recording = false;
+}
+
+
+////////////////////////////////////
+// Recording
+
+// Start a new recording of the given system, which must have just been initialised and not yet
+// stepped. The system's springs are recoloured, so a system built from the recording (adding the
+// springs in order) gets the same colours and solves its constraints in the same order
+void CPhysicsRecording::Start( CSpringSystem& system, CFixedTimestep& timestep )
+{
+	system.RecolourSprings();
+
+	// Settings
+	memset( &m_Header, 0, sizeof(m_Header) );
+	m_Header.integrator = system.GetIntegrator();
+	m_Header.numIterations = system.GetNumIterations();
+	m_Header.damping = system.GetDamping();
+	m_Header.springiness = system.GetSpringiness();
+	for (int type = 0; type < CSpringSystem::NumTypes; ++type)
+	{
+		m_Header.compliances[type] = system.GetCompliance( static_cast<CSpringSystem::ESpringType>(type) );
+	}
+	m_Header.maxCGIterations = system.GetMaxCGIterations();
+	m_Header.CGTolerance = system.GetCGTolerance();
+	m_Header.particleRadius = system.GetParticleRadius();
+	m_Header.sleepThreshold = system.GetSleepThreshold();
+	m_Header.stepTime = timestep.GetStepTime();
+	m_Header.maxSteps = timestep.GetMaxSteps();
+	m_Header.deterministic = timestep.IsDeterministic() ? 1 : 0;
+
+	// Particles, springs and colliders
+	m_Particles.resize( system.GetNumParticles() );
+	m_LastPositions.resize( system.GetNumParticles() );
+	m_LastPinned.resize( system.GetNumParticles() );
+	for (unsigned int particle = 0; particle < system.GetNumParticles(); ++particle)
+	{
+		SParticleRecord& p = m_Particles[particle];
+		p.position = system.Position( particle );
+		p.mass = system.GetMass( particle );
+		p.pinned = system.IsPinned( particle ) ? 1 : 0;
+		m_LastPositions[particle] = p.position;
+		m_LastPinned[particle] = static_cast<unsigned char>(p.pinned);
+	}
+	m_Springs.resize( system.GetNumSprings() );
+	for (unsigned int spring = 0; spring < system.GetNumSprings(); ++spring)
+	{
+		const CSpringSystem::SSpring& s = system.GetSpring( spring );
+		SSpringRecord& r = m_Springs[spring];
+		r.particle1 = s.particle1;
+		r.particle2 = s.particle2;
+		r.coefficient = s.coefficient;
+		r.inertialLength = s.inertialLength;
+		r.type = s.type;
+	}
+	m_Planes.clear();
+	m_Spheres.clear();
+	m_Capsules.clear();
+	for (unsigned int plane = 0; plane < system.GetNumPlaneColliders(); ++plane)
+	{
+		m_Planes.push_back( system.PlaneCollider( plane ) );
+	}
+	for (unsigned int sphere = 0; sphere < system.GetNumSphereColliders(); ++sphere)
+	{
+		m_Spheres.push_back( system.SphereCollider( sphere ) );
+	}
+	for (unsigned int capsule = 0; capsule < system.GetNumCapsuleColliders(); ++capsule)
+	{
+		m_Capsules.push_back( system.CapsuleCollider( capsule ) );
+	}
+	m_LastPlanes = m_Planes;
+	m_LastSpheres = m_Spheres;
+	m_LastCapsules = m_Capsules;
+
+	m_Frames.clear();
+	m_ParticleEvents.clear();
+	m_ColliderEvents.clear();
+	m_Recording = true;
+}
+
+// Record the inputs to a frame, call before updating the system. Particles whose position or pin
+// differs from the end of the last frame have been changed by the application
+void CPhysicsRecording::RecordInputs( CSpringSystem& system, float frameTime, const CVector3& gravity )
+{
+	if (!m_Recording) return;
+	if (system.GetNumParticles() != m_Particles.size() || system.GetNumSprings() != m_Springs.size() ||
+	    system.GetNumPlaneColliders() != m_Planes.size() || system.GetNumSphereColliders() != m_Spheres.size() ||
+	    system.GetNumCapsuleColliders() != m_Capsules.size())
+	{
+		m_Recording = false;
+		return;
+	}
+
+	SFrameRecord frame;
+	frame.frameTime = frameTime;
+	frame.gravity = gravity;
+	frame.firstParticleEvent = static_cast<TUInt32>(m_ParticleEvents.size());
+	frame.firstColliderEvent = static_cast<TUInt32>(m_ColliderEvents.size());
+	frame.checksum = 0;
+	m_Frames.push_back( frame );
+
+	for (unsigned int particle = 0; particle < system.GetNumParticles(); ++particle)
+	{
+		unsigned char pinned = system.IsPinned( particle ) ? 1 : 0;
+		if (pinned == m_LastPinned[particle] && SameBits( system.Position( particle ), m_LastPositions[particle] )) continue;
+
+		SParticleEvent event;
+		event.type = (pinned == m_LastPinned[particle]) ? Moved : (pinned ? Pinned : Unpinned);
+		event.particle = particle;
+		event.position = system.Position( particle );
+		m_ParticleEvents.push_back( event );
+	}
+	RecordColliders( system );
+}
+
+// Record the result of the frame, call after updating the system
+void CPhysicsRecording::RecordResult( CSpringSystem& system )
+{
+	if (!m_Recording || m_Frames.empty()) return;
+
+	m_Frames.back().checksum = Checksum( system );
+	for (unsigned int particle = 0; particle < system.GetNumParticles(); ++particle)
+	{
+		m_LastPositions[particle] = system.Position( particle );
+		m_LastPinned[particle] = system.IsPinned( particle ) ? 1 : 0;
+	}
+}
+
+
+////////////////////////////////////
+// Replay
+
+// Build the recorded system in the given system (which must be empty), initialise it and set up
+// the timestep as it was when recording started
+void CPhysicsRecording::CreateSystem( CSpringSystem& system, CFixedTimestep& timestep )
+{
+	for (unsigned int particle = 0; particle < m_Particles.size(); ++particle)
+	{
+		const SParticleRecord& p = m_Particles[particle];
+		system.AddParticle( p.position, p.mass, p.pinned != 0 );
+	}
+	for (unsigned int spring = 0; spring < m_Springs.size(); ++spring)
+	{
+		const SSpringRecord& s = m_Springs[spring];
+		system.AddSpring( s.particle1, s.particle2, s.coefficient, s.inertialLength,
+		                  static_cast<CSpringSystem::ESpringType>(s.type) );
+	}
+	for (unsigned int plane = 0; plane < m_Planes.size(); ++plane)
+	{
+		// AddPlaneCollider normalises the normal, which can change its bits - restore the plane
+		// exactly as recorded so the replay stays bit-exact
+		unsigned int added = system.AddPlaneCollider( m_Planes[plane].normal, m_Planes[plane].distance );
+		system.PlaneCollider( added ) = m_Planes[plane];
+	}
+	for (unsigned int sphere = 0; sphere < m_Spheres.size(); ++sphere)
+	{
+		system.AddSphereCollider( m_Spheres[sphere].centre, m_Spheres[sphere].radius );
+	}
+	for (unsigned int capsule = 0; capsule < m_Capsules.size(); ++capsule)
+	{
+		const CSpringSystem::SCapsuleCollider& c = m_Capsules[capsule];
+		system.AddCapsuleCollider( c.point1, c.point2, c.radius );
+	}
+
+	system.SetIntegrator( static_cast<CSpringSystem::EIntegrator>(m_Header.integrator) );
+	system.SetNumIterations( m_Header.numIterations );
+	system.SetDamping( m_Header.damping );
+	system.SetSpringiness( m_Header.springiness );
+	for (int type = 0; type < CSpringSystem::NumTypes; ++type)
+	{
+		system.SetCompliance( static_cast<CSpringSystem::ESpringType>(type), m_Header.compliances[type] );
+	}
+	system.SetMaxCGIterations( m_Header.maxCGIterations );
+	system.SetCGTolerance( m_Header.CGTolerance );
+	system.SetParticleRadius( m_Header.particleRadius );
+	system.SetSleepThreshold( m_Header.sleepThreshold );
+	system.InitSimulation();
+
+	timestep.SetStepTime( m_Header.stepTime );
+	timestep.SetMaxSteps( m_Header.maxSteps );
+	timestep.SetDeterministic( m_Header.deterministic != 0 );
+	timestep.Reset();
+}
+
+// Apply the changes recorded for a frame to the system, returns the frame time. Gravity for the
+// frame is returned in the given pointer
+float CPhysicsRecording::ApplyInputs( unsigned int frame, CSpringSystem& system, CVector3* gravity )
+{
+	const SFrameRecord& f = m_Frames[frame];
+	bool lastFrame = (frame + 1 == m_Frames.size());
+	TUInt32 lastParticleEvent = lastFrame ? static_cast<TUInt32>(m_ParticleEvents.size()) : m_Frames[frame + 1].firstParticleEvent;
+	TUInt32 lastColliderEvent = lastFrame ? static_cast<TUInt32>(m_ColliderEvents.size()) : m_Frames[frame + 1].firstColliderEvent;
+
+	for (TUInt32 event = f.firstParticleEvent; event < lastParticleEvent; ++event)
+	{
+		const SParticleEvent& e = m_ParticleEvents[event];
+		if (e.type != Moved)
+		{
+			system.Pin( e.particle, e.type == Pinned );
+		}
+		system.Position( e.particle ) = e.position;
+		system.WakeParticle( e.particle );
+	}
+
+	for (TUInt32 event = f.firstColliderEvent; event < lastColliderEvent; ++event)
+	{
+		const SColliderEvent& e = m_ColliderEvents[event];
+		if (e.type == Plane)
+		{
+			system.PlaneCollider( e.collider ).normal = e.point1;
+			system.PlaneCollider( e.collider ).distance = e.radius;
+		}
+		else if (e.type == Sphere)
+		{
+			system.SphereCollider( e.collider ).centre = e.point1;
+			system.SphereCollider( e.collider ).radius = e.radius;
+		}
+		else
+		{
+			system.CapsuleCollider( e.collider ).point1 = e.point1;
+			system.CapsuleCollider( e.collider ).point2 = e.point2;
+			system.CapsuleCollider( e.collider ).radius = e.radius;
+		}
+	}
+	if (lastColliderEvent > f.firstColliderEvent)
+	{
+		system.WakeAll();
+	}
+
+	*gravity = f.gravity;
+	return f.frameTime;
+}
+
+// Whether the system matches the recording after updating the given frame
+bool CPhysicsRecording::CheckResult( unsigned int frame, CSpringSystem& system )
+{
+	return Checksum( system ) == m_Frames[frame].checksum;
+}
+
+// Checksum of a system's particle positions and velocities - 32-bit FNV-1a hash of their bytes
+TUInt32 CPhysicsRecording::Checksum( CSpringSystem& system )
+{
+	TUInt32 hash = 2166136261u;
+	for (unsigned int particle = 0; particle < system.GetNumParticles(); ++particle)
+	{
+		CVector3 values[2] = { system.Position( particle ), system.GetVelocity( particle ) };
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values);
+		for (unsigned int byte = 0; byte < sizeof(values); ++byte)
+		{
+			hash = (hash ^ bytes[byte]) * 16777619u;
+		}
+	}
+	return hash;
+}
+
+
+////////////////////////////////////
+// File access
+
+// Save the recording to a binary file, returns true on success
+bool CPhysicsRecording::Save( const string& fileName ) const
+{
+	ofstream file( fileName.c_str(), ios::out | ios::binary | ios::trunc );
+	if (!file)
+	{
+		return false;
+	}
+
+	SHeader header = m_Header;
+	header.fileID = FILE_ID;
+	header.version = FILE_VERSION;
+	header.numParticles = static_cast<TUInt32>(m_Particles.size());
+	header.numSprings = static_cast<TUInt32>(m_Springs.size());
+	header.numPlanes = static_cast<TUInt32>(m_Planes.size());
+	header.numSpheres = static_cast<TUInt32>(m_Spheres.size());
+	header.numCapsules = static_cast<TUInt32>(m_Capsules.size());
+	header.numFrames = static_cast<TUInt32>(m_Frames.size());
+	header.numParticleEvents = static_cast<TUInt32>(m_ParticleEvents.size());
+	header.numColliderEvents = static_cast<TUInt32>(m_ColliderEvents.size());
+
+	// Write the header then each array in a single block
+	file.write( reinterpret_cast<const char*>(&header), sizeof(header) );
+	if (!m_Particles.empty())      file.write( reinterpret_cast<const char*>(&m_Particles[0]), m_Particles.size() * sizeof(SParticleRecord) );
+	if (!m_Springs.empty())        file.write( reinterpret_cast<const char*>(&m_Springs[0]), m_Springs.size() * sizeof(SSpringRecord) );
+	if (!m_Planes.empty())         file.write( reinterpret_cast<const char*>(&m_Planes[0]), m_Planes.size() * sizeof(CSpringSystem::SPlaneCollider) );
+	if (!m_Spheres.empty())        file.write( reinterpret_cast<const char*>(&m_Spheres[0]), m_Spheres.size() * sizeof(CSpringSystem::SSphereCollider) );
+	if (!m_Capsules.empty())       file.write( reinterpret_cast<const char*>(&m_Capsules[0]), m_Capsules.size() * sizeof(CSpringSystem::SCapsuleCollider) );
+	if (!m_Frames.empty())         file.write( reinterpret_cast<const char*>(&m_Frames[0]), m_Frames.size() * sizeof(SFrameRecord) );
+	if (!m_ParticleEvents.empty()) file.write( reinterpret_cast<const char*>(&m_ParticleEvents[0]), m_ParticleEvents.size() * sizeof(SParticleEvent) );
+	if (!m_ColliderEvents.empty()) file.write( reinterpret_cast<const char*>(&m_ColliderEvents[0]), m_ColliderEvents.size() * sizeof(SColliderEvent) );
+
+	return !file.fail();
+}
+
+// Load a recording saved with Save, returns false if the file can't be read, is not a
+// recording of the current version or holds records that are out of range
+bool CPhysicsRecording::Load( const string& fileName )
+{
+	ifstream file( fileName.c_str(), ios::in | ios::binary );
+	if (!file)
+	{
+		return false;
+	}
+
+	SHeader header;
+	file.read( reinterpret_cast<char*>(&header), sizeof(header) );
+	if (file.fail() || header.fileID != FILE_ID || header.version != FILE_VERSION ||
+	    header.integrator > CSpringSystem::Implicit)
+	{
+		return false;
+	}
+
+	// The file must be exactly the size the header gives, checked before anything is allocated
+	// so a corrupt header can't cause huge allocations or reads past the end of the file
+	TUInt64 dataSize = sizeof(SHeader) +
+	                   static_cast<TUInt64>(header.numParticles) * sizeof(SParticleRecord) +
+	                   static_cast<TUInt64>(header.numSprings) * sizeof(SSpringRecord) +
+	                   static_cast<TUInt64>(header.numPlanes) * sizeof(CSpringSystem::SPlaneCollider) +
+	                   static_cast<TUInt64>(header.numSpheres) * sizeof(CSpringSystem::SSphereCollider) +
+	                   static_cast<TUInt64>(header.numCapsules) * sizeof(CSpringSystem::SCapsuleCollider) +
+	                   static_cast<TUInt64>(header.numFrames) * sizeof(SFrameRecord) +
+	                   static_cast<TUInt64>(header.numParticleEvents) * sizeof(SParticleEvent) +
+	                   static_cast<TUInt64>(header.numColliderEvents) * sizeof(SColliderEvent);
+	file.seekg( 0, ios::end );
+	streamoff fileSize = file.tellg();
+	file.seekg( sizeof(SHeader), ios::beg );
+	if (file.fail() || fileSize < 0 || static_cast<TUInt64>(fileSize) != dataSize)
+	{
+		return false;
+	}
+
+	// Read each array in a single block, leaving the recording empty if any read fails or any
+	// record is out of range
+	if (!ReadArray( file, m_Particles, header.numParticles ) ||
+	    !ReadArray( file, m_Springs, header.numSprings ) ||
+	    !ReadArray( file, m_Planes, header.numPlanes ) ||
+	    !ReadArray( file, m_Spheres, header.numSpheres ) ||
+	    !ReadArray( file, m_Capsules, header.numCapsules ) ||
+	    !ReadArray( file, m_Frames, header.numFrames ) ||
+	    !ReadArray( file, m_ParticleEvents, header.numParticleEvents ) ||
+	    !ReadArray( file, m_ColliderEvents, header.numColliderEvents ) || !RecordsValid())
+	{
+		m_Particles.clear();
+		m_Springs.clear();
+		m_Planes.clear();
+		m_Spheres.clear();
+		m_Capsules.clear();
+		m_Frames.clear();
+		m_ParticleEvents.clear();
+		m_ColliderEvents.clear();
+		return false;
+	}
+
+	m_Header = header;
+	m_Recording = false;
+	return true;
+}
+
+
+////////////////////////////////////
+// Support functions
+
+// Whether every index and enum in the loaded records is in range, so a damaged recording can't
+// make CreateSystem or ApplyInputs access outside the system's arrays. Stops at the first bad value
+bool CPhysicsRecording::RecordsValid()
+{
+	TUInt32 numParticles = static_cast<TUInt32>(m_Particles.size());
+	for (unsigned int spring = 0; spring < m_Springs.size(); ++spring)
+	{
+		const SSpringRecord& s = m_Springs[spring];
+		if (s.particle1 >= numParticles || s.particle2 >= numParticles || s.type >= CSpringSystem::NumTypes)
+		{
+			return false;
+		}
+	}
+
+	// Each frame's events follow those of the frame before
+	TUInt32 lastParticleEvent = 0;
+	TUInt32 lastColliderEvent = 0;
+	for (unsigned int frame = 0; frame < m_Frames.size(); ++frame)
+	{
+		const SFrameRecord& f = m_Frames[frame];
+		if (f.firstParticleEvent < lastParticleEvent || f.firstParticleEvent > m_ParticleEvents.size() ||
+		    f.firstColliderEvent < lastColliderEvent || f.firstColliderEvent > m_ColliderEvents.size())
+		{
+			return false;
+		}
+		lastParticleEvent = f.firstParticleEvent;
+		lastColliderEvent = f.firstColliderEvent;
+	}
+
+	for (unsigned int event = 0; event < m_ParticleEvents.size(); ++event)
+	{
+		const SParticleEvent& e = m_ParticleEvents[event];
+		if (e.type > Unpinned || e.particle >= numParticles)
+		{
+			return false;
+		}
+	}
+	for (unsigned int event = 0; event < m_ColliderEvents.size(); ++event)
+	{
+		const SColliderEvent& e = m_ColliderEvents[event];
+		if ((e.type == Plane   && e.collider >= m_Planes.size()) ||
+		    (e.type == Sphere  && e.collider >= m_Spheres.size()) ||
+		    (e.type == Capsule && e.collider >= m_Capsules.size()) || e.type > Capsule)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Find the colliders that have changed since the last frame and add events for them
+void CPhysicsRecording::RecordColliders( CSpringSystem& system )
+{
+	SColliderEvent event;
+	for (unsigned int plane = 0; plane < m_LastPlanes.size(); ++plane)
+	{
+		const CSpringSystem::SPlaneCollider& p = system.PlaneCollider( plane );
+		if (SameBits( p, m_LastPlanes[plane] )) continue;
+
+		event.type = Plane;
+		event.collider = plane;
+		event.point1 = p.normal;
+		event.point2 = CVector3::kZero;
+		event.radius = p.distance;
+		m_ColliderEvents.push_back( event );
+		m_LastPlanes[plane] = p;
+	}
+	for (unsigned int sphere = 0; sphere < m_LastSpheres.size(); ++sphere)
+	{
+		const CSpringSystem::SSphereCollider& s = system.SphereCollider( sphere );
+		if (SameBits( s, m_LastSpheres[sphere] )) continue;
+
+		event.type = Sphere;
+		event.collider = sphere;
+		event.point1 = s.centre;
+		event.point2 = CVector3::kZero;
+		event.radius = s.radius;
+		m_ColliderEvents.push_back( event );
+		m_LastSpheres[sphere] = s;
+	}
+	for (unsigned int capsule = 0; capsule < m_LastCapsules.size(); ++capsule)
+	{
+		const CSpringSystem::SCapsuleCollider& c = system.CapsuleCollider( capsule );
+		if (SameBits( c, m_LastCapsules[capsule] )) continue;
+
+		event.type = Capsule;
+		event.collider = capsule;
+		event.point1 = c.point1;
+		event.point2 = c.point2;
+		event.radius = c.radius;
+		m_ColliderEvents.push_back( event );
+		m_LastCapsules[capsule] = c;
+	}
+}
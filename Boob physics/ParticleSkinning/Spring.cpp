@@ -6,17 +6,18 @@
 
 #include "Spring.h"
 #include "Particle.h"
+#include "SpringSystem.h"
 
 
 /////////////////////////////
 // Static Data / Constants
 
-// Global springiness allows simple tweak to springiness of everything in the system
-const float GLOBAL_SPRINGINESS = 0.5f;
-
 // UID for load/save - each spring has a UID which is saved in place of its pointer
 unsigned int CSpring::m_CurrentUID = 0;
 
+// Spring system holding the simulation data for all fully attached springs
+extern CSpringSystem SpringSystem;
+
 
 /////////////////////////////
 // Constructor / Destructor
@@ -30,6 +31,7 @@ CSpring::CSpring( CParticle* particle1, CParticle* particle2, float coefficient,
 	m_Particle1 = particle1;
 	m_Particle2 = particle2;
 	m_SpringCoefficient = coefficient;
+	m_Index = CSpringSystem::NO_INDEX;
 	SetInertialLength( inertialLength );
 
 	// Set UID for spring. If constructor passed DEFAULT_UID, then create a new UID
@@ -46,104 +48,90 @@ CSpring::CSpring( CParticle* particle1, CParticle* particle2, float coefficient,
 			m_CurrentUID = m_UID + 1;
 		}
 	}
+
+	UpdateSystemSpring();
 }
 
 CSpring::~CSpring()
 {
 	if (m_Particle1) m_Particle1->RemoveSpring( this );
 	if (m_Particle2) m_Particle2->RemoveSpring( this );
+	m_Particle1 = m_Particle2 = NULL;
+	UpdateSystemSpring();
 }
 
 
 ////////////////////////////////////
 // Properties, getters and setters
 
-void CSpring::SetInertialLength( float length )
+void CSpring::SetParticle1( CParticle* particle1 )
 {
-	if (length == 0.0f && m_Particle1 && m_Particle2)
-	{
-		m_InertialLength = Distance( m_Particle1->GetSimPosition(), m_Particle2->GetSimPosition() );
-	}
-	else
-	{
-		m_InertialLength = length;
-	}
+	m_Particle1 = particle1;
+	UpdateSystemSpring();
 }
 
+void CSpring::SetParticle2( CParticle* particle2 )
+{
+	m_Particle2 = particle2;
+	UpdateSystemSpring();
+}
 
-
-////////////////////////////////////
-// Simulation
-
-// TODO: Return current force exerted by spring on given particle - based on how long it currently is compared to its inertial length
-// Look at the Spring.h & Particle.h files to see the available member data and methods
-CVector3 CSpring::CalculateForce( CParticle* particle )
+void CSpring::SetType( ESpringType type )
 {
-	// Return zero force if spring not attached to given particle, or if given particle is pinned
-	if (!particle || (particle != m_Particle1 && particle != m_Particle2) || particle->IsPinned())
+	m_Type = type;
+	if (m_Index != CSpringSystem::NO_INDEX)
 	{
-		return CVector3::kZero;
+		SpringSystem.SetSpringType( m_Index, static_cast<CSpringSystem::ESpringType>(m_Type) );
 	}
+}
 
-	// Calculate strength of force based on current spring length and inertial length
-	float forceStrength;
-	//...
-	CVector3 springVec( m_Particle1->GetSimPosition(), m_Particle2->GetSimPosition() );
-	float currLength = Length( springVec );
-	forceStrength = (currLength - m_InertialLength) * m_SpringCoefficient * GLOBAL_SPRINGINESS;
-
-	// Take into account type (spring, elastic, etc.)
-	if ((m_Type == Elastic && forceStrength < 0) || m_Type == String || m_Type == Rod) 
+void CSpring::SetCoefficient( float coefficient )
+{
+	m_SpringCoefficient = coefficient;
+	if (m_Index != CSpringSystem::NO_INDEX)
 	{
-		forceStrength = 0;
+		SpringSystem.SetSpringCoefficient( m_Index, m_SpringCoefficient );
 	}
-
-	// Return force as vector - ensure direction is correct for the given particle. Length of vector should be force strength from above
-	CVector3 force = forceStrength * springVec / currLength;
-	return (particle == m_Particle1) ? force : -force;
 }
 
-
-// Update position of the particles attached to this spring based on any constraints. The constraints used in this
-// system are: rods cannot change length (always = inertial length), and strings cannot become > inertial length
-void CSpring::ApplyConstraints()
+void CSpring::SetInertialLength( float length )
 {
-	// No constraints on springs or elastic, so just return on those types
-	if (m_Type == Spring || m_Type == Elastic)
+	if (length == 0.0f && m_Particle1 && m_Particle2)
 	{
-		return;
+		m_InertialLength = Distance( m_Particle1->GetSimPosition(), m_Particle2->GetSimPosition() );
 	}
-
-	// Calculate current length of spring, and difference between that and the inertial length.
-	// Return if we have a string that is shorter than the inertial length - no constraints in that case
-	float springLen = Distance(m_Particle1->GetSimPosition(), m_Particle2->GetSimPosition());
-	float lengthDiff = springLen - m_InertialLength;
-	if (m_Type == String && lengthDiff < 0)
+	else
 	{
-		return;
+		m_InertialLength = length;
 	}
-
-	// Correct particle positions so the length is correct again. Refer to lecture notes
-	// Ensure that pinned particles are not moved
-	CVector3 correction = CVector3(m_Particle1->GetSimPosition(), m_Particle2->GetSimPosition());
-	correction *= lengthDiff / springLen;
-	if (m_Particle1->IsPinned())
+	if (m_Index != CSpringSystem::NO_INDEX)
 	{
-		m_Particle2->SetSimPosition( m_Particle2->GetSimPosition() - correction );
+		SpringSystem.SetSpringInertialLength( m_Index, m_InertialLength );
 	}
-	else if (m_Particle2->IsPinned())
+}
+
+
+
+////////////////////////////////////
+// Spring system
+
+// Add the spring to the spring system if it's attached at both ends, or remove it if not - only fully attached springs are simulated
+void CSpring::UpdateSystemSpring()
+{
+	// Remove from spring system, the last spring in the system is moved to this spring's index
+	if (m_Index != CSpringSystem::NO_INDEX)
 	{
-		m_Particle1->SetSimPosition( m_Particle1->GetSimPosition() + correction );
+		SpringSystem.RemoveSpring( m_Index );
+		if (m_Index < SpringSystem.GetNumSprings())
+		{
+			SpringSystem.GetSpringView( m_Index )->m_Index = m_Index;
+		}
+		m_Index = CSpringSystem::NO_INDEX;
 	}
-	else
+
+	if (m_Particle1 && m_Particle2)
 	{
-		// Simple improvement: When both particle positions require correction, make the lighter one move more. The idea 
-		// is that the lighter one would be more suseptible to movement by the forces transferred across the constraint (F=ma)
-		float totalMass = m_Particle1->GetMass() + m_Particle2->GetMass();
-		float c1 = 1.0f - m_Particle1->GetMass() / totalMass;
-		float c2 = 1.0f - m_Particle2->GetMass() / totalMass;
-		m_Particle1->SetSimPosition( m_Particle1->GetSimPosition() + correction * c1 );
-		m_Particle2->SetSimPosition( m_Particle2->GetSimPosition() - correction * c2 );
+		m_Index = SpringSystem.AddSpring( m_Particle1->GetIndex(), m_Particle2->GetIndex(), m_SpringCoefficient, m_InertialLength,
+		                                  static_cast<CSpringSystem::ESpringType>(m_Type), this );
 	}
 }
- 
\ No newline at end of file
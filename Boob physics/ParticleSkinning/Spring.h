@@ -46,26 +46,24 @@ public:
 	float        GetCoefficient()    { return m_SpringCoefficient; }
 	float        GetInertialLength() { return m_InertialLength; }
 	unsigned int GetUID()            { return m_UID; }
+	unsigned int GetIndex()          { return m_Index; } // Index of the spring in the spring system, NO_INDEX if not fully attached
 
-	void SetParticle1( CParticle* particle1 ) { m_Particle1 = particle1; }
-	void SetParticle2( CParticle* particle2 ) { m_Particle2 = particle2; }
-	void SetType( ESpringType type )          { m_Type = type; };
-	void SetCoefficient( float coefficient )  { m_SpringCoefficient = coefficient; }
+	void SetParticle1( CParticle* particle1 );
+	void SetParticle2( CParticle* particle2 );
+	void SetType( ESpringType type );
+	void SetCoefficient( float coefficient );
 	void SetInertialLength( float length ); // Pass 0.0f to set to distance between particles
 
 
-	////////////////////////////////////
-	// Simulation
+private:
 
-	// Return current force exerted by spring on given particle - based on how long it currently is compared to its inertial length
-	CVector3 CalculateForce( CParticle* particle );
+	////////////////////////////////////
+	// Spring system
 
-	// Update position of the particles attached to this spring based on any constraints. The constraints used in this
-	// system are: rods cannot change length (always = inertial length), and strings cannot become > inertial length
-	void ApplyConstraints();
+	// Add the spring to the spring system if it's attached at both ends, or remove it if not - only fully attached springs are simulated
+	void UpdateSystemSpring();
 
 
-private:
 
 	////////////////////////////////////
 	// Spring data
@@ -75,9 +73,10 @@ private:
 	CParticle*  m_Particle1;
 	CParticle*  m_Particle2;
 
-	// Simulation data
-	float       m_InertialLength;
-	float       m_SpringCoefficient;
+	// Simulation data - copied to the spring system when attached
+	float        m_InertialLength;
+	float        m_SpringCoefficient;
+	unsigned int m_Index;
 
 	// UID for load/save - each spring has a UID which is saved in place of its pointer
 	static const unsigned int DEFAULT_UID = 0xffffffff; // Special UID passed to constructor
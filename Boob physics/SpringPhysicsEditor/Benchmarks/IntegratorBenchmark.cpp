@@ -0,0 +1,170 @@
+//-----------------------------------------------------
+// IntegratorBenchmark.cpp
+//   Console program comparing the implicit integrator
+//   with substepped explicit integration on stiff cloth
+//-----------------------------------------------------
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+using namespace std;
+
+#include "CTimer.h"
+#include "SpringSystem.h"
+#include "SpringGenerators.h"
+using namespace gen;
+
+
+/////////////////////////
+// Constants
+
+// Cloth is a square grid of particles hanging from its top row, with springs along the grid and
+// across each square. Same mass and gravity as the editor
+const unsigned int ClothSize = 24;
+const float        ClothSpacing = 2.0f;
+const float        ParticleMass = 1.0f;
+const float        Damping = 1.0f;
+const CVector3     Gravity = CVector3(0, -50.0f, 0);
+
+// Spring coefficients tested, from just stiff enough to hold the cloth's weight up to very stiff
+const float Coefficients[] = { 2000.0f, 20000.0f, 200000.0f, 2000000.0f };
+const int   NumCoefficients = sizeof(Coefficients) / sizeof(Coefficients[0]);
+
+// Each test simulates this many frames at 60Hz
+const float FrameTime = 1.0f / 60.0f;
+const int   NumFrames = 300;
+
+// Most explicit steps per frame tried before giving up
+const int MaxSubsteps = 256;
+
+// A simulation is unstable if any spring stretches beyond this multiple of its inertial length
+const float MaxStretch = 2.0f;
+
+
+/////////////////////////
+// Test scene
+
+void CreateCloth( CSpringSystem& system, float coefficient )
+{
+	SGeneratorSettings settings;
+	settings.particleMass = ParticleMass;
+	settings.coefficient = coefficient;
+	settings.addBendSprings = false;
+	GenerateCloth( system, settings, CVector3::kZero, CVector3(0, -ClothSpacing, 0), CVector3(ClothSpacing, 0, 0),
+	               ClothSize, ClothSize );
+	for (unsigned int x = 0; x < ClothSize; ++x)
+	{
+		system.Pin( x, true );
+	}
+}
+
+// Check every spring is within the stretch limit and every position is a number
+bool IsStable( CSpringSystem& system )
+{
+	for (unsigned int spring = 0; spring < system.GetNumSprings(); ++spring)
+	{
+		const CSpringSystem::SSpring& s = system.GetSpring( spring );
+		float length = Distance( system.Position( s.particle1 ), system.Position( s.particle2 ) );
+		if (!(length < s.inertialLength * MaxStretch)) return false; // Also catches NaN
+	}
+	return true;
+}
+
+
+/////////////////////////
+// Tests
+
+struct SResult
+{
+	bool  stable;
+	float msPerFrame;
+	float springPassesPerFrame; // Times each frame's work visits every spring
+	float cgIterations;         // Average per frame, implicit only
+};
+
+// Simulate the cloth with the given integrator and number of steps per frame
+SResult RunTest( CSpringSystem::EIntegrator integrator, float coefficient, int substeps )
+{
+	CSpringSystem system;
+	CreateCloth( system, coefficient );
+	system.SetIntegrator( integrator );
+	system.SetDamping( Damping );
+	system.InitSimulation();
+
+	SResult result;
+	result.stable = true;
+	result.cgIterations = 0.0f;
+
+	CTimer timer;
+	float time = 0.0f;
+	unsigned int totalCGIterations = 0;
+	for (int frame = 0; frame < NumFrames && result.stable; ++frame)
+	{
+		timer.GetLapTime();
+		for (int step = 0; step < substeps; ++step)
+		{
+			system.Step( FrameTime / substeps, Gravity );
+			totalCGIterations += system.GetCGIterations();
+		}
+		time += timer.GetLapTime();
+		result.stable = IsStable( system );
+	}
+
+	result.msPerFrame = time * 1000.0f / NumFrames;
+	if (integrator == CSpringSystem::Implicit)
+	{
+		// Forces, jacobian, right hand side and initial residual, then one product per CG iteration
+		result.cgIterations = static_cast<float>(totalCGIterations) / (NumFrames * substeps);
+		result.springPassesPerFrame = substeps * (4.0f + result.cgIterations);
+	}
+	else
+	{
+		result.springPassesPerFrame = static_cast<float>(substeps);
+	}
+	return result;
+}
+
+// Find the fewest steps per frame (doubling each time) that keep the integrator stable, report it
+void ReportIntegrator( const char* name, CSpringSystem::EIntegrator integrator, float coefficient )
+{
+	SResult result;
+	int substeps = 1;
+	do
+	{
+		result = RunTest( integrator, coefficient, substeps );
+	} while (!result.stable && (substeps *= 2) <= MaxSubsteps);
+
+	cout << "  " << left << setw( 12 ) << name << right;
+	if (!result.stable)
+	{
+		cout << setw( 10 ) << "unstable" << endl;
+		return;
+	}
+	cout << setw( 10 ) << substeps << setw( 12 ) << result.msPerFrame << setw( 14 ) << result.springPassesPerFrame;
+	if (integrator == CSpringSystem::Implicit) cout << setw( 14 ) << result.cgIterations;
+	cout << endl;
+}
+
+
+/////////////////////////
+// Test harness
+
+int main()
+{
+	cout << fixed << setprecision( 3 );
+	cout << ClothSize << "x" << ClothSize << " cloth, " << NumFrames << " frames at 60Hz" << endl;
+	cout << "Steps: fewest steps per frame that stay stable (springs under " << MaxStretch << "x length)" << endl;
+	cout << "Spring passes: times each frame visits every spring, a measure of total work" << endl;
+
+	for (int test = 0; test < NumCoefficients; ++test)
+	{
+		cout << endl << "Spring coefficient " << Coefficients[test] << endl;
+		cout << "  " << left << setw( 12 ) << "Integrator" << right << setw( 10 ) << "Steps" << setw( 12 ) << "ms/frame"
+		     << setw( 14 ) << "Spring passes" << setw( 14 ) << "CG iterations" << endl;
+		ReportIntegrator( "Verlet", CSpringSystem::Verlet, Coefficients[test] );
+		ReportIntegrator( "Euler", CSpringSystem::Euler, Coefficients[test] );
+		ReportIntegrator( "Implicit", CSpringSystem::Implicit, Coefficients[test] );
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,249 @@
+//-----------------------------------------------------
+// PhysicsBenchmark.cpp
+//   Console program stepping generated cloth, ropes and
+//   soft bodies at 10k and 100k particle scale
+//-----------------------------------------------------
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <vector>
+using namespace std;
+
+#include "CTimer.h"
+#include "SpringSystem.h"
+#include "SpringGenerators.h"
+using namespace gen;
+
+
+/////////////////////////
+// Constants
+
+// Simulation settings for every scene. No damping, so any change in energy is the integrator's or
+// the constraint solver's doing
+const float    FrameTime = 1.0f / 60.0f;
+const CVector3 Gravity = CVector3(0, -10.0f, 0);
+const int      SolverIterations = 4;
+
+// Default number of frames simulated for each scene (can be given on the command line)
+const int DefaultFrames = 100;
+
+// Approximate particle counts tested
+const unsigned int Scales[] = { 10000, 100000 };
+const int          NumScales = sizeof(Scales) / sizeof(Scales[0]);
+
+// Scenes tested at each scale
+enum EScene
+{
+	Cloth,          // Square cloth pinned at two corners, rod grid with shear and bend springs
+	Ropes,          // Row of ropes pinned at one end, rods with bend springs
+	SoftBody,       // Tetrahedral block pinned at one corner, springs only
+	ClothCollision, // Cloth falling onto a sphere and the floor, colliding with itself
+	NumScenes
+};
+const char* SceneNames[NumScenes] = { "Cloth", "Ropes", "Soft body", "Cloth+collide" };
+
+
+/////////////////////////
+// Test scenes
+
+// Create the given scene with about numParticles particles
+void CreateScene( CSpringSystem& system, EScene scene, unsigned int numParticles )
+{
+	SGeneratorSettings settings;
+	settings.coefficient = 200.0f;
+	unsigned int side = static_cast<unsigned int>(Sqrt( static_cast<float>(numParticles) ));
+
+	if (scene == Cloth || scene == ClothCollision)
+	{
+		// Horizontal cloth, one unit between particles, above the sphere in the collision scene
+		settings.structuralType = CSpringSystem::Rod;
+		CVector3 corner( -0.5f * side, 0.3f * side + 10.0f, -0.5f * side );
+		unsigned int first = GenerateCloth( system, settings, corner, CVector3::kZAxis, CVector3::kXAxis, side, side );
+		if (scene == Cloth)
+		{
+			system.Pin( first, true );
+			system.Pin( first + side - 1, true );
+		}
+		else
+		{
+			system.SetParticleRadius( 0.4f );
+			system.AddPlaneCollider( CVector3::kYAxis, 0.0f );
+			system.AddSphereCollider( CVector3(0, 0.1f * side, 0), 0.2f * side );
+		}
+	}
+	else if (scene == Ropes)
+	{
+		// Horizontal ropes side by side, pinned at their start
+		settings.structuralType = CSpringSystem::Rod;
+		for (unsigned int rope = 0; rope < side; ++rope)
+		{
+			CVector3 start( 0, 0, static_cast<float>(rope) );
+			unsigned int first = GenerateRope( system, settings, start, start + CVector3( side - 1.0f, 0, 0 ), side );
+			system.Pin( first, true );
+		}
+	}
+	else
+	{
+		// Cube, one unit cells, hanging from a top corner
+		unsigned int resolution = static_cast<unsigned int>(Pow( static_cast<float>(numParticles), 1.0f / 3.0f )) - 1;
+		float size = static_cast<float>(resolution);
+		GenerateSoftBody( system, settings, CVector3::kZero, CVector3(size, size, size), resolution );
+		system.Pin( system.GetNumParticles() - 1, true );
+	}
+}
+
+// The particle positions at one frame
+typedef vector<CVector3> TPositions;
+
+void GetPositions( CSpringSystem& system, TPositions& positions )
+{
+	positions.resize( system.GetNumParticles() );
+	for (unsigned int particle = 0; particle < system.GetNumParticles(); ++particle)
+	{
+		positions[particle] = system.Position( particle );
+	}
+}
+
+// Energy of the system at one frame
+struct SEnergy
+{
+	float total;   // Kinetic, gravitational and stored in force springs (constraint springs are
+	               // rigid and store none). Pinned particles don't move so are left out
+	float kinetic;
+};
+
+// Energy of the system at the frame with the given positions, from the positions a frame before
+// and after it. Velocities are time-centred - (after - before) / 2dt - so they are at the same
+// instant as the positions. The velocity the system holds lags its positions by half a step for
+// Verlet, which would show as a drift of about -100 / frames percent whatever the scene does
+SEnergy FrameEnergy( CSpringSystem& system, const TPositions& before, const TPositions& at,
+                     const TPositions& after )
+{
+	double kinetic = 0.0, potential = 0.0;
+	float invTwoFrames = 0.5f / FrameTime;
+	for (unsigned int particle = 0; particle < system.GetNumParticles(); ++particle)
+	{
+		if (system.IsPinned( particle )) continue;
+		float mass = system.GetMass( particle );
+		CVector3 velocity = (after[particle] - before[particle]) * invTwoFrames;
+		kinetic += 0.5f * mass * LengthSquared( velocity );
+		potential -= mass * Dot( Gravity, at[particle] );
+	}
+	for (unsigned int spring = 0; spring < system.GetNumSprings(); ++spring)
+	{
+		const CSpringSystem::SSpring& s = system.GetSpring( spring );
+		if (system.GetCompliance( s.type ) != CSpringSystem::FORCE_ONLY) continue;
+
+		float stretch = Distance( at[s.particle1], at[s.particle2] ) - s.inertialLength;
+		if (stretch < 0.0f && (s.type == CSpringSystem::Elastic || s.type == CSpringSystem::String)) continue;
+		potential += 0.5f * s.coefficient * system.GetSpringiness() * stretch * stretch;
+	}
+	SEnergy energy = { static_cast<float>(kinetic + potential), static_cast<float>(kinetic) };
+	return energy;
+}
+
+
+/////////////////////////
+// Tests
+
+struct SResult
+{
+	unsigned int numParticles;
+	unsigned int numSprings;
+	float        nsPerParticleStep;
+	float        energyDrift;        // Change in total energy as a percentage of the most kinetic energy reached
+	float        maxConstraintError; // Largest error after the final solver iteration of any step
+};
+
+// Simulate a scene for the given number of frames, timing the steps only
+SResult RunTest( EScene scene, unsigned int numParticles, int numFrames, CThreadPool* threadPool )
+{
+	CSpringSystem system;
+	CreateScene( system, scene, numParticles );
+	system.SetNumIterations( SolverIterations );
+	system.SetThreadPool( threadPool );
+	system.InitSimulation();
+
+	SResult result;
+	result.numParticles = system.GetNumParticles();
+	result.numSprings = system.GetNumSprings();
+	result.maxConstraintError = 0.0f;
+
+	// Energies are measured a frame behind the simulation, from the positions of the frames either
+	// side - from the first frame to the last (which takes one more untimed step)
+	TPositions before, at, after;
+	GetPositions( system, after );
+	float startEnergy = 0.0f;
+	float endEnergy = 0.0f;
+	float maxKineticEnergy = 0.0f;
+
+	CTimer timer;
+	float time = 0.0f;
+	for (int frame = 0; frame <= numFrames; ++frame)
+	{
+		timer.GetLapTime();
+		system.Step( FrameTime, Gravity );
+		if (frame < numFrames) time += timer.GetLapTime();
+
+		float error = system.GetConstraintError( SolverIterations - 1 );
+		if (frame < numFrames && error > result.maxConstraintError) result.maxConstraintError = error;
+
+		before.swap( at );
+		at.swap( after );
+		GetPositions( system, after );
+		if (frame == 0) continue;
+		SEnergy energy = FrameEnergy( system, before, at, after );
+		if (frame == 1) startEnergy = energy.total;
+		endEnergy = energy.total;
+		if (energy.kinetic > maxKineticEnergy) maxKineticEnergy = energy.kinetic;
+	}
+
+	result.nsPerParticleStep = time * 1.0e9f / (static_cast<float>(numFrames) * result.numParticles);
+	float energyChange = endEnergy - startEnergy;
+	result.energyDrift = (maxKineticEnergy > 0.0f) ? 100.0f * energyChange / maxKineticEnergy : 0.0f;
+	return result;
+}
+
+
+/////////////////////////
+// Test harness
+
+// Command line: PhysicsBenchmark [frames] [threads]. Threads of 0 (default) uses all hardware
+// threads, 1 runs without a thread pool
+int main( int argc, char* argv[] )
+{
+	int numFrames = (argc > 1) ? atoi( argv[1] ) : DefaultFrames;
+	int numThreads = (argc > 2) ? atoi( argv[2] ) : 0;
+	if (numFrames < 1) numFrames = 1;
+
+	CThreadPool* threadPool = 0;
+	if (numThreads != 1)
+	{
+		threadPool = new CThreadPool( numThreads > 1 ? numThreads - 1 : 0 );
+	}
+
+	cout << fixed << setprecision( 3 );
+	cout << numFrames << " frames at 60Hz, " << SolverIterations << " solver iterations, "
+	     << (threadPool ? threadPool->GetNumThreads() : 1) << " thread(s)" << endl;
+	cout << "Energy drift: change in total energy from the first frame to the last, as a percentage of the" << endl
+	     << "  most kinetic energy reached. Velocities are time-centred from the frames either side" << endl;
+	cout << "Max error: largest constraint length error after the last solver iteration" << endl;
+
+	for (int scale = 0; scale < NumScales; ++scale)
+	{
+		cout << endl << "About " << Scales[scale] << " particles" << endl;
+		cout << "  " << left << setw( 14 ) << "Scene" << right << setw( 10 ) << "Particles" << setw( 10 ) << "Springs"
+		     << setw( 14 ) << "ns/particle" << setw( 14 ) << "Energy drift" << setw( 12 ) << "Max error" << endl;
+		for (int scene = 0; scene < NumScenes; ++scene)
+		{
+			SResult result = RunTest( static_cast<EScene>(scene), Scales[scale], numFrames, threadPool );
+			cout << "  " << left << setw( 14 ) << SceneNames[scene] << right << setw( 10 ) << result.numParticles
+			     << setw( 10 ) << result.numSprings << setw( 14 ) << result.nsPerParticleStep
+			     << setw( 13 ) << result.energyDrift << "%" << setw( 12 ) << result.maxConstraintError << endl;
+		}
+	}
+
+	delete threadPool;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,130 @@
+//-----------------------------------------------------
+// PhysicsReplay.cpp
+//   Console program replaying a physics recording,
+//   checking each frame against the recorded checksum
+//-----------------------------------------------------
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <chrono>
+using namespace std;
+
+#include "CTimer.h"
+#include "CFixedTimestep.h"
+#include "SpringSystem.h"
+#include "PhysicsRecording.h"
+using namespace gen;
+
+
+/////////////////////////
+// Replay
+
+// Update the system by a frame - the same as UpdatePhysicsSystem in the applications, as many
+// fixed steps as fit in the frame time. Returns the number of steps run
+unsigned int UpdatePhysicsSystem( CSpringSystem& system, CFixedTimestep& timestep, float frameTime, const CVector3& gravity )
+{
+	unsigned int numSteps = timestep.Update( frameTime );
+	for (unsigned int step = 0; step < numSteps; ++step)
+	{
+		system.Step( timestep.GetStepTime(), gravity );
+	}
+	return numSteps;
+}
+
+
+/////////////////////////
+// Test harness
+
+// Command line: PhysicsReplay file [fast] [threads]. Frames are replayed at their recorded pace
+// unless "fast" is given, which fast-forwards - runs every frame as soon as the last is done.
+// Threads of 0 (default) uses all hardware threads, 1 runs without a thread pool
+int main( int argc, char* argv[] )
+{
+	if (argc < 2)
+	{
+		cout << "Usage: PhysicsReplay file [fast] [threads]" << endl;
+		return EXIT_FAILURE;
+	}
+	bool fastForward = (argc > 2 && strcmp( argv[2], "fast" ) == 0);
+	int numThreads = (argc > 3) ? atoi( argv[3] ) : 0;
+
+	CPhysicsRecording recording;
+	if (!recording.Load( argv[1] ))
+	{
+		cout << "Cannot load recording " << argv[1] << endl;
+		return EXIT_FAILURE;
+	}
+
+	CThreadPool* threadPool = 0;
+	if (numThreads != 1)
+	{
+		threadPool = new CThreadPool( numThreads > 1 ? numThreads - 1 : 0 );
+	}
+	CSpringSystem system;
+	CFixedTimestep timestep;
+	recording.CreateSystem( system, timestep );
+	system.SetThreadPool( threadPool );
+
+	cout << fixed << setprecision( 3 );
+	cout << argv[1] << ": " << recording.GetNumFrames() << " frames, " << system.GetNumParticles() << " particles, "
+	     << system.GetNumSprings() << " springs" << endl;
+	cout << (fastForward ? "Fast-forward" : "Recorded pace") << ", " << (threadPool ? threadPool->GetNumThreads() : 1)
+	     << " thread(s)" << endl;
+
+	// Replay each frame, timing the update only. At recorded pace, wait out the rest of each frame
+	CTimer timer;
+	float updateTime = 0.0f;
+	float slowestFrameTime = 0.0f;
+	unsigned int slowestFrame = 0;
+	unsigned int numSteps = 0;
+	unsigned int numDiverged = 0;
+	unsigned int firstDiverged = 0;
+	for (unsigned int frame = 0; frame < recording.GetNumFrames(); ++frame)
+	{
+		CVector3 gravity;
+		float frameTime = recording.ApplyInputs( frame, system, &gravity );
+
+		timer.GetLapTime();
+		numSteps += UpdatePhysicsSystem( system, timestep, frameTime, gravity );
+		float frameUpdateTime = timer.GetLapTime();
+		updateTime += frameUpdateTime;
+		if (frameUpdateTime > slowestFrameTime)
+		{
+			slowestFrameTime = frameUpdateTime;
+			slowestFrame = frame;
+		}
+
+		if (!recording.CheckResult( frame, system ))
+		{
+			if (numDiverged == 0) firstDiverged = frame;
+			++numDiverged;
+		}
+
+		if (!fastForward && frameTime > frameUpdateTime)
+		{
+			this_thread::sleep_for( chrono::duration<float>( frameTime - frameUpdateTime ) );
+		}
+	}
+
+	cout << numSteps << " steps, " << updateTime * 1000.0f << "ms updating" << endl;
+	if (numSteps > 0 && system.GetNumParticles() > 0)
+	{
+		cout << updateTime * 1.0e9f / (static_cast<float>(numSteps) * system.GetNumParticles()) << " ns/particle/step" << endl;
+	}
+	cout << "Slowest frame " << slowestFrame << ": " << slowestFrameTime * 1000.0f << "ms" << endl;
+	if (numDiverged > 0)
+	{
+		cout << "DIVERGED from recording at frame " << firstDiverged << " (" << numDiverged << " frames differ)" << endl;
+	}
+	else
+	{
+		cout << "All frames match the recording" << endl;
+	}
+
+	system.SetThreadPool( 0 );
+	delete threadPool;
+	return (numDiverged > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -9,19 +9,22 @@ using namespace std;
 
 #include "Particle.h"
 #include "Spring.h"
+#include "SpringSystem.h"
 
 
 /////////////////////////////
 // Static Data / Constants
 
 const float MASS_SCALE = 3.0f; // Scale given to particle of mass 1
-const float DAMPING    = 1.0f; // Damping used for particle motion 
 
 // UID for load/save - each particle has a UID which is saved in place of its pointer
 unsigned int CParticle::m_CurrentUID = 0;
 
 // Height at which to draw shadows
 extern float FloorHeight;
+
+// Spring system holding the simulation data for all particles
+extern CSpringSystem SpringSystem;
 	
 /////////////////////////////
 // Constructor / Destructor
@@ -29,8 +32,10 @@ extern float FloorHeight;
 // Constructor - creates model and shadow as well as initialising particle settings
 CParticle::CParticle( IMesh* particleMesh, IMesh* shadowMesh, CVector3 position, float mass /*= 1.0f*/, bool pinned /*= false*/, unsigned int UID /*= DEFAULT_UID*/ )
 {
-	m_Model = particleMesh->CreateModel( m_Position.x, m_Position.y, m_Position.z );
-	m_Shadow = shadowMesh->CreateModel( m_Position.x, FloorHeight, m_Position.z );
+	m_Index = SpringSystem.AddParticle( position, mass, pinned, this );
+
+	m_Model = particleMesh->CreateModel( position.x, position.y, position.z );
+	m_Shadow = shadowMesh->CreateModel( position.x, FloorHeight, position.z );
 	SetPosition( position );
 	SetMass( mass );
 	Pin( pinned );
@@ -64,116 +69,91 @@ CParticle::~CParticle()
 		if ((*itSpring)->GetParticle2() == this) (*itSpring)->SetParticle2( NULL );
 		itSpring++;
 	}
+
+	// Remove from spring system, the last particle in the system is moved to this particle's index
+	SpringSystem.RemoveParticle( m_Index );
+	if (m_Index < SpringSystem.GetNumParticles())
+	{
+		SpringSystem.GetParticleView( m_Index )->m_Index = m_Index;
+	}
 }
 
 
 ////////////////////////////////////
 // Properties, getters and setters
 
-void CParticle::SetPosition( CVector3& position )
+CVector3 CParticle::GetPosition()
 {
-	m_Position = position;
-	m_Model->SetPosition( m_Position.x, m_Position.y, m_Position.z );
-	m_Shadow->SetPosition( m_Position.x, FloorHeight, m_Position.z );
-	
-	// Update any attached springs
-	list<CSpring*>::iterator itSpring = m_Springs.begin();
-	while (itSpring != m_Springs.end())
-	{
-		// Redraw model
-		(*itSpring)->OrientateModel();
-		itSpring++;
-	}
+	return SpringSystem.Position( m_Index );
 }
 
-void CParticle::SetMass( float mass )
+float CParticle::GetMass()
 {
-	m_Mass = mass;
-	m_Model->ResetScale();
-	m_Model->Scale( MASS_SCALE * Pow( m_Mass, 0.3333f ) );
-	m_Shadow->ResetScale();
-	m_Shadow->Scale( MASS_SCALE * Pow( m_Mass, 0.3333f ) );
+	return SpringSystem.GetMass( m_Index );
 }
 
-void CParticle::Pin( bool isPinned )
+bool CParticle::IsPinned()
 {
-	m_Pinned = isPinned;
-	m_Model->SetSkin( m_Pinned ? "Red.jpg" : "Black.jpg" );
+	return SpringSystem.IsPinned( m_Index );
 }
 
-
-////////////////////////////////////
-// Springs
-
-void CParticle::AddSpring( CSpring* spring )
+void CParticle::SetPosition( CVector3& position )
 {
-	m_Springs.push_back( spring );
+	SpringSystem.Position( m_Index ) = position;
+	SpringSystem.WakeParticle( m_Index );
+	UpdateModel();
 }
 
-void CParticle::RemoveSpring( CSpring* spring )
-{
-	m_Springs.remove( spring );
-}
-
-
-////////////////////////////////////
-// Simulation
-
-// Store initial position of particle at simulation start
-void CParticle::InitSimulation()
+void CParticle::SetMass( float mass )
 {
-	m_InitialPosition = m_Position;
-	m_PrevPosition = m_Position;
-	m_Velocity = CVector3::kZero;
-	m_Acceleration = CVector3::kZero;
+	SpringSystem.SetMass( m_Index, mass );
+	m_Model->ResetScale();
+	m_Model->Scale( MASS_SCALE * Pow( mass, 0.3333f ) );
+	m_Shadow->ResetScale();
+	m_Shadow->Scale( MASS_SCALE * Pow( mass, 0.3333f ) );
 }
 
-// Reset initial position of particle at simulation end
-void CParticle::ResetSimulation()
+void CParticle::Pin( bool isPinned )
 {
-	SetPosition( m_InitialPosition );
-	m_PrevPosition = m_Position;
-	m_Velocity = CVector3::kZero;
-	m_Acceleration = CVector3::kZero;
+	SpringSystem.Pin( m_Index, isPinned );
+	m_Model->SetSkin( isPinned ? "Red.jpg" : "Black.jpg" );
 }
 
-// TODO: Update position & velocity of particle based on external forces plus forces from all attached springs
-// Look at the Spring.h & Particle.h files to see the available member data and methods
-void CParticle::ApplyForces( float updateTime, CVector3 externalForces )
+// Position models (and attached springs) at the particle's current position in the spring system,
+// or part way through the last step
+void CParticle::UpdateModel( float interpolation /*= 1.0f*/ )
 {
-	// Do nothing if particle is pinned
-	//...
-	if (m_Pinned) return;
-
-	// Iterate through list of attached springs and get force exerted by each - accumulate into a total force
-	// Also add external forces to the total
-	//...
-	CVector3 force = externalForces;
+	if (interpolation < 1.0f)
+	{
+		m_ModelPosition = SpringSystem.GetInterpolatedPosition( m_Index, interpolation );
+	}
+	else
+	{
+		m_ModelPosition = SpringSystem.Position( m_Index );
+	}
+	m_Model->SetPosition( m_ModelPosition.x, m_ModelPosition.y, m_ModelPosition.z );
+	m_Shadow->SetPosition( m_ModelPosition.x, FloorHeight, m_ModelPosition.z );
+	
+	// Update any attached springs
 	list<CSpring*>::iterator itSpring = m_Springs.begin();
 	while (itSpring != m_Springs.end())
 	{
-		CVector3 springForce = (*itSpring)->CalculateForce( this );
-		force += springForce;
+		// Redraw model
+		(*itSpring)->OrientateModel();
 		itSpring++;
 	}
+}
 
- 	// Reduce force with damping - proportional to the velocity
-	//...
-	force +=  -DAMPING * (m_Position - m_PrevPosition) / updateTime;
 
-	// Get acceleration from force, then use an initial value method to update position (and velocity)
-	// Call the SetPosition function with new position to update position of models
-	//...
-	m_Acceleration = force / m_Mass;
-	
-	CVector3 newPosition; 
-	newPosition = 2 * m_Position - m_PrevPosition + m_Acceleration * updateTime * updateTime;
-	m_PrevPosition = m_Position;
-	m_Position = newPosition;
+////////////////////////////////////
+// Springs
 
-	//m_Position += updateTime * m_Velocity;
-	//m_Velocity += updateTime * m_Acceleration;
-	//m_Velocity *= Pow( 1 - DAMPING, updateTime );
+void CParticle::AddSpring( CSpring* spring )
+{
+	m_Springs.push_back( spring );
+}
 
-	SetPosition( m_Position );
-}
\ No newline at end of file
+void CParticle::RemoveSpring( CSpring* spring )
+{
+	m_Springs.remove( spring );
+}
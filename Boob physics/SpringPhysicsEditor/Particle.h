@@ -14,6 +14,7 @@ using namespace std;
 using namespace tle;
 
 #include "CVector3.h"
+#include "CPoolAllocator.h"
 using namespace gen;
 
 // Forward declaration - Particle and Spring classes depend on each other, must be careful with #includes
@@ -31,19 +32,30 @@ public:
 	CParticle( IMesh* particleMesh, IMesh* shadowMesh, CVector3 position, float mass = 1.0f, bool pinned = false, unsigned int UID = DEFAULT_UID );
 	~CParticle();
 
+	// Particles are allocated from a pool (see CPoolAllocator.h)
+	GEN_POOL_ALLOCATED( CParticle )
+
 
 	////////////////////////////////////
 	// Properties, getters and setters
 
-	CVector3 GetPosition() { return m_Position; }
-	float    GetMass()     { return m_Mass; }
-	bool     IsPinned()    { return m_Pinned; }
-	unsigned int GetUID()  { return m_UID; }
+	CVector3 GetPosition();
+	float    GetMass();
+	bool     IsPinned();
+	unsigned int GetUID()   { return m_UID; }
+	unsigned int GetIndex() { return m_Index; } // Index of the particle in the spring system
 	
 	void SetPosition( CVector3& position );
 	void SetMass( float mass );
 	void Pin( bool isPinned );
 
+	// Position models (and attached springs) at the particle's current position in the spring system,
+	// or part way through the last step (see CSpringSystem::GetInterpolatedPosition)
+	void UpdateModel( float interpolation = 1.0f );
+
+	// Position the models were last placed at, may be between simulation steps
+	CVector3 GetModelPosition() { return m_ModelPosition; }
+
 	IModel* Model()       { return m_Model; }
 	IModel* Shadow()      { return m_Shadow; }
 
@@ -56,34 +68,19 @@ public:
 	list<CSpring*>& GetSprings() { return m_Springs; }
 
 
-	////////////////////////////////////
-	// Simulation
-
-	void InitSimulation();
-	void ResetSimulation();
-	void ApplyForces( float updateTime, CVector3 externalForces );
-
-
 private:
 
 	////////////////////////////////////
 	// Particle data
 
-	// Static data
-	CVector3 m_Position;
-	float    m_Mass;
-	bool     m_Pinned;   // A pinned particle cannot be moved
+	// Position, mass and simulation data are held in the spring system (see SpringSystem.h)
+	unsigned int m_Index;
 
 	list<CSpring*> m_Springs; // All the springs attached to this particle
 
 	IModel*  m_Model;
 	IModel*  m_Shadow;
-
-	// Simulation data
-	CVector3 m_InitialPosition; // When simulation ends, particle is reset to initial position
-	CVector3 m_Acceleration;
-	CVector3 m_Velocity;        // For Euler or mid-point method
-	CVector3 m_PrevPosition;    // For verlet method
+	CVector3 m_ModelPosition;
 
 	// UID for load/save - each particle has a UID which is saved in place of its pointer
 	static const unsigned int DEFAULT_UID = 0xffffffff; // Special UID passed to constructor
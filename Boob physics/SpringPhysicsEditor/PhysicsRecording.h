@@ -0,0 +1,255 @@
+//-----------------------------------------------------
+// PhysicsRecording.h
+//   Binary recording of the inputs to a spring system
+//   simulation, for bit-exact replay
+//-----------------------------------------------------
+
+#ifndef PHYSICS_RECORDING_H_INCLUDED
+#define PHYSICS_RECORDING_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <istream>
+#include <cstring>
+using namespace std;
+
+#include "CVector3.h"
+#include "CFixedTimestep.h"
+#include "SpringSystem.h"
+using namespace gen;
+
+
+//****| INFO |*************************************************************************************//
+// A recording holds a spring system as it was when its simulation started (particles, springs,
+// colliders and settings) and the inputs to every frame after that - the frame time, gravity and
+// any changes the application made to the system between frames (particles moved or pinned by
+// hand, pinned particles following a model, colliders moved). The simulation depends only on
+// these, so replaying the inputs into a system rebuilt from the recording gives the same result
+// bit for bit, whatever the number of threads.
+//
+// Changes are found by comparing the system with its state at the end of the last frame, so the
+// application needs no extra code when it edits the system - it just calls RecordInputs before
+// updating and RecordResult after. Only what changed is stored, a frame with no edits costs a
+// few bytes. A checksum of the particle positions and velocities is stored after each frame, so
+// a replay can tell exactly which frame first diverged.
+//
+// Recording starts when the simulation does (just after InitSimulation) so there is no hidden
+// state - velocities are zero and the initial positions are the current ones. Adding or removing
+// particles, springs or colliders ends the recording (frames so far are kept). Changes to masses
+// and spring properties are not recorded. The replay wakes the islands of free particles it moves
+// and wakes all islands when a collider moves - the application should do the same
+//*************************************************************************************************//
+class CPhysicsRecording
+{
+public:
+
+	/////////////////////////////
+	// Constructor
+
+	CPhysicsRecording();
+
+
+	////////////////////////////////////
+	// Recording
+
+	// Start a new recording of the given system, which must have just been initialised and not yet
+	// stepped. The system's springs are recoloured, so a system built from the recording solves its
+	// constraints in the same order
+	void Start( CSpringSystem& system, CFixedTimestep& timestep );
+
+	// Record the inputs to a frame, call before updating the system. Adds any changes made to the
+	// system since the last frame
+	void RecordInputs( CSpringSystem& system, float frameTime, const CVector3& gravity );
+
+	// Record the result of the frame, call after updating the system
+	void RecordResult( CSpringSystem& system );
+
+	// Whether frames are being recorded - false before Start, and after particles, springs or
+	// colliders are added or removed
+	bool IsRecording() { return m_Recording; }
+
+	// Stop recording, the frames so far are kept
+	void Stop() { m_Recording = false; }
+
+
+	////////////////////////////////////
+	// Replay
+
+	unsigned int GetNumFrames() { return static_cast<unsigned int>(m_Frames.size()); }
+
+	// Build the recorded system in the given system (which must be empty), initialise it and set
+	// up the timestep as it was when recording started
+	void CreateSystem( CSpringSystem& system, CFixedTimestep& timestep );
+
+	// Apply the changes recorded for a frame to the system, returns the frame time. Gravity for the
+	// frame is returned in the given pointer
+	float ApplyInputs( unsigned int frame, CSpringSystem& system, CVector3* gravity );
+
+	// Whether the system matches the recording after updating the given frame
+	bool CheckResult( unsigned int frame, CSpringSystem& system );
+
+	// Checksum of a system's particle positions and velocities
+	static TUInt32 Checksum( CSpringSystem& system );
+
+
+	////////////////////////////////////
+	// File access
+
+	// Save the recording to a binary file, returns true on success
+	bool Save( const string& fileName ) const;
+
+	// Load a recording saved with Save, returns false if the file can't be read, is not a
+	// recording of the current version or holds records that are out of range
+	bool Load( const string& fileName );
+
+
+private:
+
+	////////////////////////////////////
+	// Types
+
+	// File identifier and version, increase the version whenever the records below change
+	static const TUInt32 FILE_ID = 0x52594850; // "PHYR"
+	static const TUInt32 FILE_VERSION = 1;
+
+	// File header, gives the size of each array that follows it (in the order listed) and the
+	// system and timestep settings
+	struct SHeader
+	{
+		TUInt32  fileID;
+		TUInt32  version;
+		TUInt32  numParticles;      // SParticleRecord
+		TUInt32  numSprings;        // SSpringRecord
+		TUInt32  numPlanes;         // CSpringSystem::SPlaneCollider
+		TUInt32  numSpheres;        // CSpringSystem::SSphereCollider
+		TUInt32  numCapsules;       // CSpringSystem::SCapsuleCollider
+		TUInt32  numFrames;         // SFrameRecord
+		TUInt32  numParticleEvents; // SParticleEvent
+		TUInt32  numColliderEvents; // SColliderEvent
+
+		TUInt32  integrator;
+		TUInt32  numIterations;
+		TFloat32 damping;
+		TFloat32 springiness;
+		TFloat32 compliances[CSpringSystem::NumTypes];
+		TUInt32  maxCGIterations;
+		TFloat32 CGTolerance;
+		TFloat32 particleRadius;
+		TFloat32 sleepThreshold;
+
+		TFloat32 stepTime;
+		TUInt32  maxSteps;
+		TUInt32  deterministic;
+	};
+
+	struct SParticleRecord
+	{
+		CVector3 position;
+		TFloat32 mass;
+		TUInt32  pinned;
+	};
+
+	struct SSpringRecord
+	{
+		TUInt32  particle1;
+		TUInt32  particle2;
+		TFloat32 coefficient;
+		TFloat32 inertialLength;
+		TUInt32  type;
+	};
+
+	// Each frame's events follow those of the frame before
+	struct SFrameRecord
+	{
+		TFloat32 frameTime;
+		CVector3 gravity;
+		TUInt32  firstParticleEvent;
+		TUInt32  firstColliderEvent;
+		TUInt32  checksum; // Of the system after the frame
+	};
+
+	// A particle moved, pinned or unpinned by the application, with its new position
+	enum EParticleEvent
+	{
+		Moved = 0,
+		Pinned,
+		Unpinned,
+	};
+	struct SParticleEvent
+	{
+		TUInt32  type;
+		TUInt32  particle;
+		CVector3 position;
+	};
+
+	// A collider moved by the application. Planes store their normal in point1 and distance in
+	// radius, spheres their centre in point1
+	enum EColliderEvent
+	{
+		Plane = 0,
+		Sphere,
+		Capsule,
+	};
+	struct SColliderEvent
+	{
+		TUInt32  type;
+		TUInt32  collider;
+		CVector3 point1;
+		CVector3 point2;
+		TFloat32 radius;
+	};
+
+
+	////////////////////////////////////
+	// Support functions
+
+	// Find the colliders that have changed since the last frame and add events for them
+	void RecordColliders( CSpringSystem& system );
+
+	// Whether every index and enum in the loaded records is in range
+	bool RecordsValid();
+
+	// Resize the array to the given number of elements and read them from the file in a single
+	// block, returns false if the read fails
+	template <class T> static bool ReadArray( istream& file, vector<T>& array, TUInt32 size )
+	{
+		array.resize( size );
+		if (size > 0)
+		{
+			file.read( reinterpret_cast<char*>(&array[0]), size * sizeof(T) );
+		}
+		return !file.fail();
+	}
+
+	// Whether two values have the same bits (unlike ==, NaN matches NaN and 0 doesn't match -0)
+	template <class T> static bool SameBits( const T& value1, const T& value2 )
+	{
+		return memcmp( &value1, &value2, sizeof(T) ) == 0;
+	}
+
+
+	////////////////////////////////////
+	// Data
+
+	// Recorded system, frames and events
+	SHeader                  m_Header;
+	vector<SParticleRecord>  m_Particles;
+	vector<SSpringRecord>    m_Springs;
+	vector<CSpringSystem::SPlaneCollider>   m_Planes;
+	vector<CSpringSystem::SSphereCollider>  m_Spheres;
+	vector<CSpringSystem::SCapsuleCollider> m_Capsules;
+	vector<SFrameRecord>     m_Frames;
+	vector<SParticleEvent>   m_ParticleEvents;
+	vector<SColliderEvent>   m_ColliderEvents;
+
+	// System state at the end of the last recorded frame, to find changes made by the application
+	bool                     m_Recording;
+	vector<CVector3>         m_LastPositions;
+	vector<unsigned char>    m_LastPinned;
+	vector<CSpringSystem::SPlaneCollider>   m_LastPlanes;
+	vector<CSpringSystem::SSphereCollider>  m_LastSpheres;
+	vector<CSpringSystem::SCapsuleCollider> m_LastCapsules;
+};
+
+
+#endif
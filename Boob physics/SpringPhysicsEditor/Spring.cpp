@@ -6,6 +6,7 @@
 
 #include "Spring.h"
 #include "Particle.h"
+#include "SpringSystem.h"
 
 #include "CMatrix4x4.h"
 using namespace gen;
@@ -21,6 +22,9 @@ const float RULER_WIDTH   = 0.05f;  // Width of inertial length ruler given coef
 // UID for load/save - each spring has a UID which is saved in place of its pointer
 unsigned int CSpring::m_CurrentUID = 0;
 
+// Spring system holding the simulation data for all fully attached springs
+extern CSpringSystem SpringSystem;
+
 
 /////////////////////////////
 // Constructor / Destructor
@@ -33,6 +37,7 @@ CSpring::CSpring( IMesh* springMesh, IMesh* inertialMesh, CParticle* particle1,
 	m_Particle1 = particle1;
 	m_Particle2 = particle2;
 	m_TempTarget = CVector3::kOrigin;
+	m_Index = CSpringSystem::NO_INDEX;
 
 	m_Model = springMesh->CreateModel();
 	SetType( type );
@@ -68,6 +73,7 @@ CSpring::CSpring( IMesh* springMesh, IMesh* inertialMesh, CParticle* particle1,
 		}
 	}
 
+	UpdateSystemSpring();
 	OrientateModel();
 }
 
@@ -76,6 +82,8 @@ CSpring::~CSpring()
 	m_Model->GetMesh()->RemoveModel( m_Model );
 	if (m_Particle1) m_Particle1->RemoveSpring( this );
 	if (m_Particle2) m_Particle2->RemoveSpring( this );
+	m_Particle1 = m_Particle2 = NULL;
+	UpdateSystemSpring();
 }
 
 
@@ -85,12 +93,14 @@ CSpring::~CSpring()
 void CSpring::SetParticle1( CParticle* particle1 )
 {
 	m_Particle1 = particle1;
+	UpdateSystemSpring();
 	OrientateModel();
 }
 
 void CSpring::SetParticle2( CParticle* particle2 )
 {
 	m_Particle2 = particle2;
+	UpdateSystemSpring();
 	OrientateModel();
 }
 
@@ -103,6 +113,10 @@ void CSpring::SetTempTarget( CVector3& target )
 void CSpring::SetType( CSpring::ESpringType type )
 {
 	m_Type = type;
+	if (m_Index != CSpringSystem::NO_INDEX)
+	{
+		SpringSystem.SetSpringType( m_Index, static_cast<CSpringSystem::ESpringType>(m_Type) );
+	}
 	switch (type)
 	{
 		case Spring: 
@@ -123,6 +137,10 @@ void CSpring::SetType( CSpring::ESpringType type )
 void CSpring::SetCoefficient( float coefficient )
 {
 	m_SpringCoefficient = coefficient;
+	if (m_Index != CSpringSystem::NO_INDEX)
+	{
+		SpringSystem.SetSpringCoefficient( m_Index, m_SpringCoefficient );
+	}
 	OrientateModel();
 }
 
@@ -136,6 +154,10 @@ void CSpring::SetInertialLength( float length )
 	{
 		m_InertialLength = length;
 	}
+	if (m_Index != CSpringSystem::NO_INDEX)
+	{
+		SpringSystem.SetSpringInertialLength( m_Index, m_InertialLength );
+	}
 	OrientateModel();
 }
 
@@ -165,23 +187,23 @@ void CSpring::OrientateModel()
 		if (m_Particle2)
 		{
 			// Spring is fully attached
-			CMatrix4x4 springMat = MatrixFaceTarget( m_Particle1->GetPosition(), m_Particle2->GetPosition(), CVector3::kZAxis );
-			springMat.ScaleZ( Distance( m_Particle1->GetPosition(), m_Particle2->GetPosition() ) );
+			CMatrix4x4 springMat = MatrixFaceTarget( m_Particle1->GetModelPosition(), m_Particle2->GetModelPosition(), CVector3::kZAxis );
+			springMat.ScaleZ( Distance( m_Particle1->GetModelPosition(), m_Particle2->GetModelPosition() ) );
 			springMat.ScaleX( SPRING_WIDTH );
 			m_Model->SetMatrix( &springMat.e00 );
 
 			// Draw inertial length model (at mid-point of spring) - width represents spring coefficient
 			if (m_InertialModel != 0)
 			{
-				springMat = MatrixFaceTarget( (m_Particle1->GetPosition() + m_Particle2->GetPosition()) * 0.5f,
-											   m_Particle2->GetPosition(), CVector3::kZAxis );
+				springMat = MatrixFaceTarget( (m_Particle1->GetModelPosition() + m_Particle2->GetModelPosition()) * 0.5f,
+											   m_Particle2->GetModelPosition(), CVector3::kZAxis );
 				springMat.ScaleZ( m_InertialLength );
-				springMat.ScaleX( m_SpringCoefficient * Distance( m_Particle1->GetPosition(), m_Particle2->GetPosition() ) * RULER_WIDTH );
+				springMat.ScaleX( m_SpringCoefficient * Distance( m_Particle1->GetModelPosition(), m_Particle2->GetModelPosition() ) * RULER_WIDTH );
 				m_InertialModel->SetMatrix( &springMat.e00 );
 			}			
 			
 			// Make string and elastic look "floppy" when short
-			float length = Distance( m_Particle1->GetPosition(), m_Particle2->GetPosition() );
+			float length = Distance( m_Particle1->GetModelPosition(), m_Particle2->GetModelPosition() );
 			if (length < m_InertialLength * FLOPPY_LENGTH) // "Floppy" at < certain proportion of normal length
 			{
 				if (m_Type == String) m_Model->SetSkin( "stringfloppy_tlxcutout.tga" ); 
@@ -196,8 +218,8 @@ void CSpring::OrientateModel()
 		}
 
 		// Spring is only attached at one end, attach other to temporary target
-		CMatrix4x4 springMat = MatrixFaceTarget( m_Particle1->GetPosition(), m_TempTarget, CVector3::kZAxis );
-		springMat.ScaleZ( Distance( m_Particle1->GetPosition(), m_TempTarget ) );
+		CMatrix4x4 springMat = MatrixFaceTarget( m_Particle1->GetModelPosition(), m_TempTarget, CVector3::kZAxis );
+		springMat.ScaleZ( Distance( m_Particle1->GetModelPosition(), m_TempTarget ) );
 		springMat.ScaleX( SPRING_WIDTH );
 		m_Model->SetMatrix( &springMat.e00 );
 		if (m_InertialModel != 0)
@@ -218,93 +240,27 @@ void CSpring::OrientateModel()
 }
 
 
-////////////////////////////////////
-// Simulation
-
-// TODO: Return current force exerted by spring on given particle - based on how long it currently is compared to its inertial length
-// Look at the Spring.h & Particle.h files to see the available member data and methods
-CVector3 CSpring::CalculateForce( CParticle* particle )
-{
-	// Return zero force if spring not attached to given particle, or if given particle is pinned
-	//...
-	if (!particle || (particle != m_Particle1 && particle != m_Particle2) || particle->IsPinned())
-	{
-		return CVector3::kZero;
-	}
-
-	// Calculate strength of force based on current spring length and inertial length
-	float forceStrength;
-	//...
-	CVector3 springVec( m_Particle1->GetPosition(), m_Particle2->GetPosition() );
-	float currLength = Length( springVec );
-	forceStrength = (currLength - m_InertialLength) * m_SpringCoefficient;
-
-	// Take into account type (spring, elastic, etc.)
-	if ((m_Type == Elastic && forceStrength < 0) || m_Type == String || m_Type == Rod) 
-	{
-		forceStrength = 0;
-	}
-
-	// Return force as vector - ensure direction is correct for the given particle. Length of vector should be force strength from above
-	//...
-	CVector3 force = forceStrength * springVec / currLength;
-	if (particle == m_Particle1)
-	{
-		return force;
-	}
-	else
-	{
-		return -force;
-	}
-
-	//return CVector3::kZero; // temporary line to make code compile, change it when you implement this function
-}
 
+////////////////////////////////////
+// Spring system
 
-// TODO: Update position of the particles attached to this spring based on any constraints. The constraints used in this
-// system are: rods cannot change length (always = inertial length), and strings cannot become > inertial length
-void CSpring::ApplyConstraints()
+// Add the spring to the spring system if it's attached at both ends, or remove it if not - only fully attached springs are simulated
+void CSpring::UpdateSystemSpring()
 {
-	// No constraints on springs or elastic, so just return on those types
-	//...
-	if (m_Type == Spring || m_Type == Elastic)
-	{
-		return;
-	}
-
-	// Calculate current length of spring, and difference between that and the inertial length.
-	// Return if we have a string that is shorter than the inertial length - no constraints in that case
-	//...
-	float springLen = Distance(m_Particle1->GetPosition(), m_Particle2->GetPosition());
-	float lengthDiff = springLen - m_InertialLength;
-	if (m_Type == String && lengthDiff < 0)
+	// Remove from spring system, the last spring in the system is moved to this spring's index
+	if (m_Index != CSpringSystem::NO_INDEX)
 	{
-		return;
+		SpringSystem.RemoveSpring( m_Index );
+		if (m_Index < SpringSystem.GetNumSprings())
+		{
+			SpringSystem.GetSpringView( m_Index )->m_Index = m_Index;
+		}
+		m_Index = CSpringSystem::NO_INDEX;
 	}
 
-	// Correct particle positions so the length is correct again. Refer to lecture notes
-	// Ensure that pinned particles are not moved
-	//...
-	CVector3 correction = CVector3(m_Particle1->GetPosition(), m_Particle2->GetPosition());
-	correction *= lengthDiff / springLen;
-	if (m_Particle1->IsPinned())
-	{
-		m_Particle2->SetPosition( m_Particle2->GetPosition() - correction );
-	}
-	else if (m_Particle2->IsPinned())
-	{
-		m_Particle1->SetPosition( m_Particle1->GetPosition() + correction );
-	}
-	else
+	if (m_Particle1 && m_Particle2)
 	{
-		// Simple improvement: When both particle positions require correction, make the lighter one move more. The idea 
-		// is that the lighter one would be more suseptible to movement by the forces transferred across the constraint (F=ma)
-		float totalMass = m_Particle1->GetMass() + m_Particle2->GetMass();
-		float c1 = 1.0f - m_Particle1->GetMass() / totalMass;
-		float c2 = 1.0f - m_Particle2->GetMass() / totalMass;
-		m_Particle1->SetPosition( m_Particle1->GetPosition() + correction * c1 );
-		m_Particle2->SetPosition( m_Particle2->GetPosition() - correction * c2 );
+		m_Index = SpringSystem.AddSpring( m_Particle1->GetIndex(), m_Particle2->GetIndex(), m_SpringCoefficient, m_InertialLength,
+		                                  static_cast<CSpringSystem::ESpringType>(m_Type), this );
 	}
-	
 }
- 
\ No newline at end of file
@@ -11,6 +11,7 @@
 using namespace tle;
 
 #include "CVector3.h"
+#include "CPoolAllocator.h"
 using namespace gen;
 
 // Forward declaration - Particle and Spring classes depend on each other, must be careful with #includes
@@ -39,6 +40,9 @@ public:
 			 float coefficient, float inertialLength = 0.0f, ESpringType type = Spring, unsigned int UID = DEFAULT_UID );
 	~CSpring();
 
+	// Springs are allocated from a pool (see CPoolAllocator.h)
+	GEN_POOL_ALLOCATED( CSpring )
+
 
 	////////////////////////////////////
 	// Properties, getters and setters
@@ -50,6 +54,7 @@ public:
 	float        GetCoefficient()    { return m_SpringCoefficient; }
 	float        GetInertialLength() { return m_InertialLength; }
 	unsigned int GetUID()            { return m_UID; }
+	unsigned int GetIndex()          { return m_Index; } // Index of the spring in the spring system, NO_INDEX if not fully attached
 
 	void SetParticle1( CParticle* particle1 );
 	void SetParticle2( CParticle* particle2 );
@@ -69,18 +74,14 @@ public:
 	void OrientateModel();
 
 
-	////////////////////////////////////
-	// Simulation
-
-	// Return current force exerted by spring on given particle - based on how long it currently is compared to its inertial length
-	CVector3 CalculateForce( CParticle* particle );
+private:
 
-	// Update position of the particles attached to this spring based on any constraints. The constraints used in this
-	// system are: rods cannot change length (always = inertial length), and strings cannot become > inertial length
-	void ApplyConstraints();
+	////////////////////////////////////
+	// Spring system
 
+	// Add the spring to the spring system if it's attached at both ends, or remove it if not - only fully attached springs are simulated
+	void UpdateSystemSpring();
 
-private:
 
 	////////////////////////////////////
 	// Spring data
@@ -97,9 +98,10 @@ private:
 
 	CVector3    m_TempTarget; // Used to help position spring before it has been fully attached
 
-	// Simulation data
-	float       m_InertialLength;
-	float       m_SpringCoefficient;
+	// Simulation data - copied to the spring system when attached
+	float        m_InertialLength;
+	float        m_SpringCoefficient;
+	unsigned int m_Index;
 
 	// UID for load/save - each spring has a UID which is saved in place of its pointer
 	static const unsigned int DEFAULT_UID = 0xffffffff; // Special UID passed to constructor
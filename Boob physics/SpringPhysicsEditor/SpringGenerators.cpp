@@ -0,0 +1,133 @@
+//-----------------------------------------------------
+// SpringGenerators.cpp
+//   Functions to build cloth, ropes and soft bodies
+//   of any resolution in a spring system
+//-----------------------------------------------------
+
+#include "SpringGenerators.h"
+
+
+/////////////////////////////
+// Helper functions
+
+// Add a spring between two particles with its current length as its inertial length
+inline void AddGeneratedSpring( CSpringSystem& system, unsigned int particle1, unsigned int particle2, float coefficient,
+                                CSpringSystem::ESpringType type )
+{
+	float length = Distance( system.Position( particle1 ), system.Position( particle2 ) );
+	system.AddSpring( particle1, particle2, coefficient, length, type );
+}
+
+
+/////////////////////////////
+// Generators
+
+// Add a cloth - a grid of rows x columns particles. Particle (row, column) is first + row * columns + column
+unsigned int GenerateCloth( CSpringSystem& system, const SGeneratorSettings& settings, const CVector3& corner,
+                            const CVector3& rowStep, const CVector3& columnStep, unsigned int rows, unsigned int columns )
+{
+	unsigned int first = system.GetNumParticles();
+	for (unsigned int row = 0; row < rows; ++row)
+	{
+		for (unsigned int column = 0; column < columns; ++column)
+		{
+			system.AddParticle( corner + row * rowStep + column * columnStep, settings.particleMass, false );
+		}
+	}
+
+	// Springs from each particle to the particles after it, so every pair is joined once
+	for (unsigned int row = 0; row < rows; ++row)
+	{
+		for (unsigned int column = 0; column < columns; ++column)
+		{
+			unsigned int particle = first + row * columns + column;
+			bool right = column + 1 < columns;
+			bool down  = row + 1 < rows;
+			if (right) AddGeneratedSpring( system, particle, particle + 1, settings.coefficient, settings.structuralType );
+			if (down)  AddGeneratedSpring( system, particle, particle + columns, settings.coefficient, settings.structuralType );
+			if (right && down && settings.addShearSprings)
+			{
+				AddGeneratedSpring( system, particle, particle + columns + 1, settings.coefficient, settings.shearType );
+				AddGeneratedSpring( system, particle + 1, particle + columns, settings.coefficient, settings.shearType );
+			}
+			if (settings.addBendSprings)
+			{
+				if (column + 2 < columns) AddGeneratedSpring( system, particle, particle + 2, settings.coefficient, settings.bendType );
+				if (row + 2 < rows)       AddGeneratedSpring( system, particle, particle + 2 * columns, settings.coefficient, settings.bendType );
+			}
+		}
+	}
+	return first;
+}
+
+// Add a rope of numParticles particles in a line from start to end. Particle i is first + i
+unsigned int GenerateRope( CSpringSystem& system, const SGeneratorSettings& settings, const CVector3& start,
+                           const CVector3& end, unsigned int numParticles )
+{
+	unsigned int first = system.GetNumParticles();
+	CVector3 step = (numParticles > 1) ? (end - start) / static_cast<float>(numParticles - 1) : CVector3::kZero;
+	for (unsigned int i = 0; i < numParticles; ++i)
+	{
+		system.AddParticle( start + static_cast<float>(i) * step, settings.particleMass, false );
+	}
+
+	for (unsigned int i = 0; i + 1 < numParticles; ++i)
+	{
+		AddGeneratedSpring( system, first + i, first + i + 1, settings.coefficient, settings.structuralType );
+		if (settings.addBendSprings && i + 2 < numParticles)
+		{
+			AddGeneratedSpring( system, first + i, first + i + 2, settings.coefficient, settings.bendType );
+		}
+	}
+	return first;
+}
+
+// Add a soft body - a block of particles with resolution cells along each side, each cell split into
+// six tetrahedra. Particle (x, y, z) is first + (z * (resolution + 1) + y) * (resolution + 1) + x
+//
+// The cells are split along their diagonal from (0,0,0) to (1,1,1), and every cell is split the same
+// way so the tetrahedra of neighbouring cells meet face to face. The tetrahedron edges are then the
+// seven offsets below from each particle - three along the grid, three face diagonals and the cell
+// diagonal - so each edge is added once, from the particle at its low corner
+unsigned int GenerateSoftBody( CSpringSystem& system, const SGeneratorSettings& settings, const CVector3& corner,
+                               const CVector3& size, unsigned int resolution )
+{
+	static const int EdgeOffsets[7][3] = { {1,0,0}, {0,1,0}, {0,0,1}, {1,1,0}, {1,0,1}, {0,1,1}, {1,1,1} };
+
+	unsigned int first = system.GetNumParticles();
+	unsigned int side = resolution + 1;
+	CVector3 cellSize = size / static_cast<float>(resolution > 0 ? resolution : 1);
+	for (unsigned int z = 0; z < side; ++z)
+	{
+		for (unsigned int y = 0; y < side; ++y)
+		{
+			for (unsigned int x = 0; x < side; ++x)
+			{
+				CVector3 position = corner + CVector3( x * cellSize.x, y * cellSize.y, z * cellSize.z );
+				system.AddParticle( position, settings.particleMass, false );
+			}
+		}
+	}
+
+	for (unsigned int z = 0; z < side; ++z)
+	{
+		for (unsigned int y = 0; y < side; ++y)
+		{
+			for (unsigned int x = 0; x < side; ++x)
+			{
+				unsigned int particle = first + (z * side + y) * side + x;
+				for (int edge = 0; edge < 7; ++edge)
+				{
+					unsigned int otherX = x + EdgeOffsets[edge][0];
+					unsigned int otherY = y + EdgeOffsets[edge][1];
+					unsigned int otherZ = z + EdgeOffsets[edge][2];
+					if (otherX >= side || otherY >= side || otherZ >= side) continue;
+
+					unsigned int other = first + (otherZ * side + otherY) * side + otherX;
+					AddGeneratedSpring( system, particle, other, settings.coefficient, settings.structuralType );
+				}
+			}
+		}
+	}
+	return first;
+}
@@ -0,0 +1,68 @@
+//-----------------------------------------------------
+// SpringGenerators.h
+//   Functions to build cloth, ropes and soft bodies
+//   of any resolution in a spring system
+//-----------------------------------------------------
+
+#ifndef SPRING_GENERATORS_H_INCLUDED
+#define SPRING_GENERATORS_H_INCLUDED
+
+#include "SpringSystem.h"
+
+
+//****| INFO |*************************************************************************************//
+// Each generator adds a block of particles and the springs between them to a spring system, and
+// returns the index of the first particle. The particles are added in order (see each function for
+// the layout) so the caller can pick out particles to pin or move. No views are attached - the
+// generators are for programs that work on the system directly, such as the benchmarks
+//
+// Springs come in up to three sets. Structural springs join neighbouring particles and give the
+// object its shape. Shear springs cross each square of a cloth, stopping it collapsing sideways.
+// Bend springs join particles two apart, resisting folding. The inertial length of every spring is
+// its length as generated
+//*************************************************************************************************//
+
+// Mass of each particle, and the coefficient and type of each set of springs
+struct SGeneratorSettings
+{
+	float                      particleMass;
+	float                      coefficient;
+	CSpringSystem::ESpringType structuralType;
+	CSpringSystem::ESpringType shearType;
+	CSpringSystem::ESpringType bendType;
+	bool                       addShearSprings;
+	bool                       addBendSprings;
+
+	// Default settings are unit mass with all spring sets using ordinary springs
+	SGeneratorSettings()
+	{
+		particleMass = 1.0f;
+		coefficient = 100.0f;
+		structuralType = CSpringSystem::Spring;
+		shearType = CSpringSystem::Spring;
+		bendType = CSpringSystem::Spring;
+		addShearSprings = true;
+		addBendSprings = true;
+	}
+};
+
+
+// Add a cloth - a grid of rows x columns particles starting at corner, with rowStep between rows
+// and columnStep between columns. Particle (row, column) is first + row * columns + column
+unsigned int GenerateCloth( CSpringSystem& system, const SGeneratorSettings& settings, const CVector3& corner,
+                            const CVector3& rowStep, const CVector3& columnStep, unsigned int rows, unsigned int columns );
+
+// Add a rope of numParticles particles in a line from start to end (no shear springs). Particle i
+// is first + i
+unsigned int GenerateRope( CSpringSystem& system, const SGeneratorSettings& settings, const CVector3& start,
+                           const CVector3& end, unsigned int numParticles );
+
+// Add a soft body - a block of particles filling the box from corner to corner + size, with
+// resolution cells along each side. Each cell is split into six tetrahedra, and a structural spring
+// is added along each tetrahedron edge (no shear or bend springs). Particle (x, y, z) is
+// first + (z * (resolution + 1) + y) * (resolution + 1) + x
+unsigned int GenerateSoftBody( CSpringSystem& system, const SGeneratorSettings& settings, const CVector3& corner,
+                               const CVector3& size, unsigned int resolution );
+
+
+#endif
@@ -15,6 +15,10 @@ using namespace tle;
 
 #include "CVector3.h"
 #include "MathIO.h"
+#include "CThreadPool.h"
+#include "CFixedTimestep.h"
+#include "SpringSystem.h"
+#include "PhysicsRecording.h"
 #include "Particle.h"
 #include "Spring.h"
 #include "Support.h"
@@ -28,6 +32,26 @@ using namespace gen;
 const float    DEFAULT_MASS        = 1.0f;
 const float    DEFAULT_COEFFICIENT = 14.0f;
 const CVector3 GRAVITY             = CVector3(0, -50.0f, 0);
+const float    DAMPING             = 1.0f; // Damping used for particle motion
+const int      SOLVER_ITERATIONS   = 4;    // Times the rods and strings are solved each frame - more keeps long chains from stretching
+const float    PARTICLE_RADIUS     = 1.5f; // Collision radius of particles (size of a particle model of default mass)
+const float    SLEEP_THRESHOLD     = 0.5f; // Kinetic energy per unit mass below which groups of particles at rest stop being simulated
+
+// Simulation data for all particles and springs - the particle and spring objects below are views onto it
+CSpringSystem SpringSystem;
+
+// Threads used to solve the constraints
+CThreadPool* ThreadPool = 0;
+
+// The simulation is stepped at a fixed rate whatever the frame rate, models are drawn between steps
+const float SIMULATION_RATE = 120.0f; // Steps per second
+const int   MAX_STEPS       = 8;      // Most steps in one frame - the simulation slows down rather than falling further behind
+CFixedTimestep Timestep( 1 / SIMULATION_RATE, MAX_STEPS );
+
+// Each simulation run is recorded and saved when it ends, so a run that goes wrong can be replayed
+// exactly (with the PhysicsReplay program)
+const string RECORDING_FILE = "LastSimulation.phr";
+CPhysicsRecording Recording;
 
 list<CParticle*> Particles;
 list<CSpring*> Springs;
@@ -46,8 +70,9 @@ float NearClip = 0.1f;
 float CameraRotX = 0;
 float CameraRotY = 0;
 
-// Height of floor (and shadows)
+// Height of floor (and shadows), particles collide with it
 float FloorHeight = 0;
+unsigned int FloorCollider;
 
 // Engine / camera constants
 const float MONITOR_REFRESH_RATE = 60.0f; // In Hertz
@@ -481,46 +506,52 @@ list<CSpring*>::iterator PickSpring( int* nearestDist )
 // Simulation Control
 //------------------------------------------
 
-void StartSimulation()
+// Position particle models (and their springs) to match the spring system, or part way through the
+// last step (0 = start of the step, 1 = end)
+void UpdateParticleModels( float interpolation = 1.0f )
 {
 	list<CParticle*>::iterator itParticle = Particles.begin();
 	while (itParticle != Particles.end())
 	{
-		(*itParticle)->InitSimulation();
+		(*itParticle)->UpdateModel( interpolation );
 		++itParticle;
 	}
+}
+
+void StartSimulation()
+{
+	SpringSystem.SetDamping( DAMPING );
+	SpringSystem.SetNumIterations( SOLVER_ITERATIONS );
+	SpringSystem.SetParticleRadius( PARTICLE_RADIUS );
+	SpringSystem.SetSleepThreshold( SLEEP_THRESHOLD );
+	SpringSystem.InitSimulation();
+	Timestep.Reset();
+	Recording.Start( SpringSystem, Timestep );
 	Simulating = true;
 }
 
 void EndSimulation()
 {
-	list<CParticle*>::iterator itParticle = Particles.begin();
-	while (itParticle != Particles.end())
-	{
-		(*itParticle)->ResetSimulation();
-		++itParticle;
-	}
+	Recording.Save( RECORDING_FILE );
+	SpringSystem.ResetSimulation();
+	UpdateParticleModels();
 	Simulating = false;
 }
 
 void UpdateSimulation( float updateTime )
 {
-	// Update particle positions based on forces from springs and external forces (e.g. gravity). Ignore constraints for now
-	list<CParticle*>::iterator itParticle = Particles.begin();
-	while (itParticle != Particles.end())
+	// Update particle positions based on forces from springs and gravity, then adjust them based on any
+	// constraints (e.g. rods cannot change length). Run as many fixed steps as fit in the frame time
+	Recording.RecordInputs( SpringSystem, updateTime, GRAVITY );
+	unsigned int numSteps = Timestep.Update( updateTime );
+	for (unsigned int step = 0; step < numSteps; ++step)
 	{
-		CVector3 externalForces = (*itParticle)->GetMass() * GRAVITY; // Particle mass * gravity acceleration = gravitation force on this particle
-		(*itParticle)->ApplyForces( updateTime, externalForces );
-		++itParticle;
+		SpringSystem.Step( Timestep.GetStepTime(), GRAVITY );
 	}
+	Recording.RecordResult( SpringSystem );
 
-	// Adjust springs (and their attached particles) based on any constraints (e.g. rods cannot change length)
-	list<CSpring*>::iterator itSpring = Springs.begin();
-	while (itSpring != Springs.end())
-	{
-		(*itSpring)->ApplyConstraints();
-		++itSpring;
-	}
+	// Draw the particles between the last two steps, at the time left over
+	UpdateParticleModels( Timestep.GetInterpolation() );
 }
 
 
@@ -540,11 +571,16 @@ void main()
 	_getcwd( currDir, MAX_PATH );
 	Engine->AddMediaFolder( currDir );
 
+	// Solve constraints across all cores
+	ThreadPool = new CThreadPool();
+	SpringSystem.SetThreadPool( ThreadPool );
+
 	// Generic scene setup
 	Camera = Engine->CreateCamera( kManual, 0, CAMERA_MOVE_SPEED, -DEFAULT_DISTANCE );
 	Camera->SetNearClip( NearClip );
 	IMesh* floorMesh = Engine->LoadMesh( "Floor.x" );
 	IModel* floor = floorMesh->CreateModel(0, FloorHeight - 0.01f, 0); // Slightly downwards to stop z-fighting shadows
+	FloorCollider = SpringSystem.AddPlaneCollider( CVector3::kYAxis, FloorHeight );
 	/*IMesh* womanMesh = Engine->LoadMesh("Woman1.x");
 	IModel* woman = womanMesh->CreateModel();
 	woman->SetSkin("Woman.ptf");*/
@@ -593,6 +629,8 @@ void main()
 		{
 			FloorHeight += FLOOR_MOVE_SPEED * updateTime;
 			floor->SetY( FloorHeight - 0.01f );
+			SpringSystem.PlaneCollider( FloorCollider ).distance = FloorHeight;
+			SpringSystem.WakeAll(); // Sleeping particles don't notice colliders moving
 			list<CParticle*>::iterator itParticle = Particles.begin();
 			while (itParticle != Particles.end())
 			{
@@ -604,6 +642,8 @@ void main()
 		{
 			FloorHeight -= FLOOR_MOVE_SPEED * updateTime;
 			floor->SetY( FloorHeight - 0.01f );
+			SpringSystem.PlaneCollider( FloorCollider ).distance = FloorHeight;
+			SpringSystem.WakeAll(); // Sleeping particles don't notice colliders moving
 			list<CParticle*>::iterator itParticle = Particles.begin();
 			while (itParticle != Particles.end())
 			{
@@ -1133,6 +1173,8 @@ void main()
 
 	// Clear up particle/spring lists
 	NewSystem();
+	SpringSystem.SetThreadPool( 0 );
+	delete ThreadPool;
 
 	// Delete the 3D engine now we are finished with it
 	Engine->Delete();
@@ -0,0 +1,1215 @@
+//-----------------------------------------------------
+// SpringSystem.cpp
+//   Particle and spring data for a spring-based physics
+//   system, held in flat arrays indexed by number
+//-----------------------------------------------------
+
+#include "SpringSystem.h"
+
+
+/////////////////////////////
+// Static Data / Constants
+
+const float CSpringSystem::FORCE_ONLY = -1.0f;
+
+// Number of constraints solved by each thread pool task, and the smallest colour batch worth
+// splitting into tasks
+const unsigned int SPRINGS_PER_TASK = 256;
+const unsigned int MIN_PARALLEL_SPRINGS = 2 * SPRINGS_PER_TASK;
+
+// Number of particles handled by each collision task
+const unsigned int PARTICLES_PER_TASK = 256;
+
+// Neighbour search distance as a multiple of the collision distance - pairs that come together
+// during the step's iterations must already be neighbours
+const float NEIGHBOUR_SEARCH_SCALE = 1.5f;
+
+// Time an island must stay below the sleep threshold before it goes to sleep
+const float SLEEP_DELAY = 0.5f;
+
+
+/////////////////////////////
+// Helper functions
+
+// Multiply two vectors component by component (e.g. by a diagonal matrix held as a vector)
+inline CVector3 MultiplyComponents( const CVector3& v1, const CVector3& v2 )
+{
+	return CVector3( v1.x * v2.x, v1.y * v2.y, v1.z * v2.z );
+}
+
+// Move a position out of a sphere to its surface, along the line from the centre
+inline void PushOutOfSphere( CVector3& position, const CVector3& centre, float radius )
+{
+	CVector3 offset = position - centre;
+	float distanceSq = LengthSquared( offset );
+	if (distanceSq >= radius * radius || distanceSq == 0.0f) return;
+	position = centre + offset * (radius / Sqrt( distanceSq ));
+}
+
+
+/////////////////////////////
+// Constructor
+
+CSpringSystem::CSpringSystem()
+{
+	m_Damping = 0.0f;
+	m_Springiness = 1.0f;
+	m_Integrator = Verlet;
+	m_NumIterations = 1;
+	m_Compliances[Spring]  = FORCE_ONLY;
+	m_Compliances[Elastic] = FORCE_ONLY;
+	m_Compliances[String]  = 0.0f;
+	m_Compliances[Rod]     = 0.0f;
+	m_MaxCGIterations = 100;
+	m_CGTolerance = 0.001f;
+	m_CGIterations = 0;
+	m_ThreadPool = 0;
+	m_BatchesChanged = true;
+	m_ConstraintErrors.assign( m_NumIterations, 0.0f );
+	m_ParticleRadius = 0.0f;
+	m_CellSize = 1.0f;
+	m_HashSize = 1;
+	m_SleepThreshold = 0.0f;
+	m_IslandsChanged = true;
+	m_NumAwakeIslands = 0;
+	m_LastGravity = CVector3::kZero;
+}
+
+
+////////////////////////////////////
+// Settings
+
+// Number of times all constraints are solved in each step (at least 1)
+void CSpringSystem::SetNumIterations( unsigned int numIterations )
+{
+	m_NumIterations = (numIterations > 0) ? numIterations : 1;
+	m_ConstraintErrors.assign( m_NumIterations, 0.0f );
+}
+
+// Kinetic energy per unit mass below which an island goes to sleep, zero turns sleeping off
+void CSpringSystem::SetSleepThreshold( float threshold )
+{
+	m_SleepThreshold = threshold;
+	if (m_SleepThreshold <= 0.0f) WakeAll();
+}
+
+
+////////////////////////////////////
+// Particles
+
+// Add a particle, returns its index. The view is optional
+unsigned int CSpringSystem::AddParticle( const CVector3& position, float mass, bool pinned, CParticle* view /*= 0*/ )
+{
+	unsigned int particle = GetNumParticles();
+	m_Positions.push_back( position );
+	m_PrevPositions.push_back( position );
+	m_Velocities.push_back( CVector3::kZero );
+	m_InitialPositions.push_back( position );
+	m_Forces.push_back( CVector3::kZero );
+	m_Masses.push_back( mass );
+	m_InvMasses.push_back( pinned ? 0.0f : 1.0f / mass );
+	m_Pinned.push_back( pinned ? 1 : 0 );
+	m_ParticleViews.push_back( view );
+	m_ParticleColours.push_back( 0 );
+	m_DeltaVelocities.push_back( CVector3::kZero );
+	m_IslandsChanged = true;
+	return particle;
+}
+
+// Remove a particle, which must have no springs attached. The last particle is moved to the
+// removed particle's index (springs attached to it are updated)
+void CSpringSystem::RemoveParticle( unsigned int particle )
+{
+	unsigned int last = GetNumParticles() - 1;
+	if (particle != last)
+	{
+		m_Positions[particle]        = m_Positions[last];
+		m_PrevPositions[particle]    = m_PrevPositions[last];
+		m_Velocities[particle]       = m_Velocities[last];
+		m_InitialPositions[particle] = m_InitialPositions[last];
+		m_Forces[particle]           = m_Forces[last];
+		m_Masses[particle]           = m_Masses[last];
+		m_InvMasses[particle]        = m_InvMasses[last];
+		m_Pinned[particle]           = m_Pinned[last];
+		m_ParticleViews[particle]    = m_ParticleViews[last];
+		m_ParticleColours[particle]  = m_ParticleColours[last];
+		m_DeltaVelocities[particle]  = m_DeltaVelocities[last];
+
+		for (unsigned int spring = 0; spring < GetNumSprings(); ++spring)
+		{
+			if (m_Springs[spring].particle1 == last) m_Springs[spring].particle1 = particle;
+			if (m_Springs[spring].particle2 == last) m_Springs[spring].particle2 = particle;
+		}
+	}
+	m_Positions.pop_back();
+	m_PrevPositions.pop_back();
+	m_Velocities.pop_back();
+	m_InitialPositions.pop_back();
+	m_Forces.pop_back();
+	m_Masses.pop_back();
+	m_InvMasses.pop_back();
+	m_Pinned.pop_back();
+	m_ParticleViews.pop_back();
+	m_ParticleColours.pop_back();
+	m_DeltaVelocities.pop_back();
+	m_IslandsChanged = true;
+}
+
+// Set a particle's mass, waking its island
+void CSpringSystem::SetMass( unsigned int particle, float mass )
+{
+	m_Masses[particle] = mass;
+	m_InvMasses[particle] = (m_Pinned[particle] || IsAsleep( particle )) ? 0.0f : 1.0f / mass;
+	WakeParticle( particle );
+}
+
+void CSpringSystem::Pin( unsigned int particle, bool isPinned )
+{
+	m_Pinned[particle] = isPinned ? 1 : 0;
+	m_InvMasses[particle] = isPinned ? 0.0f : 1.0f / m_Masses[particle];
+	m_IslandsChanged = true;
+}
+
+
+////////////////////////////////////
+// Islands
+
+// Whether a particle's island is asleep (pinned particles are never asleep)
+bool CSpringSystem::IsAsleep( unsigned int particle )
+{
+	if (m_IslandsChanged) return false; // All islands wake when they are rebuilt
+	unsigned int island = m_ParticleIslands[particle];
+	return island != NO_INDEX && !m_IslandAwake[island];
+}
+
+// Wake the island of the given particle
+void CSpringSystem::WakeParticle( unsigned int particle )
+{
+	if (m_IslandsChanged) return;
+	unsigned int island = m_ParticleIslands[particle];
+	if (island != NO_INDEX) WakeIsland( island );
+}
+
+// Wake all islands
+void CSpringSystem::WakeAll()
+{
+	if (m_IslandsChanged) return;
+	for (unsigned int island = 0; island < GetNumIslands(); ++island)
+	{
+		WakeIsland( island );
+	}
+}
+
+
+////////////////////////////////////
+// Springs
+
+// Add a spring between two particles, returns its index. The view is optional
+unsigned int CSpringSystem::AddSpring( unsigned int particle1, unsigned int particle2, float coefficient,
+                                       float inertialLength, ESpringType type, CSpring* view /*= 0*/ )
+{
+	SSpring newSpring;
+	newSpring.particle1 = particle1;
+	newSpring.particle2 = particle2;
+	newSpring.inertialLength = inertialLength;
+	newSpring.coefficient = coefficient;
+	newSpring.type = type;
+
+	unsigned int spring = GetNumSprings();
+	m_Springs.push_back( newSpring );
+	m_SpringViews.push_back( view );
+	m_SpringColours.push_back( ColourSpring( particle1, particle2 ) );
+	m_BatchesChanged = true;
+	m_IslandsChanged = true;
+	return spring;
+}
+
+// Remove a spring. The last spring is moved to the removed spring's index
+void CSpringSystem::RemoveSpring( unsigned int spring )
+{
+	// Free the spring's colour on its particles - no other spring on them has the same colour
+	unsigned int colour = m_SpringColours[spring];
+	if (colour != NO_COLOUR)
+	{
+		TUInt64 colourBit = static_cast<TUInt64>(1) << colour;
+		m_ParticleColours[m_Springs[spring].particle1] &= ~colourBit;
+		m_ParticleColours[m_Springs[spring].particle2] &= ~colourBit;
+	}
+
+	unsigned int last = GetNumSprings() - 1;
+	if (spring != last)
+	{
+		m_Springs[spring] = m_Springs[last];
+		m_SpringViews[spring] = m_SpringViews[last];
+		m_SpringColours[spring] = m_SpringColours[last];
+	}
+	m_Springs.pop_back();
+	m_SpringViews.pop_back();
+	m_SpringColours.pop_back();
+	m_BatchesChanged = true;
+	m_IslandsChanged = true;
+}
+
+// Number of colours in use (not counting NO_COLOUR)
+unsigned int CSpringSystem::GetNumColours()
+{
+	unsigned int numColours = 0;
+	for (unsigned int spring = 0; spring < GetNumSprings(); ++spring)
+	{
+		unsigned int colour = m_SpringColours[spring];
+		if (colour != NO_COLOUR && colour >= numColours) numColours = colour + 1;
+	}
+	return numColours;
+}
+
+// Colour all springs again from scratch
+void CSpringSystem::RecolourSprings()
+{
+	m_ParticleColours.assign( GetNumParticles(), 0 );
+	for (unsigned int spring = 0; spring < GetNumSprings(); ++spring)
+	{
+		m_SpringColours[spring] = ColourSpring( m_Springs[spring].particle1, m_Springs[spring].particle2 );
+	}
+	m_BatchesChanged = true;
+}
+
+
+////////////////////////////////////
+// Colliders
+
+// Add a collider, returns its index
+unsigned int CSpringSystem::AddPlaneCollider( const CVector3& normal, float distance )
+{
+	SPlaneCollider plane = { Normalise( normal ), distance };
+	m_Planes.push_back( plane );
+	return GetNumPlaneColliders() - 1;
+}
+
+unsigned int CSpringSystem::AddSphereCollider( const CVector3& centre, float radius )
+{
+	SSphereCollider sphere = { centre, radius };
+	m_Spheres.push_back( sphere );
+	return GetNumSphereColliders() - 1;
+}
+
+unsigned int CSpringSystem::AddCapsuleCollider( const CVector3& point1, const CVector3& point2, float radius )
+{
+	SCapsuleCollider capsule = { point1, point2, radius };
+	m_Capsules.push_back( capsule );
+	return GetNumCapsuleColliders() - 1;
+}
+
+// Remove all colliders
+void CSpringSystem::ClearColliders()
+{
+	m_Planes.clear();
+	m_Spheres.clear();
+	m_Capsules.clear();
+}
+
+
+////////////////////////////////////
+// Simulation
+
+// Store the current particle positions and clear velocities at simulation start
+void CSpringSystem::InitSimulation()
+{
+	m_InitialPositions = m_Positions;
+	m_PrevPositions = m_Positions;
+	m_Velocities.assign( GetNumParticles(), CVector3::kZero );
+	m_DeltaVelocities.assign( GetNumParticles(), CVector3::kZero );
+	m_IslandsChanged = true;
+}
+
+// Return the particles to their positions when InitSimulation was called
+void CSpringSystem::ResetSimulation()
+{
+	m_Positions = m_InitialPositions;
+	m_PrevPositions = m_Positions;
+	m_Velocities.assign( GetNumParticles(), CVector3::kZero );
+	m_DeltaVelocities.assign( GetNumParticles(), CVector3::kZero );
+	m_IslandsChanged = true;
+}
+
+// Update the simulation by the given time. Gravity is an acceleration applied to every particle
+void CSpringSystem::Step( float updateTime, const CVector3& gravity )
+{
+	// Wake any sleeping islands that have been disturbed. There is nothing to do if all are asleep
+	if (m_IslandsChanged)
+	{
+		BuildIslands();
+	}
+	WakeMovedIslands( gravity );
+
+	// Bring the previous positions of unmoving particles up to date, so their velocity is zero and
+	// interpolating between steps leaves them where they were put (they may have been moved by hand).
+	// Done even if all islands are asleep, so pinned particles and lone particles moved meanwhile
+	// don't jump when the system wakes
+	unsigned int numParticles = GetNumParticles();
+	for (unsigned int particle = 0; particle < numParticles; ++particle)
+	{
+		if (m_InvMasses[particle] == 0.0f) m_PrevPositions[particle] = m_Positions[particle];
+	}
+	if (m_SleepThreshold > 0.0f && m_NumAwakeIslands == 0) return;
+
+	// Start each particle's total force with gravity, then add forces from the springs
+	for (unsigned int particle = 0; particle < numParticles; ++particle)
+	{
+		m_Forces[particle] = m_Masses[particle] * gravity;
+	}
+	AccumulateSpringForces();
+
+	// Update particle positions based on their total forces
+	Integrate( updateTime );
+
+	// Correct particle positions to satisfy the constraints. Verlet velocities are implied by the
+	// positions so take account of the corrections automatically (and are kept up to date for anyone
+	// reading them). Euler and implicit velocities are given the velocity of the corrections
+	if (m_Integrator == Verlet)
+	{
+		SolveConstraints( updateTime );
+		for (unsigned int particle = 0; particle < numParticles; ++particle)
+		{
+			m_Velocities[particle] = (m_Positions[particle] - m_PrevPositions[particle]) / updateTime;
+		}
+	}
+	else
+	{
+		m_UnconstrainedPositions = m_Positions;
+		SolveConstraints( updateTime );
+		for (unsigned int particle = 0; particle < numParticles; ++particle)
+		{
+			m_Velocities[particle] += (m_Positions[particle] - m_UnconstrainedPositions[particle]) / updateTime;
+		}
+	}
+
+	UpdateSleep( updateTime );
+}
+
+
+// Total number of collision neighbours found for all particles in the last step
+unsigned int CSpringSystem::GetNumNeighbours()
+{
+	return m_NeighbourStarts.empty() ? 0 : m_NeighbourStarts.back();
+}
+
+
+////////////////////////////////////
+// Support functions
+
+// Add the force exerted by each spring to the force totals of its two particles. Each spring's
+// length and direction are calculated once, the two particles get equal and opposite forces
+void CSpringSystem::AccumulateSpringForces()
+{
+	unsigned int numSprings = GetNumSprings();
+	for (unsigned int spring = 0; spring < numSprings; ++spring)
+	{
+		// Constraints don't exert a force, and forces between pinned or sleeping particles have no effect
+		const SSpring& s = m_Springs[spring];
+		if (m_Compliances[s.type] >= 0.0f) continue;
+		if (m_InvMasses[s.particle1] + m_InvMasses[s.particle2] == 0.0f) continue;
+
+		// Strength of force based on current spring length and inertial length, elastic doesn't resist squashing
+		CVector3 springVec( m_Positions[s.particle1], m_Positions[s.particle2] );
+		float currLength = Length( springVec );
+		float forceStrength = (currLength - s.inertialLength) * s.coefficient * m_Springiness;
+		if ((IsStretchOnly( s.type ) && forceStrength < 0) || currLength == 0.0f) continue;
+
+		CVector3 force = springVec * (forceStrength / currLength);
+		m_Forces[s.particle1] += force;
+		m_Forces[s.particle2] -= force;
+	}
+}
+
+// Move each particle using its total force (reduced with damping - proportional to the velocity)
+// Pinned and sleeping particles (those with zero inverse mass) are not moved
+void CSpringSystem::Integrate( float updateTime )
+{
+	unsigned int numParticles = GetNumParticles();
+	if (m_Integrator == Implicit)
+	{
+		IntegrateImplicit( updateTime );
+	}
+	else if (m_Integrator == Verlet)
+	{
+		for (unsigned int particle = 0; particle < numParticles; ++particle)
+		{
+			if (m_InvMasses[particle] == 0.0f) continue;
+
+			CVector3& position = m_Positions[particle];
+			CVector3 force = m_Forces[particle] - m_Damping * (position - m_PrevPositions[particle]) / updateTime;
+			CVector3 acceleration = force * m_InvMasses[particle];
+
+			CVector3 newPosition = 2 * position - m_PrevPositions[particle] + acceleration * updateTime * updateTime;
+			m_PrevPositions[particle] = position;
+			position = newPosition;
+		}
+	}
+	else
+	{
+		for (unsigned int particle = 0; particle < numParticles; ++particle)
+		{
+			if (m_InvMasses[particle] == 0.0f) continue;
+
+			CVector3 force = m_Forces[particle] - m_Damping * m_Velocities[particle];
+			CVector3 acceleration = force * m_InvMasses[particle];
+
+			m_PrevPositions[particle] = m_Positions[particle];
+			m_Positions[particle] += updateTime * m_Velocities[particle];
+			m_Velocities[particle] += updateTime * acceleration;
+		}
+	}
+}
+
+// Move each particle with backward Euler - the new velocities are found from the forces at the
+// end of the step rather than the start, which stays stable however stiff the springs. With the
+// forces linearised around the current positions this gives a linear system for the change in
+// velocity dv:
+//     (M + h.d.I - h^2.K) dv = h.(f + h.K.v)
+// where M is the particle masses, h the update time, d the damping, K the spring jacobian and f
+// the current forces. It is solved with conjugate gradients, starting from the last step's dv
+void CSpringSystem::IntegrateImplicit( float updateTime )
+{
+	unsigned int numParticles = GetNumParticles();
+	unsigned int numSprings = GetNumSprings();
+	float stiffnessScale = updateTime * updateTime;
+	float massScale = updateTime * m_Damping; // Added to the mass in the system matrix
+	AssembleJacobian();
+
+	// Right hand side (in the residual), and the diagonal of the system matrix for the preconditioner.
+	// Pinned particles have no rows in the system - their elements are always zero
+	m_CGResidual.resize( numParticles );
+	m_CGInvDiagonal.resize( numParticles );
+	for (unsigned int particle = 0; particle < numParticles; ++particle)
+	{
+		m_CGResidual[particle] = updateTime * (m_Forces[particle] - m_Damping * m_Velocities[particle]);
+		float diagonal = m_Masses[particle] + massScale;
+		m_CGInvDiagonal[particle] = CVector3( diagonal, diagonal, diagonal );
+	}
+	for (unsigned int spring = 0; spring < numSprings; ++spring)
+	{
+		const SSpringJacobian& jacobian = m_Jacobians[spring];
+		if (jacobian.axial == 0.0f) continue;
+
+		const SSpring& s = m_Springs[spring];
+		CVector3 relativeVelocity = m_Velocities[s.particle1] - m_Velocities[s.particle2];
+		CVector3 stiffnessForce = stiffnessScale * (jacobian.transverse * relativeVelocity +
+		                          (jacobian.axial - jacobian.transverse) * Dot( jacobian.direction, relativeVelocity ) * jacobian.direction);
+		m_CGResidual[s.particle1] -= stiffnessForce;
+		m_CGResidual[s.particle2] += stiffnessForce;
+
+		const CVector3& n = jacobian.direction;
+		CVector3 diagonal = stiffnessScale * (jacobian.transverse * CVector3::kOne +
+		                    (jacobian.axial - jacobian.transverse) * CVector3( n.x * n.x, n.y * n.y, n.z * n.z ));
+		m_CGInvDiagonal[s.particle1] += diagonal;
+		m_CGInvDiagonal[s.particle2] += diagonal;
+	}
+	double rhsLengthSq = 0.0;
+	for (unsigned int particle = 0; particle < numParticles; ++particle)
+	{
+		CVector3& invDiagonal = m_CGInvDiagonal[particle];
+		if (m_InvMasses[particle] == 0.0f)
+		{
+			m_CGResidual[particle] = CVector3::kZero;
+			m_DeltaVelocities[particle] = CVector3::kZero;
+			invDiagonal = CVector3::kZero;
+		}
+		else
+		{
+			invDiagonal = CVector3( 1.0f / invDiagonal.x, 1.0f / invDiagonal.y, 1.0f / invDiagonal.z );
+		}
+		rhsLengthSq += LengthSquared( m_CGResidual[particle] );
+	}
+
+	// Start from the last step's solution if it is a better guess than zero (its residual is smaller
+	// than the right hand side). It usually is, but not when stiff springs swap direction every step
+	MultiplySystem( m_DeltaVelocities, m_CGProduct, massScale, stiffnessScale );
+	double warmStartLengthSq = 0.0;
+	for (unsigned int particle = 0; particle < numParticles; ++particle)
+	{
+		m_CGProduct[particle] = m_CGResidual[particle] - m_CGProduct[particle];
+		warmStartLengthSq += LengthSquared( m_CGProduct[particle] );
+	}
+	if (warmStartLengthSq < rhsLengthSq)
+	{
+		m_CGResidual.swap( m_CGProduct );
+	}
+	else
+	{
+		m_DeltaVelocities.assign( numParticles, CVector3::kZero );
+	}
+
+	// Preconditioned conjugate gradients. Residual r = b - A.dv, preconditioned residual z, search
+	// direction p. Each iteration moves dv along p to minimise the error, then picks a new direction
+	// conjugate to the previous ones
+	m_CGPreconditioned.resize( numParticles );
+	m_CGDirection.resize( numParticles );
+	double residualDotZ = 0.0;
+	double residualLengthSq = 0.0;
+	for (unsigned int particle = 0; particle < numParticles; ++particle)
+	{
+		m_CGPreconditioned[particle] = MultiplyComponents( m_CGResidual[particle], m_CGInvDiagonal[particle] );
+		m_CGDirection[particle] = m_CGPreconditioned[particle];
+		residualDotZ += Dot( m_CGResidual[particle], m_CGPreconditioned[particle] );
+		residualLengthSq += LengthSquared( m_CGResidual[particle] );
+	}
+
+	double toleranceSq = m_CGTolerance * m_CGTolerance * rhsLengthSq;
+	m_CGIterations = 0;
+	while (m_CGIterations < m_MaxCGIterations && residualLengthSq > toleranceSq)
+	{
+		MultiplySystem( m_CGDirection, m_CGProduct, massScale, stiffnessScale );
+		double directionDotProduct = 0.0;
+		for (unsigned int particle = 0; particle < numParticles; ++particle)
+		{
+			directionDotProduct += Dot( m_CGDirection[particle], m_CGProduct[particle] );
+		}
+		if (directionDotProduct <= 0.0) break;
+		float stepSize = static_cast<float>(residualDotZ / directionDotProduct);
+
+		double newResidualDotZ = 0.0;
+		residualLengthSq = 0.0;
+		for (unsigned int particle = 0; particle < numParticles; ++particle)
+		{
+			m_DeltaVelocities[particle] += stepSize * m_CGDirection[particle];
+			m_CGResidual[particle] -= stepSize * m_CGProduct[particle];
+			m_CGPreconditioned[particle] = MultiplyComponents( m_CGResidual[particle], m_CGInvDiagonal[particle] );
+			newResidualDotZ += Dot( m_CGResidual[particle], m_CGPreconditioned[particle] );
+			residualLengthSq += LengthSquared( m_CGResidual[particle] );
+		}
+
+		float directionScale = static_cast<float>(newResidualDotZ / residualDotZ);
+		for (unsigned int particle = 0; particle < numParticles; ++particle)
+		{
+			m_CGDirection[particle] = m_CGPreconditioned[particle] + directionScale * m_CGDirection[particle];
+		}
+		residualDotZ = newResidualDotZ;
+		++m_CGIterations;
+	}
+
+	// Update velocities with the solution, then positions with the new velocities
+	for (unsigned int particle = 0; particle < numParticles; ++particle)
+	{
+		if (m_InvMasses[particle] == 0.0f) continue;
+
+		m_Velocities[particle] += m_DeltaVelocities[particle];
+		m_PrevPositions[particle] = m_Positions[particle];
+		m_Positions[particle] += updateTime * m_Velocities[particle];
+	}
+}
+
+// Calculate the derivative of each spring force with respect to the particle positions. Along the
+// spring it is the spring coefficient, across it the coefficient scaled by how far the spring is
+// stretched (a rotating spring's force turns with it). The across part is not allowed below zero,
+// which a squashed spring would give, so the system matrix stays positive definite for CG
+void CSpringSystem::AssembleJacobian()
+{
+	unsigned int numSprings = GetNumSprings();
+	m_Jacobians.resize( numSprings );
+	for (unsigned int spring = 0; spring < numSprings; ++spring)
+	{
+		SSpringJacobian& jacobian = m_Jacobians[spring];
+		jacobian.axial = 0.0f;
+		jacobian.transverse = 0.0f;
+
+		// Constraints and slack elastic don't exert a force, so have no derivative
+		const SSpring& s = m_Springs[spring];
+		if (m_Compliances[s.type] >= 0.0f) continue;
+		CVector3 springVec( m_Positions[s.particle1], m_Positions[s.particle2] );
+		float currLength = Length( springVec );
+		if ((IsStretchOnly( s.type ) && currLength < s.inertialLength) || currLength == 0.0f) continue;
+
+		float stiffness = s.coefficient * m_Springiness;
+		jacobian.direction = springVec / currLength;
+		jacobian.axial = stiffness;
+		jacobian.transverse = Max( 0.0f, stiffness * (1.0f - s.inertialLength / currLength) );
+	}
+}
+
+// Multiply a vector (one element per particle) by the implicit system matrix M + h.d.I - h^2.K.
+// The mass scale is h.d and the stiffness scale h^2. Rows for pinned and sleeping particles are zero
+void CSpringSystem::MultiplySystem( const vector<CVector3>& v, vector<CVector3>& result, float massScale, float stiffnessScale )
+{
+	unsigned int numParticles = GetNumParticles();
+	unsigned int numSprings = GetNumSprings();
+	result.resize( numParticles );
+	for (unsigned int particle = 0; particle < numParticles; ++particle)
+	{
+		result[particle] = (m_Masses[particle] + massScale) * v[particle];
+	}
+
+	// Each spring adds its block times the difference of its particles' elements (the two
+	// particles have equal and opposite blocks)
+	for (unsigned int spring = 0; spring < numSprings; ++spring)
+	{
+		const SSpringJacobian& jacobian = m_Jacobians[spring];
+		if (jacobian.axial == 0.0f) continue;
+
+		const SSpring& s = m_Springs[spring];
+		CVector3 difference = v[s.particle1] - v[s.particle2];
+		CVector3 product = stiffnessScale * (jacobian.transverse * difference +
+		                   (jacobian.axial - jacobian.transverse) * Dot( jacobian.direction, difference ) * jacobian.direction);
+		result[s.particle1] += product;
+		result[s.particle2] -= product;
+	}
+
+	for (unsigned int particle = 0; particle < numParticles; ++particle)
+	{
+		if (m_InvMasses[particle] == 0.0f) result[particle] = CVector3::kZero;
+	}
+}
+
+// Move particles to satisfy the constraint springs, over the set number of iterations. Each
+// constraint gives its particles a correction along the spring, split by inverse mass. Compliance
+// makes a constraint give way under load - the correction is reduced by the total correction
+// already made this step (lambda), scaled by compliance / time^2
+//
+// Constraints are solved one colour batch at a time. Large batches are split into tasks for the
+// thread pool - constraints in a batch share no particles so the tasks can't interfere. Each task
+// keeps its own largest error, combined after the batch
+void CSpringSystem::SolveConstraints( float updateTime )
+{
+	if (m_BatchesChanged)
+	{
+		BuildBatches();
+	}
+	m_Lambdas.assign( GetNumSprings(), 0.0f );
+	float complianceScale = 1.0f / (updateTime * updateTime);
+
+	// Particles only collide with neighbours found at the start of the step. Sleeping islands that
+	// awake particles may collide with must join in
+	FindNeighbours();
+	if (m_NumAwakeIslands < GetNumIslands())
+	{
+		WakeCollidingIslands();
+	}
+	unsigned int numParticles = GetNumParticles();
+	bool hasColliders = !m_Planes.empty() || !m_Spheres.empty() || !m_Capsules.empty();
+
+	for (unsigned int iteration = 0; iteration < m_NumIterations; ++iteration)
+	{
+		float maxError = 0.0f;
+		for (unsigned int colour = 0; colour <= NO_COLOUR; ++colour)
+		{
+			unsigned int first = m_BatchStarts[colour];
+			unsigned int last  = m_BatchStarts[colour + 1];
+
+			// Springs without a colour may share particles, so are always solved in turn
+			if (!m_ThreadPool || colour == NO_COLOUR || last - first < MIN_PARALLEL_SPRINGS)
+			{
+				float batchError = SolveBatch( first, last, complianceScale );
+				if (batchError > maxError) maxError = batchError;
+				continue;
+			}
+
+			unsigned int numTasks = (last - first + SPRINGS_PER_TASK - 1) / SPRINGS_PER_TASK;
+			m_TaskErrors.resize( numTasks );
+			m_ThreadPool->Run( numTasks, [this, first, last, complianceScale]( TUInt32 task )
+			{
+				unsigned int taskFirst = first + task * SPRINGS_PER_TASK;
+				unsigned int taskLast  = (last - taskFirst > SPRINGS_PER_TASK) ? taskFirst + SPRINGS_PER_TASK : last;
+				m_TaskErrors[task] = SolveBatch( taskFirst, taskLast, complianceScale );
+			} );
+			for (unsigned int task = 0; task < numTasks; ++task)
+			{
+				if (m_TaskErrors[task] > maxError) maxError = m_TaskErrors[task];
+			}
+		}
+		m_ConstraintErrors[iteration] = maxError;
+
+		// Solve collisions after the springs, so particles end each iteration outside each other and
+		// the colliders. All moves are calculated before any are applied
+		if (m_ParticleRadius > 0.0f)
+		{
+			RunTasks( numParticles, PARTICLES_PER_TASK, [this]( unsigned int first, unsigned int last )
+			{
+				CalculateCollisions( first, last );
+			} );
+		}
+		if (m_ParticleRadius > 0.0f || hasColliders)
+		{
+			RunTasks( numParticles, PARTICLES_PER_TASK, [this]( unsigned int first, unsigned int last )
+			{
+				ApplyCollisions( first, last );
+			} );
+		}
+	}
+}
+
+// Solve the constraints in the given range of the batch list once, returns the largest error
+float CSpringSystem::SolveBatch( unsigned int first, unsigned int last, float complianceScale )
+{
+	float maxError = 0.0f;
+	for (unsigned int batchSpring = first; batchSpring < last; ++batchSpring)
+	{
+		unsigned int spring = m_BatchSprings[batchSpring];
+		const SSpring& s = m_Springs[spring];
+		float compliance = m_Compliances[s.type];
+
+		// Error is the difference between current length and inertial length. No constraint on a
+		// string or elastic that is shorter than its inertial length
+		CVector3& position1 = m_Positions[s.particle1];
+		CVector3& position2 = m_Positions[s.particle2];
+		CVector3 springVec( position1, position2 );
+		float springLen = Length( springVec );
+		float error = springLen - s.inertialLength;
+		if ((IsStretchOnly( s.type ) && error < 0.0f) || springLen == 0.0f) continue;
+		if (Abs( error ) > maxError) maxError = Abs( error );
+
+		// Lighter particles move more, pinned and sleeping particles have zero inverse mass so are not moved
+		float invMass1 = m_InvMasses[s.particle1];
+		float invMass2 = m_InvMasses[s.particle2];
+		float alpha = compliance * complianceScale;
+		float denominator = invMass1 + invMass2 + alpha;
+		if (denominator == 0.0f) continue;
+
+		float deltaLambda = (-error - alpha * m_Lambdas[spring]) / denominator;
+		m_Lambdas[spring] += deltaLambda;
+		CVector3 correction = springVec * (deltaLambda / springLen);
+		position1 -= correction * invMass1;
+		position2 += correction * invMass2;
+	}
+	return maxError;
+}
+
+// Return the lowest colour not used by the springs on the given particles, and mark it as used
+// on both. Returns NO_COLOUR if all the colours are in use
+unsigned int CSpringSystem::ColourSpring( unsigned int particle1, unsigned int particle2 )
+{
+	TUInt64 usedColours = m_ParticleColours[particle1] | m_ParticleColours[particle2];
+	for (unsigned int colour = 0; colour < MAX_COLOURS; ++colour)
+	{
+		TUInt64 colourBit = static_cast<TUInt64>(1) << colour;
+		if (!(usedColours & colourBit))
+		{
+			m_ParticleColours[particle1] |= colourBit;
+			m_ParticleColours[particle2] |= colourBit;
+			return colour;
+		}
+	}
+	return NO_COLOUR;
+}
+
+// Rebuild the list of constraint springs sorted by colour (in spring order within each colour).
+// Springs that are not constraints are left out
+void CSpringSystem::BuildBatches()
+{
+	// Count the constraints of each colour, then turn the counts into start positions
+	m_BatchStarts.assign( NO_COLOUR + 2, 0 );
+	for (unsigned int spring = 0; spring < GetNumSprings(); ++spring)
+	{
+		if (m_Compliances[m_Springs[spring].type] < 0.0f) continue;
+		++m_BatchStarts[m_SpringColours[spring] + 1];
+	}
+	for (unsigned int colour = 0; colour <= NO_COLOUR; ++colour)
+	{
+		m_BatchStarts[colour + 1] += m_BatchStarts[colour];
+	}
+
+	// Place each constraint in its batch
+	vector<unsigned int> nextSpring( m_BatchStarts.begin(), m_BatchStarts.end() - 1 );
+	m_BatchSprings.resize( m_BatchStarts[NO_COLOUR + 1] );
+	for (unsigned int spring = 0; spring < GetNumSprings(); ++spring)
+	{
+		if (m_Compliances[m_Springs[spring].type] < 0.0f) continue;
+		m_BatchSprings[nextSpring[m_SpringColours[spring]]++] = spring;
+	}
+	m_BatchesChanged = false;
+}
+
+// Put the particles in the spatial hash and find each particle's neighbours for collisions. The
+// hash is a counting sort of the particles by table entry, with the particles in particle order
+// within each entry, so the neighbours found don't depend on the number of threads. The neighbour
+// lists are gathered into one array in the same way, so there is no limit on the number of
+// neighbours a particle can have
+void CSpringSystem::FindNeighbours()
+{
+	unsigned int numParticles = GetNumParticles();
+	m_NeighbourStarts.assign( numParticles + 1, 0 );
+	m_CollisionMoves.assign( numParticles, CVector3::kZero );
+	if (m_ParticleRadius <= 0.0f) return;
+
+	// Cells are the size of the search distance, so all neighbours are in the surrounding cells. The
+	// table has at least twice as many entries as particles, so few occupied cells share an entry
+	m_CellSize = 2.0f * m_ParticleRadius * NEIGHBOUR_SEARCH_SCALE;
+	m_HashSize = 1;
+	while (m_HashSize < 2 * numParticles) m_HashSize *= 2;
+
+	// Count the particles in each entry, then total the counts so each entry holds the end of its
+	// particles. Placing the particles in reverse order moves each entry back to its start
+	m_ParticleHashes.resize( numParticles );
+	m_HashStarts.assign( m_HashSize + 1, 0 );
+	for (unsigned int particle = 0; particle < numParticles; ++particle)
+	{
+		const CVector3& position = m_Positions[particle];
+		unsigned int hash = HashCell( static_cast<int>(Floor( position.x / m_CellSize )),
+		                              static_cast<int>(Floor( position.y / m_CellSize )),
+		                              static_cast<int>(Floor( position.z / m_CellSize )) );
+		m_ParticleHashes[particle] = hash;
+		++m_HashStarts[hash];
+	}
+	for (unsigned int hash = 1; hash <= m_HashSize; ++hash)
+	{
+		m_HashStarts[hash] += m_HashStarts[hash - 1];
+	}
+	m_HashParticles.resize( numParticles );
+	for (unsigned int particle = numParticles; particle-- > 0; )
+	{
+		m_HashParticles[--m_HashStarts[m_ParticleHashes[particle]]] = particle;
+	}
+
+	// Search in parallel, each task taking a range of the particles and listing their neighbours in
+	// its own buffer. Particles are taken in index order rather than hash order - the hash scatters
+	// neighbouring cells through the table, while generated meshes number nearby particles together
+	unsigned int numTasks = (numParticles + PARTICLES_PER_TASK - 1) / PARTICLES_PER_TASK;
+	if (m_TaskNeighbours.size() < numTasks) m_TaskNeighbours.resize( numTasks );
+	RunTasks( numParticles, PARTICLES_PER_TASK, [this]( unsigned int first, unsigned int last )
+	{
+		FindCellNeighbours( first, last );
+	} );
+
+	// Total the counts so each particle holds the start of its list, then copy the lists from the
+	// task buffers. The copy uses the same tasks as the search, so each reads its own buffer
+	for (unsigned int particle = 1; particle <= numParticles; ++particle)
+	{
+		m_NeighbourStarts[particle] += m_NeighbourStarts[particle - 1];
+	}
+	m_Neighbours.resize( m_NeighbourStarts[numParticles] );
+	RunTasks( numParticles, PARTICLES_PER_TASK, [this]( unsigned int first, unsigned int last )
+	{
+		const vector<unsigned int>& found = m_TaskNeighbours[first / PARTICLES_PER_TASK];
+		unsigned int next = 0;
+		for (unsigned int particle = first; particle < last; ++particle)
+		{
+			for (unsigned int n = m_NeighbourStarts[particle]; n < m_NeighbourStarts[particle + 1]; ++n)
+			{
+				m_Neighbours[n] = found[next++];
+			}
+		}
+	} );
+}
+
+// Find the neighbours of the particles in the given range. They are listed in particle order in the
+// buffer of the task with this range, and each particle's count is stored in the entry after its
+// own in m_NeighbourStarts
+void CSpringSystem::FindCellNeighbours( unsigned int first, unsigned int last )
+{
+	vector<unsigned int>& found = m_TaskNeighbours[first / PARTICLES_PER_TASK];
+	found.clear();
+	float collisionDistance = 2.0f * m_ParticleRadius;
+	float searchDistanceSq = m_CellSize * m_CellSize;
+	for (unsigned int particle = first; particle < last; ++particle)
+	{
+		const CVector3& position = m_Positions[particle];
+		int cellX = static_cast<int>(Floor( position.x / m_CellSize ));
+		int cellY = static_cast<int>(Floor( position.y / m_CellSize ));
+		int cellZ = static_cast<int>(Floor( position.z / m_CellSize ));
+
+		unsigned int firstFound = static_cast<unsigned int>(found.size());
+		for (int z = cellZ - 1; z <= cellZ + 1; ++z)
+		{
+			for (int y = cellY - 1; y <= cellY + 1; ++y)
+			{
+				for (int x = cellX - 1; x <= cellX + 1; ++x)
+				{
+					unsigned int hash = HashCell( x, y, z );
+					for (unsigned int i = m_HashStarts[hash]; i < m_HashStarts[hash + 1]; ++i)
+					{
+						// Skip pairs that are out of reach this step, that can't move, or that were within
+						// collision distance at the start (held there by springs)
+						unsigned int other = m_HashParticles[i];
+						if (other == particle || LengthSquared( m_Positions[other] - position ) >= searchDistanceSq) continue;
+						if (m_InvMasses[particle] + m_InvMasses[other] == 0.0f) continue;
+						if (LengthSquared( m_InitialPositions[other] - m_InitialPositions[particle] ) < collisionDistance * collisionDistance) continue;
+
+						// Two of the cells searched can share a table entry, don't list a neighbour twice
+						bool listed = false;
+						for (unsigned int n = firstFound; n < found.size() && !listed; ++n)
+						{
+							listed = (found[n] == other);
+						}
+						if (!listed) found.push_back( other );
+					}
+				}
+			}
+		}
+		m_NeighbourStarts[particle + 1] = static_cast<unsigned int>(found.size()) - firstFound;
+	}
+}
+
+// Calculate the move pushing each particle in the given range away from its neighbours. Each
+// overlapping pair is split by inverse mass, this particle's share is calculated here and the
+// neighbour's share when the neighbour is processed
+void CSpringSystem::CalculateCollisions( unsigned int first, unsigned int last )
+{
+	float collisionDistance = 2.0f * m_ParticleRadius;
+	for (unsigned int particle = first; particle < last; ++particle)
+	{
+		float invMass = m_InvMasses[particle];
+		CVector3 move = CVector3::kZero;
+		unsigned int numContacts = 0;
+		for (unsigned int n = m_NeighbourStarts[particle]; n < m_NeighbourStarts[particle + 1] && invMass > 0.0f; ++n)
+		{
+			unsigned int neighbour = m_Neighbours[n];
+			CVector3 offset = m_Positions[particle] - m_Positions[neighbour];
+			float distanceSq = LengthSquared( offset );
+			if (distanceSq >= collisionDistance * collisionDistance || distanceSq == 0.0f) continue;
+
+			float distance = Sqrt( distanceSq );
+			float share = invMass / (invMass + m_InvMasses[neighbour]);
+			move += offset * ((collisionDistance - distance) / distance * share);
+			++numContacts;
+		}
+
+		// Average the moves, so a particle in contact with many others isn't pushed too far
+		m_CollisionMoves[particle] = (numContacts > 0) ? move / static_cast<float>(numContacts) : CVector3::kZero;
+	}
+}
+
+// Move each particle in the given range by its collision move, then out of any colliders it is in.
+// Pinned particles are not moved
+void CSpringSystem::ApplyCollisions( unsigned int first, unsigned int last )
+{
+	for (unsigned int particle = first; particle < last; ++particle)
+	{
+		if (m_InvMasses[particle] == 0.0f) continue;
+
+		CVector3& position = m_Positions[particle];
+		position += m_CollisionMoves[particle];
+
+		for (unsigned int plane = 0; plane < m_Planes.size(); ++plane)
+		{
+			const SPlaneCollider& p = m_Planes[plane];
+			float depth = m_ParticleRadius + p.distance - Dot( position, p.normal );
+			if (depth > 0.0f) position += p.normal * depth;
+		}
+		for (unsigned int sphere = 0; sphere < m_Spheres.size(); ++sphere)
+		{
+			PushOutOfSphere( position, m_Spheres[sphere].centre, m_Spheres[sphere].radius + m_ParticleRadius );
+		}
+		for (unsigned int capsule = 0; capsule < m_Capsules.size(); ++capsule)
+		{
+			// Push out from the nearest point on the capsule's line segment
+			const SCapsuleCollider& c = m_Capsules[capsule];
+			CVector3 axis = c.point2 - c.point1;
+			float axisLengthSq = LengthSquared( axis );
+			float t = (axisLengthSq > 0.0f) ? Dot( position - c.point1, axis ) / axisLengthSq : 0.0f;
+			if (t < 0.0f) t = 0.0f;
+			if (t > 1.0f) t = 1.0f;
+			PushOutOfSphere( position, c.point1 + axis * t, c.radius + m_ParticleRadius );
+		}
+	}
+}
+
+// Find the islands from the springs, all islands start awake. Union-find joins the two particles of
+// each spring between unpinned particles. Each set's root is its lowest particle, so taking the
+// particles in order every parent is final before it is needed and the islands are numbered in
+// order of their first particle. The islands' particle lists are a counting sort by island
+void CSpringSystem::BuildIslands()
+{
+	unsigned int numParticles = GetNumParticles();
+	vector<unsigned int> parents( numParticles );
+	for (unsigned int particle = 0; particle < numParticles; ++particle)
+	{
+		parents[particle] = particle;
+	}
+	for (unsigned int spring = 0; spring < GetNumSprings(); ++spring)
+	{
+		const SSpring& s = m_Springs[spring];
+		if (m_Pinned[s.particle1] || m_Pinned[s.particle2]) continue;
+
+		// Find both roots (halving the paths on the way), then join the higher root to the lower
+		unsigned int root1 = s.particle1;
+		while (parents[root1] != root1) root1 = parents[root1] = parents[parents[root1]];
+		unsigned int root2 = s.particle2;
+		while (parents[root2] != root2) root2 = parents[root2] = parents[parents[root2]];
+		if (root1 < root2) parents[root2] = root1;
+		else               parents[root1] = root2;
+	}
+
+	// Number the islands and count their particles
+	m_ParticleIslands.resize( numParticles );
+	m_IslandStarts.assign( 1, 0 );
+	for (unsigned int particle = 0; particle < numParticles; ++particle)
+	{
+		if (m_Pinned[particle])
+		{
+			m_ParticleIslands[particle] = NO_INDEX;
+			continue;
+		}
+		parents[particle] = parents[parents[particle]];
+		if (parents[particle] == particle)
+		{
+			m_ParticleIslands[particle] = static_cast<unsigned int>(m_IslandStarts.size()) - 1;
+			m_IslandStarts.push_back( 0 );
+		}
+		else
+		{
+			m_ParticleIslands[particle] = m_ParticleIslands[parents[particle]];
+		}
+		++m_IslandStarts[m_ParticleIslands[particle] + 1];
+	}
+	unsigned int numIslands = static_cast<unsigned int>(m_IslandStarts.size()) - 1;
+	for (unsigned int island = 0; island < numIslands; ++island)
+	{
+		m_IslandStarts[island + 1] += m_IslandStarts[island];
+	}
+	vector<unsigned int> nextParticle( m_IslandStarts.begin(), m_IslandStarts.end() - 1 );
+	m_IslandParticles.resize( m_IslandStarts[numIslands] );
+	for (unsigned int particle = 0; particle < numParticles; ++particle)
+	{
+		if (m_ParticleIslands[particle] == NO_INDEX) continue;
+		m_IslandParticles[nextParticle[m_ParticleIslands[particle]]++] = particle;
+
+		// Sleeping particles may have been moved to this island, wake them all
+		m_InvMasses[particle] = 1.0f / m_Masses[particle];
+	}
+
+	// Note the springs that hang islands from pinned particles
+	m_PinLinks.clear();
+	for (unsigned int spring = 0; spring < GetNumSprings(); ++spring)
+	{
+		const SSpring& s = m_Springs[spring];
+		if (m_Pinned[s.particle1] == m_Pinned[s.particle2]) continue;
+
+		SPinLink link;
+		link.particle = m_Pinned[s.particle1] ? s.particle1 : s.particle2;
+		link.island = m_ParticleIslands[m_Pinned[s.particle1] ? s.particle2 : s.particle1];
+		m_PinLinks.push_back( link );
+	}
+
+	m_IslandAwake.assign( numIslands, 1 );
+	m_IslandRestTimes.assign( numIslands, 0.0f );
+	m_NumAwakeIslands = numIslands;
+	m_IslandsChanged = false;
+}
+
+// Wake islands whose pinned particles have moved since the last step (pinned particles have their
+// previous position brought up to date each step), or all islands if gravity has changed
+void CSpringSystem::WakeMovedIslands( const CVector3& gravity )
+{
+	if (gravity != m_LastGravity)
+	{
+		m_LastGravity = gravity;
+		WakeAll();
+		return;
+	}
+	for (unsigned int link = 0; link < m_PinLinks.size(); ++link)
+	{
+		const SPinLink& l = m_PinLinks[link];
+		if (!m_IslandAwake[l.island] && m_Positions[l.particle] != m_PrevPositions[l.particle])
+		{
+			WakeIsland( l.island );
+		}
+	}
+}
+
+// Wake sleeping islands with a particle that is a collision neighbour of an awake particle. Pairs of
+// sleeping particles are never neighbours, so any neighbour of a particle with inverse mass is
+// checked. Runs on this thread as it changes the islands. The woken islands keep their rest time,
+// so they go back to sleep at the end of the step if the collision didn't disturb them - otherwise
+// islands resting against each other would keep waking each other and never all be asleep
+void CSpringSystem::WakeCollidingIslands()
+{
+	for (unsigned int particle = 0; particle + 1 < m_NeighbourStarts.size(); ++particle)
+	{
+		if (m_InvMasses[particle] == 0.0f) continue;
+
+		for (unsigned int n = m_NeighbourStarts[particle]; n < m_NeighbourStarts[particle + 1]; ++n)
+		{
+			unsigned int island = m_ParticleIslands[m_Neighbours[n]];
+			if (island == NO_INDEX || m_IslandAwake[island]) continue;
+
+			float restTime = m_IslandRestTimes[island];
+			WakeIsland( island );
+			m_IslandRestTimes[island] = restTime;
+		}
+	}
+}
+
+// Total the kinetic energy of each awake island, and put to sleep those that have been below the
+// threshold for long enough. The energy is divided by the island's mass, so large and small
+// islands sleep at the same speed. Speeds are taken from the distance moved in the step rather
+// than the velocities - an Euler particle at rest has the next step's gravity in its velocity
+void CSpringSystem::UpdateSleep( float updateTime )
+{
+	if (m_SleepThreshold <= 0.0f) return;
+
+	float invTimeSq = 1.0f / (updateTime * updateTime);
+	for (unsigned int island = 0; island < GetNumIslands(); ++island)
+	{
+		if (!m_IslandAwake[island]) continue;
+
+		float energy = 0.0f;
+		float mass = 0.0f;
+		for (unsigned int i = m_IslandStarts[island]; i < m_IslandStarts[island + 1]; ++i)
+		{
+			unsigned int particle = m_IslandParticles[i];
+			energy += 0.5f * m_Masses[particle] * LengthSquared( m_Positions[particle] - m_PrevPositions[particle] ) * invTimeSq;
+			mass += m_Masses[particle];
+		}
+
+		if (energy >= m_SleepThreshold * mass)
+		{
+			m_IslandRestTimes[island] = 0.0f;
+		}
+		else
+		{
+			m_IslandRestTimes[island] += updateTime;
+			if (m_IslandRestTimes[island] >= SLEEP_DELAY) SleepIsland( island );
+		}
+	}
+}
+
+// Wake an island, its particles are simulated again from rest
+void CSpringSystem::WakeIsland( unsigned int island )
+{
+	if (m_IslandAwake[island]) return;
+
+	m_IslandAwake[island] = 1;
+	m_IslandRestTimes[island] = 0.0f;
+	++m_NumAwakeIslands;
+	for (unsigned int i = m_IslandStarts[island]; i < m_IslandStarts[island + 1]; ++i)
+	{
+		unsigned int particle = m_IslandParticles[i];
+		m_InvMasses[particle] = 1.0f / m_Masses[particle];
+	}
+}
+
+// Put an island to sleep - its particles are stopped and given zero inverse mass, so the step
+// treats them as pinned
+void CSpringSystem::SleepIsland( unsigned int island )
+{
+	if (!m_IslandAwake[island]) return;
+
+	m_IslandAwake[island] = 0;
+	--m_NumAwakeIslands;
+	for (unsigned int i = m_IslandStarts[island]; i < m_IslandStarts[island + 1]; ++i)
+	{
+		unsigned int particle = m_IslandParticles[i];
+		m_InvMasses[particle] = 0.0f;
+		m_Velocities[particle] = CVector3::kZero;
+		m_DeltaVelocities[particle] = CVector3::kZero;
+		m_PrevPositions[particle] = m_Positions[particle];
+	}
+}
+
+// Call work( first, last ) over ranges of numItems items, as tasks on the thread pool when there
+// are enough items, otherwise once for all items on this thread
+void CSpringSystem::RunTasks( unsigned int numItems, unsigned int itemsPerTask,
+                              const function<void( unsigned int, unsigned int )>& work )
+{
+	if (!m_ThreadPool || numItems < 2 * itemsPerTask)
+	{
+		work( 0, numItems );
+		return;
+	}
+
+	unsigned int numTasks = (numItems + itemsPerTask - 1) / itemsPerTask;
+	m_ThreadPool->Run( numTasks, [numItems, itemsPerTask, &work]( TUInt32 task )
+	{
+		unsigned int first = task * itemsPerTask;
+		unsigned int last  = (numItems - first > itemsPerTask) ? first + itemsPerTask : numItems;
+		work( first, last );
+	} );
+}
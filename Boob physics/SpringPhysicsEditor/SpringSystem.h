@@ -0,0 +1,522 @@
+//-----------------------------------------------------
+// SpringSystem.h
+//   Particle and spring data for a spring-based physics
+//   system, held in flat arrays indexed by number
+//-----------------------------------------------------
+
+#ifndef SPRING_SYSTEM_H_INCLUDED
+#define SPRING_SYSTEM_H_INCLUDED
+
+#include <vector>
+#include <functional>
+using namespace std;
+
+#include "CVector3.h"
+#include "CThreadPool.h"
+using namespace gen;
+
+// Forward declaration - particles and springs in the system can have a CParticle / CSpring object
+// attached (a "view"), which the system stores but never uses
+class CParticle;
+class CSpring;
+
+
+//****| INFO |*************************************************************************************//
+// The spring system holds all the simulation data for particles and springs. Each particle is an
+// index into a set of arrays (positions, masses etc.), and each spring is a record holding the
+// indexes of its two particles. The simulation step runs over these arrays in order, so its cost
+// depends only on the number of particles and springs, not on where they sit in memory.
+//
+// The step has three phases. First each spring's force is calculated once and added to the force
+// totals of both its particles. Then every particle is moved using its total force. No particle
+// moves until all forces are known, so the result doesn't depend on the order of particles or
+// springs. Finally the constraints are solved.
+//
+// Verlet and Euler integration are explicit - they move particles using the forces at the start
+// of the step, and stiff springs overshoot and blow up unless the timestep is small. The implicit
+// integrator uses the forces at the end of the step instead, found by solving a linear system of
+// all the particles (with conjugate gradients). Each step costs several times more, but it stays
+// stable at a normal frame time however stiff the springs, where explicit methods would need many
+// smaller steps
+//
+// Constraints use extended position based dynamics (XPBD). Each constraint spring moves its two
+// particles towards its inertial length, split by inverse mass so pinned particles never move.
+// Its compliance (inverse stiffness) decides how far - zero compliance is rigid. All constraints
+// are solved in turn, and this is repeated for a number of iterations. More iterations give
+// stiffer rod chains, so a large timestep with a few iterations can replace many tiny timesteps.
+// Compliance is set per spring type - by default rods and strings are rigid constraints, springs
+// and elastic only exert forces
+//
+// Springs are coloured so that no two springs of the same colour share a particle. The constraints
+// are solved one colour at a time, and those of one colour can be solved in parallel on a thread
+// pool since they never move the same particle. A spring is given the lowest colour not used by
+// the other springs on its two particles when it is added, and its colour is freed when it is
+// removed, so editing never needs a full recolour. The solve order depends only on the colouring,
+// so results are the same whatever the number of threads
+//
+// Particles can collide with each other and with colliders in the scene (planes, spheres and
+// capsules). Each step the particles are put in a spatial hash - a grid of cells the size of the
+// collision search distance, hashed into a table so the grid needn't be bounded. Each particle's
+// neighbours are found in its own and the 26 surrounding cells, so finding them costs about the
+// same per particle however many particles there are. Collisions are then solved with the
+// constraints in each iteration. Each particle's collision moves are calculated from its neighbours
+// and only applied to the particle itself once all are known, so all collision work (including the
+// neighbour search, split by hash cell) runs in parallel with the same result whatever the number
+// of threads
+//
+// Particles joined by springs form islands (pinned particles don't join islands together, since
+// they don't pass on any motion). The islands are found with union-find when particles or springs
+// change. Each step every island's kinetic energy is totalled, and an island that stays below the
+// sleep threshold for a short time is put to sleep - its particles are treated as pinned and cost
+// almost nothing, and when every island is asleep the step does no work at all. An island is woken
+// when one of the pinned particles it hangs from is moved, when an awake particle comes near enough
+// to collide with it, when gravity changes, or when the application calls WakeParticle (e.g. after
+// moving a particle or changing its mass). Islands don't notice colliders moving, call WakeAll then
+//
+// CParticle and CSpring are views onto the system - they hold the index of their particle/spring
+// and the models or other data used by the application, but read and write simulation data here.
+// Particles and springs are removed by moving the last one into the gap, so indexes are not
+// stable over removal - the view of the moved particle/spring must be given its new index
+//*************************************************************************************************//
+class CSpringSystem
+{
+public:
+
+	// Springs are actually of several forms - same values as CSpring::ESpringType
+	enum ESpringType
+	{
+		Spring = 0, // Force on squash or stretch
+		Elastic,    // No resistance to squash, force on stretch
+		String,     // No resistance to squash, cannot be stretched
+		Rod,        // Cannot be squashed or stretched
+		NumTypes
+	};
+
+	// Integration method used to update particle positions
+	enum EIntegrator
+	{
+		Verlet = 0,
+		Euler,
+		Implicit, // Backward Euler - stable with stiff springs at large timesteps, but costs more per step
+	};
+
+	// Index used for "no particle" or "no spring"
+	static const unsigned int NO_INDEX = 0xffffffff;
+
+	// Number of spring colours available, and the colour for springs that don't get one
+	static const unsigned int MAX_COLOURS = 64;
+	static const unsigned int NO_COLOUR = MAX_COLOURS;
+
+	// Compliance for a spring type that means its springs are not constraints - they only exert
+	// forces based on their coefficient
+	static const float FORCE_ONLY;
+
+	// Spring record - a spring joins two particles, given by index
+	struct SSpring
+	{
+		unsigned int particle1;
+		unsigned int particle2;
+		float        inertialLength;
+		float        coefficient;
+		ESpringType  type;
+	};
+
+	// Colliders are shapes in the scene that particles cannot enter. A plane keeps particles on the
+	// side its normal faces, distance is the plane's distance from the origin along the normal. A
+	// capsule is a line segment with a radius
+	struct SPlaneCollider
+	{
+		CVector3 normal;
+		float    distance;
+	};
+	struct SSphereCollider
+	{
+		CVector3 centre;
+		float    radius;
+	};
+	struct SCapsuleCollider
+	{
+		CVector3 point1;
+		CVector3 point2;
+		float    radius;
+	};
+
+
+	/////////////////////////////
+	// Constructor
+
+	CSpringSystem();
+
+
+	////////////////////////////////////
+	// Settings
+
+	// Damping force per unit of velocity applied to every particle
+	float GetDamping()                { return m_Damping; }
+	void  SetDamping( float damping ) { m_Damping = damping; }
+
+	// Scale applied to the coefficient of every spring - a simple tweak for the whole system
+	float GetSpringiness()                    { return m_Springiness; }
+	void  SetSpringiness( float springiness ) { m_Springiness = springiness; }
+
+	EIntegrator GetIntegrator()                         { return m_Integrator; }
+	void        SetIntegrator( EIntegrator integrator ) { m_Integrator = integrator; }
+
+	// Number of times all constraints are solved in each step (at least 1)
+	unsigned int GetNumIterations() { return m_NumIterations; }
+	void         SetNumIterations( unsigned int numIterations );
+
+	// Compliance (inverse stiffness - distance per unit force) of constraints of the given spring type,
+	// or FORCE_ONLY. A spring with compliance 1 / coefficient is as stiff as the force it would exert.
+	// Elastic and string constraints only act when stretched, springs and rods also when squashed
+	float GetCompliance( ESpringType type )                   { return m_Compliances[type]; }
+	void  SetCompliance( ESpringType type, float compliance ) { m_Compliances[type] = compliance; m_BatchesChanged = true; }
+
+	// Limits for the conjugate gradient solve in each implicit step - it stops after the maximum
+	// number of iterations or when the residual is below the tolerance (relative to its start)
+	unsigned int GetMaxCGIterations()                          { return m_MaxCGIterations; }
+	void         SetMaxCGIterations( unsigned int iterations ) { m_MaxCGIterations = iterations; }
+	float        GetCGTolerance()                              { return m_CGTolerance; }
+	void         SetCGTolerance( float tolerance )             { m_CGTolerance = tolerance; }
+
+	// Radius of each particle for collisions with each other and with the colliders. Particles closer
+	// than twice the radius when the simulation starts never collide with each other (e.g. neighbours
+	// in a cloth) since their springs hold them there. Zero turns off collisions between particles
+	float GetParticleRadius()               { return m_ParticleRadius; }
+	void  SetParticleRadius( float radius ) { m_ParticleRadius = radius; }
+
+	// Kinetic energy per unit mass (half the mean squared speed) below which an island goes to sleep
+	// once it has stayed there for a short time. Zero (the default) turns sleeping off
+	float GetSleepThreshold() { return m_SleepThreshold; }
+	void  SetSleepThreshold( float threshold );
+
+	// Set the thread pool used to solve constraints in parallel, 0 to solve on the calling thread
+	// only. The pool is not owned by the system
+	void SetThreadPool( CThreadPool* threadPool ) { m_ThreadPool = threadPool; }
+
+
+	////////////////////////////////////
+	// Particles
+
+	unsigned int GetNumParticles() { return static_cast<unsigned int>(m_Positions.size()); }
+
+	// Add a particle, returns its index. The view is optional
+	unsigned int AddParticle( const CVector3& position, float mass, bool pinned, CParticle* view = 0 );
+
+	// Remove a particle, which must have no springs attached. The last particle is moved to the
+	// removed particle's index (springs attached to it are updated) - if there is a view for it
+	// then the caller must update the view's index
+	void RemoveParticle( unsigned int particle );
+
+	CParticle* GetParticleView( unsigned int particle ) { return m_ParticleViews[particle]; }
+
+	// Position can be set directly, e.g. when editing or moving pinned particles
+	CVector3&       Position( unsigned int particle )       { return m_Positions[particle]; }
+	const CVector3& Position( unsigned int particle ) const { return m_Positions[particle]; }
+
+	const CVector3& GetVelocity( unsigned int particle ) { return m_Velocities[particle]; }
+
+	// Position part way through the last step, from its start (0) to its end (1). Used to render
+	// between steps when the system is stepped at a fixed rate different from the frame rate
+	CVector3 GetInterpolatedPosition( unsigned int particle, float interpolation )
+	{
+		return m_PrevPositions[particle] + interpolation * (m_Positions[particle] - m_PrevPositions[particle]);
+	}
+
+	float GetMass( unsigned int particle )  { return m_Masses[particle]; }
+	bool  IsPinned( unsigned int particle ) { return m_Pinned[particle] != 0; }
+	void  SetMass( unsigned int particle, float mass );
+	void  Pin( unsigned int particle, bool isPinned );
+
+
+	////////////////////////////////////
+	// Islands
+
+	// Number of islands (groups of unpinned particles joined by springs), and the number awake. Up to
+	// date after the first step following any change to the particles or springs
+	unsigned int GetNumIslands()      { return static_cast<unsigned int>(m_IslandAwake.size()); }
+	unsigned int GetNumAwakeIslands() { return m_NumAwakeIslands; }
+
+	// Whether a particle's island is asleep (pinned particles are never asleep)
+	bool IsAsleep( unsigned int particle );
+
+	// Wake the island of the given particle, e.g. after moving it or applying a force to it, or wake
+	// all islands
+	void WakeParticle( unsigned int particle );
+	void WakeAll();
+
+
+	////////////////////////////////////
+	// Springs
+
+	unsigned int GetNumSprings() { return static_cast<unsigned int>(m_Springs.size()); }
+
+	// Add a spring between two particles, returns its index. The view is optional
+	unsigned int AddSpring( unsigned int particle1, unsigned int particle2, float coefficient,
+	                        float inertialLength, ESpringType type, CSpring* view = 0 );
+
+	// Remove a spring. The last spring is moved to the removed spring's index - if there is a view
+	// for it then the caller must update the view's index
+	void RemoveSpring( unsigned int spring );
+
+	CSpring*       GetSpringView( unsigned int spring ) { return m_SpringViews[spring]; }
+	const SSpring& GetSpring( unsigned int spring )     { return m_Springs[spring]; }
+
+	void SetSpringType( unsigned int spring, ESpringType type )         { m_Springs[spring].type = type; m_BatchesChanged = true; }
+	void SetSpringCoefficient( unsigned int spring, float coefficient ) { m_Springs[spring].coefficient = coefficient; }
+	void SetSpringInertialLength( unsigned int spring, float length )   { m_Springs[spring].inertialLength = length; }
+
+	// Colour of a spring, no two springs sharing a particle have the same colour. Springs on a
+	// particle with more than MAX_COLOURS springs may get NO_COLOUR, and are solved one at a time
+	unsigned int GetSpringColour( unsigned int spring ) { return m_SpringColours[spring]; }
+
+	// Number of colours in use (not counting NO_COLOUR)
+	unsigned int GetNumColours();
+
+	// Colour all springs again from scratch. Colours given as springs are added and removed can
+	// end up using more colours than necessary (fewer colours means more parallel work per colour)
+	void RecolourSprings();
+
+
+	////////////////////////////////////
+	// Colliders
+
+	// Add a collider, returns its index. Colliders can be moved at any time with the accessors below
+	unsigned int AddPlaneCollider( const CVector3& normal, float distance );
+	unsigned int AddSphereCollider( const CVector3& centre, float radius );
+	unsigned int AddCapsuleCollider( const CVector3& point1, const CVector3& point2, float radius );
+
+	unsigned int GetNumPlaneColliders()   { return static_cast<unsigned int>(m_Planes.size()); }
+	unsigned int GetNumSphereColliders()  { return static_cast<unsigned int>(m_Spheres.size()); }
+	unsigned int GetNumCapsuleColliders() { return static_cast<unsigned int>(m_Capsules.size()); }
+
+	SPlaneCollider&   PlaneCollider( unsigned int collider )   { return m_Planes[collider]; }
+	SSphereCollider&  SphereCollider( unsigned int collider )  { return m_Spheres[collider]; }
+	SCapsuleCollider& CapsuleCollider( unsigned int collider ) { return m_Capsules[collider]; }
+
+	// Remove all colliders
+	void ClearColliders();
+
+
+	////////////////////////////////////
+	// Simulation
+
+	// Store the current particle positions and clear velocities at simulation start
+	void InitSimulation();
+
+	// Return the particles to their positions when InitSimulation was called
+	void ResetSimulation();
+
+	// Update the simulation by the given time. Gravity is an acceleration applied to every particle
+	void Step( float updateTime, const CVector3& gravity );
+
+	// Largest constraint error (difference between length and inertial length) found in the given
+	// iteration of the last step. Shows how well the constraints are converging
+	float GetConstraintError( unsigned int iteration ) { return m_ConstraintErrors[iteration]; }
+
+	// Number of conjugate gradient iterations used by the last implicit step
+	unsigned int GetCGIterations() { return m_CGIterations; }
+
+	// Total number of collision neighbours found for all particles in the last step (each close pair
+	// of particles is counted twice, once from each particle)
+	unsigned int GetNumNeighbours();
+
+
+private:
+
+	////////////////////////////////////
+	// Support functions
+
+	// Add the force exerted by each spring to the force totals of its two particles
+	void AccumulateSpringForces();
+
+	// Move each particle using its total force
+	void Integrate( float updateTime );
+
+	// Move each particle with backward Euler, solving for the change in velocities with CG
+	void IntegrateImplicit( float updateTime );
+
+	// Calculate the derivative of each spring force with respect to the particle positions
+	void AssembleJacobian();
+
+	// Multiply a vector (one element per particle) by the implicit system matrix
+	void MultiplySystem( const vector<CVector3>& v, vector<CVector3>& result, float massScale, float stiffnessScale );
+
+	// Move particles to satisfy the constraint springs, over the set number of iterations
+	void SolveConstraints( float updateTime );
+
+	// Solve the constraints in the given range of the batch list once, returns the largest error
+	float SolveBatch( unsigned int first, unsigned int last, float complianceScale );
+
+	// Return the lowest colour not used by the springs on the given particles, and mark it as used
+	unsigned int ColourSpring( unsigned int particle1, unsigned int particle2 );
+
+	// Rebuild the list of constraint springs sorted by colour
+	void BuildBatches();
+
+	// Put the particles in the spatial hash and find each particle's neighbours for collisions
+	void FindNeighbours();
+
+	// Find the neighbours of the particles in the given range
+	void FindCellNeighbours( unsigned int first, unsigned int last );
+
+	// Calculate the move pushing each particle in the given range away from its neighbours
+	void CalculateCollisions( unsigned int first, unsigned int last );
+
+	// Move each particle in the given range by its collision move then out of any colliders
+	void ApplyCollisions( unsigned int first, unsigned int last );
+
+	// Hash table entry for the grid cell with the given coordinates. The coordinates are packed 21
+	// bits apart into one 64-bit key which is then fully mixed (MurmurHash3's finaliser). The prime
+	// multiply and XOR hash clumps a dense block of cells into fewer entries, giving long entry
+	// chains in crowded scenes
+	unsigned int HashCell( int x, int y, int z )
+	{
+		TUInt64 ux = static_cast<unsigned int>(x);
+		TUInt64 uy = static_cast<unsigned int>(y);
+		TUInt64 uz = static_cast<unsigned int>(z);
+		TUInt64 key = ux ^ (uy << 21 | uy >> 43) ^ (uz << 42 | uz >> 22);
+		key ^= key >> 33;
+		key *= 0xff51afd7ed558ccdULL;
+		key ^= key >> 33;
+		key *= 0xc4ceb9fe1a85ec53ULL;
+		key ^= key >> 33;
+		return static_cast<unsigned int>(key) & (m_HashSize - 1);
+	}
+
+	// Call work( first, last ) over ranges of numItems items, as tasks on the thread pool when there
+	// are enough items (itemsPerTask in each task), otherwise once for all items on this thread
+	void RunTasks( unsigned int numItems, unsigned int itemsPerTask,
+	               const function<void( unsigned int, unsigned int )>& work );
+
+	// Find the islands from the springs, all islands start awake
+	void BuildIslands();
+
+	// Wake islands whose pinned particles have moved since the last step, or all if gravity has changed
+	void WakeMovedIslands( const CVector3& gravity );
+
+	// Wake sleeping islands with a particle that is a collision neighbour of an awake particle
+	void WakeCollidingIslands();
+
+	// Total the kinetic energy of each awake island, and put to sleep those that have been at rest
+	// for long enough
+	void UpdateSleep( float updateTime );
+
+	void WakeIsland( unsigned int island );
+	void SleepIsland( unsigned int island );
+
+	// Elastic and string only resist stretching
+	static bool IsStretchOnly( ESpringType type ) { return type == Elastic || type == String; }
+
+
+	////////////////////////////////////
+	// Types
+
+	// Derivative of a spring's force with respect to the position of one of its particles, held as
+	// the spring direction and the stiffness along and across it (the 3x3 block is axial * n.nT +
+	// transverse * (I - n.nT)). The derivative for the other particle is the same block negated
+	struct SSpringJacobian
+	{
+		CVector3 direction;
+		float    axial;
+		float    transverse;
+	};
+
+	// Spring from a pinned particle to an island - the island is woken if the pinned particle moves
+	struct SPinLink
+	{
+		unsigned int particle;
+		unsigned int island;
+	};
+
+
+	////////////////////////////////////
+	// Data
+
+	// Settings
+	float        m_Damping;
+	float        m_Springiness;
+	EIntegrator  m_Integrator;
+	unsigned int m_NumIterations;
+	float        m_Compliances[NumTypes];
+	unsigned int m_MaxCGIterations;
+	float        m_CGTolerance;
+	CThreadPool* m_ThreadPool;
+
+	// Particle data, one element per particle in each array
+	vector<CVector3>      m_Positions;
+	vector<CVector3>      m_PrevPositions;    // For verlet method
+	vector<CVector3>      m_Velocities;       // For Euler method (verlet keeps it up to date too)
+	vector<CVector3>      m_InitialPositions; // When simulation ends, particles are reset to initial positions
+	vector<CVector3>      m_Forces;           // Total force on each particle, calculated during each step
+	vector<CVector3>      m_UnconstrainedPositions; // Before constraints were solved, for Euler velocities
+	vector<float>         m_Masses;
+	vector<float>         m_InvMasses;        // Zero for pinned and sleeping particles, so they are never moved
+	vector<unsigned char> m_Pinned;
+	vector<CParticle*>    m_ParticleViews;
+	vector<TUInt64>       m_ParticleColours;  // Colours used by the springs on each particle, one bit per colour
+	vector<CVector3>      m_DeltaVelocities;  // Velocity change in the last implicit step, starting point for the next
+
+	// Spring data
+	vector<SSpring>      m_Springs;
+	vector<CSpring*>     m_SpringViews;
+	vector<float>        m_Lambdas; // Total correction made by each constraint in the current step (XPBD multiplier)
+	vector<unsigned int> m_SpringColours;
+
+	// Constraint springs in colour order, batch c is m_BatchSprings[m_BatchStarts[c]] up to
+	// m_BatchSprings[m_BatchStarts[c + 1]] (the last batch is NO_COLOUR). Rebuilt when springs change
+	vector<unsigned int> m_BatchSprings;
+	vector<unsigned int> m_BatchStarts;
+	bool                 m_BatchesChanged;
+	vector<float>        m_TaskErrors; // Largest error found by each parallel task
+
+	// Largest constraint error in each iteration of the last step
+	vector<float> m_ConstraintErrors;
+
+	// Collision data
+	float                    m_ParticleRadius;
+	vector<SPlaneCollider>   m_Planes;
+	vector<SSphereCollider>  m_Spheres;
+	vector<SCapsuleCollider> m_Capsules;
+
+	// Spatial hash of the particles, table entry h holds m_HashParticles[m_HashStarts[h]] up to
+	// m_HashParticles[m_HashStarts[h + 1]]. The table size is a power of two
+	float                 m_CellSize;
+	unsigned int          m_HashSize;
+	vector<unsigned int>  m_HashStarts;
+	vector<unsigned int>  m_HashParticles;
+	vector<unsigned int>  m_ParticleHashes; // Hash table entry of each particle
+
+	// Neighbours of each particle for collisions, particle p's are m_Neighbours[m_NeighbourStarts[p]] up
+	// to m_Neighbours[m_NeighbourStarts[p + 1]], and the move each particle gets from its collisions in
+	// the current iteration
+	vector<unsigned int>  m_Neighbours;
+	vector<unsigned int>  m_NeighbourStarts;
+	vector< vector<unsigned int> > m_TaskNeighbours; // Neighbours found by each search task
+	vector<CVector3>      m_CollisionMoves;
+
+	// Islands, island i is m_IslandParticles[m_IslandStarts[i]] up to m_IslandParticles[m_IslandStarts[i + 1]].
+	// Rebuilt when particles or springs change
+	float                 m_SleepThreshold;
+	bool                  m_IslandsChanged;
+	vector<unsigned int>  m_ParticleIslands; // Island of each particle, NO_INDEX for pinned particles
+	vector<unsigned int>  m_IslandStarts;
+	vector<unsigned int>  m_IslandParticles;
+	vector<unsigned char> m_IslandAwake;
+	vector<float>         m_IslandRestTimes; // Time each island has been below the sleep threshold
+	unsigned int          m_NumAwakeIslands;
+	vector<SPinLink>      m_PinLinks;
+	CVector3              m_LastGravity;
+
+	// Implicit integrator working data - spring jacobians, and the CG vectors (one element per particle)
+	vector<SSpringJacobian> m_Jacobians;
+	vector<CVector3>        m_CGResidual;
+	vector<CVector3>        m_CGDirection;
+	vector<CVector3>        m_CGProduct;
+	vector<CVector3>        m_CGPreconditioned;
+	vector<CVector3>        m_CGInvDiagonal; // Jacobi preconditioner, inverse of the system matrix diagonal
+	unsigned int            m_CGIterations;
+};
+
+
+#endif
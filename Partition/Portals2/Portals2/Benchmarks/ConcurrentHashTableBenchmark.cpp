@@ -0,0 +1,391 @@
+/*******************************************
+	ConcurrentHashTableBenchmark.cpp
+
+	Console program stress testing the
+	concurrent hash table and timing it
+	against a mutex-locked table
+********************************************/
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+using namespace std;
+
+#include "Defines.h"
+#include "CTimer.h"
+#include "CFlatHashTable.h"
+#include "CConcurrentHashTable.h"
+
+using namespace gen;
+
+
+/////////////////////////
+// Constants
+
+// Entity UID type as in Entity.h (not included here as it needs the renderer)
+typedef TUInt32 TEntityUID;
+
+// Keys that are always in the table (entities that live through the test), keys that the writer
+// adds and removes, and keys the writer adds and never removes to make the table grow
+const TUInt32 NumStableKeys = 100000;
+const TUInt32 NumChurnKeys = 10000;
+const TEntityUID FirstChurnKey = 1000000;
+const TEntityUID FirstGrowthKey = 2000000;
+
+// Keys of entities created and destroyed in the removal test. UIDs only increase, as in the game:
+// each change removes the oldest live key and adds a new one, so removed keys are never re-added
+// and deleted markers build up until the table is rebuilt
+const TUInt32 NumLiveKeys = 10000;
+const TEntityUID FirstLiveKey = 3000000;
+
+// One in this many reader look-ups is of a churn key (or a live / removed key in the removal
+// test), the others are of stable keys
+const TUInt32 ChurnLookUpInterval = 8;
+
+// The writer makes one change then this many look-ups of its own, so changes are occasional as
+// in a game. One in this many changes adds a growth key
+const TUInt32 WriterLookUps = 100;
+const TUInt32 GrowthInterval = 16;
+
+// Length of each timed test in seconds
+const float TestTime = 1.0f;
+
+
+/////////////////////////
+// Tables under test
+
+// Mutex-locked flat hash table with the concurrent table interface - the baseline. Look-ups
+// wait for each other as well as for changes
+class CLockedHashTable
+{
+public:
+	CLockedHashTable( const TUInt32 iInitialSize ) : m_Table( iInitialSize ) {}
+
+	bool LookUpKey( const TEntityUID& key, TUInt32* pValue )
+	{
+		lock_guard<mutex> lock( m_Mutex );
+		return m_Table.LookUpKey( key, pValue );
+	}
+	void SetKeyValue( const TEntityUID& key, const TUInt32& value )
+	{
+		lock_guard<mutex> lock( m_Mutex );
+		m_Table.SetKeyValue( key, value );
+	}
+	bool RemoveKey( const TEntityUID& key )
+	{
+		lock_guard<mutex> lock( m_Mutex );
+		return m_Table.RemoveKey( key );
+	}
+	void ReclaimOldTables() {}
+
+private:
+	CFlatHashTable<TEntityUID, TUInt32> m_Table;
+	mutex                               m_Mutex;
+};
+
+typedef CConcurrentHashTable<TEntityUID, TUInt32> TConcurrentHashTable;
+
+
+/////////////////////////
+// Stress test
+
+// Changes the writer makes
+enum ETestType
+{
+	ChurnTest,   // Add and remove churn keys at random, add growth keys
+	RemovalTest, // Remove the oldest live key and add a new one
+	NumTestTypes // Leave this entry at end
+};
+const char* const TestTypeNames[NumTestTypes] = { "churn", "removal" };
+
+// Value stored with each key, so readers can check the value they find belongs to the key
+inline TUInt32 KeyValue( const TEntityUID key )
+{
+	return key * 2654435761u + 1;
+}
+
+// Pseudo-random sequence, one per thread
+struct SRandom
+{
+	TUInt32 Seed;
+
+	SRandom( const TUInt32 seed ) : Seed( seed ) {}
+	TUInt32 Next()
+	{
+		Seed = Seed * 1664525 + 1013904223;
+		return Seed >> 8;
+	}
+};
+
+// Results of one test
+struct SResults
+{
+	float   Time;       // Seconds the readers and writer ran for
+	TUInt64 NumLookUps; // Look-ups by all readers
+	TUInt32 NumChanges; // Changes by the writer
+	TUInt32 NumErrors;  // Wrong results seen by readers, or wrong table contents at the end
+};
+
+// Shared state of one test
+template <class TTable>
+struct STest
+{
+	ETestType       Type;
+	TTable*         Table;
+	atomic<bool>    Stop;
+	atomic<TUInt64> NumLookUps;
+	atomic<TUInt32> NumErrors;
+	TUInt32         NumChanges;
+	vector<bool>    ChurnKeyPresent; // Writer's record of which churn keys are in the table
+	TUInt32         NumGrowthKeys;
+	atomic<TUInt32> OldestLiveKey;   // Removal test - keys below this have been removed
+	TUInt32         WriterChecksum;  // Keeps the writer's look-ups from being optimised away
+};
+
+// Reader thread - looks up stable keys, which must always be found with their value, and churn
+// or live keys, which must have their value if they are found. In the removal test it also looks
+// up recently removed keys, which must not be found
+template <class TTable>
+void Reader( STest<TTable>* test, TUInt32 seed )
+{
+	SRandom random( seed );
+	TUInt64 numLookUps = 0;
+	TUInt32 numErrors = 0;
+	while (!test->Stop.load( memory_order_relaxed ))
+	{
+		for (TUInt32 lookUp = 0; lookUp < ChurnLookUpInterval; ++lookUp)
+		{
+			TUInt32 value;
+			if (lookUp == 0 && test->Type == ChurnTest)
+			{
+				TEntityUID key = FirstChurnKey + random.Next() % NumChurnKeys;
+				if (test->Table->LookUpKey( key, &value ) && value != KeyValue( key )) ++numErrors;
+			}
+			else if (lookUp == 0)
+			{
+				// Keys below the oldest live key were removed before it was published
+				TEntityUID oldestLiveKey = test->OldestLiveKey.load( memory_order_acquire );
+				TUInt32 numRemoved = min( NumLiveKeys, oldestLiveKey - FirstLiveKey );
+				if (numRemoved > 0 && random.Next() % 2 == 0)
+				{
+					TEntityUID key = oldestLiveKey - 1 - random.Next() % numRemoved;
+					if (test->Table->LookUpKey( key, &value )) ++numErrors;
+				}
+				else
+				{
+					TEntityUID key = oldestLiveKey + random.Next() % NumLiveKeys;
+					if (test->Table->LookUpKey( key, &value ) && value != KeyValue( key )) ++numErrors;
+				}
+			}
+			else
+			{
+				TEntityUID key = random.Next() % NumStableKeys;
+				if (!test->Table->LookUpKey( key, &value ) || value != KeyValue( key )) ++numErrors;
+			}
+		}
+		numLookUps += ChurnLookUpInterval;
+	}
+	test->NumLookUps += numLookUps;
+	test->NumErrors += numErrors;
+}
+
+// Writer thread - adds and removes churn keys and adds growth keys, which causes table rebuilds.
+// In the removal test it replaces the oldest live key with a new one, rebuilds are then caused by
+// deleted markers
+template <class TTable>
+void Writer( STest<TTable>* test )
+{
+	SRandom random( 12345 );
+	TUInt32 checksum = 0;
+	while (!test->Stop.load( memory_order_relaxed ))
+	{
+		if (test->Type == RemovalTest)
+		{
+			TEntityUID oldestLiveKey = test->OldestLiveKey.load( memory_order_relaxed );
+			test->Table->RemoveKey( oldestLiveKey );
+			test->OldestLiveKey.store( oldestLiveKey + 1, memory_order_release );
+			TEntityUID key = oldestLiveKey + NumLiveKeys;
+			test->Table->SetKeyValue( key, KeyValue( key ) );
+		}
+		else if (test->NumChanges % GrowthInterval == 0)
+		{
+			TEntityUID key = FirstGrowthKey + test->NumGrowthKeys++;
+			test->Table->SetKeyValue( key, KeyValue( key ) );
+		}
+		else
+		{
+			TUInt32 churnKey = random.Next() % NumChurnKeys;
+			TEntityUID key = FirstChurnKey + churnKey;
+			if (test->ChurnKeyPresent[churnKey])
+			{
+				test->Table->RemoveKey( key );
+			}
+			else
+			{
+				test->Table->SetKeyValue( key, KeyValue( key ) );
+			}
+			test->ChurnKeyPresent[churnKey] = !test->ChurnKeyPresent[churnKey];
+		}
+		++test->NumChanges;
+
+		for (TUInt32 lookUp = 0; lookUp < WriterLookUps; ++lookUp)
+		{
+			TUInt32 value;
+			if (test->Table->LookUpKey( random.Next() % NumStableKeys, &value )) checksum += value;
+		}
+	}
+	test->WriterChecksum = checksum;
+}
+
+// Check the table holds exactly the keys it should after a test, returns the number of errors
+template <class TTable>
+TUInt32 CheckContents( STest<TTable>* test )
+{
+	TUInt32 numErrors = 0;
+	TUInt32 value;
+	for (TEntityUID key = 0; key < NumStableKeys; ++key)
+	{
+		if (!test->Table->LookUpKey( key, &value ) || value != KeyValue( key )) ++numErrors;
+	}
+	for (TUInt32 churnKey = 0; churnKey < NumChurnKeys; ++churnKey)
+	{
+		TEntityUID key = FirstChurnKey + churnKey;
+		bool found = test->Table->LookUpKey( key, &value );
+		if (found != test->ChurnKeyPresent[churnKey] || (found && value != KeyValue( key )))
+		{
+			++numErrors;
+		}
+	}
+	for (TUInt32 growthKey = 0; growthKey < test->NumGrowthKeys; ++growthKey)
+	{
+		TEntityUID key = FirstGrowthKey + growthKey;
+		if (!test->Table->LookUpKey( key, &value ) || value != KeyValue( key )) ++numErrors;
+	}
+	TEntityUID oldestLiveKey = test->OldestLiveKey;
+	TEntityUID endLiveKey = (test->Type == RemovalTest) ? oldestLiveKey + NumLiveKeys : FirstLiveKey;
+	for (TEntityUID key = FirstLiveKey; key < endLiveKey; ++key)
+	{
+		bool found = test->Table->LookUpKey( key, &value );
+		if (found != (key >= oldestLiveKey) || (found && value != KeyValue( key ))) ++numErrors;
+	}
+	return numErrors;
+}
+
+// Run the readers and writer on a new table for the test time and check the results
+template <class TTable>
+SResults RunTest( ETestType type, TUInt32 numReaders )
+{
+	STest<TTable> test;
+	test.Type = type;
+	test.Table = new TTable( 1024 );
+	test.Stop = false;
+	test.NumLookUps = 0;
+	test.NumErrors = 0;
+	test.NumChanges = 0;
+	test.ChurnKeyPresent.assign( NumChurnKeys, false );
+	test.NumGrowthKeys = 0;
+	test.OldestLiveKey = FirstLiveKey;
+	test.WriterChecksum = 0;
+	for (TEntityUID key = 0; key < NumStableKeys; ++key)
+	{
+		test.Table->SetKeyValue( key, KeyValue( key ) );
+	}
+	if (type == RemovalTest)
+	{
+		for (TEntityUID key = FirstLiveKey; key < FirstLiveKey + NumLiveKeys; ++key)
+		{
+			test.Table->SetKeyValue( key, KeyValue( key ) );
+		}
+	}
+
+	vector<thread> threads;
+	for (TUInt32 reader = 0; reader < numReaders; ++reader)
+	{
+		threads.push_back( thread( Reader<TTable>, &test, reader + 1 ) );
+	}
+	threads.push_back( thread( Writer<TTable>, &test ) );
+
+	CTimer timer;
+	while (timer.GetTime() < TestTime)
+	{
+		this_thread::sleep_for( chrono::milliseconds( 10 ) );
+	}
+	test.Stop = true;
+	float time = timer.GetTime();
+	for (TUInt32 t = 0; t < threads.size(); ++t)
+	{
+		threads[t].join();
+	}
+
+	// All threads have finished so old tables can be reclaimed
+	test.Table->ReclaimOldTables();
+
+	SResults results;
+	results.Time = time;
+	results.NumLookUps = test.NumLookUps;
+	results.NumChanges = test.NumChanges;
+	results.NumErrors = test.NumErrors + CheckContents( &test );
+	delete test.Table;
+	return results;
+}
+
+// Run the test with the given number of readers, report throughput and return the error count
+template <class TTable>
+TUInt32 ReportTest( const char* name, ETestType type, TUInt32 numReaders )
+{
+	SResults results = RunTest<TTable>( type, numReaders );
+	cout << left << setw( 24 ) << name << setw( 9 ) << TestTypeNames[type] << right << setw( 8 ) << numReaders
+	     << setw( 14 ) << results.NumLookUps / results.Time / 1.0e6f
+	     << setw( 14 ) << results.NumChanges / results.Time / 1.0e3f
+	     << setw( 8 ) << results.NumErrors << endl;
+	return results.NumErrors;
+}
+
+
+/////////////////////////
+// Test harness
+
+int main()
+{
+	// Test with 1, 2, 4... readers up to one less than the number of hardware threads (the writer
+	// uses the other), but always at least 4 to get contention
+	TUInt32 maxReaders = max( 4u, static_cast<TUInt32>(thread::hardware_concurrency()) );
+	maxReaders -= (maxReaders > 4) ? 1 : 0;
+	vector<TUInt32> readerCounts;
+	for (TUInt32 numReaders = 1; numReaders < maxReaders; numReaders *= 2)
+	{
+		readerCounts.push_back( numReaders );
+	}
+	readerCounts.push_back( maxReaders );
+
+	cout << fixed << setprecision( 2 );
+	cout << NumStableKeys << " stable keys, " << NumChurnKeys << " churn keys, " << NumLiveKeys << " live keys, one writer, "
+	     << TestTime << "s per test" << endl << endl;
+	cout << left << setw( 24 ) << "Table" << setw( 9 ) << "Test" << right << setw( 8 ) << "Readers" << setw( 14 )
+	     << "M look-ups/s" << setw( 14 ) << "K changes/s" << setw( 8 ) << "Errors" << endl;
+
+	TUInt32 numErrors = 0;
+	for (TUInt32 type = 0; type < NumTestTypes; ++type)
+	{
+		ETestType testType = static_cast<ETestType>(type);
+		for (TUInt32 count = 0; count < readerCounts.size(); ++count)
+		{
+			numErrors += ReportTest<CLockedHashTable>( "Mutex + CFlatHashTable", testType, readerCounts[count] );
+			numErrors += ReportTest<TConcurrentHashTable>( "CConcurrentHashTable", testType, readerCounts[count] );
+		}
+	}
+
+	if (numErrors > 0)
+	{
+		cout << endl << "****Tables gave wrong results****" << endl;
+		return EXIT_FAILURE;
+	}
+	cout << endl << "All tables gave the right results" << endl;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,189 @@
+/*******************************************
+	EntityUpdateBenchmark.cpp
+
+	Console program timing the entity manager
+	update with a large number of cars
+********************************************/
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+using namespace std;
+
+#include <windows.h>
+#include <d3dx9.h>
+
+#include "Defines.h"
+#include "CTimer.h"
+#include "CThreadPool.h"
+#include "RenderMethod.h"
+#include "EntityManager.h"
+
+namespace gen
+{
+
+/////////////////////////
+// Globals
+
+// Globals that the entity and render code expect from the application. The templates load their
+// meshes, which needs a D3D device, although nothing is rendered
+LPDIRECT3DDEVICE9 g_pd3dDevice = NULL;
+CEntityManager EntityManager;
+
+LPDIRECT3D9 D3D = NULL;
+HWND Window = NULL;
+
+
+/////////////////////////
+// Constants
+
+// Number of cars, one in ParkedInterval of which is parked (created as a plain entity, so it
+// is still batch-updated but doesn't move). Cars are placed on a square grid with the given
+// spacing, in a range of headings
+const TUInt32 NumCars = 100000;
+const TUInt32 ParkedInterval = 10;
+const float CarSpacing = 6.0f;
+
+// Number of updates timed for each test, and the time step of each
+const TUInt32 NumFrames = 200;
+const float UpdateTime = 1.0f / 60.0f;
+
+// Target update time for 100,000 cars in milliseconds
+const float TargetTime = 1.0f;
+
+
+/////////////////////////
+// Device
+
+// Create a D3D device for a small hidden window, returns false on failure
+bool CreateDevice()
+{
+	Window = CreateWindow( "STATIC", "EntityUpdateBenchmark", WS_POPUP, 0, 0, 64, 64,
+	                       NULL, NULL, GetModuleHandle( NULL ), NULL );
+	D3D = Direct3DCreate9( D3D_SDK_VERSION );
+	if (!Window || !D3D)
+	{
+		return false;
+	}
+
+	D3DPRESENT_PARAMETERS d3dpp;
+	ZeroMemory( &d3dpp, sizeof(d3dpp) );
+	d3dpp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+	d3dpp.Windowed = TRUE;
+	d3dpp.BackBufferFormat = D3DFMT_UNKNOWN;
+	return SUCCEEDED(D3D->CreateDevice( D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, Window,
+	                                    D3DCREATE_HARDWARE_VERTEXPROCESSING, &d3dpp,
+	                                    &g_pd3dDevice ));
+}
+
+void ReleaseDevice()
+{
+	ReleaseMethods();
+	if (g_pd3dDevice) g_pd3dDevice->Release();
+	if (D3D)          D3D->Release();
+	if (Window)       DestroyWindow( Window );
+}
+
+
+/////////////////////////
+// Scene
+
+// Create the car templates used by the application, then the cars
+void CreateCars()
+{
+	// Template type, template name, mesh name, top speed, acceleration, turn speed
+	EntityManager.CreateCarTemplate( "Car", "Freelander", "4x4jeep.x", 48.0f, 2.2f, 2.0f );
+	EntityManager.CreateCarTemplate( "Car", "Aston Martin", "amartin.x", 61.0f, 2.8f, 1.4f );
+	EntityManager.CreateCarTemplate( "Car", "Fiat Panda", "FiatPanda.x", 42.0f, 2.0f, 3.2f );
+	EntityManager.CreateCarTemplate( "Car", "Intrepid", "Intrepid.x", 55.0f, 2.6f, 1.7f );
+	EntityManager.CreateCarTemplate( "Car", "Transit Van", "TransitVan.x", 48.0f, 2.1f, 2.2f );
+	const char* carTemplates[] = { "Freelander", "Aston Martin", "Fiat Panda", "Intrepid",
+	                               "Transit Van" };
+	TNameID carTemplateIDs[5];
+	for (int carTemplate = 0; carTemplate < 5; ++carTemplate)
+	{
+		carTemplateIDs[carTemplate] = EntityNames.GetID( carTemplates[carTemplate] );
+	}
+
+	EntityManager.ReserveEntities( NumCars );
+	TUInt32 gridSize = static_cast<TUInt32>(Sqrt( static_cast<float>(NumCars) )) + 1;
+	for (TUInt32 car = 0; car < NumCars; ++car)
+	{
+		CVector3 pos( (car % gridSize) * CarSpacing, 0.0f, (car / gridSize) * CarSpacing );
+		CVector3 rot( 0.0f, ToRadians( static_cast<float>((car * 37) % 360) ), 0.0f );
+		if (car % ParkedInterval == 0)
+		{
+			EntityManager.CreateEntity( carTemplateIDs[car % 5], kNoName, pos, rot );
+		}
+		else
+		{
+			EntityManager.CreateCar( carTemplateIDs[car % 5], kNoName, pos, rot );
+		}
+	}
+}
+
+
+/////////////////////////
+// Tests
+
+// Time the entity update with the given thread pool (0 for none), report the average time per
+// frame and per 100,000 cars. Returns the time per 100,000 cars in milliseconds
+float ReportUpdate( const char* name, CThreadPool* threadPool )
+{
+	EntityManager.SetThreadPool( threadPool );
+	EntityManager.UpdateAllEntities( UpdateTime ); // Warm up
+
+	CTimer timer;
+	timer.GetLapTime();
+	for (TUInt32 frame = 0; frame < NumFrames; ++frame)
+	{
+		EntityManager.UpdateAllEntities( UpdateTime );
+	}
+	float frameTime = timer.GetLapTime() * 1000.0f / NumFrames;
+	float time100k = frameTime * 100000.0f / EntityManager.NumEntities();
+
+	cout << left << setw( 26 ) << name << right << setw( 10 )
+	     << (threadPool ? threadPool->GetNumThreads() : 1) << setw( 12 ) << frameTime
+	     << setw( 14 ) << time100k << endl;
+	return time100k;
+}
+
+} // namespace gen
+
+using namespace gen;
+
+
+/////////////////////////
+// Test harness
+
+// Run from the project folder so the meshes and shaders are found
+int main()
+{
+	if (!CreateDevice())
+	{
+		cout << "Cannot create D3D device" << endl;
+		ReleaseDevice();
+		return EXIT_FAILURE;
+	}
+	CreateCars();
+
+	cout << fixed << setprecision( 3 );
+	cout << "Entity update: " << EntityManager.NumEntities() << " cars (1 in " << ParkedInterval
+	     << " parked), " << NumFrames << " frames, times in ms" << endl << endl;
+	cout << left << setw( 26 ) << "Update" << right << setw( 10 ) << "Threads" << setw( 12 )
+	     << "Per frame" << setw( 14 ) << "Per 100k cars" << endl;
+
+	ReportUpdate( "Serial", 0 );
+	CThreadPool* threadPool = new CThreadPool();
+	float time100k = ReportUpdate( "Thread pool", threadPool );
+
+	cout << endl << "Target " << TargetTime << "ms per 100k cars: "
+	     << (time100k <= TargetTime ? "met" : "NOT MET") << endl;
+
+	EntityManager.SetThreadPool( 0 );
+	delete threadPool;
+	EntityManager.DestroyAllEntities();
+	EntityManager.DestroyAllTemplates();
+	ReleaseDevice();
+	return EXIT_SUCCESS;
+}
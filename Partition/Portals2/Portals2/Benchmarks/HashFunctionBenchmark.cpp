@@ -0,0 +1,394 @@
+/*******************************************
+	HashFunctionBenchmark.cpp
+
+	Console program comparing the speed and
+	distribution of the hash functions for
+	integer, string and struct keys
+********************************************/
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+using namespace std;
+
+#include "Defines.h"
+#include "CTimer.h"
+#include "CHashTable.h"
+#include "Hashers.h"
+
+using namespace gen;
+
+
+/////////////////////////
+// Constants
+
+// Number of keys hashed in each speed test, and the number of times each test is repeated (the
+// fastest time is reported)
+const TUInt32 NumSpeedKeys = 1000000;
+const int NumRepeats = 5;
+
+// Number of keys and buckets for the chi-squared test - an average of 8 keys per bucket. Keys
+// are put in buckets with the low bits of the hash, as the flat hash tables do
+const TUInt32 NumChiSquaredKeys = 1 << 19;
+const TUInt32 NumChiSquaredBuckets = 1 << 16;
+
+// Number of keys for the avalanche test, every bit of each key is flipped in turn
+const TUInt32 NumAvalancheKeys = 2000;
+
+
+/////////////////////////
+// Key types
+
+// Entity UID as in Entity.h - a slot index in the low 20 bits and a generation in the high bits
+typedef TUInt32 TEntityUID;
+
+// Struct key - a spatial hash cell. Has no padding so can be hashed as raw bytes
+struct SCellKey
+{
+	TInt32 x, y, z;
+};
+
+
+// Functions to flip a bit in each type of key for the avalanche test
+TUInt32 NumKeyBits( const TEntityUID& )     { return 32; }
+TUInt32 NumKeyBits( const SCellKey& )       { return 96; }
+TUInt32 NumKeyBits( const string& key )     { return static_cast<TUInt32>(key.length()) * 8; }
+
+void FlipKeyBit( TEntityUID& key, TUInt32 bit ) { key ^= 1u << bit; }
+void FlipKeyBit( SCellKey& key, TUInt32 bit )
+{
+	reinterpret_cast<TUInt8*>(&key)[bit / 8] ^= 1 << (bit % 8);
+}
+void FlipKeyBit( string& key, TUInt32 bit )
+{
+	key[bit / 8] ^= static_cast<char>(1 << (bit % 8));
+}
+
+
+// Pseudo-random sequence, the same for every test
+TUInt32 RandomSeed;
+inline TUInt32 Random()
+{
+	RandomSeed = RandomSeed * 1664525 + 1013904223;
+	return RandomSeed >> 8;
+}
+inline TUInt32 Random32()
+{
+	return (Random() << 16) ^ Random();
+}
+
+// UIDs as the entity manager gives them out: slots mostly in order, with some reused at a
+// higher generation
+vector<TEntityUID> EntityUIDs( TUInt32 numKeys )
+{
+	vector<TEntityUID> keys( numKeys );
+	for (TUInt32 key = 0; key < numKeys; ++key)
+	{
+		TUInt32 slot = key & 0xfffff;
+		TUInt32 generation = (key >> 20) + ((Random() % 4 == 0) ? Random() % 16 : 0);
+		keys[key] = slot | (generation << 20);
+	}
+	return keys;
+}
+
+// Entity names as created in scenes: a few base names followed by a number
+vector<string> EntityNames( TUInt32 numKeys )
+{
+	const char* baseNames[] = { "Car ", "Tree ", "Building ", "Portal ", "Light " };
+	vector<string> keys( numKeys );
+	for (TUInt32 key = 0; key < numKeys; ++key)
+	{
+		char number[16];
+		sprintf( number, "%u", key );
+		keys[key] = string( baseNames[key % 5] ) + number;
+	}
+	return keys;
+}
+
+// Random strings of 8 to 63 characters, e.g. file paths
+vector<string> LongStrings( TUInt32 numKeys )
+{
+	vector<string> keys( numKeys );
+	for (TUInt32 key = 0; key < numKeys; ++key)
+	{
+		keys[key].resize( 8 + Random() % 56 );
+		for (TUInt32 c = 0; c < keys[key].length(); ++c)
+		{
+			keys[key][c] = static_cast<char>('a' + Random() % 26);
+		}
+	}
+	return keys;
+}
+
+// Cells in a block around the origin, as filled by a scene of nearby entities
+vector<SCellKey> GridCells( TUInt32 numKeys )
+{
+	vector<SCellKey> keys( numKeys );
+	for (TUInt32 key = 0; key < numKeys; ++key)
+	{
+		keys[key].x = static_cast<TInt32>(key % 128) - 64;
+		keys[key].y = static_cast<TInt32>((key / 128) % 16) - 8;
+		keys[key].z = static_cast<TInt32>(key / 2048) - 128;
+	}
+	return keys;
+}
+
+
+/////////////////////////
+// Hashers under test
+
+// Byte-at-a-time functions from CHashTable, as hashers for any key type (strings hash their
+// characters)
+template <class TKeyType> const TUInt8* KeyData( const TKeyType& key )
+{
+	return reinterpret_cast<const TUInt8*>(&key);
+}
+template <class TKeyType> TUInt32 KeyLength( const TKeyType& )
+{
+	return sizeof(TKeyType);
+}
+template <> const TUInt8* KeyData( const string& key )
+{
+	return reinterpret_cast<const TUInt8*>(key.data());
+}
+template <> TUInt32 KeyLength( const string& key )
+{
+	return static_cast<TUInt32>(key.length());
+}
+
+template <class TKeyType>
+struct CAddUpHasher
+{
+	TUInt32 operator()( const TKeyType& key ) const
+	{
+		return AddUpHash( KeyData( key ), KeyLength( key ) );
+	}
+};
+
+template <class TKeyType>
+struct COneAtATimeHasher
+{
+	TUInt32 operator()( const TKeyType& key ) const
+	{
+		return JOneAtATimeHash( KeyData( key ), KeyLength( key ) );
+	}
+};
+
+// The default string hasher before WordHash64 (FNV-1a), one character at a time
+struct CFnv1aHasher
+{
+	TUInt32 operator()( const string& key ) const
+	{
+		TUInt32 iHash = 2166136261u;
+		for (string::size_type iChar = 0; iChar < key.length(); ++iChar)
+		{
+			iHash ^= static_cast<TUInt8>(key[iChar]);
+			iHash *= 16777619u;
+		}
+		return iHash;
+	}
+};
+
+// The multiply hash the spatial hash first used for cells, with the Murmur mix used for UIDs
+struct CCellHasher
+{
+	TUInt32 operator()( const SCellKey& key ) const
+	{
+		return MixHash32( static_cast<TUInt32>(key.x) * 73856093u ^
+		                  static_cast<TUInt32>(key.y) * 19349663u ^
+		                  static_cast<TUInt32>(key.z) * 83492791u );
+	}
+};
+
+// The hash the spatial hash now uses for cells - the coordinates packed 21 bits apart into one
+// 64-bit key for MixHash64
+struct CPackedCellHasher
+{
+	TUInt32 operator()( const SCellKey& key ) const
+	{
+		TUInt64 x = static_cast<TUInt32>(key.x);
+		TUInt64 y = static_cast<TUInt32>(key.y);
+		TUInt64 z = static_cast<TUInt32>(key.z);
+		return MixHash64( x ^ (y << 21 | y >> 43) ^ (z << 42 | z >> 22) );
+	}
+};
+
+
+/////////////////////////
+// Tests
+
+// Time to hash each key (ns), the fastest of several runs
+template <class THasher, class TKeyType>
+float SpeedTest( const vector<TKeyType>& keys )
+{
+	THasher hasher;
+	CTimer timer;
+	float bestTime = 0.0f;
+	TUInt32 checksum = 0;
+	for (int repeat = 0; repeat < NumRepeats; ++repeat)
+	{
+		timer.GetLapTime();
+		for (TUInt32 key = 0; key < keys.size(); ++key)
+		{
+			checksum += hasher( keys[key] );
+		}
+		float time = timer.GetLapTime();
+		if (repeat == 0 || time < bestTime) bestTime = time;
+	}
+	if (checksum == 0) cout << " "; // Use checksum so the hashing is not optimised away
+	return bestTime * 1.0e9f / keys.size();
+}
+
+// Chi-squared test of the bucket sizes when the first keys are put in buckets with the low bits
+// of their hash. Scaled so a hash as good as random scores around 0 (within about +/-3), positive
+// values mean keys are clumped into fewer buckets, the larger the worse
+template <class THasher, class TKeyType>
+float ChiSquaredTest( const vector<TKeyType>& keys )
+{
+	THasher hasher;
+	vector<TUInt32> bucketSizes( NumChiSquaredBuckets, 0 );
+	for (TUInt32 key = 0; key < NumChiSquaredKeys; ++key)
+	{
+		++bucketSizes[hasher( keys[key] ) & (NumChiSquaredBuckets - 1)];
+	}
+
+	double expected = static_cast<double>(NumChiSquaredKeys) / NumChiSquaredBuckets;
+	double chiSquared = 0.0;
+	for (TUInt32 bucket = 0; bucket < NumChiSquaredBuckets; ++bucket)
+	{
+		double difference = bucketSizes[bucket] - expected;
+		chiSquared += difference * difference / expected;
+	}
+	double degrees = NumChiSquaredBuckets - 1;
+	return static_cast<float>((chiSquared - degrees) / sqrt( 2.0 * degrees ));
+}
+
+// Avalanche test - flipping any key bit should flip each hash bit with probability 0.5. Returns
+// the average probability and the worst bias of any key bit / hash bit pair from 0.5 (0 is
+// perfect, 0.5 means a hash bit always or never flips for some key bit) - as percentages.
+// Strings must all be the same length
+template <class THasher, class TKeyType>
+void AvalancheTest( const vector<TKeyType>& keys, float* averageFlip, float* worstBias )
+{
+	THasher hasher;
+	TUInt32 numKeyBits = NumKeyBits( keys[0] );
+	vector<TUInt32> flipCounts( numKeyBits * 32, 0 );
+	TUInt32 totalFlips = 0;
+	for (TUInt32 key = 0; key < NumAvalancheKeys; ++key)
+	{
+		TUInt32 hash = hasher( keys[key] );
+		TKeyType flippedKey = keys[key];
+		for (TUInt32 keyBit = 0; keyBit < numKeyBits; ++keyBit)
+		{
+			FlipKeyBit( flippedKey, keyBit );
+			TUInt32 flippedBits = hash ^ hasher( flippedKey );
+			FlipKeyBit( flippedKey, keyBit );
+			for (TUInt32 hashBit = 0; hashBit < 32; ++hashBit)
+			{
+				TUInt32 flipped = (flippedBits >> hashBit) & 1;
+				flipCounts[keyBit * 32 + hashBit] += flipped;
+				totalFlips += flipped;
+			}
+		}
+	}
+
+	*averageFlip = 100.0f * totalFlips / (static_cast<float>(NumAvalancheKeys) * numKeyBits * 32);
+	*worstBias = 0.0f;
+	for (TUInt32 pair = 0; pair < flipCounts.size(); ++pair)
+	{
+		float bias = fabs( static_cast<float>(flipCounts[pair]) / NumAvalancheKeys - 0.5f );
+		if (bias > *worstBias) *worstBias = bias;
+	}
+	*worstBias *= 100.0f;
+}
+
+
+// Run all tests for one hasher on one set of keys (speed and distribution) and another (fixed
+// length random keys for the avalanche test), and output a line of results
+template <class THasher, class TKeyType>
+void ReportHasher( const char* name, const vector<TKeyType>& keys,
+                   const vector<TKeyType>& avalancheKeys )
+{
+	float averageFlip, worstBias;
+	AvalancheTest<THasher>( avalancheKeys, &averageFlip, &worstBias );
+	cout << left << setw( 30 ) << name << right
+	     << setw( 10 ) << SpeedTest<THasher>( keys )
+	     << setw( 12 ) << ChiSquaredTest<THasher>( keys )
+	     << setw( 10 ) << averageFlip
+	     << setw( 10 ) << worstBias << endl;
+}
+
+void ReportHeading( const char* keyDescription )
+{
+	cout << endl << keyDescription << endl;
+	cout << left << setw( 30 ) << "Hasher" << right << setw( 10 ) << "ns/key" << setw( 12 )
+	     << "Chi-sq" << setw( 10 ) << "Flip %" << setw( 10 ) << "Bias %" << endl;
+}
+
+
+/////////////////////////
+// Test harness
+
+int main()
+{
+	cout << fixed << setprecision( 2 );
+	cout << "Chi-sq: bucket distribution, around 0 (within +/-3) is as good as random" << endl;
+	cout << "Flip %: average chance a hash bit flips when one key bit flips, ideal is 50" << endl;
+	cout << "Bias %: worst key bit / hash bit pair distance from 50%, ideal is near 0" << endl;
+
+	// Integer keys
+	RandomSeed = 1;
+	vector<TEntityUID> uids = EntityUIDs( NumSpeedKeys );
+	vector<TEntityUID> randomUIDs( NumAvalancheKeys );
+	for (TUInt32 key = 0; key < NumAvalancheKeys; ++key)
+	{
+		randomUIDs[key] = Random32();
+	}
+	ReportHeading( "Entity UIDs (32-bit)" );
+	ReportHasher< CAddUpHasher<TEntityUID> >( "AddUpHash", uids, randomUIDs );
+	ReportHasher< COneAtATimeHasher<TEntityUID> >( "JOneAtATimeHash", uids, randomUIDs );
+	ReportHasher< CHasher<TEntityUID> >( "MixHash32 (default)", uids, randomUIDs );
+	ReportHasher< CMultiplyMixHasher<TEntityUID> >( "MultiplyMixHash64", uids, randomUIDs );
+	ReportHasher< CWordHasher<TEntityUID> >( "WordHash64", uids, randomUIDs );
+
+	// String keys
+	vector<string> names = EntityNames( NumSpeedKeys );
+	vector<string> longStrings = LongStrings( NumSpeedKeys );
+	vector<string> randomStrings( NumAvalancheKeys );
+	for (TUInt32 key = 0; key < NumAvalancheKeys; ++key)
+	{
+		randomStrings[key] = longStrings[key].substr( 0, 8 ) + longStrings[key + 1].substr( 0, 8 );
+	}
+	ReportHeading( "Entity names (\"Car 123\" etc.)" );
+	ReportHasher< CAddUpHasher<string> >( "AddUpHash", names, randomStrings );
+	ReportHasher< COneAtATimeHasher<string> >( "JOneAtATimeHash", names, randomStrings );
+	ReportHasher< CFnv1aHasher >( "FNV-1a", names, randomStrings );
+	ReportHasher< CHasher<string> >( "WordHash64 (default)", names, randomStrings );
+	ReportHeading( "Random strings (8 to 63 characters)" );
+	ReportHasher< CAddUpHasher<string> >( "AddUpHash", longStrings, randomStrings );
+	ReportHasher< COneAtATimeHasher<string> >( "JOneAtATimeHash", longStrings, randomStrings );
+	ReportHasher< CFnv1aHasher >( "FNV-1a", longStrings, randomStrings );
+	ReportHasher< CHasher<string> >( "WordHash64 (default)", longStrings, randomStrings );
+
+	// Struct keys
+	vector<SCellKey> cells = GridCells( NumSpeedKeys );
+	vector<SCellKey> randomCells( NumAvalancheKeys );
+	for (TUInt32 key = 0; key < NumAvalancheKeys; ++key)
+	{
+		randomCells[key].x = static_cast<TInt32>(Random32());
+		randomCells[key].y = static_cast<TInt32>(Random32());
+		randomCells[key].z = static_cast<TInt32>(Random32());
+	}
+	ReportHeading( "Spatial hash cells (3 x 32-bit)" );
+	ReportHasher< CAddUpHasher<SCellKey> >( "AddUpHash", cells, randomCells );
+	ReportHasher< CHasher<SCellKey> >( "JOneAtATimeHash (default)", cells, randomCells );
+	ReportHasher< CCellHasher >( "Prime multiply + MixHash32", cells, randomCells );
+	ReportHasher< CWordHasher<SCellKey> >( "WordHash64", cells, randomCells );
+	ReportHasher< CPackedCellHasher >( "Packed cell + MixHash64", cells, randomCells );
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,279 @@
+/*******************************************
+	HashTableBenchmark.cpp
+
+	Console program timing the hash tables
+	on the entity UID workload
+********************************************/
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <unordered_map>
+#include <cstdlib>
+using namespace std;
+
+#include "Defines.h"
+#include "CTimer.h"
+#include "CHashTable.h"
+#include "CFlatHashTable.h"
+
+using namespace gen;
+
+
+/////////////////////////
+// Constants
+
+// Entity UID type as in Entity.h (not included here as it needs the renderer)
+typedef TUInt32 TEntityUID;
+
+// Number of live entities, and the number of operations in each timed test
+const TUInt32 NumEntities = 100000;
+const TUInt32 NumLookUps = 10000000;
+const TUInt32 NumChurns = 1000000;
+
+// Number of times each test is repeated, the fastest time is reported
+const int NumRepeats = 5;
+
+
+/////////////////////////
+// Tables under test
+
+// std::unordered_map wrapped with the CHashTable interface, so the same workload code can be
+// used for all tables
+class CStdHashTable
+{
+public:
+	CStdHashTable( const TUInt32 iInitialSize )
+	{
+		m_Map.reserve( iInitialSize );
+	}
+
+	bool LookUpKey( const TEntityUID& key, TUInt32* pValue )
+	{
+		unordered_map<TEntityUID, TUInt32>::const_iterator it = m_Map.find( key );
+		if (it == m_Map.end())
+		{
+			return false;
+		}
+		*pValue = it->second;
+		return true;
+	}
+	void SetKeyValue( const TEntityUID& key, const TUInt32& value )
+	{
+		m_Map[key] = value;
+	}
+	bool RemoveKey( const TEntityUID& key )
+	{
+		return m_Map.erase( key ) != 0;
+	}
+	void RemoveAllKeys()
+	{
+		m_Map.clear();
+	}
+
+private:
+	unordered_map<TEntityUID, TUInt32> m_Map;
+};
+
+
+/////////////////////////
+// Entity UID workload
+
+// Mimics CEntityManager: a packed list of entity UIDs with a table mapping each UID to its index
+// in the list. Destroying an entity moves the last entity into its place and re-keys it
+template <class TTable>
+class CUIDWorkload
+{
+public:
+	CUIDWorkload( TTable* table ) : m_Table( table ), m_NextUID( 0 ) {}
+
+	// Add new entity with next UID
+	void Create()
+	{
+		m_Table->SetKeyValue( m_NextUID, static_cast<TUInt32>(m_UIDs.size()) );
+		m_UIDs.push_back( m_NextUID++ );
+	}
+
+	// Remove entity with given UID, as CEntityManager::DestroyEntity
+	bool Destroy( const TEntityUID uid )
+	{
+		TUInt32 index;
+		if (!m_Table->LookUpKey( uid, &index ))
+		{
+			return false;
+		}
+		m_Table->RemoveKey( uid );
+		if (index != m_UIDs.size() - 1)
+		{
+			m_UIDs[index] = m_UIDs.back();
+			m_Table->SetKeyValue( m_UIDs[index], index );
+		}
+		m_UIDs.pop_back();
+		return true;
+	}
+
+	TTable*            m_Table;
+	vector<TEntityUID> m_UIDs;
+	TEntityUID         m_NextUID;
+};
+
+
+// Pseudo-random sequence, the same for every table
+TUInt32 RandomSeed;
+inline TUInt32 Random()
+{
+	RandomSeed = RandomSeed * 1664525 + 1013904223;
+	return RandomSeed >> 8;
+}
+
+
+// Results of one run of the workload (seconds), and a checksum that must match across tables
+struct SResults
+{
+	float   Create;
+	float   LookUpHit;
+	float   LookUpMiss;
+	float   Churn;
+	TUInt32 Checksum;
+};
+
+// Run the entity UID workload on a new table created by the given function
+template <class TTable>
+SResults RunWorkload( TTable* (*createTable)() )
+{
+	SResults results;
+	TTable* table = createTable();
+	CUIDWorkload<TTable> workload( table );
+	RandomSeed = 1;
+	results.Checksum = 0;
+	CTimer timer;
+
+	// Create the entities - the table grows from its initial size as entities are added
+	timer.GetLapTime();
+	for (TUInt32 entity = 0; entity < NumEntities; ++entity)
+	{
+		workload.Create();
+	}
+	results.Create = timer.GetLapTime();
+
+	// Destroy some entities and create others so the UIDs are not all contiguous, as in a game
+	for (TUInt32 entity = 0; entity < NumEntities / 4; ++entity)
+	{
+		workload.Destroy( workload.m_UIDs[Random() % workload.m_UIDs.size()] );
+		workload.Create();
+	}
+
+	// Look up random live UIDs, as CEntityManager::GetEntity
+	vector<TEntityUID> keys( NumLookUps );
+	for (TUInt32 lookUp = 0; lookUp < NumLookUps; ++lookUp)
+	{
+		keys[lookUp] = workload.m_UIDs[Random() % workload.m_UIDs.size()];
+	}
+	timer.GetLapTime();
+	for (TUInt32 lookUp = 0; lookUp < NumLookUps; ++lookUp)
+	{
+		TUInt32 index;
+		if (table->LookUpKey( keys[lookUp], &index ))
+		{
+			results.Checksum += index;
+		}
+	}
+	results.LookUpHit = timer.GetLapTime();
+
+	// Look up UIDs of destroyed entities (or never created), e.g. a stale target UID
+	for (TUInt32 lookUp = 0; lookUp < NumLookUps; ++lookUp)
+	{
+		keys[lookUp] = (Random() % 2) ? workload.m_NextUID + Random() % NumEntities :
+		                                Random() % workload.m_NextUID;
+	}
+	timer.GetLapTime();
+	for (TUInt32 lookUp = 0; lookUp < NumLookUps; ++lookUp)
+	{
+		TUInt32 index;
+		if (table->LookUpKey( keys[lookUp], &index ))
+		{
+			results.Checksum += index;
+		}
+	}
+	results.LookUpMiss = timer.GetLapTime();
+
+	// Destroy random entities and create new ones (removal, re-key of the moved entity, insert)
+	for (TUInt32 churn = 0; churn < NumChurns; ++churn)
+	{
+		keys[churn] = Random();
+	}
+	timer.GetLapTime();
+	for (TUInt32 churn = 0; churn < NumChurns; ++churn)
+	{
+		workload.Destroy( workload.m_UIDs[keys[churn] % workload.m_UIDs.size()] );
+		workload.Create();
+	}
+	results.Churn = timer.GetLapTime();
+	results.Checksum += workload.m_UIDs.back();
+
+	delete table;
+	return results;
+}
+
+// Run the workload several times and report the fastest time for each test
+template <class TTable>
+TUInt32 ReportWorkload( const char* name, TTable* (*createTable)() )
+{
+	SResults best = RunWorkload( createTable );
+	for (int repeat = 1; repeat < NumRepeats; ++repeat)
+	{
+		SResults results = RunWorkload( createTable );
+		if (results.Create < best.Create) best.Create = results.Create;
+		if (results.LookUpHit < best.LookUpHit) best.LookUpHit = results.LookUpHit;
+		if (results.LookUpMiss < best.LookUpMiss) best.LookUpMiss = results.LookUpMiss;
+		if (results.Churn < best.Churn) best.Churn = results.Churn;
+	}
+
+	// Times per operation in nanoseconds
+	cout << left << setw( 26 ) << name << right
+	     << setw( 10 ) << best.Create * 1.0e9f / NumEntities
+	     << setw( 10 ) << best.LookUpHit * 1.0e9f / NumLookUps
+	     << setw( 10 ) << best.LookUpMiss * 1.0e9f / NumLookUps
+	     << setw( 10 ) << best.Churn * 1.0e9f / NumChurns << endl;
+	return best.Checksum;
+}
+
+
+// Table creation functions. Tables start at the size used by CEntityManager
+CHashTable<TEntityUID, TUInt32>* CreateListTable()
+{
+	return new CHashTable<TEntityUID, TUInt32>( 2048, JOneAtATimeHash );
+}
+CFlatHashTable<TEntityUID, TUInt32>* CreateFlatTable()
+{
+	return new CFlatHashTable<TEntityUID, TUInt32>( 2048 );
+}
+CStdHashTable* CreateStdTable()
+{
+	return new CStdHashTable( 2048 );
+}
+
+
+/////////////////////////
+// Test harness
+
+int main()
+{
+	cout << fixed << setprecision( 1 );
+	cout << "Entity UID workload: " << NumEntities << " entities, times in ns per operation"
+	     << endl << endl;
+	cout << left << setw( 26 ) << "Table" << right << setw( 10 ) << "Create" << setw( 10 )
+	     << "Hit" << setw( 10 ) << "Miss" << setw( 10 ) << "Churn" << endl;
+
+	TUInt32 listChecksum = ReportWorkload( "CHashTable (list buckets)", CreateListTable );
+	TUInt32 flatChecksum = ReportWorkload( "CFlatHashTable", CreateFlatTable );
+	TUInt32 stdChecksum  = ReportWorkload( "std::unordered_map", CreateStdTable );
+
+	if (listChecksum != flatChecksum || listChecksum != stdChecksum)
+	{
+		cout << endl << "****Tables gave different results****" << endl;
+		return EXIT_FAILURE;
+	}
+	cout << endl << "All tables gave the same results" << endl;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,379 @@
+/**************************************************************************************************
+	Module:       CConcurrentHashTable.h
+
+	Open-addressing hash table that can be read from any number of threads while another thread
+	changes it, with the same interface as CHashTable. Look-ups take no locks and never wait:
+	a look-up reads a key slot, then the value beside it, using atomic loads.
+
+	Changes (add, update, remove) are made one at a time under a writer lock. A new key is only
+	ever written into an empty slot, and a removed key is replaced by a deleted marker rather
+	than shifting its neighbours, so a look-up in progress always sees a consistent slot. When
+	the table becomes too full (of keys or deleted markers) it is not resized in place: the
+	writer builds a new table and publishes it with a single pointer swap, so readers still
+	using the old table are unaffected (read-copy-update). Old tables are kept until the owner
+	calls ReclaimOldTables at a point where no look-ups can be in progress, e.g. between the
+	parallel parts of a frame.
+
+	Keys must be integers (e.g. UIDs or name IDs) - the two largest values are reserved for
+	marking empty and deleted slots and cannot be stored. Values must be integers or pointers
+**************************************************************************************************/
+
+#ifndef GEN_C_CONCURRENT_HASH_TABLE_H_INCLUDED
+#define GEN_C_CONCURRENT_HASH_TABLE_H_INCLUDED
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <type_traits>
+using namespace std;
+
+#include "Defines.h"
+#include "Error.h"
+#include "Hashers.h"
+
+namespace gen
+{
+
+/*---------------------------------------------------------------------------------------------
+	CConcurrentHashTable class
+---------------------------------------------------------------------------------------------*/
+
+// Template class with key type, value type and hasher type (see Hashers.h)
+template <class TKeyType, class TValueType, class THasher = CHasher<TKeyType> >
+class CConcurrentHashTable
+{
+	static_assert( is_integral<TKeyType>::value, "Concurrent hash table keys must be integers" );
+	static_assert( is_integral<TValueType>::value || is_pointer<TValueType>::value,
+	               "Concurrent hash table values must be integers or pointers" );
+
+/*---------------------------------------------------------------------------------------------
+	Constructors / Destructors
+---------------------------------------------------------------------------------------------*/
+public:
+	// Constructor takes initial table size (rounded up to a power of 2) and the maximum load
+	// factor (keys and deleted markers) before the table is rebuilt - see data section at end
+	CConcurrentHashTable
+	(
+		const TUInt32  iInitialSize,         // Initial size for the hash table
+		const TFloat32 fMaxLoadFactor = 0.5f // Maximum load factor
+	) : m_kfMaxLoadFactor( fMaxLoadFactor )
+	{
+		GEN_GUARD;
+
+		// Table size must be a power of 2 so slot indexes can be found with a bitwise and
+		TUInt32 iSize = 8;
+		while (iSize < iInitialSize)
+		{
+			iSize *= 2;
+		}
+		m_pTable.store( CreateTable( iSize ), memory_order_relaxed );
+
+		// Starting with no hash table entries
+		m_iNumEntries = 0;
+
+		GEN_ENDGUARD;
+	}
+
+private:
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CConcurrentHashTable( const CConcurrentHashTable& );
+	CConcurrentHashTable& operator=( const CConcurrentHashTable& );
+
+public:
+	// Destructor to free hash table memory, including old tables. No look-ups can be in progress
+	~CConcurrentHashTable()
+	{
+		ReclaimOldTables();
+		DestroyTable( m_pTable.load( memory_order_relaxed ) );
+	}
+
+
+/*---------------------------------------------------------------------------------------------
+	Public interface
+---------------------------------------------------------------------------------------------*/
+public:
+	// Looks up value associated with given key and puts in in given pointer. Returns true if
+	// the key was found. Can be called from any thread at any time and never waits. If another
+	// thread is changing the same key, the result is either the old or the new state of the key
+	bool LookUpKey
+	(
+		const TKeyType& key,
+		TValueType*     pValue
+	) const
+	{
+		if (key == kEmptyKey || key == kDeletedKey)
+		{
+			return false;
+		}
+
+		// Acquire loads pair with the release stores of the writer, so a key is never seen before
+		// its value, nor a table before its contents
+		const STable* pTable = m_pTable.load( memory_order_acquire );
+		TUInt32 iSlot = m_Hasher( key ) & pTable->iMask;
+		while (true)
+		{
+			TKeyType slotKey = pTable->aSlots[iSlot].key.load( memory_order_acquire );
+			if (slotKey == key)
+			{
+				*pValue = pTable->aSlots[iSlot].value.load( memory_order_acquire );
+				return true;
+			}
+			if (slotKey == kEmptyKey)
+			{
+				return false;
+			}
+			iSlot = (iSlot + 1) & pTable->iMask;
+		}
+	}
+
+
+	// Add the given key-value pair to the table, if the key already exists, just update its value
+	void SetKeyValue
+	(
+		const TKeyType&   key,
+		const TValueType& value
+	)
+	{
+		GEN_ASSERT( key != kEmptyKey && key != kDeletedKey, "Reserved key in hash table" );
+		lock_guard<mutex> writeLock( m_WriteMutex );
+
+		// If key already exists, simply update the value associated with it
+		STable* pTable = m_pTable.load( memory_order_relaxed );
+		TUInt32 iSlot = FindSlot( pTable, key );
+		if (iSlot != kNotFound)
+		{
+			pTable->aSlots[iSlot].value.store( value, memory_order_release );
+			return;
+		}
+
+		// Check loading of table - if too full of keys and deleted markers, then rebuild it
+		if (pTable->iNumUsed + 1 > (pTable->iMask + 1) * m_kfMaxLoadFactor)
+		{
+			Rebuild( m_iNumEntries + 1 );
+			pTable = m_pTable.load( memory_order_relaxed );
+		}
+		Insert( pTable, key, value );
+		++m_iNumEntries;
+	}
+
+
+	// Remove the given key (and associated value) from the table, returns false if not found
+	bool RemoveKey( const TKeyType& key )
+	{
+		GEN_ASSERT( key != kEmptyKey && key != kDeletedKey, "Reserved key in hash table" );
+		lock_guard<mutex> writeLock( m_WriteMutex );
+
+		STable* pTable = m_pTable.load( memory_order_relaxed );
+		TUInt32 iSlot = FindSlot( pTable, key );
+		if (iSlot == kNotFound)
+		{
+			return false;
+		}
+
+		// Mark the slot deleted. The slot still counts as used until the table is rebuilt, so
+		// the key slot cannot be reused while a reader might be reading its value
+		pTable->aSlots[iSlot].key.store( kDeletedKey, memory_order_release );
+		--m_iNumEntries;
+		return true;
+	}
+
+
+	// Remove all keys and associated values. Readers see either the old or the new (empty) table
+	void RemoveAllKeys()
+	{
+		lock_guard<mutex> writeLock( m_WriteMutex );
+
+		STable* pTable = m_pTable.load( memory_order_relaxed );
+		Publish( CreateTable( pTable->iMask + 1 ) );
+		m_iNumEntries = 0;
+	}
+
+
+	// Free the old tables replaced by rebuilds. Only call when no look-ups can be in progress on
+	// other threads (e.g. after a parallel update has finished)
+	void ReclaimOldTables()
+	{
+		lock_guard<mutex> writeLock( m_WriteMutex );
+
+		for (TUInt32 iTable = 0; iTable < m_OldTables.size(); ++iTable)
+		{
+			DestroyTable( m_OldTables[iTable] );
+		}
+		m_OldTables.clear();
+	}
+
+
+	/////////////////////////////////////
+	//	Getters
+
+	// Number of key/value pairs in the table. Only reliable on the thread making changes
+	TUInt32 GetNumEntries() const
+	{
+		return m_iNumEntries;
+	}
+
+	// Number of old tables waiting to be reclaimed. Only reliable on the thread making changes
+	TUInt32 GetNumOldTables() const
+	{
+		return static_cast<TUInt32>(m_OldTables.size());
+	}
+
+
+/*-----------------------------------------------------------------------------------------
+	Private interface
+-----------------------------------------------------------------------------------------*/
+private:
+
+	/*---------------------------------------------------------------------------------------------
+		Types
+	---------------------------------------------------------------------------------------------*/
+
+	// A slot in the table holding a key/value pair. The key is kEmptyKey until a key is added,
+	// then changes only to kDeletedKey when the key is removed
+	struct TSlot
+	{
+		atomic<TKeyType>   key;
+		atomic<TValueType> value;
+	};
+
+	// A table of slots. Never resized - a larger table is built instead
+	struct STable
+	{
+		TSlot*  aSlots;   // Dynamically allocated array of slots
+		TUInt32 iMask;    // Size of the table - 1, the size is a power of 2
+		TUInt32 iNumUsed; // Number of slots holding keys or deleted markers (writer use only)
+	};
+
+	// Reserved keys marking empty and deleted slots
+	static const TKeyType kEmptyKey = static_cast<TKeyType>(~static_cast<TKeyType>(0));
+	static const TKeyType kDeletedKey = static_cast<TKeyType>(~static_cast<TKeyType>(1));
+
+	// Returned by FindSlot if the key is not in the table
+	static const TUInt32 kNotFound = 0xffffffff;
+
+
+	/*---------------------------------------------------------------------------------------------
+		Support functions
+	---------------------------------------------------------------------------------------------*/
+
+	// Create a table of the given size (a power of 2) with all slots empty
+	STable* CreateTable( const TUInt32 iSize )
+	{
+		STable* pTable = new STable;
+		pTable->aSlots = new TSlot[iSize];
+		GEN_ASSERT( pTable->aSlots, "Fatal memory error reserving hash table memory" );
+		pTable->iMask = iSize - 1;
+		pTable->iNumUsed = 0;
+		for (TUInt32 iSlot = 0; iSlot < iSize; ++iSlot)
+		{
+			pTable->aSlots[iSlot].key.store( kEmptyKey, memory_order_relaxed );
+			pTable->aSlots[iSlot].value.store( TValueType(), memory_order_relaxed );
+		}
+		return pTable;
+	}
+
+	void DestroyTable( STable* pTable )
+	{
+		delete[] pTable->aSlots;
+		delete pTable;
+	}
+
+
+	// Find the slot containing the given key, returns kNotFound if the key is not in the table.
+	// Writer only - the table cannot change during the search
+	TUInt32 FindSlot( const STable* pTable, const TKeyType& key ) const
+	{
+		TUInt32 iSlot = m_Hasher( key ) & pTable->iMask;
+		while (true)
+		{
+			TKeyType slotKey = pTable->aSlots[iSlot].key.load( memory_order_relaxed );
+			if (slotKey == key)
+			{
+				return iSlot;
+			}
+			if (slotKey == kEmptyKey)
+			{
+				return kNotFound;
+			}
+			iSlot = (iSlot + 1) & pTable->iMask;
+		}
+	}
+
+
+	// Insert a key/value pair that is not already in the table into the first empty slot after
+	// its home slot. Deleted slots are skipped, see RemoveKey. The value is stored before the
+	// key so a reader that finds the key also finds the value
+	void Insert( STable* pTable, const TKeyType& key, const TValueType& value )
+	{
+		TUInt32 iSlot = m_Hasher( key ) & pTable->iMask;
+		while (pTable->aSlots[iSlot].key.load( memory_order_relaxed ) != kEmptyKey)
+		{
+			iSlot = (iSlot + 1) & pTable->iMask;
+		}
+		pTable->aSlots[iSlot].value.store( value, memory_order_relaxed );
+		pTable->aSlots[iSlot].key.store( key, memory_order_release );
+		++pTable->iNumUsed;
+	}
+
+
+	// Build a new table holding all current keys (without deleted markers), large enough for the
+	// given number of keys to fill it to half the maximum load, and publish it
+	void Rebuild( const TUInt32 iNumKeys )
+	{
+		GEN_GUARD;
+
+		const STable* pOldTable = m_pTable.load( memory_order_relaxed );
+		TUInt32 iNewSize = 8;
+		while (iNewSize * m_kfMaxLoadFactor < iNumKeys * 2)
+		{
+			iNewSize *= 2;
+		}
+		STable* pNewTable = CreateTable( iNewSize );
+
+		// Insert each key/value pair from the old table
+		for (TUInt32 iSlot = 0; iSlot <= pOldTable->iMask; ++iSlot)
+		{
+			TKeyType key = pOldTable->aSlots[iSlot].key.load( memory_order_relaxed );
+			if (key != kEmptyKey && key != kDeletedKey)
+			{
+				Insert( pNewTable, key, pOldTable->aSlots[iSlot].value.load( memory_order_relaxed ) );
+			}
+		}
+
+		Publish( pNewTable );
+
+		GEN_ENDGUARD;
+	}
+
+
+	// Make the given table current. The old table may still be in use by readers so it is kept
+	// until ReclaimOldTables is called
+	void Publish( STable* pNewTable )
+	{
+		m_OldTables.push_back( m_pTable.load( memory_order_relaxed ) );
+		m_pTable.store( pNewTable, memory_order_release );
+	}
+
+
+	/*---------------------------------------------------------------------------------------------
+		Data
+	---------------------------------------------------------------------------------------------*/
+
+	atomic<STable*>  m_pTable;      // Current table, read by look-ups on any thread
+	vector<STable*>  m_OldTables;   // Tables replaced since the last ReclaimOldTables
+	mutex            m_WriteMutex;  // Held by changes, only one change is made at a time
+	TUInt32          m_iNumEntries; // Number of key/value pairs in the table
+
+	// Hash function object to use - inlined into the functions above
+	THasher m_Hasher;
+
+	// If table becomes too full of keys and deleted markers, then it is rebuilt to keep keys near
+	// their home slots and to clear the markers. The max load factor defines how full it needs
+	// to be before this happens. The new table may be smaller if many keys have been removed
+	const TFloat32 m_kfMaxLoadFactor;
+};
+
+
+} // namespace gen
+
+#endif // GEN_C_CONCURRENT_HASH_TABLE_H_INCLUDED
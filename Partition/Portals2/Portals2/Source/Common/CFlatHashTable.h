@@ -0,0 +1,334 @@
+/**************************************************************************************************
+	Module:       CFlatHashTable.h
+
+	Open-addressing hash table storing keys and associated values, with the same interface as
+	CHashTable. All key/value pairs are held in a single array so a look-up reads one or two
+	neighbouring slots rather than following list nodes around the heap.
+
+	Collisions are resolved with "robin hood" linear probing: each key is stored as near as
+	possible to the slot its hash selects (its home slot), and when inserting, a key that is
+	further from home takes the place of one that is nearer. This keeps every key close to its
+	home, and a look-up can stop as soon as it reaches a key nearer home than the one it seeks.
+	Removal shifts the following keys back one slot rather than leaving deleted markers, so the
+	table never needs cleaning up after many removals
+**************************************************************************************************/
+
+#ifndef GEN_C_FLAT_HASH_TABLE_H_INCLUDED
+#define GEN_C_FLAT_HASH_TABLE_H_INCLUDED
+
+#include <iostream>
+#include <algorithm>
+using namespace std;
+
+#include "Defines.h"
+#include "Error.h"
+#include "Hashers.h"
+
+namespace gen
+{
+
+/*---------------------------------------------------------------------------------------------
+	CFlatHashTable class
+---------------------------------------------------------------------------------------------*/
+
+// Template class with key type, value type and hasher type (see Hashers.h). The hasher is a
+// function object converting a key to a 4-byte hash. As with CHashTable, the key type must have
+// operator== and operator= defined and the value type must have operator= defined. Both types
+// also need a default constructor as all slots in the table are constructed up-front
+template <class TKeyType, class TValueType, class THasher = CHasher<TKeyType> >
+class CFlatHashTable
+{
+
+/*---------------------------------------------------------------------------------------------
+	Constructors / Destructors
+---------------------------------------------------------------------------------------------*/
+public:
+	// Constructor takes initial table size (rounded up to a power of 2) and the maximum load
+	// factor before the table is resized - see data section at end
+	CFlatHashTable
+	(
+		const TUInt32  iInitialSize,         // Initial size for the hash table
+		const TFloat32 fMaxLoadFactor = 0.5f // Maximum load factor
+	) : m_kfMaxLoadFactor( fMaxLoadFactor )
+	{
+		GEN_GUARD;
+
+		// Table size must be a power of 2 so slot indexes can be found with a bitwise and
+		m_iSize = 8;
+		while (m_iSize < iInitialSize)
+		{
+			m_iSize *= 2;
+		}
+		m_aSlots = new TSlot[m_iSize];
+		GEN_ASSERT( m_aSlots, "Fatal memory error reserving hash table memory" );
+
+		// Starting with no hash table entries
+		m_iNumEntries = 0;
+
+		GEN_ENDGUARD;
+	}
+
+private:
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CFlatHashTable( const CFlatHashTable& );
+	CFlatHashTable& operator=( const CFlatHashTable& );
+
+public:
+	// Destructor to free hash table memory
+	~CFlatHashTable()
+	{
+		delete[] m_aSlots;
+	}
+
+
+/*---------------------------------------------------------------------------------------------
+	Public interface
+---------------------------------------------------------------------------------------------*/
+public:
+	// Looks up value associated with given key and puts in in given pointer. Returns true if
+	// the key was found
+	bool LookUpKey
+	(
+		const TKeyType& key,
+		TValueType*     pValue
+	) const
+	{
+		TUInt32 iSlot = FindSlot( key );
+		if (iSlot == kNotFound)
+		{
+			return false;
+		}
+
+		// Found key, copy its value out and return true
+		*pValue = m_aSlots[iSlot].value;
+		return true;
+	}
+
+
+	// Add the given key-value pair to the table, if the key already exists, just update its value
+	void SetKeyValue
+	(
+		const TKeyType&   key,
+		const TValueType& value
+	)
+	{
+		// If key already exists, simply update the value associated with it
+		TUInt32 iSlot = FindSlot( key );
+		if (iSlot != kNotFound)
+		{
+			m_aSlots[iSlot].value = value;
+			return;
+		}
+
+		// Check loading of table - if too full, then double it in size
+		if (m_iNumEntries + 1 > m_iSize * m_kfMaxLoadFactor)
+		{
+			Resize( m_iSize * 2 );
+		}
+		TSlot newSlot;
+		newSlot.key = key;
+		newSlot.value = value;
+		Insert( newSlot );
+	}
+
+
+	// Remove the given key (and associated value) from the table, returns false if not found
+	bool RemoveKey( const TKeyType& key )
+	{
+		TUInt32 iSlot = FindSlot( key );
+		if (iSlot == kNotFound)
+		{
+			return false;
+		}
+
+		// Shift following keys back one slot (nearer their home slots) until reaching an empty
+		// slot or a key that is already in its home slot. Leaves no gaps that would end a later
+		// look-up early
+		TUInt32 iNext = (iSlot + 1) & (m_iSize - 1);
+		while (m_aSlots[iNext].distance > 1)
+		{
+			m_aSlots[iSlot] = m_aSlots[iNext];
+			--m_aSlots[iSlot].distance;
+			iSlot = iNext;
+			iNext = (iNext + 1) & (m_iSize - 1);
+		}
+		m_aSlots[iSlot] = TSlot(); // Release any resources held by the key / value, marks empty
+
+		// Decrease number of table entries - note that table is never resized downwards
+		--m_iNumEntries;
+
+		return true;
+	}
+
+
+	// Remove all keys and associated values
+	void RemoveAllKeys()
+	{
+		for (TUInt32 iSlot = 0; iSlot < m_iSize; ++iSlot)
+		{
+			if (m_aSlots[iSlot].distance)
+			{
+				m_aSlots[iSlot] = TSlot();
+			}
+		}
+		m_iNumEntries = 0;
+	}
+
+
+	// Output a table illustrating how far each key is from its home slot - the number of slots
+	// a look-up for the key must read ('.' is an empty slot, '1' is a key in its home slot).
+	// Good hash functions keep nearly all keys within one or two slots of home
+	void OutputDistribution() const
+	{
+		cout << "Hash Table Distribution:" << endl << endl;
+
+		TUInt32 iTotalDistance = 0;
+		TUInt32 iMaxDistance = 0;
+		for (TUInt32 iSlot = 0; iSlot < m_iSize; ++iSlot)
+		{
+			TUInt32 iDistance = m_aSlots[iSlot].distance;
+			if (iDistance == 0)
+			{
+				cout << '.';
+			}
+			else if (iDistance < 10)
+			{
+				cout << iDistance;
+			}
+			else
+			{
+				cout << '+'; // Output '+' for keys 10 or more slots from home
+			}
+			iTotalDistance += iDistance;
+			if (iDistance > iMaxDistance) iMaxDistance = iDistance;
+		}
+		cout << endl << "% used slots: " << 100.0f * static_cast<float>(m_iNumEntries) / m_iSize;
+		cout << endl << "Average slots read per look-up: "
+		     << (m_iNumEntries ? static_cast<float>(iTotalDistance) / m_iNumEntries : 0.0f);
+		cout << endl << "Maximum slots read per look-up: " << iMaxDistance << endl;
+		cout << endl;
+	}
+
+
+/*-----------------------------------------------------------------------------------------
+	Private interface
+-----------------------------------------------------------------------------------------*/
+private:
+
+	/*---------------------------------------------------------------------------------------------
+		Types
+	---------------------------------------------------------------------------------------------*/
+
+	// A slot in the table holding a key/value pair. The distance of the key from its home slot
+	// is stored with the key so a look-up usually reads a single cache line
+	struct TSlot
+	{
+		TKeyType         key;
+		TValueType       value;
+		TUInt32          distance; // 1 + slots from home slot (0 if slot is empty)
+
+		TSlot() : key(), value(), distance( 0 ) {}
+	};
+
+	// Returned by FindSlot if the key is not in the table
+	static const TUInt32 kNotFound = 0xffffffff;
+
+
+	/*---------------------------------------------------------------------------------------------
+		Support functions
+	---------------------------------------------------------------------------------------------*/
+
+	// Find the slot containing the given key, returns kNotFound if the key is not in the table
+	TUInt32 FindSlot( const TKeyType& key ) const
+	{
+		TUInt32 iSlot = m_Hasher( key ) & (m_iSize - 1);
+		TUInt32 iDistance = 1;
+
+		// Step through slots until the key is found, or a slot that is empty or holds a key
+		// nearer to its home than the key would be here (robin hood insertion would have put
+		// the key in that slot)
+		while (m_aSlots[iSlot].distance >= iDistance)
+		{
+			if (m_aSlots[iSlot].distance == iDistance && m_aSlots[iSlot].key == key)
+			{
+				return iSlot;
+			}
+			iSlot = (iSlot + 1) & (m_iSize - 1);
+			++iDistance;
+		}
+		return kNotFound;
+	}
+
+
+	// Insert a key/value pair that is not already in the table
+	void Insert( TSlot slot )
+	{
+		TUInt32 iSlot = m_Hasher( slot.key ) & (m_iSize - 1);
+		slot.distance = 1;
+		while (m_aSlots[iSlot].distance != 0)
+		{
+			// If the key here is nearer its home than the one being inserted, then take its slot
+			// and carry on to find a new place for the key that was here
+			if (m_aSlots[iSlot].distance < slot.distance)
+			{
+				swap( slot, m_aSlots[iSlot] );
+			}
+			iSlot = (iSlot + 1) & (m_iSize - 1);
+			++slot.distance;
+		}
+		m_aSlots[iSlot] = slot;
+		++m_iNumEntries;
+	}
+
+
+	// Resize the hash table - reinserts all keys
+	void Resize( const TUInt32 iNewSize )
+	{
+		GEN_GUARD;
+
+		// Store old slots and size
+		TUInt32 iOldSize = m_iSize;
+		TSlot* aOldSlots = m_aSlots;
+
+		// Update size and create new set of (empty) slots
+		m_iSize = iNewSize;
+		m_aSlots = new TSlot[m_iSize];
+		GEN_ASSERT( m_aSlots, "Fatal memory error reserving hash table memory" );
+
+		// Insert each key/value pair from the old slots
+		m_iNumEntries = 0;
+		for (TUInt32 iSlot = 0; iSlot < iOldSize; ++iSlot)
+		{
+			if (aOldSlots[iSlot].distance)
+			{
+				Insert( aOldSlots[iSlot] );
+			}
+		}
+
+		delete[] aOldSlots;
+
+		GEN_ENDGUARD;
+	}
+
+
+	/*---------------------------------------------------------------------------------------------
+		Data
+	---------------------------------------------------------------------------------------------*/
+
+	TSlot*  m_aSlots;      // Dynamically allocated array of slots
+	TUInt32 m_iSize;       // Size (capacity) of the table - number of slots, a power of 2
+	TUInt32 m_iNumEntries; // Number of key/value pairs in the table
+
+	// Hash function object to use - inlined into the functions above
+	THasher m_Hasher;
+
+	// If table becomes too full, then it is increased in size to keep keys near their home
+	// slots. The max load factor defines how full it needs to be before this happens. In this
+	// implementation, the table is never decreased in size
+	const TFloat32 m_kfMaxLoadFactor;
+};
+
+
+} // namespace gen
+
+#endif // GEN_C_FLAT_HASH_TABLE_H_INCLUDED
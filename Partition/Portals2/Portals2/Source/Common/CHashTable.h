@@ -46,6 +46,10 @@ TUInt32 AddUpHash( const TUInt8* pKey, const TUInt32 iKeyLen );
 // distribution of indexes (few collisions)
 TUInt32 JOneAtATimeHash( const TUInt8* pKey, const TUInt32 iKeyLen );
 
+// Hashes the key 8 bytes at a time with 64-bit multiplies (see WordHash64 in Hashers.h). Faster
+// than one-at-a-time for keys longer than a few bytes, with at least as good a distribution
+TUInt32 WordAtATimeHash( const TUInt8* pKey, const TUInt32 iKeyLen );
+
 
 /*---------------------------------------------------------------------------------------------
 	CHashTable class
@@ -225,6 +229,13 @@ public:
 	void OutputDistribution() const
 	{
 		cout << "Hash Table Distribution:" << endl << endl;
+
+		// The statistics below are relative to the number of entries, so mean nothing when empty
+		if (m_iNumEntries == 0)
+		{
+			cout << "No entries in " << m_iSize << " buckets" << endl << endl;
+			return;
+		}
 		
 		// Calculate the average size of those buckets that contain keys. This gives an idea of the
 		// efficiency to look up a key
@@ -255,6 +266,20 @@ public:
 		cout << endl << "% used buckets: " << 100.0f * static_cast<float>(iUsedBuckets) / m_iSize;
 		cout << endl << "Average (used) bucket size: " 
 		     << static_cast<float>(iAverageBucketSize) / iUsedBuckets << endl;
+
+		// Chi-squared test of the bucket sizes against a uniform distribution, scaled so a good
+		// hash function scores around 0 (within about +/-3). Large positive values mean keys are
+		// clumped into some buckets
+		float fExpected = static_cast<float>(m_iNumEntries) / m_iSize;
+		float fChiSquared = 0.0f;
+		for (iBucket = 0; iBucket < m_iSize; ++iBucket)
+		{
+			float fDifference = static_cast<float>(m_aBuckets[iBucket].size()) - fExpected;
+			fChiSquared += fDifference * fDifference;
+		}
+		fChiSquared /= fExpected;
+		cout << "Chi-squared score: " << (fChiSquared - (m_iSize - 1)) / sqrt( 2.0f * (m_iSize - 1) )
+		     << endl;
 		cout << endl;
 	}
 
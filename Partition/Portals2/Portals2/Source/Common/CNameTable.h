@@ -0,0 +1,112 @@
+/**************************************************************************************************
+	Module:       CNameTable.h
+
+	String interning table. Each distinct string added to the table is given a 32-bit ID, and the
+	same string always gets the same ID for the lifetime of the table. Names can then be stored
+	and compared as IDs - the string itself is only needed when the name is first added or when
+	it is displayed
+**************************************************************************************************/
+
+#ifndef GEN_C_NAME_TABLE_H_INCLUDED
+#define GEN_C_NAME_TABLE_H_INCLUDED
+
+#include <string>
+#include <deque>
+using namespace std;
+
+#include "Defines.h"
+#include "CFlatHashTable.h"
+
+namespace gen
+{
+
+/*---------------------------------------------------------------------------------------------
+	Types
+---------------------------------------------------------------------------------------------*/
+
+// A name ID is a 32-bit index into a name table
+typedef TUInt32 TNameID;
+
+// ID of the empty string in every name table, used for "no name" or to match any name
+const TNameID kNoName = 0;
+
+// Returned by CNameTable::FindID for strings that have never been added to the table
+const TNameID kUnknownName = 0xffffffff;
+
+
+/*---------------------------------------------------------------------------------------------
+	CNameTable class
+---------------------------------------------------------------------------------------------*/
+
+class CNameTable
+{
+
+/*---------------------------------------------------------------------------------------------
+	Constructors / Destructors
+---------------------------------------------------------------------------------------------*/
+public:
+	// Constructor takes initial size of the string to ID hash table. The empty string is always
+	// given the ID kNoName
+	CNameTable( const TUInt32 iInitialSize = 256 ) : m_IDs( iInitialSize )
+	{
+		m_Strings.push_back( string() );
+		m_IDs.SetKeyValue( m_Strings.back(), kNoName );
+	}
+
+private:
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CNameTable( const CNameTable& );
+	CNameTable& operator=( const CNameTable& );
+
+
+/*---------------------------------------------------------------------------------------------
+	Public interface
+---------------------------------------------------------------------------------------------*/
+public:
+	// Return the ID for the given string, adding it to the table if it is new
+	TNameID GetID( const string& name )
+	{
+		TNameID id;
+		if (!m_IDs.LookUpKey( name, &id ))
+		{
+			id = static_cast<TNameID>(m_Strings.size());
+			m_Strings.push_back( name );
+			m_IDs.SetKeyValue( name, id );
+		}
+		return id;
+	}
+
+	// Return the ID for the given string without adding it. Returns kUnknownName if the string
+	// is not in the table - so no stored name can be equal to it
+	TNameID FindID( const string& name ) const
+	{
+		TNameID id;
+		return m_IDs.LookUpKey( name, &id ) ? id : kUnknownName;
+	}
+
+	// Return the string for the given ID. The reference remains valid for the lifetime of the
+	// table, names are held in a deque so adding names does not move existing ones
+	const string& GetString( const TNameID id ) const
+	{
+		return m_Strings[id];
+	}
+
+	// Return the number of names in the table (including the empty string)
+	TUInt32 GetNumNames() const
+	{
+		return static_cast<TUInt32>(m_Strings.size());
+	}
+
+
+/*---------------------------------------------------------------------------------------------
+	Data
+---------------------------------------------------------------------------------------------*/
+private:
+	CFlatHashTable<string, TNameID> m_IDs;     // String to ID
+	deque<string>                   m_Strings; // ID to string
+};
+
+
+} // namespace gen
+
+#endif // GEN_C_NAME_TABLE_H_INCLUDED
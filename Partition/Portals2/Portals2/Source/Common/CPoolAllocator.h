@@ -0,0 +1,280 @@
+/**************************************************************************************************
+	Module:       CPoolAllocator.h
+
+	Fixed-size pool allocator for objects of a single type. Memory is reserved in chunks holding
+	many objects and freed objects are kept on a free list for reuse, so allocating and freeing
+	take a few instructions with no calls to the general heap, and objects of the same type are
+	kept close together in memory.
+
+	A class uses a pool by putting GEN_POOL_ALLOCATED in its declaration (see end of file), which
+	gives it class-specific operator new and delete. Objects are then created and destroyed with
+	new and delete as usual.
+
+	In debug builds, freeing an object twice (or one that is not from the pool) is a fatal error,
+	and objects still allocated when the pool is destroyed are reported as leaks
+**************************************************************************************************/
+
+#ifndef GEN_C_POOL_ALLOCATOR_H_INCLUDED
+#define GEN_C_POOL_ALLOCATOR_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <type_traits>
+using namespace std;
+
+#include "Defines.h"
+#include "Error.h"
+#include "Utility.h"
+
+namespace gen
+{
+
+/*---------------------------------------------------------------------------------------------
+	Types
+---------------------------------------------------------------------------------------------*/
+
+// Allocation counters for a pool, e.g. for display in a profiler
+struct SPoolStats
+{
+	TUInt32 iNumAllocations; // Total objects allocated
+	TUInt32 iNumFrees;       // Total objects freed individually (not including Reset)
+	TUInt32 iNumLive;        // Objects currently allocated
+	TUInt32 iPeakLive;       // Highest number of objects allocated at once
+	TUInt32 iNumChunks;      // Number of chunks reserved
+	TUInt32 iChunkSize;      // Objects per chunk
+};
+
+
+/*---------------------------------------------------------------------------------------------
+	CPoolAllocator class
+---------------------------------------------------------------------------------------------*/
+
+// Template class with the type of object allocated. The pool only provides memory, objects are
+// constructed and destroyed by the caller (done by new and delete with GEN_POOL_ALLOCATED)
+template <class TObject>
+class CPoolAllocator
+{
+
+/*---------------------------------------------------------------------------------------------
+	Constructors / Destructors
+---------------------------------------------------------------------------------------------*/
+public:
+	// Constructor takes a name for reports and the number of objects per chunk of memory. No
+	// memory is reserved until the first allocation
+	CPoolAllocator
+	(
+		const string&  sName,
+		const TUInt32  iChunkSize = 256
+	) : m_sName( sName ), m_pFirstFree( 0 )
+	{
+		m_Stats.iNumAllocations = 0;
+		m_Stats.iNumFrees = 0;
+		m_Stats.iNumLive = 0;
+		m_Stats.iPeakLive = 0;
+		m_Stats.iNumChunks = 0;
+		m_Stats.iChunkSize = iChunkSize;
+	}
+
+private:
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CPoolAllocator( const CPoolAllocator& );
+	CPoolAllocator& operator=( const CPoolAllocator& );
+
+public:
+	// Destructor frees all chunks. Any objects still allocated are lost - reported in debug
+	~CPoolAllocator()
+	{
+	#ifdef _DEBUG
+		if (m_Stats.iNumLive > 0)
+		{
+			try
+			{
+				SystemMessageBox( ToString( m_Stats.iNumLive ) + " " + m_sName +
+				                  " object(s) not freed", "Memory leak", false );
+			}
+			catch (...) {} // Can't throw from destructor
+		}
+	#endif
+		for (TUInt32 iChunk = 0; iChunk < m_Chunks.size(); ++iChunk)
+		{
+			delete[] m_Chunks[iChunk];
+		}
+	}
+
+
+/*---------------------------------------------------------------------------------------------
+	Public interface
+---------------------------------------------------------------------------------------------*/
+public:
+	// Return memory for one object, reserving a new chunk if there are no free objects
+	void* Allocate()
+	{
+		if (!m_pFirstFree)
+		{
+			AddChunk();
+		}
+		SNode* pNode = m_pFirstFree;
+		m_pFirstFree = pNode->pNextFree;
+
+	#ifdef _DEBUG
+		pNode->iState = kAllocated;
+	#endif
+		++m_Stats.iNumAllocations;
+		if (++m_Stats.iNumLive > m_Stats.iPeakLive)
+		{
+			m_Stats.iPeakLive = m_Stats.iNumLive;
+		}
+		return &pNode->object;
+	}
+
+	// Return the memory for an object to the pool. The object must already be destroyed
+	void Free( void* pObject )
+	{
+		SNode* pNode = reinterpret_cast<SNode*>(pObject);
+
+	#ifdef _DEBUG
+		GEN_ASSERT( OwnsNode( pNode ), "Freeing object not from its pool" );
+		GEN_ASSERT( pNode->iState == kAllocated, "Pool object freed twice" );
+		pNode->iState = kFree;
+	#endif
+		pNode->pNextFree = m_pFirstFree;
+		m_pFirstFree = pNode;
+
+		++m_Stats.iNumFrees;
+		--m_Stats.iNumLive;
+	}
+
+	// Return every object to the pool at once, e.g. at the end of each frame for objects that
+	// only last a frame. Destructors are not called, so only use for objects that have already
+	// been destroyed, or whose destructors do nothing needed. Chunks are kept for reuse
+	void Reset()
+	{
+		m_pFirstFree = 0;
+		for (TUInt32 iChunk = static_cast<TUInt32>(m_Chunks.size()); iChunk-- > 0; )
+		{
+			LinkChunk( m_Chunks[iChunk] );
+		}
+		m_Stats.iNumLive = 0;
+	}
+
+
+	/////////////////////////////////////
+	//	Getters
+
+	const string& GetName() const
+	{
+		return m_sName;
+	}
+
+	const SPoolStats& GetStats() const
+	{
+		return m_Stats;
+	}
+
+
+/*---------------------------------------------------------------------------------------------
+	Private interface
+---------------------------------------------------------------------------------------------*/
+private:
+
+	/*---------------------------------------------------------------------------------------------
+		Types
+	---------------------------------------------------------------------------------------------*/
+
+	// Memory for one object. While the object is free the memory holds the free list link
+	struct SNode
+	{
+		union
+		{
+			typename aligned_storage<sizeof(TObject), alignment_of<TObject>::value>::type object;
+			SNode* pNextFree;
+		};
+	#ifdef _DEBUG
+		TUInt32 iState; // kAllocated or kFree
+	#endif
+	};
+
+	static const TUInt32 kFree = 0xfee1f00d;
+	static const TUInt32 kAllocated = 0xa110c8ed;
+
+
+	/*---------------------------------------------------------------------------------------------
+		Support functions
+	---------------------------------------------------------------------------------------------*/
+
+	// Reserve a new chunk and put its objects on the free list
+	void AddChunk()
+	{
+		SNode* pChunk = new SNode[m_Stats.iChunkSize];
+		GEN_ASSERT( pChunk, "Fatal memory error reserving pool memory" );
+		m_Chunks.push_back( pChunk );
+		++m_Stats.iNumChunks;
+		LinkChunk( pChunk );
+	}
+
+	// Put the objects in a chunk at the front of the free list, in address order so objects
+	// allocated one after another are next to each other
+	void LinkChunk( SNode* pChunk )
+	{
+		for (TUInt32 iNode = m_Stats.iChunkSize; iNode-- > 0; )
+		{
+		#ifdef _DEBUG
+			pChunk[iNode].iState = kFree;
+		#endif
+			pChunk[iNode].pNextFree = m_pFirstFree;
+			m_pFirstFree = &pChunk[iNode];
+		}
+	}
+
+	// Return true if the given node is in one of this pool's chunks (debug checks only)
+	bool OwnsNode( const SNode* pNode ) const
+	{
+		for (TUInt32 iChunk = 0; iChunk < m_Chunks.size(); ++iChunk)
+		{
+			if (pNode >= m_Chunks[iChunk] && pNode < m_Chunks[iChunk] + m_Stats.iChunkSize)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+
+	/*---------------------------------------------------------------------------------------------
+		Data
+	---------------------------------------------------------------------------------------------*/
+
+	string         m_sName;      // Name used in reports
+	vector<SNode*> m_Chunks;     // Dynamically allocated arrays of m_Stats.iChunkSize nodes
+	SNode*         m_pFirstFree; // Start of free list, linked through SNode::pNextFree
+	SPoolStats     m_Stats;
+};
+
+
+/*---------------------------------------------------------------------------------------------
+	Pool allocated classes
+---------------------------------------------------------------------------------------------*/
+
+// Put in the declaration of a class to allocate its objects from a pool with new and delete.
+// Pool() returns the pool, e.g. to read its stats. A derived class without its own pool has a
+// different size and uses the general heap. Leaves following declarations public
+#define GEN_POOL_ALLOCATED( TClass )\
+public:\
+	static gen::CPoolAllocator<TClass>& Pool()\
+	{\
+		static gen::CPoolAllocator<TClass> pool( #TClass );\
+		return pool;\
+	}\
+	static void* operator new( size_t size )\
+	{\
+		return (size == sizeof(TClass)) ? Pool().Allocate() : ::operator new( size );\
+	}\
+	static void operator delete( void* pObject, size_t size )\
+	{\
+		if (size == sizeof(TClass)) Pool().Free( pObject ); else ::operator delete( pObject );\
+	}
+
+
+} // namespace gen
+
+#endif // GEN_C_POOL_ALLOCATOR_H_INCLUDED
@@ -0,0 +1,249 @@
+/**************************************************************************************************
+	Module:       Hashers.h
+
+	Typed hashing function objects for hash tables. Unlike the THashFunction pointers used by
+	CHashTable, each key type gets its own hasher chosen at compile time, so the hash is inlined
+	into the table code and can use the key's type (e.g. integers are mixed as whole words rather
+	than one byte at a time)
+**************************************************************************************************/
+
+#ifndef GEN_HASHERS_H_INCLUDED
+#define GEN_HASHERS_H_INCLUDED
+
+#include <string>
+#include <cstring>
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+using namespace std;
+
+#include "Defines.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Mixing functions
+ ------------------------------------------------------------------------------------------------*/
+
+// Finalising mix from MurmurHash3 - every bit of the input affects every bit of the result. Good
+// for integer keys that are often sequential (e.g. UIDs), which would otherwise all fall in
+// neighbouring table slots
+inline TUInt32 MixHash32( TUInt32 iKey )
+{
+	iKey ^= iKey >> 16;
+	iKey *= 0x85ebca6b;
+	iKey ^= iKey >> 13;
+	iKey *= 0xc2b2ae35;
+	iKey ^= iKey >> 16;
+	return iKey;
+}
+
+// 64-bit version of the above, folded to a 32-bit hash
+inline TUInt32 MixHash64( TUInt64 iKey )
+{
+	iKey ^= iKey >> 33;
+	iKey *= 0xff51afd7ed558ccdULL;
+	iKey ^= iKey >> 33;
+	iKey *= 0xc4ceb9fe1a85ec53ULL;
+	iKey ^= iKey >> 33;
+	return static_cast<TUInt32>(iKey);
+}
+
+// Full 64 x 64 -> 128-bit multiply, returning the high and low halves of the product XORed
+// together. Every bit of the result depends on every bit of both inputs. Uses the 128-bit
+// multiply instruction on 64-bit targets, or is built from 32-bit multiplies otherwise
+inline TUInt64 MultiplyFold64( TUInt64 a, TUInt64 b )
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	TUInt64 productHigh;
+	TUInt64 productLow = _umul128( a, b, &productHigh );
+	return productLow ^ productHigh;
+#elif defined(__SIZEOF_INT128__)
+	unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+	return static_cast<TUInt64>(product) ^ static_cast<TUInt64>(product >> 64);
+#else
+	TUInt64 aLow = a & 0xffffffff, aHigh = a >> 32;
+	TUInt64 bLow = b & 0xffffffff, bHigh = b >> 32;
+	TUInt64 lowLow = aLow * bLow;
+	TUInt64 lowHigh = aLow * bHigh;
+	TUInt64 highLow = aHigh * bLow;
+	TUInt64 highHigh = aHigh * bHigh;
+	TUInt64 middle = (lowLow >> 32) + (lowHigh & 0xffffffff) + (highLow & 0xffffffff);
+	TUInt64 productLow = (middle << 32) | (lowLow & 0xffffffff);
+	TUInt64 productHigh = highHigh + (lowHigh >> 32) + (highLow >> 32) + (middle >> 32);
+	return productLow ^ productHigh;
+#endif
+}
+
+// Multiply-mix hash for integer keys up to 64 bits, in the style of wyhash: two rounds of wide
+// multiply and fold with constant offsets (so a zero key mixes too), folded to 32 bits. One round
+// leaves some key bits with little effect on the low hash bits, as the avalanche test shows
+inline TUInt32 MultiplyMixHash64( TUInt64 iKey )
+{
+	TUInt64 iHash = MultiplyFold64( iKey ^ 0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL );
+	iHash = MultiplyFold64( iHash ^ 0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL );
+	return static_cast<TUInt32>(iHash ^ (iHash >> 32));
+}
+
+// Hash a sequence of bytes 8 at a time. Each 8-byte word is mixed into the hash with a multiply,
+// the last 1 to 7 bytes are read into a final word, and the result is finished with the full
+// 64-bit mix. Several times faster than one byte at a time for keys longer than a few bytes
+inline TUInt32 WordHash64( const TUInt8* pData, const TUInt32 iLength )
+{
+	const TUInt64 kMultiplier = 0x9e3779b97f4a7c15ULL;
+	TUInt64 iHash = iLength * kMultiplier;
+	TUInt32 iByte = 0;
+	for (; iByte + 8 <= iLength; iByte += 8)
+	{
+		TUInt64 iWord;
+		memcpy( &iWord, pData + iByte, 8 ); // Unaligned read, compiles to a single load
+		iHash = (iHash ^ iWord) * kMultiplier;
+		iHash ^= iHash >> 32;
+	}
+	// Read the last 1 to 7 bytes without a byte loop: if the key is at least 8 bytes long, read
+	// its last 8 bytes and shift off those already hashed (x86 is little-endian), otherwise read
+	// two overlapping 4-byte words or pick out three bytes that between them cover the rest
+	TUInt32 iRemaining = iLength - iByte;
+	if (iRemaining > 0)
+	{
+		TUInt64 iWord;
+		if (iLength >= 8)
+		{
+			memcpy( &iWord, pData + iLength - 8, 8 );
+			iWord >>= 64 - 8 * iRemaining;
+		}
+		else if (iRemaining >= 4)
+		{
+			TUInt32 iFirst, iLast;
+			memcpy( &iFirst, pData, 4 );
+			memcpy( &iLast, pData + iRemaining - 4, 4 );
+			iWord = iFirst | (static_cast<TUInt64>(iLast) << 32);
+		}
+		else
+		{
+			iWord = pData[0] | (pData[iRemaining / 2] << 8) | (pData[iRemaining - 1] << 16);
+		}
+		iHash = (iHash ^ iWord) * kMultiplier;
+	}
+	return MixHash64( iHash );
+}
+
+
+/*------------------------------------------------------------------------------------------------
+	Hashers
+ ------------------------------------------------------------------------------------------------*/
+
+// Default hasher treats the key as a sequence of raw bytes (Jenkins one-at-a-time hash). As with
+// CHashTable, keys hashed this way must not contain pointers or padding. Specialisations below
+// provide faster hashers for common key types
+template <class TKeyType>
+struct CHasher
+{
+	TUInt32 operator()( const TKeyType& key ) const
+	{
+		const TUInt8* pKeyData = reinterpret_cast<const TUInt8*>(&key);
+		TUInt32 iHash = 0;
+		for (TUInt32 iKeyIndex = 0; iKeyIndex < sizeof(TKeyType); ++iKeyIndex)
+		{
+			iHash += pKeyData[iKeyIndex];
+			iHash += (iHash << 10);
+			iHash ^= (iHash >> 6);
+		}
+		iHash += (iHash << 3);
+		iHash ^= (iHash >> 11);
+		iHash += (iHash << 15);
+		return iHash;
+	}
+};
+
+// Integer keys
+template <>
+struct CHasher<TUInt32>
+{
+	TUInt32 operator()( const TUInt32 key ) const
+	{
+		return MixHash32( key );
+	}
+};
+
+template <>
+struct CHasher<TInt32>
+{
+	TUInt32 operator()( const TInt32 key ) const
+	{
+		return MixHash32( static_cast<TUInt32>(key) );
+	}
+};
+
+template <>
+struct CHasher<TUInt64>
+{
+	TUInt32 operator()( const TUInt64 key ) const
+	{
+		return MixHash64( key );
+	}
+};
+
+template <>
+struct CHasher<TInt64>
+{
+	TUInt32 operator()( const TInt64 key ) const
+	{
+		return MixHash64( static_cast<TUInt64>(key) );
+	}
+};
+
+// String keys - hashes the characters, not the string object, 8 at a time (see WordHash64). The
+// HashFunctionBenchmark shows it faster than FNV-1a on short entity names and long strings, and
+// free of FNV-1a's bias - its multiply only carries upwards, so the low hash bits that pick the
+// bucket never see the high bits of the last character
+template <>
+struct CHasher<string>
+{
+	TUInt32 operator()( const string& key ) const
+	{
+		return WordHash64( reinterpret_cast<const TUInt8*>(key.data()),
+		                   static_cast<TUInt32>(key.length()) );
+	}
+};
+
+
+/*------------------------------------------------------------------------------------------------
+	Alternative hashers
+ ------------------------------------------------------------------------------------------------*/
+
+// These can be passed as the hasher parameter of a table in place of the defaults above. See
+// the HashFunctionBenchmark project for a comparison of speed and distribution
+
+// Multiply-mix hasher for integer keys up to 64 bits (see MultiplyMixHash64)
+template <class TKeyType>
+struct CMultiplyMixHasher
+{
+	TUInt32 operator()( const TKeyType key ) const
+	{
+		return MultiplyMixHash64( static_cast<TUInt64>(key) );
+	}
+};
+
+// Hashes the raw bytes of the key 8 at a time (see WordHash64). As with the default hasher, the
+// key must not contain pointers or padding
+template <class TKeyType>
+struct CWordHasher
+{
+	TUInt32 operator()( const TKeyType& key ) const
+	{
+		return WordHash64( reinterpret_cast<const TUInt8*>(&key), sizeof(TKeyType) );
+	}
+};
+
+// String keys - the default string hasher already hashes 8 characters at a time
+template <>
+struct CWordHasher<string> : public CHasher<string>
+{
+};
+
+
+} // namespace gen
+
+#endif // GEN_HASHERS_H_INCLUDED
@@ -8,20 +8,28 @@
 #include <list>
 #include <sstream>
 #include <string>
+#include <algorithm>
 using namespace std;
 
 #include <d3dx9.h>
 
 #include "Defines.h"
+#include "CTimer.h"
+#include "CThreadPool.h"
+#include "CPoolAllocator.h"
 #include "CVector3.h"
 #include "CVector4.h"
 #include "CMatrix4x4.h"
 #include "MathDX.h"
 #include "RenderMethod.h"
 #include "Mesh.h"
+#include "OcclusionBuffer.h"
+#include "RenderQueue.h"
 #include "Camera.h"
 #include "Light.h"
 #include "EntityManager.h"
+#include "SceneSnapshot.h"
+#include "CellPortalExtractor.h"
 #include "Portals2.h"
 
 namespace gen
@@ -32,9 +40,12 @@ namespace gen
 //-----------------------------------------------------------------------------
 
 // Fixed array sizes
-const int NumPartitions = 7;
+const int NumHousePartitions = 7; // Partitions expected in the house level (see SceneSetup)
 const int MaxPortals = 5;
+const int MaxPortalDepth = 4; // Deepest level of portals tested through other portals
 const int NumCars = 10;
+const int NumParkedCarsX = 4; // Grid of static cars placed in each room of the house
+const int NumParkedCarsZ = 4;
 const int NumLights = 1;
 
 // Control speed
@@ -69,6 +80,18 @@ CEntityManager EntityManager;
 // List of car UIDs
 TEntityUID Cars[NumCars];
 
+// Return the UID of a random car from the list above. Used by the car behaviour
+TEntityUID RandomCar()
+{
+	return Cars[Random( 0, NumCars - 1 )];
+}
+
+// Checkpoint of the entities, partition membership and cars. Saved to / loaded from the file
+// with F8 / F9, with the time taken by the last save or load
+CSceneSnapshot Checkpoint;
+const string CheckpointFileName = "Media\\Checkpoint.snapshot";
+float CheckpointTime = 0.0f;
+
 // Other scene elements
 SColourRGBA AmbientLight;
 CLight* Lights[NumLights];
@@ -77,6 +100,22 @@ CCamera* MainCamera;
 // Depth of portal recursion, used for stencil buffer work
 int PortalDepth;
 
+// Software occlusion buffer used to cull entities hidden behind large scenery in each partition
+COcclusionBuffer OcclusionBuffer;
+bool UseOcclusionCulling = true;
+
+// Number of entities rendered and culled by the occlusion buffer this frame
+TUInt32 EntitiesRendered;
+TUInt32 EntitiesCulled;
+
+// Render queue used to sort the entities of each partition by render state before drawing
+CRenderQueue RenderQueue;
+bool UseSortedRendering = true;
+
+// Render state changes (shaders + materials) this frame, with and without sorting
+TUInt32 StateChangesUnsorted;
+TUInt32 StateChangesSorted;
+
 
 /********************************
 	Portal Shape Types & Data
@@ -89,6 +128,7 @@ enum EPortalShape
 	Window,
 	Taper,
 	Diamond,
+	Quad,
 	NumPortalShapes // Leave this entry at the end to keep its value correct
 };
 
@@ -112,6 +152,8 @@ TPortalShape PortalShapes[] =
 	  CVector3( 0.3f, 2.1f, 0.0f), CVector3( 0.7f, 0.0f, 0.0f) },
 	{ CVector3( 0.0f, 0.0f, 0.0f), CVector3(-0.6f, 1.05f, 0.0f),    // Diamond portal shape
 	  CVector3( 0.0f, 2.1f, 0.0f), CVector3( 0.6f, 1.05f, 0.0f) },
+	{ CVector3(-0.5f, 0.0f, 0.0f), CVector3(-0.5f, 1.0f, 0.0f),     // Unit quad - scaled by the
+	  CVector3( 0.5f, 1.0f, 0.0f), CVector3( 0.5f, 0.0f, 0.0f) },   // matrix to fit any opening
 };
 
 
@@ -140,6 +182,9 @@ struct SPortal
 	CMatrix4x4 OutMatrix;    // World matrix to position the portal "exit"
 	int        InPartition;  // The partition containing the "entrance"
 	int        OutPartition; // The partition containing the "exit"
+
+	// Portals are allocated from a pool (see CPoolAllocator.h)
+	GEN_POOL_ALLOCATED( SPortal )
 };
 
 // A global list of all the portals in the scene. Define a couple of types to improve readability
@@ -147,6 +192,100 @@ typedef list<SPortal*>        TPortalList;
 typedef TPortalList::iterator TPortalIter;
 TPortalList Portals;
 
+// Count of changes made to the portals (added / moved / removed) - cached portal visibility is
+// recalculated when this changes. Use SetPortalMatrices rather than editing portal matrices
+// directly so the change is counted
+TUInt32 PortalEditCount = 0;
+
+
+/********************************
+	Portal Visibility Types & Data
+********************************/
+
+// Result of testing one side of a portal for visibility. The portals tested when traversing
+// from the camera's partition form a tree, stored as a depth-first list of these records: a
+// visible portal's record is followed by the records for the portals in its target partition
+struct SPortalVisit
+{
+	SPortal* Portal;
+	bool     InPortal;     // Whether the entrance (true) or exit (false) of the portal was tested
+	bool     Visible;      // Whether the target partition is visible through the portal
+	int      NumChildren;  // Number of records following this one that are in its subtree
+
+	// Screen area where the target partition is visible (if visible)
+	int      MinX, MinY, MaxX, MaxY;
+
+	// How close the test was to changing result, in pixels, and the nearest depth (from the
+	// camera) of this portal or any portal before it in the tree. Used to decide if the result
+	// can be reused when the camera moves slightly (see UpdatePortalVisits)
+	float    BoundaryDist;
+	float    MinDepth;
+};
+typedef vector<SPortalVisit> TPortalVisits;
+
+// Visibility cache - the portal visit tree from the last frame is reused while the camera
+// remains in the same partition, position cell and orientation sector
+struct SPortalVisibilityCache
+{
+	bool          Valid;
+	int           Partition;
+	int           Position[3];     // Position cell - camera position divided by cell size
+	int           Orientation[6];  // Orientation sector - camera facing and right axes quantised
+	TUInt32       PortalEditCount; // Portal edit count when the visits were calculated
+};
+bool UsePortalCache = true;
+
+// Size of the camera position cells and orientation sectors used by the cache. Smaller sizes
+// give fewer cache hits but fewer portal tests to repeat on each hit
+const float PortalCachePositionCell = 0.1f;
+const float PortalCacheCellDiagonal = PortalCachePositionCell * 1.7321f;
+const float PortalCacheOrientationSector = 0.02f; // Quantisation of camera axis components
+
+// Boundary distance for portal tests that can't change while the camera stays in its cell
+const float PortalNeverRetest = 1.0e9f;
+
+// Portal visibility statistics
+struct SPortalStats
+{
+	TUInt32 PortalsTested;   // Portal visibility tests this frame
+	TUInt32 PortalsVisible;  // Portals found visible this frame
+	TUInt32 CacheHits;       // Frames that reused cached visibility (total)
+	TUInt32 CacheMisses;     // Frames that recalculated visibility (total)
+	float   TraversalTime;   // Time spent finding visible portals this frame (seconds)
+	float   AverageFullTime; // Average time to find visible portals without the cache (seconds)
+	float   TimeSaved;       // Estimated time saved by cache hits (total, seconds)
+};
+
+// A view of the scene that needs the set of visible portals and partitions, e.g. the main
+// camera, a split-screen player, a light or a mirror. All portal traversal state is held in the
+// view so the visible sets of several views can be found at the same time on different threads
+struct SPortalView
+{
+	CCamera                Camera;            // Camera for the view, set before finding portals
+	int                    Width, Height;     // Viewport size (pixels)
+
+	// Results of FindVisiblePortals
+	int                    Partition;         // Partition containing the camera
+	TPortalVisits          Visits;            // Tree of portals tested (see SPortalVisit)
+	vector<int>            VisiblePartitions; // Camera's partition then those seen through portals
+
+	SPortalVisibilityCache Cache;
+	SPortalStats           Stats;
+};
+
+// Main camera view, plus a view from each car (e.g. for split-screen) to test many views at once
+SPortalView MainView;
+vector<SPortalView> CarViews;
+bool UseCarViews = false;
+
+// Time to find visible portals for all views this frame (seconds), and total partitions visible
+// from the car views
+float PortalViewsTime;
+TUInt32 CarViewsVisiblePartitions;
+
+// Threads used to update entities and to find visible portals for several views in parallel
+CThreadPool* ThreadPool;
+
 
 /********************************
 	Partition Types & Data
@@ -164,24 +303,23 @@ struct SPartition
 	// A vector (dynamic array) of the entities contained in this partition
 	vector<TEntityUID> Entities;
 
+	// World space triangles (three vertices each) of the large static entities in this partition
+	// that may hide other entities. Drawn into the occlusion buffer before rendering the partition
+	vector<CVector3> OccluderTriangles;
+
 	// A list of the portals contained in this partition. Poiinters to portals held in the
 	// main portal list above - each portal is shared between two partitions
 	TPortalList Portals;
 };
 
 
-// Array of partitions - partitions A-G numbered 0-6 here in the code
-// Initialise partition bounds only
-SPartition Partitions[NumPartitions] = 
-{
-	{ -500.0f, 500.0f,   0.0f,  1000.0f,  -500.0f, 500.0f, }, // Partition A (0)
-	{ -2.50f, -0.50f,   -20.0f, 2.55f,    -4.70f, -3.15f, },  // Partition B (1)
-	{ -3.60f,  0.45f,   -20.0f, 3.05f,    -3.15f, -0.05f, },  // Partition C (2)
-	{ -3.60f,  3.55f,   -20.0f, 3.05f,    -0.05f,  4.00f, },  // Partition D (3)
-	{  3.55f,  5.60f,   -20.0f, 3.05f,    -3.10f,  4.00f, },  // Partition E (4)
-	{  0.45f,  3.55f,   -20.0f, 3.05f,    -3.10f, -0.05f, },  // Partition F (5)
-	{ -9.50f, -8.00f,   -20.0f, 2.55f,    -4.00f, -1.00f, },  // Partition G (6)
-};
+// Partitions - partition 0 (A) is the world outside all other partitions. The others are
+// loaded from a file, or extracted from the level geometry (see SetupPartitions). Partitions
+// A-G are numbered 0-6 here in the code for the house level
+vector<SPartition> Partitions;
+
+// File holding the partitions and portals extracted from the house level
+const string PartitionFileName = "Media\\House.portals";
 
 
 //-----------------------------------------------------------------------------
@@ -196,7 +334,7 @@ SPartition Partitions[NumPartitions] =
 int GetPartitionFromPt( CVector3 pt )
 {
 	// Go through each partition except the first...
-	for (int part = 1; part < NumPartitions; ++part)
+	for (int part = 1; part < static_cast<int>(Partitions.size()); ++part)
 	{
 		// Test if point is within bounds of the partition
 		if (pt.x > Partitions[part].MinX && pt.x < Partitions[part].MaxX && 
@@ -212,18 +350,70 @@ int GetPartitionFromPt( CVector3 pt )
 }
 
 
-// Render all the instances in the given partition number with the given camera
-void RenderPartition( int part, CCamera* camera )
+// Add the geometry of the given entity to the occluders of a partition. The mesh triangles are
+// transformed to world space once here, so only static entities should be used as occluders
+void AddPartitionOccluder( int part, TEntityUID uid )
+{
+	CEntity* entity = EntityManager.GetEntity( uid );
+	CMesh* mesh = entity->Template()->Mesh();
+
+	vector<CVector3>& triangles = Partitions[part].OccluderTriangles;
+	triangles.reserve( triangles.size() + mesh->GetNumTriangles() * 3 );
+
+	CVector3 vertex1, vertex2, vertex3;
+	mesh->BeginEnumTriangles();
+	while (mesh->GetTriangle( &vertex1, &vertex2, &vertex3 ))
+	{
+		triangles.push_back( entity->Matrix().TransformPoint( vertex1 ) );
+		triangles.push_back( entity->Matrix().TransformPoint( vertex2 ) );
+		triangles.push_back( entity->Matrix().TransformPoint( vertex3 ) );
+	}
+}
+
+
+// Render all the instances in the given partition number with the given camera. If occlusion
+// culling is on, the partition's occluders are first drawn into the occlusion buffer and any
+// entity whose bounding box is hidden is skipped. When rendering through a portal, pass the clip
+// plane in use (in clip space) so that occluders removed by the plane are ignored
+void RenderPartition( int part, CCamera* camera, const CVector4* clipPlane = 0 )
 {
-	// Step through entity vector, rendering each one
+	CMatrix4x4 viewProjMatrix = camera->GetViewProjMatrix();
+	bool cullEntities = UseOcclusionCulling && !Partitions[part].OccluderTriangles.empty();
+	if (cullEntities)
+	{
+		vector<CVector3>& occluders = Partitions[part].OccluderTriangles;
+		OcclusionBuffer.Clear();
+		OcclusionBuffer.RenderOccluders( &occluders[0], static_cast<TUInt32>(occluders.size() / 3),
+		                                 CMatrix4x4::kIdentity, viewProjMatrix, clipPlane );
+	}
+
+	// Step through entity vector, queuing each one that isn't hidden
+	RenderQueue.Begin( camera );
 	vector<TEntityUID>::iterator itEntity;
 	itEntity = Partitions[part].Entities.begin();
 	while (itEntity != Partitions[part].Entities.end())
 	{
-		EntityManager.GetEntity( *itEntity )->Render( camera );
+		CEntity* entity = EntityManager.GetEntity( *itEntity );
+		CMesh* mesh = entity->Template()->Mesh();
+		if (cullEntities && !OcclusionBuffer.IsBoxVisible( mesh->MinBounds(), mesh->MaxBounds(),
+		                                                   entity->Matrix(), viewProjMatrix ))
+		{
+			++EntitiesCulled;
+		}
+		else
+		{
+			entity->Render( &RenderQueue );
+			++EntitiesRendered;
+		}
 		++itEntity;
 	}
 
+	// Draw the queued entities, sorted by render state if required
+	RenderQueue.Submit( UseSortedRendering );
+	const CRenderQueue::SStats& queueStats = RenderQueue.GetStats();
+	StateChangesUnsorted += queueStats.MethodChangesUnsorted + queueStats.MaterialChangesUnsorted;
+	StateChangesSorted += queueStats.MethodChangesSorted + queueStats.MaterialChangesSorted;
+
 	// Mark partition as rendered
 	Partitions[part].Rendered = true;
 }
@@ -312,160 +502,446 @@ void PostRenderPortalShape( int shape, CMatrix4x4 matrix, CCamera* camera )
 }
 
 
-// Prototype function below for mutual recursion (functions that call each other)
-void RenderPortals( int part, CCamera* camera, int minX, int minY, int maxX, int maxY );
-
-// Check visiblity of a portal (specify entrance or exit side). If it is visible in the given
-// screen area and camera, then render the appropriate target partition and all the portals
-// within it. Will apply a transform to the camera before rendering the target partition
-// allowing the portal to have its entrance and exit in different places.
-// Doesn't deal with portals clipped at the near plane => errors when very close to portals
-void RenderPortal( TPortalIter itPortal, bool renderInPortal, 
-                   CCamera* camera, int minX, int minY, int maxX, int maxY )
+// Get the matrix for the given side of a portal, the transform to apply to a camera looking
+// through that side, and the partition seen through it
+void GetPortalSide( SPortal* portal, bool inPortal,
+                    CMatrix4x4* matrix, CMatrix4x4* transform, int* targetPartition )
 {
-	// Different set-up depending on whether rendering entrance or exit portal
-	CMatrix4x4 matrix;
-	CMatrix4x4 transform;
-	int targetPartition;
-	if (renderInPortal)
+	if (inPortal)
 	{
 		// Matrix for portal
-		matrix = (*itPortal)->InMatrix;
+		*matrix = portal->InMatrix;
 
 		// Matrix to transfrom camera when looking through portal
-		transform = InverseAffine( (*itPortal)->InMatrix ) * (*itPortal)->OutMatrix;
+		*transform = InverseAffine( portal->InMatrix ) * portal->OutMatrix;
 
 		// Partition on other side of portal
-		targetPartition = (*itPortal)->OutPartition;
+		*targetPartition = portal->OutPartition;
 	}
 	else
 	{
 		// Similar for reverse direction
-		matrix = (*itPortal)->OutMatrix;
-		transform = InverseAffine( (*itPortal)->OutMatrix ) * (*itPortal)->InMatrix;
-		targetPartition = (*itPortal)->InPartition;
+		*matrix = portal->OutMatrix;
+		*transform = InverseAffine( portal->OutMatrix ) * portal->InMatrix;
+		*targetPartition = portal->InPartition;
 	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Portal Visibility
+//-----------------------------------------------------------------------------
+
+// Portal traversal is re-entrant: the camera passed to these functions is never changed (cameras
+// looking through portals are copies) and all results and statistics are written to the view
+
+// Check visibility of one side of a portal (set in the visit record) with the given camera
+// within the given screen area of a view. Fills in the rest of the visit record: whether the
+// portal is visible, the screen area visible through it and how close the test was to changing
+// result. Pass the nearest portal depth of the portals already passed through (or the far clip)
+// Doesn't deal with portals clipped at the near plane => errors when very close to portals
+bool TestPortalVisibility( SPortalView* view, SPortalVisit* visit, CCamera* camera,
+                           int minX, int minY, int maxX, int maxY, float pathMinDepth )
+{
+	++view->Stats.PortalsTested;
+	visit->Visible = false;
+	visit->NumChildren = 0;
+	visit->MinDepth = pathMinDepth;
+	visit->BoundaryDist = 0.0f;
 
 	// Get world space polygon for the portal
-	// Need to transform the portal's shape by the portal's world matrix
+	CMatrix4x4 matrix, transform;
+	int targetPartition;
+	GetPortalSide( visit->Portal, visit->InPortal, &matrix, &transform, &targetPartition );
 	TPortalShape portalPoly;
-	TransformPortalShape( (*itPortal)->Shape, matrix, portalPoly );
+	TransformPortalShape( visit->Portal->Shape, matrix, portalPoly );
 
-	// Get vector from portal to camera and facing vector of portal
+	// Only consider portal if it is facing the camera. The result can only change if the camera
+	// can cross the portal plane without leaving its cache cell
 	CVector3 portalCamera = camera->Position() - portalPoly[0];
 	CVector3 portalFacing = GetPortalPolyNormal( portalPoly );
-	
-	// Only consider portal if it is facing the camera
-	if ((renderInPortal && Dot( portalCamera, portalFacing ) > 0.0f) ||
-		(!renderInPortal && Dot( portalCamera, portalFacing ) < 0.0f))
-	{
-		// Convert each portal point to screen coords, keep track of min and max coords
-		int portalMinX = ViewportWidth, portalMaxX = -1; // Set initial off-screen values so
-		int portalMinY = ViewportHeight, portalMaxY = -1;// portal fails if no pts on screen
-		for (int pt = 0; pt < 4; ++pt)
+	float planeDist = Dot( portalCamera, portalFacing );
+	if (!visit->InPortal) planeDist = -planeDist;
+	bool nearPlane = Abs( planeDist ) < PortalCacheCellDiagonal;
+	if (planeDist <= 0.0f)
+	{
+		visit->BoundaryDist = nearPlane ? 0.0f : PortalNeverRetest;
+		return false;
+	}
+
+	// Convert each portal point to screen coords, keep track of min and max coords and the
+	// nearest point depth
+	CMatrix4x4 viewMatrix = camera->GetViewMatrix();
+	int portalMinX = view->Width, portalMaxX = -1; // Set initial off-screen values so
+	int portalMinY = view->Height, portalMaxY = -1;// portal fails if no pts on screen
+	bool allPointsOnScreen = true;
+	for (int pt = 0; pt < 4; ++pt)
+	{
+		// Convert portal coordinate to screen pt - if possible
+		int x, y;
+		if (camera->PixelFromWorldPt( portalPoly[pt], view->Width, view->Height, &x, &y ))
 		{
-			// Convert portal coordinate to screen pt - if possible
-			int x, y;
-			if (camera->PixelFromWorldPt( portalPoly[pt], ViewportWidth, ViewportHeight, &x, &y ))
-			{
-				// Test portal screen point against current min/max
-				portalMinX = Min( x, portalMinX );
-				portalMinY = Min( y, portalMinY );
-				portalMaxX = Max( x, portalMaxX );
-				portalMaxY = Max( y, portalMaxY );
-			}
+			// Test portal screen point against current min/max
+			portalMinX = Min( x, portalMinX );
+			portalMinY = Min( y, portalMinY );
+			portalMaxX = Max( x, portalMaxX );
+			portalMaxY = Max( y, portalMaxY );
+			visit->MinDepth = Min( visit->MinDepth, viewMatrix.TransformPoint( portalPoly[pt] ).z );
 		}
-
-		// Min and max coordinates form a screen bounding rectangle for the current
-		// portal - see if it intersects with the screen area passed to the function
-		if (portalMaxX > minX && portalMinX < maxX && portalMaxY > minY && portalMinY < maxY)
+		else
 		{
-			// The portal can be seen. Calculate the screen area where it is visible - the
-			// intersection of the portal rectangle and the screen area being tested
-			int newMinX = Max( minX, portalMinX );
-			int newMaxX = Min( maxX, portalMaxX );
-			int newMinY = Max( minY, portalMinY );
-			int newMaxY = Min( maxY, portalMaxY );
-
-			// Test target partition of portal
-			if (1)//!Partitions[targetPartition].Rendered)
-			{
-				// Prepare stencil/z-buffer in portal area
-				PreRenderPortalShape( (*itPortal)->Shape, matrix, camera );
-
-				// Prepare a custom clipping plane for the portal, this prevents geometry *nearer*
-				// than the portal being visible through it (similar to stencil mirror issue).
-				// Can only occur on a portal with the entrance & exit in different places
-				D3DXPLANE portalPlane, clipPlane;
-				D3DXPlaneFromPoints( &portalPlane, ToD3DXVECTORPtr(&portalPoly[0]),
-				                     ToD3DXVECTORPtr(&portalPoly[renderInPortal?2:1]),
-				                     ToD3DXVECTORPtr(&portalPoly[renderInPortal?1:2]) );
-				D3DXMATRIXA16 planeViewProjMatrix = // Extra step needed as per D3DXPlaneTransform documentation...
-					ToD3DXMATRIX(Transpose( Inverse( camera->GetViewProjMatrix() ) ));
-				D3DXPlaneTransform( &clipPlane, &portalPlane, &planeViewProjMatrix );
-				g_pd3dDevice->SetRenderState( D3DRS_CLIPPLANEENABLE, D3DCLIPPLANE0 );
-				g_pd3dDevice->SetClipPlane( 0, (float*)&clipPlane );
-
-				// Transform camera to new position in target partition
-				CMatrix4x4 prevCameraMatrix = camera->Matrix();
-				camera->Matrix() *= transform;
-				camera->CalculateMatrices();
-
-				// Render the new partition
-				RenderPartition( targetPartition, camera );
-
-				// Render all portals of new partition if visible in the new screen area
-				// (Calls function below, not this one)
-				RenderPortals( targetPartition, camera, newMinX, newMinY, newMaxX, newMaxY );
-
-				// Reset camera to previous position (source partition)
-				camera->Matrix() = prevCameraMatrix;
-				camera->CalculateMatrices();
-
-				// Switch off the custom clip plane
-				g_pd3dDevice->SetRenderState( D3DRS_CLIPPLANEENABLE, 0 );
-
-				// Reset stencil buffer in portal area
-				PostRenderPortalShape( (*itPortal)->Shape, matrix, camera );
-			}
+			allPointsOnScreen = false;
 		}
 	}
+
+	// Min and max coordinates form a screen bounding rectangle for the current portal - see if
+	// it intersects with the screen area passed to the function. The boundary distance is the
+	// smallest change to the rectangles that would change the result
+	int overlapX = Min( portalMaxX - minX, maxX - portalMinX );
+	int overlapY = Min( portalMaxY - minY, maxY - portalMinY );
+	if (overlapX > 0 && overlapY > 0)
+	{
+		// The portal can be seen. Calculate the screen area where it is visible - the
+		// intersection of the portal rectangle and the screen area being tested
+		visit->Visible = true;
+		visit->MinX = Max( minX, portalMinX );
+		visit->MaxX = Min( maxX, portalMaxX );
+		visit->MinY = Max( minY, portalMinY );
+		visit->MaxY = Min( maxY, portalMaxY );
+		visit->BoundaryDist = static_cast<float>(Min( overlapX, overlapY ));
+	}
+	else
+	{
+		visit->BoundaryDist = static_cast<float>(-Min( overlapX, overlapY ));
+	}
+
+	// Points behind the camera make the rectangle unreliable, so always retest such portals, and
+	// those the camera is near enough to see edge-on
+	if (!allPointsOnScreen || nearPlane)
+	{
+		visit->BoundaryDist = 0.0f;
+	}
+
+	return visit->Visible;
 }
 
 
-// Check visiblity of portals in a partition - if any are visible in the given screen area
-// and camera, then render them, and then recursively render their visible portals
-// Doesn't deal with portals clipped at the near plane => errors when very close to portals
-// Checks both entrance and exit polygons of each portal, calls function above for main work
-void RenderPortals( int part, CCamera* camera, int minX, int minY, int maxX, int maxY )
+// Make a copy of a camera transformed to look through one side of a portal
+void GetPortalCamera( SPortal* portal, bool inPortal, CCamera* camera, CCamera* portalCamera )
+{
+	CMatrix4x4 matrix, transform;
+	int targetPartition;
+	GetPortalSide( portal, inPortal, &matrix, &transform, &targetPartition );
+	*portalCamera = *camera;
+	portalCamera->Matrix() *= transform;
+	portalCamera->CalculateMatrices();
+}
+
+
+// Prototype function below for mutual recursion (functions that call each other)
+void TraversePortals( SPortalView* view, int part, CCamera* camera, int depth,
+                      int minX, int minY, int maxX, int maxY, float pathMinDepth );
+
+// Test visibility of one side of a portal, adding a record to the view's visit list. If it is
+// visible then test the portals of the target partition with a camera looking through the
+// portal, which adds their records after this one
+void TraversePortal( SPortalView* view, SPortal* portal, bool inPortal, CCamera* camera, int depth,
+                     int minX, int minY, int maxX, int maxY, float pathMinDepth )
+{
+	// Add record by index - the list may reallocate when adding records for the target partition
+	TPortalVisits& visits = view->Visits;
+	int visitIndex = static_cast<int>(visits.size());
+	visits.push_back( SPortalVisit() );
+	visits[visitIndex].Portal = portal;
+	visits[visitIndex].InPortal = inPortal;
+	if (TestPortalVisibility( view, &visits[visitIndex], camera, minX, minY, maxX, maxY,
+	                          pathMinDepth ))
+	{
+		++view->Stats.PortalsVisible;
+		SPortalVisit visit = visits[visitIndex];
+
+		CCamera portalCamera;
+		GetPortalCamera( portal, inPortal, camera, &portalCamera );
+		int targetPartition = inPortal ? portal->OutPartition : portal->InPartition;
+		TraversePortals( view, targetPartition, &portalCamera, depth + 1, visit.MinX, visit.MinY,
+		                 visit.MaxX, visit.MaxY, visit.MinDepth );
+	}
+	visits[visitIndex].NumChildren = static_cast<int>(visits.size()) - visitIndex - 1;
+}
+
+// Test visibility of portals in a partition within the given screen area and camera, then
+// recursively test the portals visible through them. Adds a record for each portal side tested
+// to the view's visit list
+void TraversePortals( SPortalView* view, int part, CCamera* camera, int depth,
+                      int minX, int minY, int maxX, int maxY, float pathMinDepth )
 {
 	// Limit recursion through portals
 	// e.g Possible to set up a portal whose exit can see its entrance (!)
-	if (PortalDepth > 4) return;
+	if (depth > MaxPortalDepth) return;
 
 	// For each portal of given partition
 	TPortalIter itPortal = Partitions[part].Portals.begin();
 	while (itPortal != Partitions[part].Portals.end())
 	{
-		// If entrance portal is in current partition....
+		// If entrance portal is in current partition test its visibility, then same process
+		// for the exit portal...
 		if ((*itPortal)->InPartition == part)
 		{
-			// Test visibility of entrance portal, and render its target partition (the partition
-			// containing the exit) if appropriate
-			RenderPortal( itPortal, true, camera, minX, minY, maxX, maxY );
+			TraversePortal( view, *itPortal, true, camera, depth, minX, minY, maxX, maxY,
+			                pathMinDepth );
 		}
-
-		// Same process for the exit portal...
 		if ((*itPortal)->OutPartition == part)
 		{
-			RenderPortal( itPortal, false, camera, minX, minY, maxX, maxY );
+			TraversePortal( view, *itPortal, false, camera, depth, minX, minY, maxX, maxY,
+			                pathMinDepth );
 		}
-
 		++itPortal;
 	}
 }
 
 
+// Distance in pixels that a portal test's overlap could change by while the camera stays within
+// one position cell and orientation sector of the visibility cache. Pass the nearest depth of
+// the portal and those before it, and the portal depth in the tree (0 for the camera's partition)
+float PortalCacheMotionPixels( SPortalView* view, float minDepth, int portalDepth )
+{
+	// Camera can move up to a cell diagonal and turn by about two sectors (radians)
+	const float maxTurn = PortalCacheOrientationSector * 2.0f;
+	float pixelsPerUnit = view->Camera.GetProjMatrix().e00 * view->Width * 0.5f; // At unit depth
+	if (minDepth <= view->Camera.GetNearClip())
+	{
+		minDepth = view->Camera.GetNearClip();
+	}
+
+	// Screen motion is least at the centre. Towards the edges the projection stretches it, by up to
+	// 1 + tan^2 of the angle from the centre, which is greatest in the screen corners
+	float tanHalfFOVX = 1.0f / view->Camera.GetProjMatrix().e00;
+	float tanHalfFOVY = 1.0f / view->Camera.GetProjMatrix().e11;
+	float edgeStretch = 1.0f + tanHalfFOVX * tanHalfFOVX + tanHalfFOVY * tanHalfFOVY;
+	float motion = (PortalCacheCellDiagonal / minDepth + maxTurn) * edgeStretch * pixelsPerUnit;
+
+	// Beyond the camera's partition the screen area being tested is also a portal's area, which
+	// can move as far (its portals are no deeper), so the overlap can shrink by twice as much
+	if (portalDepth > 0)
+	{
+		motion *= 2.0f;
+	}
+	return motion + 2.0f; // +2 for rounding
+}
+
+// Update a range of a view's cached portal visit records for a camera that has moved slightly.
+// Only the records whose result could have changed (near the boundary of their previous screen
+// areas) are retested. Returns false if any retested portal changed visibility, in which case
+// the cached tree is no longer valid
+bool UpdatePortalVisits( SPortalView* view, int first, int last, CCamera* camera, int depth,
+                         int minX, int minY, int maxX, int maxY, float pathMinDepth )
+{
+	TPortalVisits& visits = view->Visits;
+	for (int visitIndex = first; visitIndex < last; )
+	{
+		SPortalVisit& visit = visits[visitIndex];
+		if (visit.BoundaryDist < PortalCacheMotionPixels( view, visit.MinDepth, depth ))
+		{
+			bool wasVisible = visit.Visible;
+			int numChildren = visit.NumChildren;
+			if (TestPortalVisibility( view, &visit, camera, minX, minY, maxX, maxY, pathMinDepth ) !=
+			    wasVisible)
+			{
+				return false;
+			}
+			visit.NumChildren = numChildren;
+		}
+
+		// Update the portals seen through visible portals
+		if (visit.Visible)
+		{
+			++view->Stats.PortalsVisible;
+			if (visit.NumChildren > 0)
+			{
+				CCamera portalCamera;
+				GetPortalCamera( visit.Portal, visit.InPortal, camera, &portalCamera );
+				if (!UpdatePortalVisits( view, visitIndex + 1, visitIndex + 1 + visit.NumChildren,
+				                         &portalCamera, depth + 1, visit.MinX, visit.MinY, visit.MaxX, visit.MaxY,
+				                         visit.MinDepth ))
+				{
+					return false;
+				}
+			}
+		}
+
+		// Next record at the same level of the tree
+		visitIndex += visit.NumChildren + 1;
+	}
+	return true;
+}
+
+
+// Find the portals and partitions visible from a view's camera, storing the results in the view
+// (see SPortalView). Reuses the previous frame's result if the camera has only moved slightly
+// and the portals haven't changed, retesting only portals that are near the boundary of their
+// previous screen areas. Views are independent so this function can be called for several
+// views at once on different threads
+void FindVisiblePortals( SPortalView* view )
+{
+	CTimer timer;
+	view->Stats.PortalsTested = 0;
+	view->Stats.PortalsVisible = 0;
+	CCamera* camera = &view->Camera;
+	view->Partition = GetPartitionFromPt( camera->Position() );
+
+	// Camera position cell and orientation sector for the cache
+	SPortalVisibilityCache& cache = view->Cache;
+	int position[3], orientation[6];
+	CMatrix4x4& cameraMatrix = camera->Matrix();
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const float sectorSize = PortalCacheOrientationSector;
+		position[axis] = static_cast<int>(Floor( cameraMatrix.Position()[axis] / PortalCachePositionCell ));
+		orientation[axis]     = static_cast<int>(Floor( cameraMatrix.ZAxis()[axis] / sectorSize ));
+		orientation[axis + 3] = static_cast<int>(Floor( cameraMatrix.XAxis()[axis] / sectorSize ));
+	}
+
+	// Try to use the cached visits if camera is in the same partition / cell / sector
+	bool cacheHit = UsePortalCache && cache.Valid && cache.Partition == view->Partition &&
+	                cache.PortalEditCount == PortalEditCount;
+	for (int axis = 0; axis < 3 && cacheHit; ++axis)
+	{
+		cacheHit = cache.Position[axis] == position[axis] &&
+		           cache.Orientation[axis] == orientation[axis] &&
+		           cache.Orientation[axis + 3] == orientation[axis + 3];
+	}
+	if (cacheHit)
+	{
+		cacheHit = UpdatePortalVisits( view, 0, static_cast<int>(view->Visits.size()), camera, 0,
+		                               0, 0, view->Width - 1, view->Height - 1,
+		                               camera->GetFarClip() );
+	}
+
+	if (!cacheHit)
+	{
+		// Full traversal
+		view->Stats.PortalsTested = 0;
+		view->Stats.PortalsVisible = 0;
+		view->Visits.clear();
+		TraversePortals( view, view->Partition, camera, 0, 0, 0, view->Width - 1, view->Height - 1,
+		                 camera->GetFarClip() );
+
+		cache.Valid = true;
+		cache.Partition = view->Partition;
+		cache.PortalEditCount = PortalEditCount;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			cache.Position[axis] = position[axis];
+			cache.Orientation[axis] = orientation[axis];
+			cache.Orientation[axis + 3] = orientation[axis + 3];
+		}
+	}
+
+	// List the visible partitions - the camera's partition and the targets of visible portals
+	view->VisiblePartitions.clear();
+	view->VisiblePartitions.push_back( view->Partition );
+	for (TUInt32 visitIndex = 0; visitIndex < view->Visits.size(); ++visitIndex)
+	{
+		const SPortalVisit& visit = view->Visits[visitIndex];
+		if (visit.Visible)
+		{
+			int targetPartition = visit.InPortal ? visit.Portal->OutPartition : visit.Portal->InPartition;
+			if (find( view->VisiblePartitions.begin(), view->VisiblePartitions.end(), targetPartition ) ==
+			    view->VisiblePartitions.end())
+			{
+				view->VisiblePartitions.push_back( targetPartition );
+			}
+		}
+	}
+
+	// Timing - keep a running average of the full traversal time to estimate time saved by hits
+	SPortalStats& stats = view->Stats;
+	stats.TraversalTime = timer.GetTime();
+	if (cacheHit)
+	{
+		++stats.CacheHits;
+		stats.TimeSaved += Max( 0.0f, stats.AverageFullTime - stats.TraversalTime );
+	}
+	else
+	{
+		++stats.CacheMisses;
+		stats.AverageFullTime = (stats.CacheMisses == 1) ? stats.TraversalTime :
+			stats.AverageFullTime * 0.9f + stats.TraversalTime * 0.1f;
+	}
+}
+
+// Find the visible portals and partitions for a list of views, spreading the views across the
+// portal thread pool
+void FindVisiblePortals( SPortalView** views, TUInt32 numViews )
+{
+	ThreadPool->Run( numViews, [views]( TUInt32 view ) { FindVisiblePortals( views[view] ); } );
+}
+
+// Reset a view's cache statistics (hits, misses and time saved)
+void ResetPortalStats( SPortalView* view )
+{
+	view->Stats.CacheHits = 0;
+	view->Stats.CacheMisses = 0;
+	view->Stats.TimeSaved = 0.0f;
+	view->Stats.AverageFullTime = 0.0f;
+}
+
+
+//-----------------------------------------------------------------------------
+// Portal Tree Rendering
+//-----------------------------------------------------------------------------
+
+// Render the visible portals in a range of a view's portal visit tree (see FindVisiblePortals),
+// each followed by its target partition and the portals visible within it. The target partition
+// is rendered with a copy of the camera transformed through the portal, allowing the portal to
+// have its entrance and exit in different places.
+void RenderPortals( const TPortalVisits& visits, int first, int last, CCamera* camera )
+{
+	for (int visitIndex = first; visitIndex < last; visitIndex += visits[visitIndex].NumChildren + 1)
+	{
+		const SPortalVisit& visit = visits[visitIndex];
+		if (!visit.Visible) continue;
+
+		// Different set-up depending on whether rendering entrance or exit portal
+		CMatrix4x4 matrix, transform;
+		int targetPartition;
+		GetPortalSide( visit.Portal, visit.InPortal, &matrix, &transform, &targetPartition );
+		TPortalShape portalPoly;
+		TransformPortalShape( visit.Portal->Shape, matrix, portalPoly );
+
+		// Prepare stencil/z-buffer in portal area
+		PreRenderPortalShape( visit.Portal->Shape, matrix, camera );
+
+		// Prepare a custom clipping plane for the portal, this prevents geometry *nearer*
+		// than the portal being visible through it (similar to stencil mirror issue).
+		// Can only occur on a portal with the entrance & exit in different places
+		D3DXPLANE portalPlane, clipPlane;
+		D3DXPlaneFromPoints( &portalPlane, ToD3DXVECTORPtr(&portalPoly[0]),
+		                     ToD3DXVECTORPtr(&portalPoly[visit.InPortal?2:1]),
+		                     ToD3DXVECTORPtr(&portalPoly[visit.InPortal?1:2]) );
+		D3DXMATRIXA16 planeViewProjMatrix = // Extra step needed as per D3DXPlaneTransform documentation...
+			ToD3DXMATRIX(Transpose( Inverse( camera->GetViewProjMatrix() ) ));
+		D3DXPlaneTransform( &clipPlane, &portalPlane, &planeViewProjMatrix );
+		g_pd3dDevice->SetRenderState( D3DRS_CLIPPLANEENABLE, D3DCLIPPLANE0 );
+		g_pd3dDevice->SetClipPlane( 0, (float*)&clipPlane );
+		CVector4 occluderClipPlane( clipPlane.a, clipPlane.b, clipPlane.c, clipPlane.d );
+
+		// Render the new partition, and all portals visible through this one, with the camera
+		// transformed to its new position in the target partition
+		CCamera portalCamera;
+		GetPortalCamera( visit.Portal, visit.InPortal, camera, &portalCamera );
+		RenderPartition( targetPartition, &portalCamera, &occluderClipPlane );
+		RenderPortals( visits, visitIndex + 1, visitIndex + 1 + visit.NumChildren, &portalCamera );
+
+		// Switch off the custom clip plane
+		g_pd3dDevice->SetRenderState( D3DRS_CLIPPLANEENABLE, 0 );
+
+		// Reset stencil buffer in portal area
+		PostRenderPortalShape( visit.Portal->Shape, matrix, camera );
+	}
+}
+
+
 //-----------------------------------------------------------------------------
 // Portal Management Functions
 //-----------------------------------------------------------------------------
@@ -504,6 +980,38 @@ void AddPortal( int shape, CVector3 inPos, float inRotY, CVector3 outPos, float
 	Portals.push_back( newPortal );
 	Partitions[newPortal->InPartition].Portals.push_back( newPortal );
 	Partitions[newPortal->OutPartition].Portals.push_back( newPortal );
+	++PortalEditCount;
+}
+
+// Add a portal fitting the given world space quad (parallelogram) between two given partitions.
+// The quad must face (by the same rule as GetPortalPolyNormal) into the entrance partition.
+// Entrance and exit are the same, the unit quad shape is scaled by the matrix to fit
+void AddQuadPortal( const TPortalShape quad, int inPartition, int outPartition )
+{
+	SPortal* newPortal = new SPortal;
+	newPortal->Shape = Quad;
+
+	// Matrix rows map the unit quad's x and y axes onto the quad edges, z is the facing vector
+	CVector3 quadX = quad[3] - quad[0];
+	CVector3 quadY = quad[1] - quad[0];
+	CVector3 quadZ = Normalise( Cross( quadY, quadX ) );
+	newPortal->InMatrix = CMatrix4x4( quadX, quadY, quadZ, (quad[0] + quad[3]) * 0.5f );
+	newPortal->OutMatrix = newPortal->InMatrix;
+
+	newPortal->InPartition = inPartition;
+	newPortal->OutPartition = outPartition;
+	Portals.push_back( newPortal );
+	Partitions[inPartition].Portals.push_back( newPortal );
+	Partitions[outPartition].Portals.push_back( newPortal );
+	++PortalEditCount;
+}
+
+// Move an existing portal's entrance and exit. The portal stays linked to the same partitions
+void SetPortalMatrices( SPortal* portal, const CMatrix4x4& inMatrix, const CMatrix4x4& outMatrix )
+{
+	portal->InMatrix = inMatrix;
+	portal->OutMatrix = outMatrix;
+	++PortalEditCount;
 }
 
 // Release the global list of portals
@@ -516,6 +1024,77 @@ void RemoveAllPortals()
 		delete (*itPortal);
 		++itPortal;
 	}
+	++PortalEditCount;
+}
+
+
+//-----------------------------------------------------------------------------
+// Partition / Portal Setup
+//-----------------------------------------------------------------------------
+
+// Create the partitions and portals from a list of cells and the portals between them (as
+// loaded from file or extracted from level geometry). Partition 0 is the world outside all cells
+void CreatePartitions( const vector<SCellVolume>& cells, const vector<SCellPortal>& portals )
+{
+	Partitions.clear();
+	Partitions.resize( cells.size() + 1 );
+	Partitions[0].MinX = Partitions[0].MinY = Partitions[0].MinZ = -500.0f;
+	Partitions[0].MaxX = Partitions[0].MaxY = Partitions[0].MaxZ =  500.0f;
+	for (TUInt32 cell = 0; cell < cells.size(); ++cell)
+	{
+		SPartition& partition = Partitions[cell + 1];
+		partition.MinX = cells[cell].MinBounds.x;
+		partition.MinY = cells[cell].MinBounds.y;
+		partition.MinZ = cells[cell].MinBounds.z;
+		partition.MaxX = cells[cell].MaxBounds.x;
+		partition.MaxY = cells[cell].MaxBounds.y;
+		partition.MaxZ = cells[cell].MaxBounds.z;
+	}
+
+	for (TUInt32 portal = 0; portal < portals.size(); ++portal)
+	{
+		AddQuadPortal( portals[portal].Points, portals[portal].InCell, portals[portal].OutCell );
+	}
+}
+
+// Set up the partitions and portals for the house. They are loaded from the partition file if
+// it exists, otherwise they are extracted from the room, door and window meshes (the templates
+// must already be loaded) and saved to the file for next time. Returns false on failure
+bool SetupPartitions()
+{
+	vector<SCellVolume> cells;
+	vector<SCellPortal> portals;
+	if (!LoadCellsAndPortals( PartitionFileName, &cells, &portals ))
+	{
+		// Rooms are added in order so they become partitions B-G (1-6). Meshes are used with
+		// an identity matrix as the room / door / window entities are placed at the origin
+		const char* rooms[] = { "Room B", "Room C", "Room D", "Room E", "Room F", "Room G" };
+		const char* openings[] = { "Door A-B", "Door A-G", "Door B-C", "Door C-D", "Door D-E",
+		                           "Door E-F", "Window A-C", "Window A-D 1", "Window A-D 2" };
+
+		CCellPortalExtractor extractor;
+		for (int room = 0; room < sizeof(rooms) / sizeof(rooms[0]); ++room)
+		{
+			CEntityTemplate* roomTemplate = EntityManager.GetTemplate( rooms[room] );
+			if (!roomTemplate) return false;
+			extractor.AddCellMesh( rooms[room], roomTemplate->Mesh() );
+		}
+		for (int opening = 0; opening < sizeof(openings) / sizeof(openings[0]); ++opening)
+		{
+			CEntityTemplate* openingTemplate = EntityManager.GetTemplate( openings[opening] );
+			if (!openingTemplate) return false;
+			extractor.AddOpeningMesh( openings[opening], openingTemplate->Mesh() );
+		}
+		extractor.Extract();
+
+		// Failing to save is not an error, the partitions are just extracted again next time
+		extractor.Save( PartitionFileName );
+		cells = extractor.GetCells();
+		portals = extractor.GetPortals();
+	}
+
+	CreatePartitions( cells, portals );
+	return true;
 }
 
 
@@ -621,6 +1200,13 @@ bool SceneSetup()
 	EntityManager.CreateTemplate( "Scenery", "Window A-D 1", "WindowA-D1.x" );
 	EntityManager.CreateTemplate( "Scenery", "Window A-D 2", "WindowA-D2.x" );
 
+	// Load or extract the partitions and portals from the room / door / window meshes. Entities
+	// are added to the house partitions by number below, so check the expected number were found
+	if (!SetupPartitions() || static_cast<int>(Partitions.size()) != NumHousePartitions)
+	{
+		return false;
+	}
+
 	// Create scenery entities, add each to the appropriate partition
 	// Note that template name = entity name for many entities here since each template has only
 	// one entity instance
@@ -631,21 +1217,41 @@ bool SceneSetup()
 	Partitions[0].Entities.push_back( id );
 	id = EntityManager.CreateEntity( "House", "House" );
 	Partitions[0].Entities.push_back( id );
+	AddPartitionOccluder( 0, id );
 	id = EntityManager.CreateEntity( "Shed", "Shed" );
 	Partitions[0].Entities.push_back( id );
+	AddPartitionOccluder( 0, id );
 
+	// Room walls are also used as occluders for the entities in each room, and in the rooms it has
+	// doors to. A room seen through a doorway has all its entities tested, not only those in view
+	// through the opening, and the walls of the room it is seen from hide many of the others.
+	// The room walls would not help partition A, where the house walls already hide the rooms
 	id = EntityManager.CreateEntity( "Room B", "Room B" );
 	Partitions[1].Entities.push_back( id );
+	AddPartitionOccluder( 1, id );
+	AddPartitionOccluder( 2, id );
 	id = EntityManager.CreateEntity( "Room C", "Room C" );
 	Partitions[2].Entities.push_back( id );
+	AddPartitionOccluder( 2, id );
+	AddPartitionOccluder( 1, id );
+	AddPartitionOccluder( 3, id );
 	id = EntityManager.CreateEntity( "Room D", "Room D" );
 	Partitions[3].Entities.push_back( id );
+	AddPartitionOccluder( 3, id );
+	AddPartitionOccluder( 2, id );
+	AddPartitionOccluder( 4, id );
 	id = EntityManager.CreateEntity( "Room E", "Room E" );
 	Partitions[4].Entities.push_back( id );
+	AddPartitionOccluder( 4, id );
+	AddPartitionOccluder( 3, id );
+	AddPartitionOccluder( 5, id );
 	id = EntityManager.CreateEntity( "Room F", "Room F" );
 	Partitions[5].Entities.push_back( id );
+	AddPartitionOccluder( 5, id );
+	AddPartitionOccluder( 4, id );
 	id = EntityManager.CreateEntity( "Room G", "Room G" );
 	Partitions[6].Entities.push_back( id );
+	AddPartitionOccluder( 6, id );
 
 	id = EntityManager.CreateEntity( "Door A-B", "Door A-B" );
 	Partitions[0].Entities.push_back( id );
@@ -693,25 +1299,7 @@ bool SceneSetup()
 	LoadMethod( ClearDepth );
 
 
-	// Add portals for existing doors / windows. Entrance and exit portals are the same here
-	AddPortal( Door, CVector3(-1.5f, 0.0f, -4.75f), 0,   // Entrance   // Door A-B
-	                 CVector3(-1.5f, 0.0f, -4.75f), 0 ); // Exit 
-	AddPortal( Door, CVector3(-7.975f, 0.0f, -3.25f), ToRadians(90),   // Door A-G
-                     CVector3(-7.975f, 0.0f, -3.25f), ToRadians(90) );
-	AddPortal( Door, CVector3(-1.5f, 0.0f, -3.15f), 0,                 // Door B-C
-                     CVector3(-1.5f, 0.0f, -3.15f), 0 );
-	AddPortal( Door, CVector3(-0.5f, 0.0f, -0.05f), 0,                 // Door C-D
-                     CVector3(-0.5f, 0.0f, -0.05f), 0 );
-	AddPortal( Door, CVector3(3.55f, 0.0f, 2.05f), ToRadians(90),      // Door D-E
-                     CVector3(3.55f, 0.0f, 2.05f), ToRadians(90) );
-	AddPortal( Door, CVector3(3.55f, 0.0f, -1.45f), ToRadians(90),     // Door E-F
-                     CVector3(3.55f, 0.0f, -1.45f), ToRadians(90) );
-	AddPortal( Window, CVector3(-3.65f, 0.75f, -1.5f), ToRadians(90),    // Window A-C
-                       CVector3(-3.65f, 0.75f, -1.5f), ToRadians(90) );
-	AddPortal( Window, CVector3( 1.75f, 0.75f, 4.05f), 0,                // Window A-D 1
-                       CVector3( 1.75f, 0.75f, 4.05f), 0 );
-	AddPortal( Window, CVector3(-1.75f, 0.75f, 4.05f), 0,                // Window A-D 2
-                       CVector3(-1.75f, 0.75f, 4.05f), 0 );
+	// Portals for existing doors / windows were created with the partitions (see SetupPartitions)
 
 	// Add a new portal with a tapered shape in the middle of a wall (see EPortalShape for shapes)
 	AddPortal( Taper, CVector3(2.5f, 0.0f, -3.21f), 0, 
@@ -765,6 +1353,40 @@ bool SceneSetup()
 		Partitions[0].Entities.push_back( Cars[car] );
 	}
 
+	// Fill each room of the house with a grid of small static (parked) cars. Gives a dense
+	// interior scene where most entities are hidden by walls - tests the occlusion culling
+	const char* parkedCarTemplates[] = { "Freelander", "Aston Martin", "Fiat Panda", "Intrepid",
+	                                     "Transit Van" };
+	TNameID parkedCarTemplateIDs[5];
+	for (int carTemplate = 0; carTemplate < 5; ++carTemplate)
+	{
+		parkedCarTemplateIDs[carTemplate] = EntityNames.GetID( parkedCarTemplates[carTemplate] );
+	}
+	TNameID parkedCarName = EntityNames.GetID( "Parked" );
+	const float parkedCarScale = 0.08f;
+	const float roomInset = 0.3f;
+	int parkedCar = 0;
+	for (int part = 1; part < static_cast<int>(Partitions.size()); ++part)
+	{
+		float roomSizeX = Partitions[part].MaxX - Partitions[part].MinX - 2 * roomInset;
+		float roomSizeZ = Partitions[part].MaxZ - Partitions[part].MinZ - 2 * roomInset;
+		float spacingX = roomSizeX / (NumParkedCarsX - 1);
+		float spacingZ = roomSizeZ / (NumParkedCarsZ - 1);
+		for (int carX = 0; carX < NumParkedCarsX; ++carX)
+		{
+			for (int carZ = 0; carZ < NumParkedCarsZ; ++carZ)
+			{
+				CVector3 pos( Partitions[part].MinX + roomInset + carX * spacingX, 0.0f,
+				              Partitions[part].MinZ + roomInset + carZ * spacingZ );
+				id = EntityManager.CreateEntity( parkedCarTemplateIDs[parkedCar % 5], parkedCarName,
+				                                 pos, CVector3(0.0f, ToRadians(parkedCar * 37.0f), 0.0f),
+				                                 CVector3(parkedCarScale, parkedCarScale, parkedCarScale) );
+				Partitions[part].Entities.push_back( id );
+				++parkedCar;
+			}
+		}
+	}
+
 
 	/////////////////////////////
 	// Camera / light setup
@@ -774,6 +1396,11 @@ bool SceneSetup()
 	                          CVector3(ToRadians(25.0f), 0, 0) );
 	MainCamera->SetNearFarClip( 0.1f, 10000.0f ); 
 
+	// Threads for entity updates and finding visible portals, and views for the latter
+	ThreadPool = new CThreadPool();
+	EntityManager.SetThreadPool( ThreadPool );
+	CarViews.resize( NumCars );
+
 
 	// Ambient light level
 	AmbientLight = SColourRGBA( 0.6f, 0.6f, 0.6f, 1.0f );
@@ -802,8 +1429,11 @@ void SceneShutdown()
 		delete Lights[light];
 	}
 
-	// Release camera
+	// Release camera and portal views
 	delete MainCamera;
+	CarViews.clear();
+	EntityManager.SetThreadPool( 0 );
+	delete ThreadPool;
 
 	// Release global portal list and portal meshes
 	RemoveAllPortals();
@@ -818,10 +1448,93 @@ void SceneShutdown()
 }
 
 
+// Save the entities to the checkpoint file, with the entities in each partition and the cars
+// as entity lists. Returns true on success
+bool SaveCheckpoint()
+{
+	CTimer timer;
+	Checkpoint.Capture( EntityManager );
+	for (TUInt32 part = 0; part < Partitions.size(); ++part)
+	{
+		Checkpoint.AddEntityList( Partitions[part].Entities );
+	}
+	Checkpoint.AddEntityList( vector<TEntityUID>( Cars, Cars + NumCars ) );
+	bool saved = Checkpoint.Save( CheckpointFileName );
+	CheckpointTime = timer.GetTime();
+	return saved;
+}
+
+// Replace the entities with those in the checkpoint file and update the partition entity lists
+// and cars with their new UIDs. The partitions, portals and occluders are not in the checkpoint
+// and are left unchanged (the scenery they depend on doesn't move). Returns true on success
+bool LoadCheckpoint()
+{
+	CTimer timer;
+	if (!Checkpoint.Load( CheckpointFileName ) ||
+	    Checkpoint.GetNumEntityLists() != Partitions.size() + 1)
+	{
+		return false;
+	}
+	bool restored = Checkpoint.Restore( EntityManager );
+	for (TUInt32 part = 0; part < Partitions.size(); ++part)
+	{
+		Checkpoint.GetEntityList( part, &Partitions[part].Entities );
+	}
+	vector<TEntityUID> cars;
+	Checkpoint.GetEntityList( static_cast<TUInt32>(Partitions.size()), &cars );
+	for (int car = 0; car < NumCars; ++car)
+	{
+		Cars[car] = (car < static_cast<int>(cars.size())) ? cars[car] : SystemUID;
+	}
+	CheckpointTime = timer.GetTime();
+	return restored;
+}
+
+
 //-----------------------------------------------------------------------------
 // Game loop functions
 //-----------------------------------------------------------------------------
 
+// Set up the portal views for this frame and find the portals and partitions visible from them.
+// The views are spread across the portal thread pool
+void FindAllVisiblePortals()
+{
+	CTimer timer;
+	vector<SPortalView*> views;
+
+	MainView.Camera = *MainCamera;
+	MainView.Width = ViewportWidth;
+	MainView.Height = ViewportHeight;
+	views.push_back( &MainView );
+
+	// Car views look forward from just above each car, with the same projection as the main camera
+	if (UseCarViews)
+	{
+		for (int car = 0; car < NumCars; ++car)
+		{
+			CEntity* carEntity = EntityManager.GetEntity( Cars[car] );
+			if (!carEntity) continue;
+			SPortalView& view = CarViews[car];
+			view.Camera = *MainCamera;
+			view.Camera.Matrix() = carEntity->Matrix();
+			view.Camera.Matrix().MoveLocalY( 1.0f );
+			view.Camera.CalculateMatrices();
+			view.Width = ViewportWidth;
+			view.Height = ViewportHeight;
+			views.push_back( &view );
+		}
+	}
+
+	FindVisiblePortals( &views[0], static_cast<TUInt32>(views.size()) );
+
+	PortalViewsTime = timer.GetTime();
+	CarViewsVisiblePartitions = 0;
+	for (TUInt32 view = 1; view < views.size(); ++view)
+	{
+		CarViewsVisiblePartitions += static_cast<TUInt32>(views[view]->VisiblePartitions.size());
+	}
+}
+
 // Draw one frame of the scene
 void RenderScene( float updateTime )
 {
@@ -834,27 +1547,30 @@ void RenderScene( float updateTime )
 
 		// Prepare camera
 		MainCamera->CalculateMatrices();
+		EntitiesRendered = 0;
+		EntitiesCulled = 0;
+		StateChangesUnsorted = 0;
+		StateChangesSorted = 0;
 
 		// Mark all partitions as not rendered
-		for (int part = 0; part < NumPartitions; ++part)
+		for (int part = 0; part < static_cast<int>(Partitions.size()); ++part)
 		{
 			Partitions[part].Rendered = false;
 		}
 
-		// Find current partition
-		int currentPartition = GetPartitionFromPt( MainCamera->Position() );
+		// Find the portals and partitions visible from each view
+		FindAllVisiblePortals();
 
 		// Render all entities in the current partition
-		RenderPartition( currentPartition, MainCamera );
+		RenderPartition( MainView.Partition, MainCamera );
 
 		PortalDepth = 0;
 		g_pd3dDevice->SetRenderState( D3DRS_STENCILENABLE, TRUE );
 		g_pd3dDevice->SetRenderState( D3DRS_STENCILFUNC, D3DCMP_EQUAL );
 		g_pd3dDevice->SetRenderState( D3DRS_STENCILREF, PortalDepth );
 
-		// Render partitions visible (in the viewport area) through the portals in
-		// the current partition
-		RenderPortals( currentPartition, MainCamera, 0, 0, ViewportWidth - 1, ViewportHeight - 1 );
+		// Render the partitions visible through the portals found for the main view
+		RenderPortals( MainView.Visits, 0, static_cast<int>(MainView.Visits.size()), MainCamera );
 
 		g_pd3dDevice->SetRenderState( D3DRS_STENCILENABLE, FALSE );
 
@@ -870,6 +1586,15 @@ void RenderScene( float updateTime )
 }
 
 
+// Output one line of pool allocator counters for the on-screen text
+template <class TObject>
+void OutputPoolStats( stringstream& outText, const CPoolAllocator<TObject>& pool )
+{
+	const SPoolStats& stats = pool.GetStats();
+	outText << "  " << pool.GetName() << ": " << stats.iNumLive << " / " << stats.iPeakLive
+	        << " / " << stats.iNumChunks << "  Allocs: " << stats.iNumAllocations << endl;
+}
+
 // Render on-screen text each frame
 void RenderSceneText( float updateTime )
 {
@@ -886,7 +1611,7 @@ void RenderSceneText( float updateTime )
 
 	// Display rendered partitions
 	outText << "Partitions Rendered: ";
-	for (int part = 0; part < NumPartitions; ++part)
+	for (int part = 0; part < static_cast<int>(Partitions.size()); ++part)
 	{
 		if (Partitions[part].Rendered)
 		{
@@ -896,6 +1621,70 @@ void RenderSceneText( float updateTime )
 	SetRect( &rect, 0, 40, 0, 0 );  // Top/left of text at (0,0), don't need bottom/right (DT_NOCLIP)
 	g_pFont->DrawText( NULL, outText.str().c_str(), -1, &rect, DT_NOCLIP,
 	                   D3DXCOLOR( 1.0f, 1.0f, 1.0f, 1.0f ));
+	outText.str("");
+
+	// Display occlusion culling results
+	outText << "Occlusion Culling (F4): " << (UseOcclusionCulling ? "On" : "Off") << endl
+	        << "Entities Rendered: " << EntitiesRendered << "  Culled: " << EntitiesCulled;
+	SetRect( &rect, 0, 60, 0, 0 );
+	g_pFont->DrawText( NULL, outText.str().c_str(), -1, &rect, DT_NOCLIP,
+	                   D3DXCOLOR( 1.0f, 1.0f, 1.0f, 1.0f ));
+	outText.str("");
+
+	// Display state changes with and without render queue sorting
+	outText << "Sorted Rendering (F5): " << (UseSortedRendering ? "On" : "Off") << endl
+	        << "State Changes Unsorted: " << StateChangesUnsorted
+	        << "  Sorted: " << StateChangesSorted;
+	SetRect( &rect, 0, 100, 0, 0 );
+	g_pFont->DrawText( NULL, outText.str().c_str(), -1, &rect, DT_NOCLIP,
+	                   D3DXCOLOR( 1.0f, 1.0f, 1.0f, 1.0f ));
+	outText.str("");
+
+	// Display portal visibility cache results (main view)
+	const SPortalStats& stats = MainView.Stats;
+	TUInt32 cacheFrames = stats.CacheHits + stats.CacheMisses;
+	outText << "Portal Cache (F6): " << (UsePortalCache ? "On" : "Off") << endl
+	        << "Portals Tested: " << stats.PortalsTested
+	        << "  Visible: " << stats.PortalsVisible
+	        << "  Time: " << stats.TraversalTime * 1000000.0f << "us" << endl
+	        << "Cache Hit Rate: "
+	        << (cacheFrames > 0 ? 100.0f * stats.CacheHits / cacheFrames : 0.0f) << "%"
+	        << "  Time Saved: " << stats.TimeSaved * 1000.0f << "ms";
+	SetRect( &rect, 0, 140, 0, 0 );
+	g_pFont->DrawText( NULL, outText.str().c_str(), -1, &rect, DT_NOCLIP,
+	                   D3DXCOLOR( 1.0f, 1.0f, 1.0f, 1.0f ));
+	outText.str("");
+
+	// Display multi-view portal results
+	outText << "Car Views (F7): " << (UseCarViews ? "On" : "Off")
+	        << "  Views: " << (UseCarViews ? NumCars + 1 : 1)
+	        << "  Threads: " << ThreadPool->GetNumThreads() << endl
+	        << "All Views Time: " << PortalViewsTime * 1000000.0f << "us";
+	if (UseCarViews)
+	{
+		outText << "  Partitions Visible Per Car: "
+		        << static_cast<float>(CarViewsVisiblePartitions) / NumCars;
+	}
+	SetRect( &rect, 0, 200, 0, 0 );
+	g_pFont->DrawText( NULL, outText.str().c_str(), -1, &rect, DT_NOCLIP,
+	                   D3DXCOLOR( 1.0f, 1.0f, 1.0f, 1.0f ));
+	outText.str("");
+
+	// Display pool allocator counters
+	outText << "Pools (live / peak / chunks):" << endl;
+	OutputPoolStats( outText, CEntity::Pool() );
+	OutputPoolStats( outText, CCarEntity::Pool() );
+	OutputPoolStats( outText, SPortal::Pool() );
+	SetRect( &rect, 0, 240, 0, 0 );
+	g_pFont->DrawText( NULL, outText.str().c_str(), -1, &rect, DT_NOCLIP,
+	                   D3DXCOLOR( 1.0f, 1.0f, 1.0f, 1.0f ));
+	outText.str("");
+
+	// Display time of last checkpoint save / load
+	outText << "Checkpoint (F8 Save / F9 Load): " << CheckpointTime * 1000.0f << "ms";
+	SetRect( &rect, 0, 330, 0, 0 );
+	g_pFont->DrawText( NULL, outText.str().c_str(), -1, &rect, DT_NOCLIP,
+	                   D3DXCOLOR( 1.0f, 1.0f, 1.0f, 1.0f ));
 }
 
 
@@ -910,6 +1699,30 @@ void UpdateScene( float updateTime )
 	if (KeyHit( Key_F2 )) CameraMoveSpeed = 5.0f;
 	if (KeyHit( Key_F3 )) CameraMoveSpeed = 40.0f;
 
+	// Toggle occlusion culling
+	if (KeyHit( Key_F4 )) UseOcclusionCulling = !UseOcclusionCulling;
+
+	// Toggle render queue sorting
+	if (KeyHit( Key_F5 )) UseSortedRendering = !UseSortedRendering;
+
+	// Toggle portal visibility cache, statistics restart to compare with / without the cache
+	if (KeyHit( Key_F6 ))
+	{
+		UsePortalCache = !UsePortalCache;
+		ResetPortalStats( &MainView );
+		for (int car = 0; car < NumCars; ++car)
+		{
+			ResetPortalStats( &CarViews[car] );
+		}
+	}
+
+	// Toggle finding visible portals from each car as well as the main camera
+	if (KeyHit( Key_F7 )) UseCarViews = !UseCarViews;
+
+	// Save the entities to a checkpoint, or replace them with the saved checkpoint
+	if (KeyHit( Key_F8 )) SaveCheckpoint();
+	if (KeyHit( Key_F9 )) LoadCheckpoint();
+
 	// Move the camera - accumulate movement from keys, then use special portal move function
 	CMatrix4x4 camMat = MainCamera->Matrix();
 	CVector3 moveVec = CVector3::kZero;
@@ -23,10 +23,14 @@ static const string MediaFolder = "Media\\";
 // Constructor / destructor
 //-----------------------------------------------------------------------------
 
+// Mesh IDs are provided using a single increasing integer
+TUInt32 CMesh::m_NextID = 0;
+
 // Model constructor
 CMesh::CMesh()
 {
 	// Initialise member variables
+	m_ID = m_NextID++;
 	m_HasGeometry = false;
 
 	m_NumNodes = 0;
@@ -232,6 +236,53 @@ bool CMesh::GetVertex( CVector3* pVertex )
 }
 
 
+// Get the axis-aligned bounds of the geometry controlled by a single node, in the mesh's root
+// space (i.e. including the transforms of the node's parents, but not of the root). Returns
+// false if the node controls no geometry
+bool CMesh::GetNodeBounds( TUInt32 node, CVector3* pMinBounds, CVector3* pMaxBounds )
+{
+	// Combine node matrices up to (but not including) the root
+	CMatrix4x4 nodeMatrix = CMatrix4x4::kIdentity;
+	for (TUInt32 parentNode = node; parentNode != 0; parentNode = m_Nodes[parentNode].parent)
+	{
+		nodeMatrix = nodeMatrix * m_Nodes[parentNode].positionMatrix;
+	}
+
+	bool foundVertex = false;
+	for (TUInt32 subMesh = 0; subMesh < m_NumSubMeshes; ++subMesh)
+	{
+		if (m_SubMeshes[subMesh].node != node)
+		{
+			continue;
+		}
+
+		// Assuming first three floats are the vertex coord x,y & z. See comment in CMesh::PreProcess
+		for (TUInt32 vert = 0; vert < m_SubMeshes[subMesh].numVertices; ++vert)
+		{
+			TFloat32* pVertexCoord = reinterpret_cast<TFloat32*>(m_SubMeshes[subMesh].vertices + 
+			                         vert * m_SubMeshes[subMesh].vertexSize);
+			CVector3 vertex = nodeMatrix.TransformPoint( CVector3( pVertexCoord ) );
+			if (!foundVertex)
+			{
+				*pMinBounds = *pMaxBounds = vertex;
+				foundVertex = true;
+			}
+			else
+			{
+				pMinBounds->x = Min( pMinBounds->x, vertex.x );
+				pMinBounds->y = Min( pMinBounds->y, vertex.y );
+				pMinBounds->z = Min( pMinBounds->z, vertex.z );
+				pMaxBounds->x = Max( pMaxBounds->x, vertex.x );
+				pMaxBounds->y = Max( pMaxBounds->y, vertex.y );
+				pMaxBounds->z = Max( pMaxBounds->z, vertex.z );
+			}
+		}
+	}
+
+	return foundVertex;
+}
+
+
 //-----------------------------------------------------------------------------
 // Creation
 //-----------------------------------------------------------------------------
@@ -662,30 +713,48 @@ void CMesh::Render(	CMatrix4x4* matrices, CCamera* camera, int renderMethod /*=
 			SSubMeshDX& sub = m_SubMeshesDX[subMesh];
 			SMeshMaterialDX& material = m_Materials[sub.material];
 
-			// Set textures from the material
-			for (TUInt32 texture = 0; texture < material.numTextures; ++texture)
-			{
-				g_pd3dDevice->SetTexture( texture, material.textures[texture] );
-			}
-			
-			// Set material properties
-			SetMaterialColour( material.diffuseColour, material.specularPower );
+			// Set textures and material properties
+			SetMaterial( sub.material );
 
 			// Use the provided render method or the render method from the sub-mesh's material
 			// Use the matrix from the sub-mesh's node
 			UseMethod( ((renderMethod == -1) ? material.renderMethod : renderMethod),
 			           &matrices[sub.node], camera );
 
-			// Tell DirectX the vertex and index buffers to use
-			g_pd3dDevice->SetStreamSource( 0, sub.vertexBuffer, 0, sub.vertexSize );
-			g_pd3dDevice->SetIndices( sub.indexBuffer );
-
-			// Draw the primitives from the buffer - a triangle list
-			g_pd3dDevice->DrawIndexedPrimitive( D3DPT_TRIANGLELIST, 0, 0, sub.numVertices, 0,
-			                                    sub.numIndices / 3 );
+			DrawSubMesh( subMesh );
 		}
 	}
 }
 
+// Set the textures and material colour of the given material ready for rendering
+void CMesh::SetMaterial( TUInt32 material )
+{
+	SMeshMaterialDX& materialDX = m_Materials[material];
+
+	// Set textures from the material
+	for (TUInt32 texture = 0; texture < materialDX.numTextures; ++texture)
+	{
+		g_pd3dDevice->SetTexture( texture, materialDX.textures[texture] );
+	}
+
+	// Set material properties
+	SetMaterialColour( materialDX.diffuseColour, materialDX.specularPower );
+}
+
+// Draw the triangles of a single sub-mesh. The render method and material must already be
+// set up - used when rendering is sorted by state (see CRenderQueue)
+void CMesh::DrawSubMesh( TUInt32 subMesh )
+{
+	SSubMeshDX& sub = m_SubMeshesDX[subMesh];
+
+	// Tell DirectX the vertex and index buffers to use
+	g_pd3dDevice->SetStreamSource( 0, sub.vertexBuffer, 0, sub.vertexSize );
+	g_pd3dDevice->SetIndices( sub.indexBuffer );
+
+	// Draw the primitives from the buffer - a triangle list
+	g_pd3dDevice->DrawIndexedPrimitive( D3DPT_TRIANGLELIST, 0, 0, sub.numVertices, 0,
+	                                    sub.numIndices / 3 );
+}
+
 
 } // namespace gen
\ No newline at end of file
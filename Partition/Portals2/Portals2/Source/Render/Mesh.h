@@ -88,6 +88,44 @@ public:
 	// there are no more vertices to enumerate
 	bool GetVertex( CVector3* pVertex );
 
+	// Get the axis-aligned bounds of the geometry controlled by a single node, in the mesh's root
+	// space (i.e. including the transforms of the node's parents, but not of the root). Returns
+	// false if the node controls no geometry
+	bool GetNodeBounds( TUInt32 node, CVector3* pMinBounds, CVector3* pMaxBounds );
+
+
+	/////////////////////////////////////
+	// Sub-mesh / material access
+
+	// Unique number identifying this mesh, used to group rendering by mesh
+	TUInt32 GetID()
+	{
+		return m_ID;
+	}
+
+	TUInt32 GetNumSubMeshes()
+	{
+		return m_HasGeometry ? m_NumSubMeshes : 0;
+	}
+
+	// Get the node controlling the given sub-mesh
+	TUInt32 GetSubMeshNode( TUInt32 subMesh )
+	{
+		return m_SubMeshesDX[subMesh].node;
+	}
+
+	// Get the index of the material used by the given sub-mesh
+	TUInt32 GetSubMeshMaterial( TUInt32 subMesh )
+	{
+		return m_SubMeshesDX[subMesh].material;
+	}
+
+	// Get the render method used by the given material
+	ERenderMethod GetMaterialRenderMethod( TUInt32 material )
+	{
+		return m_Materials[material].renderMethod;
+	}
+
 
 	/////////////////////////////////////
 	// Hierarchy access
@@ -130,6 +168,13 @@ public:
 	// and from the given camera. May provide an alternative render method to use for the whole mesh
 	void Render( CMatrix4x4* matrices, CCamera* camera, int renderMethod = -1 );
 
+	// Set the textures and material colour of the given material ready for rendering
+	void SetMaterial( TUInt32 material );
+
+	// Draw the triangles of a single sub-mesh. The render method and material must already be
+	// set up - used when rendering is sorted by state (see CRenderQueue)
+	void DrawSubMesh( TUInt32 subMesh );
+
 
 /*-----------------------------------------------------------------------------------------
 	Private interface
@@ -203,6 +248,10 @@ private:
 		Data
 	---------------------------------------------------------------------------------------------*/
 
+	// Unique number for this mesh, and the number to use for the next mesh created
+	TUInt32          m_ID;
+	static TUInt32   m_NextID;
+
 	// Does this mesh have any geometry to render
 	bool             m_HasGeometry;
 
@@ -0,0 +1,441 @@
+/*******************************************
+	OcclusionBuffer.cpp
+
+	Software occlusion buffer implementation
+********************************************/
+
+#if defined(__AVX__)
+	#include <immintrin.h>
+#else
+	#include <emmintrin.h>
+#endif
+
+#include "BaseMath.h"
+#include "OcclusionBuffer.h"
+
+namespace gen
+{
+
+/*-----------------------------------------------------------------------------------------
+	SIMD support
+-----------------------------------------------------------------------------------------*/
+// The rasteriser works on rows of eight depths at a time. When compiled for AVX a row is a
+// single 256-bit register, otherwise it is held as a pair of 128-bit SSE registers. The small
+// set of functions below hides the difference from the rest of the code
+
+namespace
+{
+
+#if defined(__AVX__)
+
+typedef __m256 TFloat8;
+
+inline TFloat8 Float8Set( TFloat32 f )                 { return _mm256_set1_ps( f ); }
+inline TFloat8 Float8Ramp()                            { return _mm256_set_ps( 7, 6, 5, 4, 3, 2, 1, 0 ); }
+inline TFloat8 Float8Load( const TFloat32* p )         { return _mm256_load_ps( p ); }
+inline void    Float8Store( TFloat32* p, TFloat8 v )   { _mm256_store_ps( p, v ); }
+inline TFloat8 Float8Add( TFloat8 a, TFloat8 b )       { return _mm256_add_ps( a, b ); }
+inline TFloat8 Float8Mul( TFloat8 a, TFloat8 b )       { return _mm256_mul_ps( a, b ); }
+inline TFloat8 Float8Min( TFloat8 a, TFloat8 b )       { return _mm256_min_ps( a, b ); }
+inline TFloat8 Float8Max( TFloat8 a, TFloat8 b )       { return _mm256_max_ps( a, b ); }
+inline TFloat8 Float8And( TFloat8 a, TFloat8 b )       { return _mm256_and_ps( a, b ); }
+inline TFloat8 Float8GreaterEqual( TFloat8 a, TFloat8 b ) { return _mm256_cmp_ps( a, b, _CMP_GE_OQ ); }
+inline TFloat8 Float8LessEqual( TFloat8 a, TFloat8 b )    { return _mm256_cmp_ps( a, b, _CMP_LE_OQ ); }
+
+// Return a where mask is set, b elsewhere
+inline TFloat8 Float8Select( TFloat8 mask, TFloat8 a, TFloat8 b )
+{
+	return _mm256_blendv_ps( b, a, mask );
+}
+
+// Return non-zero if any element of the mask is set
+inline int Float8Any( TFloat8 mask )
+{
+	return _mm256_movemask_ps( mask );
+}
+
+// Return the largest of the eight elements
+inline TFloat32 Float8HorizontalMax( TFloat8 v )
+{
+	__m128 m = _mm_max_ps( _mm256_castps256_ps128( v ), _mm256_extractf128_ps( v, 1 ) );
+	m = _mm_max_ps( m, _mm_shuffle_ps( m, m, _MM_SHUFFLE(1, 0, 3, 2) ) );
+	m = _mm_max_ps( m, _mm_shuffle_ps( m, m, _MM_SHUFFLE(2, 3, 0, 1) ) );
+	return _mm_cvtss_f32( m );
+}
+
+#else // SSE2
+
+struct TFloat8
+{
+	__m128 lo, hi;
+};
+
+inline TFloat8 Make8( __m128 lo, __m128 hi )
+{
+	TFloat8 r = { lo, hi };
+	return r;
+}
+
+inline TFloat8 Float8Set( TFloat32 f )                 { return Make8( _mm_set1_ps( f ), _mm_set1_ps( f ) ); }
+inline TFloat8 Float8Ramp()                            { return Make8( _mm_set_ps( 3, 2, 1, 0 ), _mm_set_ps( 7, 6, 5, 4 ) ); }
+inline TFloat8 Float8Load( const TFloat32* p )         { return Make8( _mm_load_ps( p ), _mm_load_ps( p + 4 ) ); }
+inline void    Float8Store( TFloat32* p, TFloat8 v )   { _mm_store_ps( p, v.lo ); _mm_store_ps( p + 4, v.hi ); }
+inline TFloat8 Float8Add( TFloat8 a, TFloat8 b )       { return Make8( _mm_add_ps( a.lo, b.lo ), _mm_add_ps( a.hi, b.hi ) ); }
+inline TFloat8 Float8Mul( TFloat8 a, TFloat8 b )       { return Make8( _mm_mul_ps( a.lo, b.lo ), _mm_mul_ps( a.hi, b.hi ) ); }
+inline TFloat8 Float8Min( TFloat8 a, TFloat8 b )       { return Make8( _mm_min_ps( a.lo, b.lo ), _mm_min_ps( a.hi, b.hi ) ); }
+inline TFloat8 Float8Max( TFloat8 a, TFloat8 b )       { return Make8( _mm_max_ps( a.lo, b.lo ), _mm_max_ps( a.hi, b.hi ) ); }
+inline TFloat8 Float8And( TFloat8 a, TFloat8 b )       { return Make8( _mm_and_ps( a.lo, b.lo ), _mm_and_ps( a.hi, b.hi ) ); }
+inline TFloat8 Float8GreaterEqual( TFloat8 a, TFloat8 b ) { return Make8( _mm_cmpge_ps( a.lo, b.lo ), _mm_cmpge_ps( a.hi, b.hi ) ); }
+inline TFloat8 Float8LessEqual( TFloat8 a, TFloat8 b )    { return Make8( _mm_cmple_ps( a.lo, b.lo ), _mm_cmple_ps( a.hi, b.hi ) ); }
+
+// Return a where mask is set, b elsewhere
+inline TFloat8 Float8Select( TFloat8 mask, TFloat8 a, TFloat8 b )
+{
+	return Make8( _mm_or_ps( _mm_and_ps( mask.lo, a.lo ), _mm_andnot_ps( mask.lo, b.lo ) ),
+	              _mm_or_ps( _mm_and_ps( mask.hi, a.hi ), _mm_andnot_ps( mask.hi, b.hi ) ) );
+}
+
+// Return non-zero if any element of the mask is set
+inline int Float8Any( TFloat8 mask )
+{
+	return _mm_movemask_ps( _mm_or_ps( mask.lo, mask.hi ) );
+}
+
+// Return the largest of the eight elements
+inline TFloat32 Float8HorizontalMax( TFloat8 v )
+{
+	__m128 m = _mm_max_ps( v.lo, v.hi );
+	m = _mm_max_ps( m, _mm_shuffle_ps( m, m, _MM_SHUFFLE(1, 0, 3, 2) ) );
+	m = _mm_max_ps( m, _mm_shuffle_ps( m, m, _MM_SHUFFLE(2, 3, 0, 1) ) );
+	return _mm_cvtss_f32( m );
+}
+
+#endif
+
+} // anonymous namespace
+
+
+/*-----------------------------------------------------------------------------------------
+	Constructors/Destructors
+-----------------------------------------------------------------------------------------*/
+
+// Constructor takes the buffer size in pixels, which is rounded up to whole tiles
+COcclusionBuffer::COcclusionBuffer( TUInt32 width /*= 256*/, TUInt32 height /*= 128*/ )
+{
+	m_TilesX = (width + kTileSize - 1) / kTileSize;
+	m_TilesY = (height + kTileSize - 1) / kTileSize;
+	m_Width = m_TilesX * kTileSize;
+	m_Height = m_TilesY * kTileSize;
+
+	// Allocate depth buffer with extra space to align it to 32 bytes for SIMD loads and stores
+	TUInt32 numPixels = m_Width * m_Height;
+	m_DepthMemory = new TUInt8[numPixels * sizeof(TFloat32) + 31];
+	m_Depths = reinterpret_cast<TFloat32*>((reinterpret_cast<size_t>(m_DepthMemory) + 31) & ~size_t(31));
+
+	m_TileMaxDepths = new TFloat32[m_TilesX * m_TilesY];
+
+	Clear();
+	ResetStats();
+}
+
+// Destructor
+COcclusionBuffer::~COcclusionBuffer()
+{
+	delete[] m_TileMaxDepths;
+	delete[] m_DepthMemory;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+	Rendering / testing
+-----------------------------------------------------------------------------------------*/
+
+void COcclusionBuffer::ResetStats()
+{
+	m_Stats.OccluderTriangles = 0;
+	m_Stats.RejectedTriangles = 0;
+	m_Stats.BoxesTested = 0;
+	m_Stats.BoxesCulled = 0;
+}
+
+// Set all depths in the buffer to the far clip distance (1.0)
+void COcclusionBuffer::Clear()
+{
+	TFloat8 farDepth = Float8Set( 1.0f );
+	TFloat32* depths = m_Depths;
+	TFloat32* depthsEnd = m_Depths + m_Width * m_Height;
+	while (depths != depthsEnd)
+	{
+		Float8Store( depths, farDepth );
+		depths += kTileSize;
+	}
+
+	for (TUInt32 tile = 0; tile < m_TilesX * m_TilesY; ++tile)
+	{
+		m_TileMaxDepths[tile] = 1.0f;
+	}
+}
+
+
+// Rasterise a list of occluder triangles into the buffer. Vertices are given as an array of
+// positions, three per triangle, transformed by the given world matrix and view-projection
+// matrix. Triangles are treated as double-sided. Triangles crossing the near clip plane are
+// skipped, which is conservative - an occluder can only ever hide less. Optionally pass a
+// user clip plane (in clip space, as given to the device) - triangles that are even partly
+// clipped by it are also skipped. Only pixels wholly covered by a triangle are written
+void COcclusionBuffer::RenderOccluders( const CVector3* vertices, TUInt32 numTriangles,
+                                        const CMatrix4x4& worldMatrix,
+                                        const CMatrix4x4& viewProjMatrix,
+                                        const CVector4* clipPlane /*= 0*/ )
+{
+	CMatrix4x4 worldViewProj = worldMatrix * viewProjMatrix;
+	TFloat32 halfWidth = 0.5f * static_cast<TFloat32>(m_Width);
+	TFloat32 halfHeight = 0.5f * static_cast<TFloat32>(m_Height);
+
+	for (TUInt32 tri = 0; tri < numTriangles; ++tri)
+	{
+		// Project the three vertices to buffer pixel coordinates
+		CVector3 screenPts[3];
+		bool clipped = false;
+		for (int vert = 0; vert < 3; ++vert)
+		{
+			CVector4 projPt = CVector4( vertices[tri * 3 + vert], 1.0f ) * worldViewProj;
+			TFloat32 depth = projPt.z;
+			if (projPt.w <= 0.0f || depth < 0.0f || (clipPlane && Dot( projPt, *clipPlane ) < 0.0f))
+			{
+				// Vertex is nearer than the near clip plane or outside the user clip plane - the
+				// GPU would clip this triangle so it cannot be relied on to hide anything
+				clipped = true;
+				break;
+			}
+			TFloat32 invW = 1.0f / projPt.w;
+			screenPts[vert].x = (projPt.x * invW + 1.0f) * halfWidth;
+			screenPts[vert].y = (1.0f - projPt.y * invW) * halfHeight; // Buffer y is down the screen
+			screenPts[vert].z = depth * invW;
+		}
+
+		if (clipped)
+		{
+			++m_Stats.RejectedTriangles;
+			continue;
+		}
+		RasteriseTriangle( screenPts[0], screenPts[1], screenPts[2] );
+	}
+
+	UpdateTileMaxDepths();
+}
+
+
+// Rasterise a single triangle given in buffer pixel coordinates (x, y) and depth (z). Writes the
+// pixels wholly inside the triangle, with the furthest depth the triangle has in each
+void COcclusionBuffer::RasteriseTriangle( const CVector3& v0, const CVector3& v1In,
+                                          const CVector3& v2In )
+{
+	// Double-sided: swap vertices to make the triangle's signed area positive
+	TFloat32 area = (v1In.x - v0.x) * (v2In.y - v0.y) - (v2In.x - v0.x) * (v1In.y - v0.y);
+	const CVector3& v1 = (area < 0.0f) ? v2In : v1In;
+	const CVector3& v2 = (area < 0.0f) ? v1In : v2In;
+	area = Abs( area );
+	if (area < 1.0e-6f)
+	{
+		++m_Stats.RejectedTriangles;
+		return;
+	}
+
+	// Pixel range covered by triangle (pixel centres are at +0.5), clamped to the buffer
+	TInt32 minPx = static_cast<TInt32>(ceil( Min( v0.x, Min( v1.x, v2.x ) ) - 0.5f ));
+	TInt32 maxPx = static_cast<TInt32>(floor( Max( v0.x, Max( v1.x, v2.x ) ) - 0.5f ));
+	TInt32 minPy = static_cast<TInt32>(ceil( Min( v0.y, Min( v1.y, v2.y ) ) - 0.5f ));
+	TInt32 maxPy = static_cast<TInt32>(floor( Max( v0.y, Max( v1.y, v2.y ) ) - 0.5f ));
+	minPx = Max( minPx, 0 );
+	minPy = Max( minPy, 0 );
+	maxPx = Min( maxPx, static_cast<TInt32>(m_Width) - 1 );
+	maxPy = Min( maxPy, static_cast<TInt32>(m_Height) - 1 );
+	if (minPx > maxPx || minPy > maxPy)
+	{
+		return;
+	}
+	++m_Stats.OccluderTriangles;
+
+	// Edge functions E(x,y) = A*x + B*y + C, positive inside the triangle for each edge. Occluders
+	// must not hide more than they cover, so a pixel is only written if all of it is inside the
+	// triangle, not just its centre. Across a pixel E varies by up to (|A| + |B|) / 2 either side
+	// of its value at the centre, so each edge is moved inwards by that much
+	const CVector3* edgeStart[3] = { &v0, &v1, &v2 };
+	const CVector3* edgeEnd[3]   = { &v1, &v2, &v0 };
+	TFloat8 edgeA[3], edgeB[3], edgeC[3];
+	for (int edge = 0; edge < 3; ++edge)
+	{
+		TFloat32 a = edgeStart[edge]->y - edgeEnd[edge]->y;
+		TFloat32 b = edgeEnd[edge]->x - edgeStart[edge]->x;
+		TFloat32 c = -(a * edgeStart[edge]->x + b * edgeStart[edge]->y) - 0.5f * (Abs( a ) + Abs( b ));
+		edgeA[edge] = Float8Set( a );
+		edgeB[edge] = Float8Set( b );
+		edgeC[edge] = Float8Set( c );
+	}
+
+	// Depth plane z(x,y) = zA*x + zB*y + zC - post-projection z is linear in screen space. For the
+	// same reason the depth stored is the furthest the triangle reaches over the pixel rather than
+	// the depth at its centre
+	TFloat32 invArea = 1.0f / area;
+	TFloat32 dzdx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) * invArea;
+	TFloat32 dzdy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) * invArea;
+	TFloat8 zA = Float8Set( dzdx );
+	TFloat8 zB = Float8Set( dzdy );
+	TFloat8 zC = Float8Set( v0.z - dzdx * v0.x - dzdy * v0.y + 0.5f * (Abs( dzdx ) + Abs( dzdy )) );
+	TFloat8 zero = Float8Set( 0.0f );
+
+	// Visit each tile overlapping the triangle's pixel range
+	TFloat8 laneOffsets = Float8Add( Float8Ramp(), Float8Set( 0.5f ) );
+	TUInt32 minTileX = minPx / kTileSize, maxTileX = maxPx / kTileSize;
+	TUInt32 minTileY = minPy / kTileSize, maxTileY = maxPy / kTileSize;
+	for (TUInt32 tileY = minTileY; tileY <= maxTileY; ++tileY)
+	{
+		for (TUInt32 tileX = minTileX; tileX <= maxTileX; ++tileX)
+		{
+			TFloat32* tileDepths = m_Depths + (tileY * m_TilesX + tileX) * kTilePixels;
+
+			// Lane x coordinates are the same for every row of the tile, so precalculate the
+			// x part of each edge function and of the depth
+			TFloat8 xs = Float8Add( Float8Set( static_cast<TFloat32>(tileX * kTileSize) ), laneOffsets );
+			TFloat8 edgeX[3];
+			for (int edge = 0; edge < 3; ++edge)
+			{
+				edgeX[edge] = Float8Add( Float8Mul( edgeA[edge], xs ), edgeC[edge] );
+			}
+			TFloat8 zX = Float8Add( Float8Mul( zA, xs ), zC );
+
+			// Rows of the tile that the triangle can touch
+			TUInt32 firstRow = Max( static_cast<TInt32>(tileY * kTileSize), minPy ) - tileY * kTileSize;
+			TUInt32 lastRow = Min( static_cast<TInt32>(tileY * kTileSize + kTileSize - 1), maxPy ) -
+			                  tileY * kTileSize;
+			for (TUInt32 row = firstRow; row <= lastRow; ++row)
+			{
+				TFloat8 y = Float8Set( static_cast<TFloat32>(tileY * kTileSize + row) + 0.5f );
+				TFloat8 inside = Float8GreaterEqual( Float8Add( edgeX[0], Float8Mul( edgeB[0], y ) ), zero );
+				inside = Float8And( inside, Float8GreaterEqual( Float8Add( edgeX[1], Float8Mul( edgeB[1], y ) ), zero ) );
+				inside = Float8And( inside, Float8GreaterEqual( Float8Add( edgeX[2], Float8Mul( edgeB[2], y ) ), zero ) );
+				if (!Float8Any( inside ))
+				{
+					continue;
+				}
+
+				// Keep nearest depth where the triangle covers the pixel
+				TFloat32* rowDepths = tileDepths + row * kTileSize;
+				TFloat8 depth = Float8Load( rowDepths );
+				TFloat8 triDepth = Float8Add( zX, Float8Mul( zB, y ) );
+				Float8Store( rowDepths, Float8Select( inside, Float8Min( depth, triDepth ), depth ) );
+			}
+		}
+	}
+}
+
+
+// Recalculate the furthest depth held in each tile
+void COcclusionBuffer::UpdateTileMaxDepths()
+{
+	const TFloat32* tileDepths = m_Depths;
+	for (TUInt32 tile = 0; tile < m_TilesX * m_TilesY; ++tile)
+	{
+		TFloat8 maxDepth = Float8Load( tileDepths );
+		for (TUInt32 row = 1; row < kTileSize; ++row)
+		{
+			maxDepth = Float8Max( maxDepth, Float8Load( tileDepths + row * kTileSize ) );
+		}
+		m_TileMaxDepths[tile] = Float8HorizontalMax( maxDepth );
+		tileDepths += kTilePixels;
+	}
+}
+
+
+// Test whether an axis-aligned box (in model space, positioned by the given world matrix)
+// could be visible given the occluders in the buffer. Returns true if any part of the box
+// may be in front of the stored depths or the box crosses the near clip plane. Returns false
+// if the box is completely hidden or completely off-screen
+bool COcclusionBuffer::IsBoxVisible( const CVector3& minBounds, const CVector3& maxBounds,
+                                     const CMatrix4x4& worldMatrix,
+                                     const CMatrix4x4& viewProjMatrix )
+{
+	++m_Stats.BoxesTested;
+
+	// Project the eight corners of the box, finding the screen rectangle and nearest depth
+	CMatrix4x4 worldViewProj = worldMatrix * viewProjMatrix;
+	TFloat32 minX = 1.0e30f, maxX = -1.0e30f;
+	TFloat32 minY = 1.0e30f, maxY = -1.0e30f;
+	TFloat32 minZ = 1.0e30f;
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		CVector3 pt( (corner & 1) ? maxBounds.x : minBounds.x,
+		             (corner & 2) ? maxBounds.y : minBounds.y,
+		             (corner & 4) ? maxBounds.z : minBounds.z );
+		CVector4 projPt = CVector4( pt, 1.0f ) * worldViewProj;
+		if (projPt.w <= 0.0f || projPt.z < 0.0f)
+		{
+			// Box crosses the near clip plane - assume visible
+			return true;
+		}
+		TFloat32 invW = 1.0f / projPt.w;
+		TFloat32 x = (projPt.x * invW + 1.0f) * 0.5f * static_cast<TFloat32>(m_Width);
+		TFloat32 y = (1.0f - projPt.y * invW) * 0.5f * static_cast<TFloat32>(m_Height);
+		minX = Min( minX, x );
+		maxX = Max( maxX, x );
+		minY = Min( minY, y );
+		maxY = Max( maxY, y );
+		minZ = Min( minZ, projPt.z * invW );
+	}
+
+	// Every pixel that the screen rectangle touches, clamped to the buffer
+	TInt32 minPx = Max( static_cast<TInt32>(floor( minX )), 0 );
+	TInt32 maxPx = Min( static_cast<TInt32>(floor( maxX )), static_cast<TInt32>(m_Width) - 1 );
+	TInt32 minPy = Max( static_cast<TInt32>(floor( minY )), 0 );
+	TInt32 maxPy = Min( static_cast<TInt32>(floor( maxY )), static_cast<TInt32>(m_Height) - 1 );
+	if (minPx > maxPx || minPy > maxPy || minZ > 1.0f)
+	{
+		// Off-screen or beyond the far clip
+		++m_Stats.BoxesCulled;
+		return false;
+	}
+
+	// The box is visible if any pixel in the rectangle holds a depth further than the box
+	TFloat8 boxDepth = Float8Set( minZ );
+	TFloat8 laneOffsets = Float8Ramp();
+	TFloat8 rectMinX = Float8Set( static_cast<TFloat32>(minPx) );
+	TFloat8 rectMaxX = Float8Set( static_cast<TFloat32>(maxPx) );
+	TUInt32 minTileX = minPx / kTileSize, maxTileX = maxPx / kTileSize;
+	TUInt32 minTileY = minPy / kTileSize, maxTileY = maxPy / kTileSize;
+	for (TUInt32 tileY = minTileY; tileY <= maxTileY; ++tileY)
+	{
+		for (TUInt32 tileX = minTileX; tileX <= maxTileX; ++tileX)
+		{
+			// Skip whole tile if even its furthest depth is in front of the box
+			TUInt32 tile = tileY * m_TilesX + tileX;
+			if (m_TileMaxDepths[tile] < minZ)
+			{
+				continue;
+			}
+
+			// Mask of the lanes within the rectangle's x range
+			TFloat8 xs = Float8Add( Float8Set( static_cast<TFloat32>(tileX * kTileSize) ), laneOffsets );
+			TFloat8 inRect = Float8And( Float8GreaterEqual( xs, rectMinX ), Float8LessEqual( xs, rectMaxX ) );
+
+			const TFloat32* tileDepths = m_Depths + tile * kTilePixels;
+			TUInt32 firstRow = Max( static_cast<TInt32>(tileY * kTileSize), minPy ) - tileY * kTileSize;
+			TUInt32 lastRow = Min( static_cast<TInt32>(tileY * kTileSize + kTileSize - 1), maxPy ) -
+			                  tileY * kTileSize;
+			for (TUInt32 row = firstRow; row <= lastRow; ++row)
+			{
+				TFloat8 depth = Float8Load( tileDepths + row * kTileSize );
+				if (Float8Any( Float8And( inRect, Float8GreaterEqual( depth, boxDepth ) ) ))
+				{
+					return true;
+				}
+			}
+		}
+	}
+
+	++m_Stats.BoxesCulled;
+	return false;
+}
+
+
+} // namespace gen
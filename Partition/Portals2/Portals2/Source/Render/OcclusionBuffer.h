@@ -0,0 +1,149 @@
+/*******************************************
+	OcclusionBuffer.h
+
+	Software occlusion buffer declarations
+********************************************/
+
+#pragma once
+
+#include "Defines.h"
+#include "CVector3.h"
+#include "CVector4.h"
+#include "CMatrix4x4.h"
+
+namespace gen
+{
+
+// A small CPU-side depth buffer used to cull entities hidden behind large occluders (walls,
+// houses etc.) before they are sent to the GPU. Occluder triangles are rasterised into the
+// buffer at low resolution, then entity bounding boxes are tested against it. Works entirely
+// on the CPU (no DirectX dependency) so it can also be used without a render device.
+//
+// The buffer is split into 8x8 pixel tiles, each stored contiguously. Every tile row is eight
+// depths processed together with SIMD instructions (one AVX register or a pair of SSE registers).
+// Each tile also keeps its furthest depth so box tests can reject whole tiles at a time.
+// Depths are post-projection z values (0 = near clip, 1 = far clip)
+class COcclusionBuffer
+{
+/////////////////////////////////////
+//	Constructors/Destructors
+public:
+	// Constructor takes the buffer size in pixels, which is rounded up to whole tiles. The
+	// buffer resolution is independent of the viewport - only the aspect ratio matters
+	COcclusionBuffer( TUInt32 width = 256, TUInt32 height = 128 );
+
+	// Destructor
+	~COcclusionBuffer();
+
+private:
+	// Prevent use of copy constructor and assignment operator (private and not defined)
+	COcclusionBuffer( const COcclusionBuffer& );
+	COcclusionBuffer& operator=( const COcclusionBuffer& );
+
+
+/////////////////////////////////////
+//	Public interface
+public:
+
+	/////////////////////////////////////
+	// Types
+
+	// Statistics gathered since the last call to ResetStats
+	struct SStats
+	{
+		TUInt32 OccluderTriangles; // Occluder triangles rasterised
+		TUInt32 RejectedTriangles; // Occluder triangles skipped (crossing near clip or degenerate)
+		TUInt32 BoxesTested;       // Bounding boxes tested against the buffer
+		TUInt32 BoxesCulled;       // Bounding boxes found to be hidden
+	};
+
+
+	/////////////////////////////////////
+	// Getters
+
+	TUInt32 GetWidth()
+	{
+		return m_Width;
+	}
+
+	TUInt32 GetHeight()
+	{
+		return m_Height;
+	}
+
+	const SStats& GetStats()
+	{
+		return m_Stats;
+	}
+
+	void ResetStats();
+
+
+	/////////////////////////////////////
+	// Rendering / testing
+
+	// Set all depths in the buffer to the far clip distance (1.0)
+	void Clear();
+
+	// Rasterise a list of occluder triangles into the buffer. Vertices are given as an array of
+	// positions, three per triangle, transformed by the given world matrix and view-projection
+	// matrix. Triangles are treated as double-sided. Triangles crossing the near clip plane are
+	// skipped, which is conservative - an occluder can only ever hide less. Optionally pass a
+	// user clip plane (in clip space, as given to the device) - triangles that are even partly
+	// clipped by it are also skipped. Only pixels wholly covered by a triangle are written
+	void RenderOccluders( const CVector3* vertices, TUInt32 numTriangles,
+	                      const CMatrix4x4& worldMatrix, const CMatrix4x4& viewProjMatrix,
+	                      const CVector4* clipPlane = 0 );
+
+	// Test whether an axis-aligned box (in model space, positioned by the given world matrix)
+	// could be visible given the occluders in the buffer. Returns true if any part of the box
+	// may be in front of the stored depths or the box crosses the near clip plane. Returns false
+	// if the box is completely hidden or completely off-screen
+	bool IsBoxVisible( const CVector3& minBounds, const CVector3& maxBounds,
+	                   const CMatrix4x4& worldMatrix, const CMatrix4x4& viewProjMatrix );
+
+
+/////////////////////////////////////
+//	Private interface
+private:
+
+	/////////////////////////////////////
+	// Constants
+
+	static const TUInt32 kTileSize = 8;                     // Tile width & height in pixels
+	static const TUInt32 kTilePixels = kTileSize * kTileSize;
+
+
+	/////////////////////////////////////
+	// Support functions
+
+	// Rasterise a single triangle given in buffer pixel coordinates (x, y) and depth (z), writing
+	// only the pixels wholly inside it
+	void RasteriseTriangle( const CVector3& v0, const CVector3& v1, const CVector3& v2 );
+
+	// Recalculate the furthest depth held in each tile
+	void UpdateTileMaxDepths();
+
+
+	/////////////////////////////////////
+	// Data
+
+	// Buffer dimensions in pixels and in tiles
+	TUInt32   m_Width;
+	TUInt32   m_Height;
+	TUInt32   m_TilesX;
+	TUInt32   m_TilesY;
+
+	// Depth values stored tile by tile, each tile as 8 rows of 8 depths. Dynamically allocated
+	// and 32-byte aligned for SIMD access (m_DepthMemory is the unaligned allocation)
+	TFloat32* m_Depths;
+	TUInt8*   m_DepthMemory;
+
+	// Furthest depth within each tile
+	TFloat32* m_TileMaxDepths;
+
+	SStats    m_Stats;
+};
+
+
+} // namespace gen
@@ -144,12 +144,23 @@ RenderMethodDecl renderMethodDecls[NumRenderMethods] =
 
 // Use the given method for rendering, pass the world matrix and camera to be used for the shaders
 void UseMethod( int method, CMatrix4x4* worldMatrix, CCamera* camera )
+{
+	SetMethodShaders( method );
+	SetMethodConstants( method, worldMatrix, camera );
+}
+
+// Set the vertex declaration and shaders for the given method - only needed when method changes
+void SetMethodShaders( int method )
 {
 	// Set shaders in DirectX
 	g_pd3dDevice->SetVertexDeclaration( renderMethodDecls[method].vertexDecl );
 	g_pd3dDevice->SetVertexShader( renderMethods[method].vertexShader );
 	g_pd3dDevice->SetPixelShader( renderMethods[method].pixelShader );
+}
 
+// Set the shader constants for the given method, world matrix and camera
+void SetMethodConstants( int method, CMatrix4x4* worldMatrix, CCamera* camera )
+{
 	// Initialise shader constants and other render settings
 	renderMethods[method].vertexShaderFn( method, worldMatrix, camera );
 	renderMethods[method].pixelShaderFn( method, worldMatrix, camera );
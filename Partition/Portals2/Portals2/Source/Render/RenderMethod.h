@@ -83,6 +83,13 @@ void SetLights( CLight** lights );
 // Use the given method for rendering, pass the world matrix and camera to be used for the shaders
 void UseMethod( int method, CMatrix4x4* worldMatrix, CCamera* camera );
 
+// The two stages of UseMethod above, for use when rendering is sorted by render method:
+// Set the vertex declaration and shaders for the given method - only needed when method changes
+void SetMethodShaders( int method );
+
+// Set the shader constants for the given method, world matrix and camera
+void SetMethodConstants( int method, CMatrix4x4* worldMatrix, CCamera* camera );
+
 
 //-----------------------------------------------------------------------------
 // Method initialisation
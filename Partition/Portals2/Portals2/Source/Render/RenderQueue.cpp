@@ -0,0 +1,245 @@
+/*******************************************
+	RenderQueue.cpp
+
+	Sorted render queue implementation
+********************************************/
+
+#include "BaseMath.h"
+#include "RenderMethod.h"
+#include "RenderQueue.h"
+
+namespace gen
+{
+
+/*-----------------------------------------------------------------------------------------
+	Sort key layout
+-----------------------------------------------------------------------------------------*/
+// Most significant fields are the most expensive state to change
+//   Bits 56-63: Render method (shaders)
+//   Bits 40-55: Mesh ID (lower 16 bits)
+//   Bits 32-39: Material index within mesh
+//   Bits 16-31: Depth bucket - near to far
+//   Bits  0-15: Unused
+const TUInt32 kMethodShift   = 56;
+const TUInt32 kMeshShift     = 40;
+const TUInt32 kMaterialShift = 32;
+const TUInt32 kDepthShift    = 16;
+
+// Number of depth buckets per world unit, buckets beyond the 16-bit range share the last one
+const TFloat32 kDepthBucketsPerUnit = 16.0f;
+const TUInt32  kMaxDepthBucket = 0xffff;
+
+
+/*-----------------------------------------------------------------------------------------
+	Constructors/Destructors
+-----------------------------------------------------------------------------------------*/
+
+// Constructor reserves space for the given number of packets
+CRenderQueue::CRenderQueue( TUInt32 initialPackets /*= 1024*/ )
+{
+	m_Packets.reserve( initialPackets );
+	m_SortItems.reserve( initialPackets );
+	m_SortTemp.reserve( initialPackets );
+	m_Camera = 0;
+	m_IsSorted = true;
+
+	m_Stats.NumPackets = 0;
+	m_Stats.MethodChangesUnsorted = 0;
+	m_Stats.MethodChangesSorted = 0;
+	m_Stats.MaterialChangesUnsorted = 0;
+	m_Stats.MaterialChangesSorted = 0;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+	Queue building
+-----------------------------------------------------------------------------------------*/
+
+// Empty the queue and prepare to collect packets for the given camera
+void CRenderQueue::Begin( CCamera* camera )
+{
+	m_Camera = camera;
+	m_ViewMatrix = camera->GetViewMatrix();
+	m_Packets.clear();
+	m_IsSorted = false;
+}
+
+// Add a packet for each sub-mesh of the given mesh. The matrices (one per node) must remain
+// valid until the queue is submitted
+void CRenderQueue::AddMesh( CMesh* mesh, CMatrix4x4* matrices )
+{
+	// Depth bucket from the view space depth of the mesh origin
+	TFloat32 depth = m_ViewMatrix.TransformPoint( matrices[0].Position() ).z;
+	TUInt32 depthBucket = 0;
+	if (depth > 0.0f)
+	{
+		depthBucket = static_cast<TUInt32>(Min( depth * kDepthBucketsPerUnit,
+		                                        static_cast<TFloat32>(kMaxDepthBucket) ));
+	}
+
+	TUInt32 numSubMeshes = mesh->GetNumSubMeshes();
+	for (TUInt32 subMesh = 0; subMesh < numSubMeshes; ++subMesh)
+	{
+		SRenderPacket packet;
+		packet.mesh = mesh;
+		packet.subMesh = subMesh;
+		packet.material = mesh->GetSubMeshMaterial( subMesh );
+		packet.renderMethod = mesh->GetMaterialRenderMethod( packet.material );
+		packet.matrix = &matrices[mesh->GetSubMeshNode( subMesh )];
+		packet.sortKey = (static_cast<TUInt64>(packet.renderMethod & 0xff) << kMethodShift) |
+		                 (static_cast<TUInt64>(mesh->GetID() & 0xffff) << kMeshShift) |
+		                 (static_cast<TUInt64>(packet.material & 0xff) << kMaterialShift) |
+		                 (static_cast<TUInt64>(depthBucket) << kDepthShift);
+		m_Packets.push_back( packet );
+	}
+	m_IsSorted = false;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+	Sorting / rendering
+-----------------------------------------------------------------------------------------*/
+
+// Sort the packets by key and count state changes before and after sorting. Does not use
+// the device
+void CRenderQueue::Sort()
+{
+	TUInt32 numPackets = static_cast<TUInt32>(m_Packets.size());
+	m_SortItems.resize( numPackets );
+	m_SortTemp.resize( numPackets );
+	for (TUInt32 packet = 0; packet < numPackets; ++packet)
+	{
+		m_SortItems[packet].key = m_Packets[packet].sortKey;
+		m_SortItems[packet].packet = packet;
+	}
+
+	m_Stats.NumPackets = numPackets;
+	if (numPackets == 0)
+	{
+		m_Stats.MethodChangesUnsorted = m_Stats.MethodChangesSorted = 0;
+		m_Stats.MaterialChangesUnsorted = m_Stats.MaterialChangesSorted = 0;
+		m_IsSorted = true;
+		return;
+	}
+	CountStateChanges( &m_SortItems[0], &m_Stats.MethodChangesUnsorted,
+	                   &m_Stats.MaterialChangesUnsorted );
+
+	// Least significant digit radix sort, one byte of the key per pass. Count the occurrences
+	// of every byte value for all eight passes in a single sweep first
+	TUInt32 counts[8][256] = { 0 };
+	for (TUInt32 item = 0; item < numPackets; ++item)
+	{
+		TUInt64 key = m_SortItems[item].key;
+		for (TUInt32 pass = 0; pass < 8; ++pass)
+		{
+			++counts[pass][(key >> (pass * 8)) & 0xff];
+		}
+	}
+
+	SSortItem* source = &m_SortItems[0];
+	SSortItem* dest = &m_SortTemp[0];
+	for (TUInt32 pass = 0; pass < 8; ++pass)
+	{
+		// Skip passes where every key has the same byte value (e.g. unused key bits)
+		TUInt32 shift = pass * 8;
+		if (counts[pass][(source[0].key >> shift) & 0xff] == numPackets)
+		{
+			continue;
+		}
+
+		// Convert counts to starting offsets, then scatter items in order (stable)
+		TUInt32 offset = 0;
+		for (TUInt32 digit = 0; digit < 256; ++digit)
+		{
+			TUInt32 count = counts[pass][digit];
+			counts[pass][digit] = offset;
+			offset += count;
+		}
+		for (TUInt32 item = 0; item < numPackets; ++item)
+		{
+			dest[counts[pass][(source[item].key >> shift) & 0xff]++] = source[item];
+		}
+
+		SSortItem* temp = source;
+		source = dest;
+		dest = temp;
+	}
+
+	// Odd number of passes leaves the result in the temporary array
+	if (source != &m_SortItems[0])
+	{
+		m_SortItems.swap( m_SortTemp );
+	}
+
+	CountStateChanges( &m_SortItems[0], &m_Stats.MethodChangesSorted,
+	                   &m_Stats.MaterialChangesSorted );
+	m_IsSorted = true;
+}
+
+
+// Render all packets, in sorted order or in the order they were added. Sorts the queue
+// first if it hasn't been sorted since the last packet was added
+void CRenderQueue::Submit( bool sorted /*= true*/ )
+{
+	if (!m_IsSorted)
+	{
+		Sort();
+	}
+
+	// Track current state to skip redundant shader and material changes
+	TUInt32 currentMethod = NumRenderMethods;
+	CMesh*  currentMesh = 0;
+	TUInt32 currentMaterial = 0;
+
+	TUInt32 numPackets = static_cast<TUInt32>(m_Packets.size());
+	for (TUInt32 item = 0; item < numPackets; ++item)
+	{
+		SRenderPacket& packet = m_Packets[sorted ? m_SortItems[item].packet : item];
+
+		if (packet.renderMethod != currentMethod)
+		{
+			SetMethodShaders( packet.renderMethod );
+			currentMethod = packet.renderMethod;
+		}
+		if (packet.mesh != currentMesh || packet.material != currentMaterial)
+		{
+			packet.mesh->SetMaterial( packet.material );
+			currentMesh = packet.mesh;
+			currentMaterial = packet.material;
+		}
+
+		// Constants include the world matrix so are needed for every packet
+		SetMethodConstants( packet.renderMethod, packet.matrix, m_Camera );
+		packet.mesh->DrawSubMesh( packet.subMesh );
+	}
+}
+
+
+// Count the render method and material changes needed to render the packets in the given
+// order (an array of packet indices)
+void CRenderQueue::CountStateChanges( const SSortItem* order, TUInt32* methodChanges,
+                                      TUInt32* materialChanges )
+{
+	*methodChanges = 0;
+	*materialChanges = 0;
+
+	const SRenderPacket* prevPacket = 0;
+	TUInt32 numPackets = static_cast<TUInt32>(m_Packets.size());
+	for (TUInt32 item = 0; item < numPackets; ++item)
+	{
+		const SRenderPacket* packet = &m_Packets[order[item].packet];
+		if (!prevPacket || packet->renderMethod != prevPacket->renderMethod)
+		{
+			++(*methodChanges);
+		}
+		if (!prevPacket || packet->mesh != prevPacket->mesh ||
+		    packet->material != prevPacket->material)
+		{
+			++(*materialChanges);
+		}
+		prevPacket = packet;
+	}
+}
+
+
+} // namespace gen
@@ -0,0 +1,152 @@
+/*******************************************
+	RenderQueue.h
+
+	Sorted render queue declarations
+********************************************/
+
+#pragma once
+
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+#include "CMatrix4x4.h"
+#include "Mesh.h"
+#include "Camera.h"
+
+namespace gen
+{
+
+// A render queue collects the sub-meshes to draw for one view (camera) rather than drawing
+// them immediately. Each sub-mesh is stored as a packet with a 64-bit sort key built from its
+// render method, mesh, material and depth. The packets are radix sorted on this key and then
+// submitted in order, only changing shaders / textures when they differ from the previous
+// packet. Near packets are drawn before far ones within each state group to help early-z.
+//
+// The number of state changes in the original and sorted order is counted without using the
+// device, so the benefit of sorting can be measured without rendering
+class CRenderQueue
+{
+/////////////////////////////////////
+//	Constructors/Destructors
+public:
+	// Constructor reserves space for the given number of packets
+	CRenderQueue( TUInt32 initialPackets = 1024 );
+
+private:
+	// Prevent use of copy constructor and assignment operator (private and not defined)
+	CRenderQueue( const CRenderQueue& );
+	CRenderQueue& operator=( const CRenderQueue& );
+
+
+/////////////////////////////////////
+//	Public interface
+public:
+
+	/////////////////////////////////////
+	// Types
+
+	// State changes counted for the packets in the queue
+	struct SStats
+	{
+		TUInt32 NumPackets;
+		TUInt32 MethodChangesUnsorted;   // Shader changes in the order packets were added
+		TUInt32 MethodChangesSorted;     // ...and after sorting
+		TUInt32 MaterialChangesUnsorted; // Texture / material changes in the order added
+		TUInt32 MaterialChangesSorted;   // ...and after sorting
+	};
+
+
+	/////////////////////////////////////
+	// Getters
+
+	TUInt32 GetNumPackets()
+	{
+		return static_cast<TUInt32>(m_Packets.size());
+	}
+
+	// Get state change counts, calculated by Sort
+	const SStats& GetStats()
+	{
+		return m_Stats;
+	}
+
+
+	/////////////////////////////////////
+	// Queue building
+
+	// Empty the queue and prepare to collect packets for the given camera
+	void Begin( CCamera* camera );
+
+	// Add a packet for each sub-mesh of the given mesh. The matrices (one per node) must remain
+	// valid until the queue is submitted
+	void AddMesh( CMesh* mesh, CMatrix4x4* matrices );
+
+
+	/////////////////////////////////////
+	// Sorting / rendering
+
+	// Sort the packets by key and count state changes before and after sorting. Does not use
+	// the device
+	void Sort();
+
+	// Render all packets, in sorted order or in the order they were added. Sorts the queue
+	// first if it hasn't been sorted since the last packet was added
+	void Submit( bool sorted = true );
+
+
+/////////////////////////////////////
+//	Private interface
+private:
+
+	/////////////////////////////////////
+	// Types
+
+	// Everything needed to render one sub-mesh
+	struct SRenderPacket
+	{
+		TUInt64     sortKey;
+		CMesh*      mesh;
+		TUInt32     subMesh;
+		TUInt32     material;
+		TUInt32     renderMethod;
+		CMatrix4x4* matrix;   // World matrix for the sub-mesh
+	};
+
+	// Key / packet index pairs are sorted rather than moving whole packets
+	struct SSortItem
+	{
+		TUInt64 key;
+		TUInt32 packet;
+	};
+
+
+	/////////////////////////////////////
+	// Support functions
+
+	// Count the render method and material changes needed to render the packets in the given
+	// order (an array of packet indices)
+	void CountStateChanges( const SSortItem* order, TUInt32* methodChanges,
+	                        TUInt32* materialChanges );
+
+
+	/////////////////////////////////////
+	// Data
+
+	// Camera for the current view, and its view matrix for calculating packet depths
+	CCamera*              m_Camera;
+	CMatrix4x4            m_ViewMatrix;
+
+	// Packets in the order they were added
+	vector<SRenderPacket> m_Packets;
+
+	// Sort order of packets, and temporary space used while sorting
+	vector<SSortItem>     m_SortItems;
+	vector<SSortItem>     m_SortTemp;
+	bool                  m_IsSorted;
+
+	SStats                m_Stats;
+};
+
+
+} // namespace gen
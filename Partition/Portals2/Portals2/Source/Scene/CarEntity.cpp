@@ -23,6 +23,120 @@ extern TEntityUID RandomCar();
 
 
 
+/*-----------------------------------------------------------------------------------------
+-------------------------------------------------------------------------------------------
+	Car Template Class
+-------------------------------------------------------------------------------------------
+-----------------------------------------------------------------------------------------*/
+
+// Update the car instances with indexes from first to last - 1 - controls their behaviour.
+// The shell code just performs some test behaviour
+void CCarTemplate::UpdateInstances( TUInt32 first, TUInt32 last, TFloat32 updateTime )
+{
+	// Calculate wheel rotation per unit of speed
+	const TFloat32 wheelDiameter = 0.8f;
+	const TFloat32 wheelRotation = ToRadians(360.0f) * updateTime / (wheelDiameter * kfPi);
+
+	// Cars slow down for moving cars ahead in their direction of travel: within the avoid
+	// distance and the avoid width to either side. They stop at the minimum gap. Stopped and
+	// parked cars are not avoided
+	const TFloat32 avoidDistance = 8.0f;
+	const TFloat32 avoidWidth = 2.5f;
+	const TFloat32 minGap = 3.0f;
+	const CSpatialHash& spatialHash = EntityManager.GetSpatialHash();
+
+	for (TUInt32 instance = first; instance < last; ++instance)
+	{
+		// Only move if in Go state (although this shell code doesn't ever change state)
+		if (m_States[instance] != Go)
+		{
+			m_Speeds[instance] = 0;
+			continue;
+		}
+
+		// Cycle speed up and down using a sine wave - just test behaviour
+		TFloat32 speed = 10.0f * Sin( m_Timers[instance] * 4.0f );
+		m_Timers[instance] += updateTime;
+
+		// Avoidance - find nearby cars with the spatial hash and slow down for the nearest ahead
+		CMatrix4x4* matrices = RelMatrices( instance );
+		const CVector3& position = matrices[0].Position();
+		CVector3 travel = Normalise( matrices[0].ZAxis() ) * ((speed < 0.0f) ? -1.0f : 1.0f);
+
+		// Every car in range is checked, and the brake is set by the nearest moving car ahead
+		TFloat32 nearestAhead = avoidDistance;
+		auto avoid = [&]( const SSpatialEntity& neighbour )
+		{
+			if (neighbour.TemplateType != GetTypeID()) return true;
+			CVector3 offset = neighbour.Position - position;
+			TFloat32 ahead = Dot( offset, travel );
+			if (ahead <= 0.0f || ahead >= nearestAhead ||
+			    LengthSquared( offset ) - ahead * ahead > avoidWidth * avoidWidth)
+			{
+				return true; // Behind, to the side or no nearer (also skips this car)
+			}
+
+			// Only avoid cars in the Go state. States are not changed by the batch update, so
+			// they can be read while other threads update other instances
+			CEntity* other = EntityManager.GetEntity( neighbour.UID );
+			if (!other || !other->Template()->IsCarTemplate()) return true;
+			CCarTemplate* otherTemplate = static_cast<CCarTemplate*>(other->Template());
+			if (otherTemplate->State( other->GetInstanceIndex() ) == Go)
+			{
+				nearestAhead = ahead;
+			}
+			return true;
+		};
+		spatialHash.VisitInRadius( position, avoidDistance, avoid );
+		TFloat32 brake = Max( (nearestAhead - minGap) / (avoidDistance - minGap), 0.0f );
+		speed *= brake;
+		m_Speeds[instance] = speed;
+
+		// Perform movement...
+		// Move along local Z axis scaled by update time
+		matrices[0].MoveLocalZ( speed * updateTime );
+
+		// Rotate each wheel - meshes have been arranged so nodes 3->6 are the wheels
+		TFloat32 wheelSpeed = wheelRotation * speed;
+		matrices[3].RotateLocalX( wheelSpeed );
+		matrices[4].RotateLocalX( wheelSpeed );
+		matrices[5].RotateLocalX( wheelSpeed );
+		matrices[6].RotateLocalX( wheelSpeed );
+	}
+}
+
+
+// Keep car instance data in step with the base class instance arrays
+void CCarTemplate::ReserveInstanceData( TUInt32 numInstances )
+{
+	m_Speeds.reserve( numInstances );
+	m_States.reserve( numInstances );
+	m_Timers.reserve( numInstances );
+}
+
+void CCarTemplate::AddInstanceData()
+{
+	m_Speeds.push_back( 0.0f );
+	m_States.push_back( Stop );
+	m_Timers.push_back( 0.0f );
+}
+
+void CCarTemplate::MoveInstanceData( TUInt32 from, TUInt32 to )
+{
+	m_Speeds[to] = m_Speeds[from];
+	m_States[to] = m_States[from];
+	m_Timers[to] = m_Timers[from];
+}
+
+void CCarTemplate::RemoveLastInstanceData()
+{
+	m_Speeds.pop_back();
+	m_States.pop_back();
+	m_Timers.pop_back();
+}
+
+
+
 /*-----------------------------------------------------------------------------------------
 -------------------------------------------------------------------------------------------
 	Car Entity Class
@@ -35,7 +149,7 @@ CCarEntity::CCarEntity
 (
 	CCarTemplate*   carTemplate,
 	TEntityUID      UID,
-	const string&   name /*=""*/,
+	TNameID         name /*= kNoName*/,
 	const CVector3& position /*= CVector3::kOrigin*/, 
 	const CVector3& rotation /*= CVector3( 0.0f, 0.0f, 0.0f )*/,
 	const CVector3& scale /*= CVector3( 1.0f, 1.0f, 1.0f )*/
@@ -44,42 +158,20 @@ CCarEntity::CCarEntity
 	m_CarTemplate = carTemplate;
 
 	// Initialise car data and state
-	m_Speed = 0.0f;
-	m_State = Go;
-	m_Timer = 0.0f;
+	TUInt32 instance = GetInstanceIndex();
+	m_CarTemplate->Speed( instance ) = 0.0f;
+	m_CarTemplate->State( instance ) = CCarTemplate::Go;
+	m_CarTemplate->Timer( instance ) = 0.0f;
 }
 
 
-// Update the car - controls its behaviour. The shell code just performs some test behaviour
+// Update the car - controls its behaviour. The entity manager updates all cars together with
+// the template's batch update, this function runs the same behaviour for this car alone
 // Return false if the entity is to be destroyed
 bool CCarEntity::Update( TFloat32 updateTime )
 {
-	// Only move if in Go state (although this shell code doesn't ever change state)
-	if (m_State == Go)
-	{
-		// Cycle speed up and down using a sine wave - just test behaviour
-		m_Speed = 10.0f * Sin( m_Timer * 4.0f );
-		m_Timer += updateTime;
-	}
-	else
-	{
-		m_Speed = 0;
-	}
-
-	// Perform movement...
-	// Move along local Z axis scaled by update time
-	Matrix().MoveLocalZ( m_Speed * updateTime );
-	
-	// Calculate speed to rotate wheels based on speed
-	const TFloat32 wheelDiameter = 0.8f;
-	TFloat32 wheelSpeed = ToRadians(360.0f) * m_Speed * updateTime / (wheelDiameter * kfPi);
-
-	// Rotate each wheel - meshes have been arranged so nodes 3->6 are the wheels
-	Matrix(3).RotateLocalX( wheelSpeed );
-	Matrix(4).RotateLocalX( wheelSpeed );
-	Matrix(5).RotateLocalX( wheelSpeed );
-	Matrix(6).RotateLocalX( wheelSpeed );
-
+	TUInt32 instance = GetInstanceIndex();
+	m_CarTemplate->UpdateInstances( instance, instance + 1, updateTime );
 	return true;
 }
 
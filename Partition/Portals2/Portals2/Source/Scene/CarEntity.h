@@ -7,6 +7,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 using namespace std;
 
 #include "Defines.h"
@@ -23,7 +24,8 @@ namespace gen
 -----------------------------------------------------------------------------------------*/
 
 // A car template inherits the type, name and mesh from the base template and adds further
-// car specifications
+// car specifications. It also holds the car state of each instance in arrays, and performs
+// the car behaviour for all its instances in a batch update
 class CCarTemplate : public CEntityTemplate
 {
 /////////////////////////////////////
@@ -68,6 +70,61 @@ public:
 		return m_TurnSpeed;
 	}
 
+	virtual bool IsCarTemplate()
+	{
+		return true;
+	}
+
+
+	/////////////////////////////////////
+	//	Instance data
+
+	// States available for a car - placeholders for shell code
+	enum EState
+	{
+		Stop,
+		Go,
+		NumStates // Leave this entry at end
+	};
+
+	// Car data for the given instance. Instances start in the Stop state - entities created
+	// from a car template without being car entities (e.g. parked cars) stay still
+	TFloat32& Speed( TUInt32 instance )
+	{
+		return m_Speeds[instance];
+	}
+	EState& State( TUInt32 instance )
+	{
+		return m_States[instance];
+	}
+	TFloat32& Timer( TUInt32 instance )
+	{
+		return m_Timers[instance];
+	}
+
+
+	/////////////////////////////////////
+	//	Batch update
+
+	virtual bool HasBatchUpdate()
+	{
+		return true;
+	}
+
+	// Update the car instances with indexes from first to last - 1 - performs car behaviour
+	virtual void UpdateInstances( TUInt32 first, TUInt32 last, TFloat32 updateTime );
+
+
+/////////////////////////////////////
+//	Protected interface
+protected:
+
+	// Keep car instance data in step with the base class instance arrays
+	virtual void ReserveInstanceData( TUInt32 numInstances );
+	virtual void AddInstanceData();
+	virtual void MoveInstanceData( TUInt32 from, TUInt32 to );
+	virtual void RemoveLastInstanceData();
+
 
 /////////////////////////////////////
 //	Private interface
@@ -77,6 +134,11 @@ private:
 	TFloat32 m_MaxSpeed;     // Maximum speed for this kind of car
 	TFloat32 m_Acceleration; // Acceleration  -"-
 	TFloat32 m_TurnSpeed;    // Turn speed    -"-
+
+	// Car data and state for each instance
+	vector<TFloat32> m_Speeds; // Current speed (in facing direction)
+	vector<EState>   m_States; // Current state
+	vector<TFloat32> m_Timers; // A timer used in the example update function
 };
 
 
@@ -88,8 +150,9 @@ private:
 -----------------------------------------------------------------------------------------*/
 
 // A car entity inherits the ID/positioning/rendering support of the base entity class
-// and adds instance data (just speed in this code). It overrides the update function to
-// perform the car entity behaviour - very limited here
+// and gives access to the car instance data held by its template (just speed in this code).
+// The car behaviour is performed by the template's batch update for all cars together, the
+// update function here runs it for this car alone
 class CCarEntity : public CEntity
 {
 /////////////////////////////////////
@@ -101,7 +164,7 @@ public:
 	(
 		CCarTemplate*   carTemplate,
 		TEntityUID      UID,
-		const string&   name = "",
+		TNameID         name = kNoName,
 		const CVector3& position = CVector3::kOrigin, 
 		const CVector3& rotation = CVector3( 0.0f, 0.0f, 0.0f ),
 		const CVector3& scale = CVector3( 1.0f, 1.0f, 1.0f )
@@ -110,6 +173,13 @@ public:
 	// No destructor needed
 
 
+/////////////////////////////////////
+//	Allocation
+
+	// Car entities are allocated from their own pool (see CPoolAllocator.h)
+	GEN_POOL_ALLOCATED( CCarEntity )
+
+
 /////////////////////////////////////
 //	Public interface
 public:
@@ -119,7 +189,12 @@ public:
 
 	TFloat32 GetSpeed()
 	{
-		return m_Speed;
+		return m_CarTemplate->Speed( GetInstanceIndex() );
+	}
+
+	virtual bool IsCar()
+	{
+		return true;
 	}
 
 
@@ -136,29 +211,11 @@ public:
 //	Private interface
 private:
 
-	/////////////////////////////////////
-	// Types
-
-	// States available for a car - placeholders for shell code
-	enum EState
-	{
-		Stop,
-		Go,
-	};
-
-
 	/////////////////////////////////////
 	// Data
 
-	// The template holding common data for all car entities
+	// The template holding common data for all car entities, and the instance data of this car
 	CCarTemplate* m_CarTemplate;
-
-	// Car data
-	TFloat32  m_Speed; // Current speed (in facing direction)
-
-	// Car state
-	EState m_State; // Current state
-	TFloat32  m_Timer; // A timer used in the example update function   
 };
 
 
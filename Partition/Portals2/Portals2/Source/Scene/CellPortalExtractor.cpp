@@ -0,0 +1,352 @@
+/*******************************************
+	CellPortalExtractor.cpp
+
+	Automatic extraction of cells (partitions)
+	and portals from level geometry
+********************************************/
+
+#include <fstream>
+#include <sstream>
+using namespace std;
+
+#include "BaseMath.h"
+#include "MathIO.h"
+#include "CellPortalExtractor.h"
+
+namespace gen
+{
+
+/*-----------------------------------------------------------------------------------------
+	Constructors/Destructors
+-----------------------------------------------------------------------------------------*/
+
+// Constructor takes the margin added to room bounds (half the interior wall thickness), the
+// distance cells extend below each room's floor (so points on the floor are in the room) and
+// the distance beyond an opening's wall used to find the cells it connects
+CCellPortalExtractor::CCellPortalExtractor( TFloat32 wallMargin /*= 0.05f*/,
+                                            TFloat32 floorMargin /*= 0.25f*/,
+                                            TFloat32 probeDistance /*= 0.1f*/ )
+{
+	m_WallMargin = wallMargin;
+	m_FloorMargin = floorMargin;
+	m_ProbeDistance = probeDistance;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+	Geometry input
+-----------------------------------------------------------------------------------------*/
+
+// Transform model space bounds by a world matrix and return the world space axis-aligned
+// bounds of the result
+static void TransformBounds( const CVector3& minBounds, const CVector3& maxBounds,
+                             const CMatrix4x4& worldMatrix,
+                             CVector3* pWorldMin, CVector3* pWorldMax )
+{
+	for (TUInt32 corner = 0; corner < 8; ++corner)
+	{
+		CVector3 point( (corner & 1) ? maxBounds.x : minBounds.x,
+		                (corner & 2) ? maxBounds.y : minBounds.y,
+		                (corner & 4) ? maxBounds.z : minBounds.z );
+		point = worldMatrix.TransformPoint( point );
+		if (corner == 0)
+		{
+			*pWorldMin = *pWorldMax = point;
+		}
+		else
+		{
+			for (TUInt32 axis = 0; axis < 3; ++axis)
+			{
+				(*pWorldMin)[axis] = Min( (*pWorldMin)[axis], point[axis] );
+				(*pWorldMax)[axis] = Max( (*pWorldMax)[axis], point[axis] );
+			}
+		}
+	}
+}
+
+// Add a room directly as world space bounds, or from a mesh with a given world matrix.
+// Cells are numbered from 1 in the order they are added
+void CCellPortalExtractor::AddCell( const string& name, const CVector3& minBounds,
+                                    const CVector3& maxBounds )
+{
+	SNamedBounds room = { name, minBounds, maxBounds };
+	m_Rooms.push_back( room );
+}
+
+void CCellPortalExtractor::AddCellMesh( const string& name, CMesh* mesh,
+                                        const CMatrix4x4& worldMatrix /*= CMatrix4x4::kIdentity*/ )
+{
+	CVector3 worldMin, worldMax;
+	TransformBounds( mesh->MinBounds(), mesh->MaxBounds(), worldMatrix, &worldMin, &worldMax );
+	AddCell( name, worldMin, worldMax );
+}
+
+
+// Add an opening (door, window etc.) directly as world space bounds, or from a mesh with a
+// given world matrix
+void CCellPortalExtractor::AddOpening( const string& name, const CVector3& minBounds,
+                                       const CVector3& maxBounds )
+{
+	SNamedBounds opening = { name, minBounds, maxBounds };
+	m_Openings.push_back( opening );
+}
+
+void CCellPortalExtractor::AddOpeningMesh( const string& name, CMesh* mesh,
+                                           const CMatrix4x4& worldMatrix /*= CMatrix4x4::kIdentity*/ )
+{
+	CVector3 worldMin, worldMax;
+	TransformBounds( mesh->MinBounds(), mesh->MaxBounds(), worldMatrix, &worldMin, &worldMax );
+	AddOpening( name, worldMin, worldMax );
+}
+
+
+// Add a whole level mesh. Nodes whose name contains cellTag are added as cells, nodes whose
+// name contains any of the (space separated) openingTags are added as openings and other
+// nodes are ignored
+void CCellPortalExtractor::AddLevelMesh( CMesh* mesh,
+                                         const CMatrix4x4& worldMatrix /*= CMatrix4x4::kIdentity*/,
+                                         const string& cellTag /*= "Room"*/,
+                                         const string& openingTags /*= "Door Window"*/ )
+{
+	// Split opening tags into a list
+	vector<string> tags;
+	istringstream tagStream( openingTags );
+	string tag;
+	while (tagStream >> tag)
+	{
+		tags.push_back( tag );
+	}
+
+	for (TUInt32 node = 0; node < mesh->GetNumNodes(); ++node)
+	{
+		const string& nodeName = mesh->GetNode( node ).name;
+		bool isCell = nodeName.find( cellTag ) != string::npos;
+		bool isOpening = false;
+		for (TUInt32 t = 0; t < tags.size() && !isCell; ++t)
+		{
+			isOpening = isOpening || nodeName.find( tags[t] ) != string::npos;
+		}
+		if (!isCell && !isOpening)
+		{
+			continue;
+		}
+
+		CVector3 nodeMin, nodeMax;
+		if (!mesh->GetNodeBounds( node, &nodeMin, &nodeMax ))
+		{
+			continue; // Node has no geometry of its own
+		}
+		CVector3 worldMin, worldMax;
+		TransformBounds( nodeMin, nodeMax, worldMatrix, &worldMin, &worldMax );
+		if (isCell)
+		{
+			AddCell( nodeName, worldMin, worldMax );
+		}
+		else
+		{
+			AddOpening( nodeName, worldMin, worldMax );
+		}
+	}
+}
+
+
+/*-----------------------------------------------------------------------------------------
+	Extraction / output
+-----------------------------------------------------------------------------------------*/
+
+// Build the cell volumes and portals from the geometry added. Openings that do not connect two
+// different cells are skipped. Returns the number of portals found
+TUInt32 CCellPortalExtractor::Extract()
+{
+	// Cells are the room bounds grown by the wall margin, and extended below the floor
+	m_Cells.clear();
+	CVector3 minMargin( m_WallMargin, m_FloorMargin, m_WallMargin );
+	CVector3 maxMargin( m_WallMargin, m_WallMargin, m_WallMargin );
+	for (TUInt32 room = 0; room < m_Rooms.size(); ++room)
+	{
+		SCellVolume cell = { m_Rooms[room].name, m_Rooms[room].minBounds - minMargin,
+		                                         m_Rooms[room].maxBounds + maxMargin };
+		m_Cells.push_back( cell );
+	}
+
+	m_Portals.clear();
+	for (TUInt32 opening = 0; opening < m_Openings.size(); ++opening)
+	{
+		const CVector3& minBounds = m_Openings[opening].minBounds;
+		const CVector3& maxBounds = m_Openings[opening].maxBounds;
+		CVector3 size = maxBounds - minBounds;
+
+		// The thinnest axis of the opening is the wall normal (n). The portal quad is spanned by
+		// the other two axes (u, v) - v is vertical (y) unless the opening is in a floor / ceiling
+		TUInt32 n = 0;
+		if (size[1] < size[n]) n = 1;
+		if (size[2] < size[n]) n = 2;
+		TUInt32 u, v;
+		if (n == 1)
+		{
+			u = 0;
+			v = 2;
+		}
+		else
+		{
+			u = 2 - n; // x for z-facing openings, z for x-facing ones
+			v = 1;
+		}
+		if (size[u] <= 0.0f || size[v] <= 0.0f)
+		{
+			continue; // Degenerate opening
+		}
+
+		// Quad in the middle of the wall
+		TFloat32 wallMid = (minBounds[n] + maxBounds[n]) * 0.5f;
+		SCellPortal portal;
+		portal.Name = m_Openings[opening].name;
+		for (TUInt32 point = 0; point < 4; ++point)
+		{
+			portal.Points[point][n] = wallMid;
+			portal.Points[point][u] = (point < 2) ? minBounds[u] : maxBounds[u];
+			portal.Points[point][v] = (point == 0 || point == 3) ? minBounds[v] : maxBounds[v];
+		}
+
+		// Find the cells on each side of the wall - the portal faces into the cell on the side of
+		// its normal. Probe from the centre of the opening to just beyond the wall surfaces
+		CVector3 normal = Normalise( Cross( portal.Points[1] - portal.Points[0],
+		                                    portal.Points[2] - portal.Points[1] ) );
+		CVector3 centre = (minBounds + maxBounds) * 0.5f;
+		TFloat32 probe = size[n] * 0.5f + m_ProbeDistance;
+		portal.InCell  = GetCellFromPt( centre + normal * probe );
+		portal.OutCell = GetCellFromPt( centre - normal * probe );
+		if (portal.InCell == portal.OutCell)
+		{
+			continue; // Opening doesn't lead anywhere (e.g. outside to outside)
+		}
+		m_Portals.push_back( portal );
+	}
+
+	return static_cast<TUInt32>(m_Portals.size());
+}
+
+
+// Return the cell containing the given point, 0 if it is not in any cell (uses the results
+// of Extract)
+int CCellPortalExtractor::GetCellFromPt( const CVector3& pt )
+{
+	for (TUInt32 cell = 0; cell < m_Cells.size(); ++cell)
+	{
+		if (pt.x >= m_Cells[cell].MinBounds.x && pt.x <= m_Cells[cell].MaxBounds.x &&
+		    pt.y >= m_Cells[cell].MinBounds.y && pt.y <= m_Cells[cell].MaxBounds.y &&
+		    pt.z >= m_Cells[cell].MinBounds.z && pt.z <= m_Cells[cell].MaxBounds.z)
+		{
+			return cell + 1;
+		}
+	}
+	return 0;
+}
+
+
+// Save the results of Extract to a text file, returns true on success
+bool CCellPortalExtractor::Save( const string& fileName )
+{
+	ofstream file( fileName.c_str(), ios::out | ios::trunc );
+	if (!file) return false;
+
+	// Cell 0 (the outside world) is implicit, cells are numbered from 1 in file order
+	file << "CELLS" << endl;
+	for (TUInt32 cell = 0; cell < m_Cells.size(); ++cell)
+	{
+		file << "C " << m_Cells[cell].MinBounds << " " << m_Cells[cell].MaxBounds << " "
+		     << m_Cells[cell].Name << endl;
+	}
+	file << "PORTALS" << endl;
+	for (TUInt32 portal = 0; portal < m_Portals.size(); ++portal)
+	{
+		const SCellPortal& p = m_Portals[portal];
+		file << "P " << p.InCell << " " << p.OutCell << " " << p.Points[0] << " " << p.Points[1]
+		     << " " << p.Points[2] << " " << p.Points[3] << " " << p.Name << endl;
+	}
+
+	file.close();
+	return !file.fail();
+}
+
+
+/*-----------------------------------------------------------------------------------------
+	Loading
+-----------------------------------------------------------------------------------------*/
+
+// Load cells and portals saved by CCellPortalExtractor::Save. Cells are numbered from 1 in file
+// order (the cell list returned starts at cell 1), cell 0 is the outside world. Returns true on
+// success, the lists are emptied on failure
+bool LoadCellsAndPortals( const string& fileName, vector<SCellVolume>* cells,
+                          vector<SCellPortal>* portals )
+{
+	cells->clear();
+	portals->clear();
+
+	ifstream file( fileName.c_str(), ios::in );
+	if (!file) return false;
+
+	// Get opening keyword
+	string keyword;
+	file >> keyword;
+	if (keyword != "CELLS")
+	{
+		file.setstate( ios::failbit );
+	}
+
+	// Each cell line must begin with "C" or have reached the end of the cell section
+	while (file.good())
+	{
+		file >> keyword;
+		if (!file.good() || keyword != "C") break;
+		SCellVolume cell;
+		file >> cell.MinBounds >> cell.MaxBounds >> ws;
+		getline( file, cell.Name ) >> ws; // Name is the rest of the line, may contain spaces
+		if (!file.fail())
+		{
+			cells->push_back( cell );
+		}
+	}
+
+	if (keyword != "PORTALS")
+	{
+		file.setstate( ios::failbit );
+	}
+	file >> ws; // Allows for an empty portal section at the end of the file
+
+	// Portals must refer to cells in the list (or cell 0)
+	int numCells = static_cast<int>(cells->size());
+	while (file.good())
+	{
+		file >> keyword;
+		if (keyword != "P") break;
+		SCellPortal portal;
+		file >> portal.InCell >> portal.OutCell >> portal.Points[0] >> portal.Points[1]
+		     >> portal.Points[2] >> portal.Points[3] >> ws;
+		getline( file, portal.Name ) >> ws;
+		if (!file.fail())
+		{
+			if (portal.InCell < 0 || portal.InCell > numCells ||
+			    portal.OutCell < 0 || portal.OutCell > numCells)
+			{
+				file.setstate( ios::failbit );
+			}
+			else
+			{
+				portals->push_back( portal );
+			}
+		}
+	}
+
+	file.close();
+	if (file.fail())
+	{
+		cells->clear();
+		portals->clear();
+		return false;
+	}
+	return true;
+}
+
+
+} // namespace gen
@@ -0,0 +1,168 @@
+/*******************************************
+	CellPortalExtractor.h
+
+	Automatic extraction of cells (partitions)
+	and portals from level geometry
+********************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include "Mesh.h"
+
+namespace gen
+{
+
+// A cell (space partition) volume - all cells are axis-aligned boxes
+struct SCellVolume
+{
+	string   Name;
+	CVector3 MinBounds;
+	CVector3 MaxBounds;
+};
+
+// A portal between two cells - a world space quad (parallelogram). The points are ordered so
+// the polygon normal, Cross(p1 - p0, p2 - p1), faces into InCell. Cell 0 is the outside world
+typedef CVector3 TCellPortalQuad[4];
+struct SCellPortal
+{
+	string          Name;
+	TCellPortalQuad Points;
+	int             InCell;
+	int             OutCell;
+};
+
+
+// The cell and portal extractor is a preprocessing tool that builds the cell and portal data
+// for a level from its geometry, rather than the data being authored by hand.
+//
+// Cells come from room meshes: each room's bounding box, grown by a margin so that neighbouring
+// rooms meet in the middle of their shared walls. Openings (doors, windows) come from the meshes
+// lining each opening: the thinnest axis of the opening's bounding box is the wall normal and the
+// other two axes span the portal quad. The cells on either side of an opening are found by
+// probing just beyond the wall - points outside every cell are in cell 0, the outside world.
+//
+// Geometry can be given as separate meshes for each room / opening, or as a single level mesh
+// whose nodes are named after rooms, doors and windows. The results are saved to a text file
+// that can be loaded at run-time without the source geometry (see LoadCellsAndPortals)
+class CCellPortalExtractor
+{
+/////////////////////////////////////
+//	Constructors/Destructors
+public:
+	// Constructor takes the margin added to room bounds (half the interior wall thickness), the
+	// distance cells extend below each room's floor (so points on the floor are in the room) and
+	// the distance beyond an opening's wall used to find the cells it connects
+	CCellPortalExtractor( TFloat32 wallMargin = 0.05f, TFloat32 floorMargin = 0.25f,
+	                      TFloat32 probeDistance = 0.1f );
+
+private:
+	// Prevent use of copy constructor and assignment operator (private and not defined)
+	CCellPortalExtractor( const CCellPortalExtractor& );
+	CCellPortalExtractor& operator=( const CCellPortalExtractor& );
+
+
+/////////////////////////////////////
+//	Public interface
+public:
+
+	/////////////////////////////////////
+	// Geometry input
+
+	// Add a room directly as world space bounds, or from a mesh with a given world matrix.
+	// Cells are numbered from 1 in the order they are added
+	void AddCell( const string& name, const CVector3& minBounds, const CVector3& maxBounds );
+	void AddCellMesh( const string& name, CMesh* mesh,
+	                  const CMatrix4x4& worldMatrix = CMatrix4x4::kIdentity );
+
+	// Add an opening (door, window etc.) directly as world space bounds, or from a mesh with a
+	// given world matrix
+	void AddOpening( const string& name, const CVector3& minBounds, const CVector3& maxBounds );
+	void AddOpeningMesh( const string& name, CMesh* mesh,
+	                     const CMatrix4x4& worldMatrix = CMatrix4x4::kIdentity );
+
+	// Add a whole level mesh. Nodes whose name contains cellTag are added as cells, nodes whose
+	// name contains any of the (space separated) openingTags are added as openings and other
+	// nodes are ignored
+	void AddLevelMesh( CMesh* mesh, const CMatrix4x4& worldMatrix = CMatrix4x4::kIdentity,
+	                   const string& cellTag = "Room", const string& openingTags = "Door Window" );
+
+
+	/////////////////////////////////////
+	// Extraction / output
+
+	// Build the cell volumes and portals from the geometry added. Openings that do not connect two
+	// different cells are skipped. Returns the number of portals found
+	TUInt32 Extract();
+
+	// Results of Extract
+	const vector<SCellVolume>& GetCells()
+	{
+		return m_Cells;
+	}
+	const vector<SCellPortal>& GetPortals()
+	{
+		return m_Portals;
+	}
+
+	// Return the cell containing the given point, 0 if it is not in any cell (uses the results
+	// of Extract)
+	int GetCellFromPt( const CVector3& pt );
+
+	// Save the results of Extract to a text file, returns true on success. Names are saved at the
+	// end of each line so may contain spaces
+	bool Save( const string& fileName );
+
+
+/////////////////////////////////////
+//	Private interface
+private:
+
+	/////////////////////////////////////
+	// Types
+
+	// Bounds of a room or opening, as given to the extractor
+	struct SNamedBounds
+	{
+		string   name;
+		CVector3 minBounds;
+		CVector3 maxBounds;
+	};
+
+
+	/////////////////////////////////////
+	// Data
+
+	// Extraction settings
+	TFloat32 m_WallMargin;
+	TFloat32 m_FloorMargin;
+	TFloat32 m_ProbeDistance;
+
+	// Geometry input
+	vector<SNamedBounds> m_Rooms;
+	vector<SNamedBounds> m_Openings;
+
+	// Extraction results
+	vector<SCellVolume> m_Cells;
+	vector<SCellPortal> m_Portals;
+};
+
+
+/*-----------------------------------------------------------------------------------------
+	Loading
+-----------------------------------------------------------------------------------------*/
+
+// Load cells and portals saved by CCellPortalExtractor::Save. Cells are numbered from 1 in file
+// order (the cell list returned starts at cell 1), cell 0 is the outside world. Returns true on
+// success, the lists are emptied on failure
+bool LoadCellsAndPortals( const string& fileName, vector<SCellVolume>* cells,
+                          vector<SCellPortal>* portals );
+
+
+} // namespace gen
@@ -4,11 +4,73 @@
 	Entity class implementation
 ********************************************/
 
+#include <algorithm>
+using namespace std;
+
 #include "Entity.h"
 
 namespace gen
 {
 
+// Template types, template names and entity names are interned in this table and stored as
+// IDs, so entities can be created and searched for by name without string operations
+CNameTable EntityNames;
+
+
+/*-----------------------------------------------------------------------------------------
+-------------------------------------------------------------------------------------------
+	Entity Template Base Class
+-------------------------------------------------------------------------------------------
+-----------------------------------------------------------------------------------------*/
+
+// Add an instance for the given entity with matrices set from the mesh defaults. Returns
+// the instance index, which changes if other instances are removed (see RemoveInstance)
+TUInt32 CEntityTemplate::AddInstance( CEntity* entity )
+{
+	TUInt32 instance = static_cast<TUInt32>(m_Instances.size());
+	m_Instances.push_back( entity );
+	for (TUInt32 node = 0; node < m_NumNodes; ++node)
+	{
+		m_RelMatrices.push_back( m_Mesh->GetNode( node ).positionMatrix );
+		m_Matrices.push_back( m_Mesh->GetNode( node ).positionMatrix );
+	}
+	AddInstanceData();
+	return instance;
+}
+
+// Remove the instance with the given index. The last instance is moved into its place to
+// keep the arrays packed and its entity is told its new index
+void CEntityTemplate::RemoveInstance( TUInt32 instance )
+{
+	TUInt32 last = static_cast<TUInt32>(m_Instances.size()) - 1;
+	if (instance != last)
+	{
+		m_Instances[instance] = m_Instances[last];
+		m_Instances[instance]->m_Instance = instance;
+		copy( &m_RelMatrices[last * m_NumNodes], &m_RelMatrices[last * m_NumNodes] + m_NumNodes,
+		      &m_RelMatrices[instance * m_NumNodes] );
+		copy( &m_Matrices[last * m_NumNodes], &m_Matrices[last * m_NumNodes] + m_NumNodes,
+		      &m_Matrices[instance * m_NumNodes] );
+		MoveInstanceData( last, instance );
+	}
+	m_Instances.pop_back();
+	m_RelMatrices.resize( last * m_NumNodes );
+	m_Matrices.resize( last * m_NumNodes );
+	RemoveLastInstanceData();
+}
+
+// Reserve space for the given number of instances, so they can be added without the
+// instance arrays being reallocated
+void CEntityTemplate::ReserveInstances( TUInt32 numInstances )
+{
+	m_Instances.reserve( numInstances );
+	m_RelMatrices.reserve( numInstances * m_NumNodes );
+	m_Matrices.reserve( numInstances * m_NumNodes );
+	ReserveInstanceData( numInstances );
+}
+
+
+
 /*-----------------------------------------------------------------------------------------
 -------------------------------------------------------------------------------------------
 	Base Entity Class
@@ -16,12 +78,13 @@ namespace gen
 -----------------------------------------------------------------------------------------*/
 
 // Base entity constructor, needs pointer to common template data and UID, may also pass 
-// name, initial position, rotation and scaling. Set up positional matrices for the entity
+// name (ID in EntityNames), initial position, rotation and scaling. Set up positional
+// matrices for the entity
 CEntity::CEntity
 (
 	CEntityTemplate* entityTemplate,
 	TEntityUID       UID,
-	const string&    name /*=""*/,
+	TNameID          name /*= kNoName*/,
 	const CVector3&  position /*= CVector3::kOrigin*/, 
 	const CVector3&  rotation /*= CVector3( 0.0f, 0.0f, 0.0f )*/,
 	const CVector3&  scale /*= CVector3( 1.0f, 1.0f, 1.0f )*/
@@ -31,40 +94,49 @@ CEntity::CEntity
 	m_UID = UID;
 	m_Name = name;
 
-	// Allocate space for matrices
-	TUInt32 numNodes = m_Template->Mesh()->GetNumNodes();
-	m_RelMatrices = new CMatrix4x4[numNodes];
-	m_Matrices = new CMatrix4x4[numNodes];
-
-	// Set initial matrices from mesh defaults
-	for (TUInt32 node = 0; node < numNodes; ++node)
-	{
-		m_RelMatrices[node] = m_Template->Mesh()->GetNode( node ).positionMatrix;
-	}
+	// Add instance data to the template, matrices are initialised from mesh defaults
+	m_Instance = m_Template->AddInstance( this );
 
 	// Override root matrix with constructor parameters
-	m_RelMatrices[0] = CMatrix4x4( position, rotation, kZXY, scale );
+	Matrix() = CMatrix4x4( position, rotation, kZXY, scale );
 }
 
 
 // Render the model from the given camera
 void CEntity::Render( CCamera* camera )
 {
-	// Get pointer to mesh to simplify code
+	CalculateMatrices();
+
+	// Render with absolute matrices
+	m_Template->Mesh()->Render( m_Template->Matrices( m_Instance ), camera );
+}
+
+// Add the entity to the given render queue rather than rendering it immediately. The entity
+// must not be rendered or queued again until the queue has been submitted
+void CEntity::Render( CRenderQueue* queue )
+{
+	CalculateMatrices();
+
+	// Queue with absolute matrices
+	queue->AddMesh( m_Template->Mesh(), m_Template->Matrices( m_Instance ) );
+}
+
+// Calculate absolute matrices from relative node matrices & node heirarchy
+void CEntity::CalculateMatrices()
+{
+	// Get pointers to mesh and matrices to simplify code
 	CMesh* Mesh = m_Template->Mesh();
+	CMatrix4x4* relMatrices = m_Template->RelMatrices( m_Instance );
+	CMatrix4x4* matrices = m_Template->Matrices( m_Instance );
 
-	// Calculate absolute matrices from relative node matrices & node heirarchy
-	m_Matrices[0] = m_RelMatrices[0];
+	matrices[0] = relMatrices[0];
 	TUInt32 numNodes = Mesh->GetNumNodes();
 	for (TUInt32 node = 1; node < numNodes; ++node)
 	{
-		m_Matrices[node] = m_RelMatrices[node] * m_Matrices[Mesh->GetNode( node ).parent];
+		matrices[node] = relMatrices[node] * matrices[Mesh->GetNode( node ).parent];
 	}
 	// Incorporate any bone<->mesh offsets (only relevant for skinning)
 	// Don't need this step for this exercise
-
-	// Render with absolute matrices
-	Mesh->Render( m_Matrices, camera );
 }
 
 
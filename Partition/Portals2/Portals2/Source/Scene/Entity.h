@@ -7,13 +7,17 @@
 #pragma once
 
 #include <string>
+#include <vector>
 using namespace std;
 
 #include "Defines.h"
+#include "CNameTable.h"
+#include "CPoolAllocator.h"
 #include "CVector3.h"
 #include "CMatrix4x4.h"
 #include "Camera.h"
 #include "Mesh.h"
+#include "RenderQueue.h"
 
 namespace gen
 {
@@ -26,6 +30,16 @@ typedef TUInt32 TEntityUID;
 const TEntityUID SystemUID = 0xffffffff;
 
 
+/////////////////////////////////////
+//	Names
+
+// Template types, template names and entity names are interned in this table and stored as
+// IDs, so entities can be created and searched for by name without string operations
+extern CNameTable EntityNames;
+
+class CEntity;
+
+
 /*-----------------------------------------------------------------------------------------
 -------------------------------------------------------------------------------------------
 	Entity Template Base Class
@@ -35,6 +49,10 @@ const TEntityUID SystemUID = 0xffffffff;
 // Base entity template only contains a mesh, i.e. the only common feature of all entities
 // is that they have some geometry. In fact, if we had cameras or lights as entities, we couldn't
 // even make this assumption. However, this is just a simple example of an entity system
+//
+// The template also stores the per-instance data of every entity using it (the node matrices,
+// and in derived templates any other instance data). Entities of one type are then held in
+// contiguous arrays and can be updated in batches rather than one virtual call at a time
 class CEntityTemplate
 {
 /////////////////////////////////////
@@ -44,12 +62,14 @@ public:
 	// and the associated mesh (e.g. "panda.x")
 	CEntityTemplate( const string& type, const string& name, const string& meshFilename )
 	{
-		m_Type = type;
-		m_Name = name;
+		m_Type = EntityNames.GetID( type );
+		m_Name = EntityNames.GetID( name );
+		m_MeshFilename = meshFilename;
 
 		// Load mesh - assuming success for simplicity
 		m_Mesh = new CMesh();
 		m_Mesh->Load( meshFilename );
+		m_NumNodes = m_Mesh->GetNumNodes();
 	}
 
 	// Destructor - base class destructors should always be virtual
@@ -73,30 +93,132 @@ public:
 
 	const string& GetType()
 	{
-		return m_Type;
+		return EntityNames.GetString( m_Type );
 	}
 
 	const string& GetName()
+	{
+		return EntityNames.GetString( m_Name );
+	}
+
+	// Name IDs of the type and name (see EntityNames)
+	TNameID GetTypeID()
+	{
+		return m_Type;
+	}
+
+	TNameID GetNameID()
 	{
 		return m_Name;
 	}
 
+	const string& GetMeshFilename()
+	{
+		return m_MeshFilename;
+	}
+
 	CMesh* const Mesh()
 	{
 		return m_Mesh;
 	}
 
+	// Number of nodes (matrices) in each instance
+	TUInt32 GetNumNodes()
+	{
+		return m_NumNodes;
+	}
+
+	// Return true if this is a car template (CCarTemplate), which can be cast to one
+	virtual bool IsCarTemplate()
+	{
+		return false;
+	}
+
+
+	/////////////////////////////////////
+	//	Instances
+
+	// Add an instance for the given entity with matrices set from the mesh defaults. Returns
+	// the instance index, which changes if other instances are removed (see RemoveInstance)
+	TUInt32 AddInstance( CEntity* entity );
+
+	// Remove the instance with the given index. The last instance is moved into its place to
+	// keep the arrays packed and its entity is told its new index
+	void RemoveInstance( TUInt32 instance );
+
+	// Reserve space for the given number of instances, so they can be added without the
+	// instance arrays being reallocated
+	void ReserveInstances( TUInt32 numInstances );
+
+	TUInt32 GetNumInstances()
+	{
+		return static_cast<TUInt32>(m_Instances.size());
+	}
+
+	CEntity* GetInstance( TUInt32 instance )
+	{
+		return m_Instances[instance];
+	}
+
+	// Relative and absolute matrices for each node of the given instance. Pointers are only
+	// valid until the next instance is added to this template
+	CMatrix4x4* RelMatrices( TUInt32 instance )
+	{
+		return &m_RelMatrices[instance * m_NumNodes];
+	}
+	CMatrix4x4* Matrices( TUInt32 instance )
+	{
+		return &m_Matrices[instance * m_NumNodes];
+	}
+
+
+	/////////////////////////////////////
+	//	Batch update
+
+	// Return true if this template updates its instances with UpdateInstances. Otherwise the
+	// entity manager calls the Update function of each entity
+	virtual bool HasBatchUpdate()
+	{
+		return false;
+	}
+
+	// Update the instances with indexes from first to last - 1, pass time since last update.
+	// Different ranges of instances may be updated at the same time on different threads, so
+	// only the data of these instances can be changed and instances cannot be added or removed
+	virtual void UpdateInstances( TUInt32 first, TUInt32 last, TFloat32 updateTime ) {}
+
+
+/////////////////////////////////////
+//	Protected interface
+protected:
+
+	// Derived templates with extra instance data keep it in arrays matching the instance index.
+	// These functions are called to reserve space, push a new instance, move the last instance into the given
+	// index, and pop the last instance
+	virtual void ReserveInstanceData( TUInt32 numInstances ) {}
+	virtual void AddInstanceData() {}
+	virtual void MoveInstanceData( TUInt32 from, TUInt32 to ) {}
+	virtual void RemoveLastInstanceData() {}
+
 
 /////////////////////////////////////
 //	Private interface
 private:
 
-	// Type and name of the template
-	string m_Type;
-	string m_Name;
+	// Type and name of the template (IDs in EntityNames)
+	TNameID m_Type;
+	TNameID m_Name;
 
-	// The mesh representing this entity
-	CMesh* m_Mesh;
+	// The mesh representing this entity, and the file it was loaded from
+	string  m_MeshFilename;
+	CMesh*  m_Mesh;
+	TUInt32 m_NumNodes;
+
+	// Instance data - the entity for each instance, and its relative and absolute matrices for
+	// each node of the mesh (m_NumNodes matrices per instance)
+	vector<CEntity*>   m_Instances;
+	vector<CMatrix4x4> m_RelMatrices;
+	vector<CMatrix4x4> m_Matrices;
 };
 
 
@@ -107,21 +229,23 @@ private:
 -------------------------------------------------------------------------------------------
 -----------------------------------------------------------------------------------------*/
 
-// Base entity holds a pointer to its template data and the current position as a set of
-// matrices. The entity can be rendered but its update function does nothing - base class
-// entities are assumed to be static scene elements
+// Base entity holds a pointer to its template data and the index of its instance data in the
+// template, which holds the current position as a set of matrices. The entity can be rendered
+// but its update function does nothing - base class entities are assumed to be static scene
+// elements
 class CEntity
 {
 /////////////////////////////////////
 //	Constructors/Destructors
 public:
 	// Base entity constructor, needs pointer to common template data and UID, may also pass 
-	// name, initial position, rotation and scaling. Set up positional matrices for the entity
+	// name (ID in EntityNames), initial position, rotation and scaling. Set up positional
+	// matrices for the entity
 	CEntity
 	(
 		CEntityTemplate* entityTemplate,
 		TEntityUID       UID,
-		const string&    name = "",
+		TNameID          name = kNoName,
 		const CVector3&  position = CVector3::kOrigin, 
 		const CVector3&  rotation = CVector3( 0.0f, 0.0f, 0.0f ),
 		const CVector3&  scale = CVector3( 1.0f, 1.0f, 1.0f )
@@ -130,8 +254,7 @@ public:
 	// Destructor - base class destructors should always be virtual
 	virtual ~CEntity()
 	{
-		delete[] m_Matrices;
-		delete[] m_RelMatrices;
+		m_Template->RemoveInstance( m_Instance );
 	}
 
 private:
@@ -140,6 +263,13 @@ private:
 	CEntity& operator=( const CEntity& );
 
 
+/////////////////////////////////////
+//	Allocation
+
+	// Base entities are allocated from a pool (see CPoolAllocator.h)
+	GEN_POOL_ALLOCATED( CEntity )
+
+
 /////////////////////////////////////
 //	Public interface
 public:
@@ -158,22 +288,42 @@ public:
 	}
 
 	const string& GetName()
+	{
+		return EntityNames.GetString( m_Name );
+	}
+
+	// Name ID of the entity name (see EntityNames)
+	TNameID GetNameID()
 	{
 		return m_Name;
 	}
 
+	// Index of this entity's data in its template's instance arrays
+	TUInt32 GetInstanceIndex()
+	{
+		return m_Instance;
+	}
+
+	// Return true if this is a car entity (CCarEntity). Entities using a car template are not
+	// necessarily car entities (e.g. parked cars)
+	virtual bool IsCar()
+	{
+		return false;
+	}
+
 
 	/////////////////////////////////////
 	// Matrix access
 
-	// Direct access to position and matrix
+	// Direct access to position and matrix. References are only valid until another entity
+	// with the same template is created
 	CVector3& Position( TUInt32 node = 0 )
 	{
-		return m_RelMatrices[node].Position();
+		return m_Template->RelMatrices( m_Instance )[node].Position();
 	}
 	CMatrix4x4& Matrix( TUInt32 node = 0 )
 	{
-		return m_RelMatrices[node];
+		return m_Template->RelMatrices( m_Instance )[node];
 	}
 
 
@@ -188,21 +338,29 @@ public:
 	// Render the entity from the given camera
 	void Render( CCamera* camera );
 
+	// Add the entity to the given render queue rather than rendering it immediately. The entity
+	// must not be rendered or queued again until the queue has been submitted
+	void Render( CRenderQueue* queue );
+
 
 /////////////////////////////////////
 //	Private interface
 private:
 
+	// Calculate absolute matrices from relative node matrices & node heirarchy
+	void CalculateMatrices();
+
 	// The template used by this entity - the common data for all entities of this type
 	CEntityTemplate* m_Template;
 
-	// Unique identifier and name for the entity
+	// Unique identifier and name (ID in EntityNames) for the entity
 	TEntityUID  m_UID;
-	string      m_Name;
+	TNameID     m_Name;
 
-	// Relative and absolute world matrices for each node in the template's mesh
-	CMatrix4x4* m_RelMatrices; // Dynamically allocated arrays
-	CMatrix4x4* m_Matrices;
+	// Index of the instance data (node matrices etc.) held for this entity by the template.
+	// Updated by the template when instances are moved
+	TUInt32 m_Instance;
+	friend class CEntityTemplate;
 };
 
 
@@ -5,25 +5,33 @@
 	destruction
 ********************************************/
 
+#include <algorithm>
+using namespace std;
+
 #include "EntityManager.h"
 
 namespace gen
 {
 
+// Cell size for the spatial hash - around the distance of typical proximity queries
+const TFloat32 CEntityManager::kSpatialHashCellSize = 8.0f;
+
 /////////////////////////////////////
 // Constructors/Destructors
 
-// Constructor reserves space for entities and UID hash map, also sets first UID
-CEntityManager::CEntityManager()
+// Constructor reserves space for entities and UID slots
+CEntityManager::CEntityManager() : m_TemplateTable( 64 ), m_SpatialHash( kSpatialHashCellSize )
 {
-	// Initialise list of entities and UID hash map
+	// Initialise list of entities and UID slots, no free slots yet
 	m_Entities.reserve( 1024 );
-	m_EntityUIDMap = new CHashTable<TEntityUID, TUInt32>( 2048, JOneAtATimeHash ); 
-
-	// Set first entity UID that will be used
-	m_NextUID = 0;
+	m_EntitySlots.reserve( 1024 );
+	m_FirstFreeSlot = kNoEntitySlot;
+	m_LastFreeSlot = kNoEntitySlot;
+	m_DestroyQueue.reserve( 1024 );
+	m_IsUpdating = false;
 
 	m_IsEnumerating = false;
+	m_ThreadPool = 0;
 }
 
 // Destructor removes all entities
@@ -44,8 +52,9 @@ CEntityTemplate* CEntityManager::CreateTemplate( const string& type, const strin
 	// Create new entity template
 	CEntityTemplate* newTemplate = new CEntityTemplate( type, name, mesh );
 
-	// Add the template name / template pointer pair to the map
-	m_Templates[name] = newTemplate;
+	// Add the template to the list and the template name ID / template pointer pair to the table
+	m_Templates.push_back( newTemplate );
+	m_TemplateTable.SetKeyValue( newTemplate->GetNameID(), newTemplate );
 
 	return newTemplate;
 }
@@ -60,8 +69,9 @@ CCarTemplate* CEntityManager::CreateCarTemplate( const string& type, const strin
 	CCarTemplate* newTemplate =
 	new CCarTemplate( type, name, mesh, maxSpeed, acceleration, turnSpeed );
 
-	// Add the template name / template pointer pair to the map
-	m_Templates[name] = newTemplate;
+	// Add the template to the list and the template name ID / template pointer pair to the table
+	m_Templates.push_back( newTemplate );
+	m_TemplateTable.SetKeyValue( newTemplate->GetNameID(), newTemplate );
 
 	return newTemplate;
 }
@@ -69,45 +79,44 @@ CCarTemplate* CEntityManager::CreateCarTemplate( const string& type, const strin
 // Destroy the given template (name) - returns true if the template existed and was destroyed
 bool CEntityManager::DestroyTemplate( const string& name )
 {
-	// Find the template name in the template map
-	TTemplateIter entityTemplate = m_Templates.find( name );
-	if (entityTemplate == m_Templates.end())
+	// Find the template name in the template table
+	CEntityTemplate* entityTemplate = GetTemplate( name );
+	if (!entityTemplate)
 	{
 		// Not found
 		return false;
 	}
 
-	// Delete the template and remove the map entry
-	delete entityTemplate->second;
-	m_Templates.erase( entityTemplate );
+	// Delete the template and remove it from the list and table
+	m_Templates.erase( find( m_Templates.begin(), m_Templates.end(), entityTemplate ) );
+	m_TemplateTable.RemoveKey( entityTemplate->GetNameID() );
+	delete entityTemplate;
 	return true;
 }
 
 // Destroy all templates held by the manager
 void CEntityManager::DestroyAllTemplates()
 {
-	while (m_Templates.size())
+	TTemplateIter entityTemplate = m_Templates.begin();
+	while (entityTemplate != m_Templates.end())
 	{
-		TTemplateIter entityTemplate = m_Templates.begin();
-		while (entityTemplate != m_Templates.end())
-		{
-			delete entityTemplate->second;
-			++entityTemplate;
-		}
-		m_Templates.clear();
+		delete *entityTemplate;
+		++entityTemplate;
 	}
+	m_Templates.clear();
+	m_TemplateTable.RemoveAllKeys();
 }
 
 
 /////////////////////////////////////
 // Entity creation / destruction
 
-// Create a base class entity - requires a template name, may supply entity name and position
-// Returns the UID of the new entity
+// Create a base class entity - requires a template name ID, may supply entity name ID and
+// position. Returns the UID of the new entity
 TEntityUID CEntityManager::CreateEntity
 (
-	const string&    templateName,
-	const string&    name /*= ""*/,
+	TNameID          templateName,
+	TNameID          name /*= kNoName*/,
 	const CVector3&  position /*= CVector3::kOrigin*/, 
 	const CVector3&  rotation /*= CVector3( 0.0f, 0.0f, 0.0f )*/,
 	const CVector3&  scale /*= CVector3( 1.0f, 1.0f, 1.0f )*/
@@ -116,28 +125,18 @@ TEntityUID CEntityManager::CreateEntity
 	// Get template associated with the template name
 	CEntityTemplate* entityTemplate = GetTemplate( templateName );
 
-	// Create new entity with next UID
-	CEntity* newEntity = new CEntity( entityTemplate, m_NextUID, name, position, rotation, scale );
-
-	// Get vector index for new entity and add it to vector
-	TUInt32 entityIndex = static_cast<TUInt32>(m_Entities.size());
-	m_Entities.push_back( newEntity );
-
-	// Add mapping from UID to entity index into hash map
-	m_EntityUIDMap->SetKeyValue( m_NextUID, entityIndex );
-	
-	m_IsEnumerating = false; // Cancel any entity enumeration (entity list has changed)
-
-	// Return UID of new entity then increase it ready for next entity
-	return m_NextUID++;
+	// Create new entity with a new UID and add it to the entity list
+	TEntityUID UID = NewEntityUID();
+	AddEntity( new CEntity( entityTemplate, UID, name, position, rotation, scale ) );
+	return UID;
 }
 
-// Create a car, requires a car template name, may supply entity name and position
+// Create a car, requires a car template name ID, may supply entity name ID and position
 // Returns the UID of the new entity
 TEntityUID CEntityManager::CreateCar
 (
-	const string&   templateName,
-	const string&   name /*= ""*/,
+	TNameID         templateName,
+	TNameID         name /*= kNoName*/,
 	const CVector3& position /*= CVector3::kOrigin*/, 
 	const CVector3& rotation /*= CVector3( 0.0f, 0.0f, 0.0f )*/,
 	const CVector3& scale /*= CVector3( 1.0f, 1.0f, 1.0f )*/
@@ -147,44 +146,41 @@ TEntityUID CEntityManager::CreateCar
 	// This will cause an error if the template is not a car type
 	CCarTemplate* carTemplate = static_cast<CCarTemplate*>(GetTemplate( templateName ));
 
-	// Create new car entity with next UID
-	CEntity* newEntity = new CCarEntity( carTemplate, m_NextUID, name, position, rotation, scale );
-
-	// Get vector index for new entity and add it to vector
-	TUInt32 entityIndex = static_cast<int>(m_Entities.size());
-	m_Entities.push_back( newEntity );
-
-	// Add mapping from UID to entity index into hash map
-	m_EntityUIDMap->SetKeyValue( m_NextUID, entityIndex );
-	
-	m_IsEnumerating = false; // Cancel any entity enumeration (entity list has changed)
-
-	// Return UID of new entity then increase it ready for next entity
-	return m_NextUID++;
+	// Create new car entity with a new UID and add it to the entity list
+	TEntityUID UID = NewEntityUID();
+	AddEntity( new CCarEntity( carTemplate, UID, name, position, rotation, scale ) );
+	return UID;
 }
 
 
-// Destroy the given entity - returns true if the entity existed and was destroyed
+// Destroy the given entity - returns true if the entity existed and was destroyed (or
+// queued for destruction). Entities destroyed during UpdateAllEntities are queued and
+// destroyed together at the end of the update
 bool CEntityManager::DestroyEntity( TEntityUID UID )
 {
-	// Find the vector index of the given UID
-	TUInt32 entityIndex;
-	if (!m_EntityUIDMap->LookUpKey( UID, &entityIndex ))
+	if (m_IsUpdating)
+	{
+		return QueueDestroyEntity( UID );
+	}
+
+	// Quit if the UID is not for an existing entity
+	if (!GetEntity( UID ))
 	{
-		// Quit if not found
 		return false;
 	}
 
-	// Delete the given entity and remove from UID map
+	// Delete the given entity and free its slot
+	TUInt32 slot = UID & kUIDSlotMask;
+	TUInt32 entityIndex = m_EntitySlots[slot].entityIndex;
 	delete m_Entities[entityIndex];
-	m_EntityUIDMap->RemoveKey( UID );
+	FreeEntitySlot( slot );
 
 	// If not removing last entity...
 	if (entityIndex != m_Entities.size() - 1)
 	{
-		// ...put the last entity into the empty entity slot and update UID map
+		// ...put the last entity into the empty list position and update its slot
 		m_Entities[entityIndex] = m_Entities.back();
-		m_EntityUIDMap->SetKeyValue( m_Entities.back()->GetUID(), entityIndex );
+		m_EntitySlots[m_Entities[entityIndex]->GetUID() & kUIDSlotMask].entityIndex = entityIndex;
 	}
 	m_Entities.pop_back(); // Remove last entity
 
@@ -193,50 +189,281 @@ bool CEntityManager::DestroyEntity( TEntityUID UID )
 }
 
 
+// Queue the given entity for destruction by the next call to DestroyQueuedEntities (or end
+// of UpdateAllEntities). Returns false if the entity does not exist
+bool CEntityManager::QueueDestroyEntity( TEntityUID UID )
+{
+	if (!GetEntity( UID ))
+	{
+		return false;
+	}
+
+	// Only queue each entity once
+	SEntitySlot& slot = m_EntitySlots[UID & kUIDSlotMask];
+	if (!slot.isQueued)
+	{
+		slot.isQueued = true;
+		m_DestroyQueue.push_back( UID );
+	}
+	return true;
+}
+
+
+// Destroy all queued entities in a single pass over the entity list
+void CEntityManager::DestroyQueuedEntities()
+{
+	if (m_DestroyQueue.empty())
+	{
+		return;
+	}
+
+	// Delete the queued entities and free their slots, leaving gaps in the entity list. The
+	// queue is reused to hold the indexes of the gaps. Entities already destroyed by a direct
+	// call to DestroyEntity have a new slot generation and are skipped
+	TUInt32 numGaps = 0;
+	for (TUInt32 queued = 0; queued < m_DestroyQueue.size(); ++queued)
+	{
+		TEntityUID UID = m_DestroyQueue[queued];
+		if (GetEntity( UID ))
+		{
+			TUInt32 slot = UID & kUIDSlotMask;
+			TUInt32 entityIndex = m_EntitySlots[slot].entityIndex;
+			delete m_Entities[entityIndex];
+			m_Entities[entityIndex] = 0;
+			FreeEntitySlot( slot );
+			m_DestroyQueue[numGaps++] = entityIndex;
+		}
+	}
+	m_DestroyQueue.resize( numGaps );
+
+	// Fill the gaps from the lowest up with entities from the end of the list, so only the
+	// slots of entities that are moved are updated and the list is left packed
+	sort( m_DestroyQueue.begin(), m_DestroyQueue.end() );
+	TUInt32 numEntities = static_cast<TUInt32>(m_Entities.size());
+	for (TUInt32 gap = 0; gap < numGaps; ++gap)
+	{
+		// Drop gaps at the end of the list
+		while (numEntities > 0 && !m_Entities[numEntities - 1])
+		{
+			--numEntities;
+		}
+		TUInt32 entityIndex = m_DestroyQueue[gap];
+		if (entityIndex >= numEntities)
+		{
+			break;
+		}
+
+		m_Entities[entityIndex] = m_Entities[--numEntities];
+		m_EntitySlots[m_Entities[entityIndex]->GetUID() & kUIDSlotMask].entityIndex = entityIndex;
+	}
+	while (numEntities > 0 && !m_Entities[numEntities - 1])
+	{
+		--numEntities;
+	}
+	m_Entities.resize( numEntities );
+	m_DestroyQueue.clear();
+
+	if (numGaps > 0)
+	{
+		m_IsEnumerating = false; // Cancel any entity enumeration (entity list has changed)
+	}
+}
+
+
 // Destroy all entities held by the manager
 void CEntityManager::DestroyAllEntities()
 {
-	m_EntityUIDMap->RemoveAllKeys();
 	while (m_Entities.size())
 	{
+		FreeEntitySlot( m_Entities.back()->GetUID() & kUIDSlotMask );
 		delete m_Entities.back();
 		m_Entities.pop_back();
 	}
+	m_DestroyQueue.clear();
 
 	m_IsEnumerating = false; // Cancel any entity enumeration (entity list has changed)
 }
 
 
+// Reserve space for the given total number of entities, so they can be created without the
+// entity list and UID slots being reallocated
+void CEntityManager::ReserveEntities( TUInt32 numEntities )
+{
+	m_Entities.reserve( numEntities );
+	m_EntitySlots.reserve( numEntities );
+}
+
+
+/////////////////////////////////////
+// Entity UID slots
+
+// Get a free slot for a new entity and return the UID for it. The entity must be constructed
+// with this UID then passed to AddEntity
+TEntityUID CEntityManager::NewEntityUID()
+{
+	// Reuse the oldest free slot, or add a new slot if there are none
+	TUInt32 slot;
+	if (m_FirstFreeSlot != kNoEntitySlot)
+	{
+		slot = m_FirstFreeSlot;
+		m_FirstFreeSlot = m_EntitySlots[slot].nextFree;
+		if (m_FirstFreeSlot == kNoEntitySlot)
+		{
+			m_LastFreeSlot = kNoEntitySlot;
+		}
+	}
+	else
+	{
+		GEN_ASSERT( m_EntitySlots.size() < kMaxEntitySlots, "Too many entities" );
+		slot = static_cast<TUInt32>(m_EntitySlots.size());
+		SEntitySlot newSlot = { 0, 0, kNoEntitySlot, false };
+		m_EntitySlots.push_back( newSlot );
+	}
+
+	// Point slot at the end of the entity list, where AddEntity will put the new entity
+	m_EntitySlots[slot].entityIndex = static_cast<TUInt32>(m_Entities.size());
+	return (m_EntitySlots[slot].generation << kUIDSlotBits) | slot;
+}
+
+// Add an entity constructed with a UID from NewEntityUID to the entity list. Any entity
+// enumeration remains valid and will include the new entity
+void CEntityManager::AddEntity( CEntity* newEntity )
+{
+	m_Entities.push_back( newEntity );
+}
+
+// Add a slot to the end of the free list, advancing its generation to invalidate old UIDs.
+// Retires the slot instead if it has used its last generation
+void CEntityManager::FreeEntitySlot( TUInt32 slot )
+{
+	m_EntitySlots[slot].nextFree = kNoEntitySlot;
+	m_EntitySlots[slot].isQueued = false;
+	if (m_EntitySlots[slot].generation == kUIDGenerationMask)
+	{
+		// Wrapping to generation 0 would make old UIDs for the slot valid again. The slot is
+		// left out of the free list for good, with a generation no UID can match
+		m_EntitySlots[slot].generation = kRetiredGeneration;
+		return;
+	}
+	++m_EntitySlots[slot].generation;
+	if (m_LastFreeSlot != kNoEntitySlot)
+	{
+		m_EntitySlots[m_LastFreeSlot].nextFree = slot;
+	}
+	else
+	{
+		m_FirstFreeSlot = slot;
+	}
+	m_LastFreeSlot = slot;
+}
+
+
 /////////////////////////////////////
 // Update / Rendering
 
-// Call all entity update functions. Pass the time since last update
+// Call all entity update functions. Pass the time since last update. Templates with a batch
+// update have their instances updated in chunks spread across the thread pool (if set), other
+// entities are updated one at a time
 void CEntityManager::UpdateAllEntities( float updateTime )
 {
-	TUInt32 entity = 0;
-	while (entity < m_Entities.size())
+	// Rebuild the spatial hash from the current entity positions, reading them from the
+	// template instance arrays
+	m_SpatialHash.BeginBuild( NumEntities() );
+	TTemplateIter hashTemplate = m_Templates.begin();
+	while (hashTemplate != m_Templates.end())
 	{
-		// Update entity, if it returns false, then destroy it
-		if (!m_Entities[entity]->Update( updateTime ))
+		TUInt32 numInstances = (*hashTemplate)->GetNumInstances();
+		for (TUInt32 instance = 0; instance < numInstances; ++instance)
 		{
-			DestroyEntity(m_Entities[entity]->GetUID());
+			m_SpatialHash.AddEntity( (*hashTemplate)->GetInstance( instance )->GetUID(),
+			                         (*hashTemplate)->GetTypeID(),
+			                         (*hashTemplate)->RelMatrices( instance )[0].Position() );
 		}
-		else
+		++hashTemplate;
+	}
+	m_SpatialHash.EndBuild();
+
+	// Collect chunks of instances from all templates with a batch update
+	m_UpdateChunks.clear();
+	TTemplateIter entityTemplate = m_Templates.begin();
+	while (entityTemplate != m_Templates.end())
+	{
+		CEntityTemplate* batchTemplate = *entityTemplate;
+		if (batchTemplate->HasBatchUpdate())
 		{
-			++entity;
+			TUInt32 numInstances = batchTemplate->GetNumInstances();
+			for (TUInt32 first = 0; first < numInstances; first += kUpdateChunkSize)
+			{
+				SUpdateChunk chunk;
+				chunk.entityTemplate = batchTemplate;
+				chunk.first = first;
+				chunk.last = min( first + kUpdateChunkSize, numInstances );
+				m_UpdateChunks.push_back( chunk );
+			}
 		}
+		++entityTemplate;
+	}
+
+	// Update the chunks - entities are not created or destroyed by batch updates
+	const TUpdateChunks& chunks = m_UpdateChunks;
+	CThreadPool::TTask updateChunk = [&chunks, updateTime]( TUInt32 chunk )
+	{
+		chunks[chunk].entityTemplate->UpdateInstances( chunks[chunk].first, chunks[chunk].last,
+		                                               updateTime );
+	};
+	TUInt32 numChunks = static_cast<TUInt32>(m_UpdateChunks.size());
+	if (m_ThreadPool)
+	{
+		m_ThreadPool->Run( numChunks, updateChunk );
 	}
+	else
+	{
+		for (TUInt32 chunk = 0; chunk < numChunks; ++chunk)
+		{
+			updateChunk( chunk );
+		}
+	}
+
+	// Update the instances of the remaining templates one at a time, so the batch-updated
+	// entities are not visited again. Entities destroyed in the meantime (including by other
+	// entities' update functions) are queued until the end of the update so the instance lists
+	// don't change while they are being iterated. Entities and templates created during the
+	// update are added to the end of the lists and are updated too
+	m_IsUpdating = true;
+	for (TUInt32 templateIndex = 0; templateIndex < m_Templates.size(); ++templateIndex)
+	{
+		CEntityTemplate* serialTemplate = m_Templates[templateIndex];
+		if (serialTemplate->HasBatchUpdate())
+		{
+			continue;
+		}
+		for (TUInt32 instance = 0; instance < serialTemplate->GetNumInstances(); ++instance)
+		{
+			// Update entity, if it returns false, then destroy it
+			CEntity* entity = serialTemplate->GetInstance( instance );
+			if (!entity->Update( updateTime ))
+			{
+				QueueDestroyEntity( entity->GetUID() );
+			}
+		}
+	}
+	m_IsUpdating = false;
+
+	DestroyQueuedEntities();
 }
 
-// Render all entities from the given camera
+// Render all entities from the given camera. Entities are collected in a render queue and
+// drawn sorted to reduce state changes
 void CEntityManager::RenderAllEntities( CCamera* camera )
 {
+	m_RenderQueue.Begin( camera );
 	TEntityIter entity = m_Entities.begin();
 	while (entity != m_Entities.end())
 	{
-		(*entity)->Render( camera );
+		(*entity)->Render( &m_RenderQueue );
 		++entity;
 	}
+	m_RenderQueue.Submit();
 }
 
 
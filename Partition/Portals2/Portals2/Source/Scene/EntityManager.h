@@ -7,20 +7,25 @@
 
 #pragma once
 
-#include <map>
+#include <vector>
 using namespace std;
 
 #include "Defines.h"
-#include "CHashTable.h"
+#include "CNameTable.h"
+#include "CFlatHashTable.h"
+#include "CThreadPool.h"
 #include "Entity.h"
 #include "CarEntity.h"
+#include "SpatialHash.h"
 #include "Camera.h"
+#include "RenderQueue.h"
 
 namespace gen
 {
 
 // The entity manager is responsible for creation, update, rendering and deletion of
-// entities. It also manages UIDs for entities using a hash table
+// entities. It also manages UIDs for entities, which are handles into a table of slots (see
+// the data section)
 class CEntityManager
 {
 /////////////////////////////////////
@@ -76,6 +81,21 @@ public:
 		const CVector3&  position = CVector3::kOrigin, 
 		const CVector3&  rotation = CVector3( 0.0f, 0.0f, 0.0f ),
 		const CVector3&  scale = CVector3( 1.0f, 1.0f, 1.0f )
+	)
+	{
+		return CreateEntity( EntityNames.FindID( templateName ), EntityNames.GetID( name ),
+		                     position, rotation, scale );
+	}
+
+	// As above, but with template name and entity name given as IDs from EntityNames. Use this
+	// version when creating many entities - no strings are hashed or copied
+	TEntityUID CreateEntity
+	(
+		TNameID          templateName,
+		TNameID          name = kNoName,
+		const CVector3&  position = CVector3::kOrigin, 
+		const CVector3&  rotation = CVector3( 0.0f, 0.0f, 0.0f ),
+		const CVector3&  scale = CVector3( 1.0f, 1.0f, 1.0f )
 	);
 
 	// Create a car, requires a car template name, may supply entity name and position
@@ -87,15 +107,42 @@ public:
 		const CVector3& position = CVector3::kOrigin, 
 		const CVector3& rotation = CVector3( 0.0f, 0.0f, 0.0f ),
 		const CVector3& scale = CVector3( 1.0f, 1.0f, 1.0f )
+	)
+	{
+		return CreateCar( EntityNames.FindID( templateName ), EntityNames.GetID( name ),
+		                  position, rotation, scale );
+	}
+
+	// As above, but with template name and entity name given as IDs from EntityNames
+	TEntityUID CreateCar
+	(
+		TNameID         templateName,
+		TNameID         name = kNoName,
+		const CVector3& position = CVector3::kOrigin, 
+		const CVector3& rotation = CVector3( 0.0f, 0.0f, 0.0f ),
+		const CVector3& scale = CVector3( 1.0f, 1.0f, 1.0f )
 	);
 
 
-	// Destroy the given entity - returns true if the entity existed and was destroyed
+	// Destroy the given entity - returns true if the entity existed and was destroyed (or
+	// queued for destruction). Entities destroyed during UpdateAllEntities are queued and
+	// destroyed together at the end of the update. Until then GetEntity still returns them
 	bool DestroyEntity( TEntityUID UID );
 
+	// Queue the given entity for destruction by the next call to DestroyQueuedEntities (or end
+	// of UpdateAllEntities). Returns false if the entity does not exist
+	bool QueueDestroyEntity( TEntityUID UID );
+
+	// Destroy all queued entities in a single pass over the entity list
+	void DestroyQueuedEntities();
+
 	// Destroy all entities held by the manager
 	void DestroyAllEntities();
 
+	// Reserve space for the given total number of entities, so they can be created without the
+	// entity list and UID slots being reallocated
+	void ReserveEntities( TUInt32 numEntities );
+
 
 	/////////////////////////////////////
 	// Template / Entity access
@@ -103,14 +150,32 @@ public:
 	// Return the template with the given name
 	CEntityTemplate* GetTemplate( const string& name )
 	{
-		// Find the template name in the template map
-		TTemplateIter entityTemplate = m_Templates.find( name );
-		if (entityTemplate == m_Templates.end())
+		return GetTemplate( EntityNames.FindID( name ) );
+	}
+
+	// Return the template with the given name ID
+	CEntityTemplate* GetTemplate( TNameID name )
+	{
+		CEntityTemplate* entityTemplate;
+		if (!m_TemplateTable.LookUpKey( name, &entityTemplate ))
 		{
 			// Template name not found
 			return 0;
 		}
-		return (*entityTemplate).second;
+		return entityTemplate;
+	}
+
+
+	// Return the number of templates
+	TUInt32 NumTemplates()
+	{
+		return static_cast<TUInt32>(m_Templates.size());
+	}
+
+	// Return the template at the given array index
+	CEntityTemplate* GetTemplateAtIndex( TUInt32 index )
+	{
+		return m_Templates[index];
 	}
 
 
@@ -126,28 +191,38 @@ public:
 		return m_Entities[index];
 	}
 
-	// Return the entity with the given UID
+	// Return the entity with the given UID, 0 if the entity has been destroyed
 	CEntity* GetEntity( TEntityUID UID )
 	{
-		// Find the entity UID in the entity hash map
-		TUInt32 entityIndex;
-		if (!m_EntityUIDMap->LookUpKey( UID, &entityIndex ))
+		// The UID holds the index of the entity's slot, and the slot's generation when the
+		// entity was created. If the generation has changed then the entity has been destroyed
+		TUInt32 slot = UID & kUIDSlotMask;
+		if (slot >= m_EntitySlots.size() || m_EntitySlots[slot].generation != (UID >> kUIDSlotBits))
 		{
 			return 0;
 		}
-		return m_Entities[entityIndex];
+		return m_Entities[m_EntitySlots[slot].entityIndex];
 	}
 
 	// Return the entity with the given name & optionally the given template name & type
 	CEntity* GetEntity( const string& name, const string& templateName = "",
 	                    const string& templateType = "" )
+	{
+		return FindEntity( EntityNames.FindID( name ), EntityNames.FindID( templateName ),
+		                   EntityNames.FindID( templateType ) );
+	}
+
+	// As above, but with names given as IDs from EntityNames (kNoName for template name or
+	// type matches any)
+	CEntity* FindEntity( TNameID name, TNameID templateName = kNoName,
+	                     TNameID templateType = kNoName )
 	{
 		TEntityIter entity = m_Entities.begin();
 		while (entity != m_Entities.end())
 		{
-			if ((*entity)->GetName() == name && 
-				(templateName.length() == 0 || (*entity)->Template()->GetName() == templateName) &&
-				(templateType.length() == 0 || (*entity)->Template()->GetType() == templateType))
+			if ((*entity)->GetNameID() == name && 
+				(templateName == kNoName || (*entity)->Template()->GetNameID() == templateName) &&
+				(templateType == kNoName || (*entity)->Template()->GetTypeID() == templateType))
 			{
 				return (*entity);
 			}
@@ -159,12 +234,20 @@ public:
 
 	// Begin an enumeration of entities matching given name, template name and type
 	// An empty string indicates to match anything in this field (would be nice to support
-	// wildcards, e.g. match name of "Ship*")
+	// wildcards, e.g. match name of "Ship*"). The enumeration is cancelled when entities are
+	// destroyed, entities created during an enumeration are included in it
 	void BeginEnumEntities( const string& name, const string& templateName,
 	                        const string& templateType = "" )
+	{
+		BeginEnumEntities( EntityNames.FindID( name ), EntityNames.FindID( templateName ),
+		                   EntityNames.FindID( templateType ) );
+	}
+
+	// As above, but with names given as IDs from EntityNames (kNoName matches anything)
+	void BeginEnumEntities( TNameID name, TNameID templateName, TNameID templateType = kNoName )
 	{
 		m_IsEnumerating = true;
-		m_EnumEntity = m_Entities.begin();
+		m_EnumIndex = 0;
 		m_EnumName = name;
 		m_EnumTemplateName = templateName;
 		m_EnumTemplateType = templateType;
@@ -185,19 +268,18 @@ public:
 			return 0;
 		}
 
-		while (m_EnumEntity != m_Entities.end())
+		while (m_EnumIndex < m_Entities.size())
 		{
-			if ((m_EnumName.length() == 0 || (*m_EnumEntity)->GetName() == m_EnumName) && 
-				(m_EnumTemplateName.length() == 0 ||
-				 (*m_EnumEntity)->Template()->GetName() == m_EnumTemplateName) &&
-				(m_EnumTemplateType.length() == 0 ||
-				 (*m_EnumEntity)->Template()->GetType() == m_EnumTemplateType))
+			CEntity* entity = m_Entities[m_EnumIndex];
+			++m_EnumIndex;
+			if ((m_EnumName == kNoName || entity->GetNameID() == m_EnumName) && 
+				(m_EnumTemplateName == kNoName ||
+				 entity->Template()->GetNameID() == m_EnumTemplateName) &&
+				(m_EnumTemplateType == kNoName ||
+				 entity->Template()->GetTypeID() == m_EnumTemplateType))
 			{
-				CEntity* foundEntity = *m_EnumEntity;
-				++m_EnumEntity;
-				return foundEntity;
+				return entity;
 			}
-			++m_EnumEntity;
 		}
 		
 		m_IsEnumerating = false;
@@ -208,13 +290,37 @@ public:
 	/////////////////////////////////////
 	// Update / Rendering
 
-	// Call all entity update functions - not the ideal method, OK for this example
-	// Pass the time since last update
+	// Set the thread pool used to update entities in parallel, 0 to update on the calling
+	// thread only. The pool is not owned by the manager
+	void SetThreadPool( CThreadPool* threadPool )
+	{
+		m_ThreadPool = threadPool;
+	}
+
+	// Call all entity update functions. Entities whose template has a batch update (e.g. cars)
+	// are updated in chunks on the thread pool. Entities destroyed during the update (e.g. when
+	// their Update returns false) are destroyed together at the end. Pass the time since last
+	// update
 	void UpdateAllEntities( float updateTime );
 
 	// Render all entities from the given camera - not the ideal method, OK for this example
+	// Entities are collected in a render queue and drawn sorted to reduce state changes
 	void RenderAllEntities( CCamera* camera );
 
+	// Get the spatial hash of entity positions for proximity queries. It is rebuilt at the start
+	// of UpdateAllEntities, so holds the positions from the end of the previous update. Can be
+	// queried from entity updates, including batch updates running in parallel
+	const CSpatialHash& GetSpatialHash()
+	{
+		return m_SpatialHash;
+	}
+
+	// Get the render queue used by RenderAllEntities, e.g. to read its state change counts
+	CRenderQueue& GetRenderQueue()
+	{
+		return m_RenderQueue;
+	}
+
 		
 /////////////////////////////////////
 //	Private interface
@@ -223,20 +329,73 @@ private:
 	/////////////////////////////////////
 	// Types
 
-	// Entity templates are held in a map, define some types for convenience
-	typedef map<string, CEntityTemplate*> TTemplates;
+	// Entity templates are held in a list, and in a hash table to look them up by name ID
+	typedef vector<CEntityTemplate*> TTemplates;
 	typedef TTemplates::iterator TTemplateIter;
+	typedef CFlatHashTable<TNameID, CEntityTemplate*> TTemplateTable;
 
 	// Entity instances are held in a vector, define some types for convenience
 	typedef vector<CEntity*> TEntities;
 	typedef TEntities::iterator TEntityIter;
 
+	// Each entity UID is a slot index in the low bits and a generation in the high bits
+	static const TUInt32 kUIDSlotBits = 20;
+	static const TUInt32 kUIDSlotMask = (1 << kUIDSlotBits) - 1;
+	static const TUInt32 kMaxEntitySlots = kUIDSlotMask; // Last slot unused, so no UID is SystemUID
+	static const TUInt32 kUIDGenerationMask = (1 << (32 - kUIDSlotBits)) - 1;
+	static const TUInt32 kRetiredGeneration = kUIDGenerationMask + 1; // Matches no UID
+	static const TUInt32 kNoEntitySlot = 0xffffffff;
+
+	// A slot maps a UID to the index of its entity in the entity list. Slots are reused once
+	// their entity is destroyed, the generation is increased each time so old UIDs for the slot
+	// no longer match. The generation never wraps - a slot is retired once its last generation is
+	// used (4096 entities), so an old UID can never refer to a later entity
+	struct SEntitySlot
+	{
+		TUInt32 entityIndex; // Index into entity list (if slot in use)
+		TUInt32 generation;  // Generation of current entity, or next entity if slot is free
+		TUInt32 nextFree;    // Next slot in free list (if slot is free)
+		bool    isQueued;    // Entity is queued for destruction
+	};
+	typedef vector<SEntitySlot> TEntitySlots;
+
+	// A range of instances of one template, updated as a single task by UpdateAllEntities
+	struct SUpdateChunk
+	{
+		CEntityTemplate* entityTemplate;
+		TUInt32          first;
+		TUInt32          last;
+	};
+	typedef vector<SUpdateChunk> TUpdateChunks;
+
+	// Number of instances per update task - large enough that threads rarely share cache lines
+	// and the cost of taking a task is small compared to the work
+	static const TUInt32 kUpdateChunkSize = 1024;
+
+	// Cell size for the spatial hash - around the distance of typical proximity queries
+	static const TFloat32 kSpatialHashCellSize;
+
+
+	/////////////////////////////////////
+	// Support functions
+
+	// Get a free slot for a new entity and return the UID for it. The entity must be constructed
+	// with this UID then passed to AddEntity
+	TEntityUID NewEntityUID();
+	void AddEntity( CEntity* newEntity );
+
+	// Add a slot to the end of the free list, advancing its generation to invalidate old UIDs.
+	// Retires the slot instead if it has used its last generation
+	void FreeEntitySlot( TUInt32 slot );
+
 
 	/////////////////////////////////////
 	// Template Data
 
-	// The map of template names / templates
-	TTemplates m_Templates;
+	// The list of templates and the table of template name IDs / templates. Each name in the
+	// table refers to the most recently created template with that name
+	TTemplates     m_Templates;
+	TTemplateTable m_TemplateTable;
 
 
 	/////////////////////////////////////
@@ -247,21 +406,46 @@ private:
 	// fill its space
 	TEntities m_Entities;
 
-	// A mapping from UIDs to indexes into the above array
-	CHashTable<TEntityUID, TUInt32>* m_EntityUIDMap;
+	// Slots mapping UIDs to indexes into the above array. Only the slot of the moved entity
+	// needs updating when an entity is removed from the middle of the list
+	TEntitySlots m_EntitySlots;
 
-	// Entity IDs are provided using a single increasing integer
-	TEntityUID m_NextUID;
+	// Free slots are reused oldest first, so each slot's generations last as long as possible.
+	// Linked through the nextFree member of each slot
+	TUInt32 m_FirstFreeSlot;
+	TUInt32 m_LastFreeSlot;
+
+	// UIDs of entities queued for destruction, and whether UpdateAllEntities is running (when
+	// DestroyEntity queues rather than destroying immediately)
+	vector<TEntityUID> m_DestroyQueue;
+	bool               m_IsUpdating;
 
 
 	/////////////////////////////////////
 	// Data for Entity Enumeration
 
 	bool        m_IsEnumerating;
-	TEntityIter m_EnumEntity;
-	string      m_EnumName;
-	string      m_EnumTemplateName;
-	string      m_EnumTemplateType;
+	TUInt32     m_EnumIndex; // Index rather than iterator, so creating entities doesn't cancel it
+	TNameID     m_EnumName;         // Names to match (IDs in EntityNames), kNoName matches any,
+	TNameID     m_EnumTemplateName; // kUnknownName matches none
+	TNameID     m_EnumTemplateType;
+
+
+	/////////////////////////////////////
+	// Update Data
+
+	CThreadPool*  m_ThreadPool;   // Not owned, may be 0
+	TUpdateChunks m_UpdateChunks; // Kept between updates to avoid reallocation
+
+	// Entity positions for proximity queries, rebuilt each update
+	CSpatialHash  m_SpatialHash;
+
+
+	/////////////////////////////////////
+	// Rendering Data
+
+	// Queue used to sort entities by render state in RenderAllEntities
+	CRenderQueue m_RenderQueue;
 };
 
 
@@ -0,0 +1,453 @@
+/*******************************************
+	SceneSnapshot.cpp
+
+	Binary snapshot of the entity manager's
+	templates and entities, for checkpoints
+	and fast scene loading
+********************************************/
+
+#include <fstream>
+#include <cstring>
+using namespace std;
+
+#include "SceneSnapshot.h"
+#include "CarEntity.h"
+
+namespace gen
+{
+
+/////////////////////////////////////
+// Constructors/Destructors
+
+// Constructor creates an empty snapshot
+CSceneSnapshot::CSceneSnapshot() : m_EntityIndexes( 1024 ), m_NameIndexes( 256 )
+{
+	Clear();
+}
+
+
+/////////////////////////////////////
+// Capture / Restore
+
+// Capture all templates and entities from the given entity manager, replacing the current
+// contents of the snapshot (including entity lists)
+void CSceneSnapshot::Capture( CEntityManager& manager )
+{
+	Clear();
+	m_Templates.reserve( manager.NumTemplates() );
+	m_Entities.reserve( manager.NumEntities() );
+	m_UIDs.reserve( manager.NumEntities() );
+
+	// Entities are captured template by template from the template instance arrays, so each
+	// template's node matrices are copied in a single block
+	for (TUInt32 templateIndex = 0; templateIndex < manager.NumTemplates(); ++templateIndex)
+	{
+		CEntityTemplate* entityTemplate = manager.GetTemplateAtIndex( templateIndex );
+		CCarTemplate* carTemplate = entityTemplate->IsCarTemplate() ?
+		                            static_cast<CCarTemplate*>(entityTemplate) : 0;
+
+		STemplateRecord templateRecord;
+		templateRecord.type = AddName( entityTemplate->GetTypeID() );
+		templateRecord.name = AddName( entityTemplate->GetNameID() );
+		templateRecord.mesh = AddName( EntityNames.GetID( entityTemplate->GetMeshFilename() ) );
+		templateRecord.isCar = (carTemplate != 0);
+		templateRecord.maxSpeed = carTemplate ? carTemplate->GetMaxSpeed() : 0.0f;
+		templateRecord.acceleration = carTemplate ? carTemplate->GetAcceleration() : 0.0f;
+		templateRecord.turnSpeed = carTemplate ? carTemplate->GetTurnSpeed() : 0.0f;
+		m_Templates.push_back( templateRecord );
+
+		TUInt32 numInstances = entityTemplate->GetNumInstances();
+		TUInt32 numNodes = entityTemplate->GetNumNodes();
+		if (numInstances == 0)
+		{
+			continue;
+		}
+		TUInt32 firstMatrix = static_cast<TUInt32>(m_Matrices.size());
+		CMatrix4x4* relMatrices = entityTemplate->RelMatrices( 0 );
+		m_Matrices.insert( m_Matrices.end(), relMatrices, relMatrices + numInstances * numNodes );
+
+		for (TUInt32 instance = 0; instance < numInstances; ++instance)
+		{
+			CEntity* entity = entityTemplate->GetInstance( instance );
+
+			SEntityRecord entityRecord;
+			entityRecord.templateIndex = templateIndex;
+			entityRecord.name = AddName( entity->GetNameID() );
+			entityRecord.capturedUID = entity->GetUID();
+			entityRecord.firstMatrix = firstMatrix + instance * numNodes;
+			entityRecord.isCar = entity->IsCar();
+			entityRecord.speed = carTemplate ? carTemplate->Speed( instance ) : 0.0f;
+			entityRecord.state = carTemplate ? carTemplate->State( instance ) : 0;
+			entityRecord.timer = carTemplate ? carTemplate->Timer( instance ) : 0.0f;
+
+			m_EntityIndexes.SetKeyValue( entity->GetUID(), static_cast<TUInt32>(m_Entities.size()) );
+			m_Entities.push_back( entityRecord );
+			m_UIDs.push_back( entity->GetUID() );
+		}
+	}
+}
+
+
+// Add a list of entities to the snapshot (e.g. those in a partition), after Capture.
+// Entities that were not captured are left out. Returns the index of the list
+TUInt32 CSceneSnapshot::AddEntityList( const vector<TEntityUID>& UIDs )
+{
+	for (TUInt32 entity = 0; entity < UIDs.size(); ++entity)
+	{
+		TUInt32 entityIndex;
+		if (m_EntityIndexes.LookUpKey( UIDs[entity], &entityIndex ))
+		{
+			m_ListEntries.push_back( entityIndex );
+		}
+	}
+	m_ListStarts.push_back( static_cast<TUInt32>(m_ListEntries.size()) );
+	return GetNumEntityLists() - 1;
+}
+
+
+// Destroy all entities in the given manager and recreate them from the snapshot. Templates
+// in the snapshot are reused if the manager has a template of the same name, otherwise they
+// are created (loading the mesh). Returns false if an existing template doesn't match the
+// snapshot (different class or number of nodes) - some entities will not have been created
+bool CSceneSnapshot::Restore( CEntityManager& manager )
+{
+	manager.DestroyAllEntities();
+
+	// Convert the snapshot's names to name IDs, one string operation per name rather than
+	// per entity
+	vector<TNameID> nameIDs( m_NumNames );
+	const char* name = &m_Names[0];
+	for (TUInt32 nameIndex = 0; nameIndex < m_NumNames; ++nameIndex)
+	{
+		nameIDs[nameIndex] = EntityNames.GetID( name );
+		name += strlen( name ) + 1;
+	}
+
+	// Find or create the templates and check they match the snapshot
+	TUInt32 numTemplates = static_cast<TUInt32>(m_Templates.size());
+	vector<CEntityTemplate*> templates( numTemplates );
+	vector<bool> templateMatches( numTemplates );
+	vector<TUInt32> numInstances( numTemplates, 0 );
+	for (TUInt32 entity = 0; entity < m_Entities.size(); ++entity)
+	{
+		++numInstances[m_Entities[entity].templateIndex];
+	}
+	bool allMatch = true;
+	for (TUInt32 templateIndex = 0; templateIndex < numTemplates; ++templateIndex)
+	{
+		const STemplateRecord& record = m_Templates[templateIndex];
+		CEntityTemplate* entityTemplate = manager.GetTemplate( nameIDs[record.name] );
+		if (!entityTemplate)
+		{
+			const string& type = EntityNames.GetString( nameIDs[record.type] );
+			const string& templateName = EntityNames.GetString( nameIDs[record.name] );
+			const string& mesh = EntityNames.GetString( nameIDs[record.mesh] );
+			if (record.isCar)
+			{
+				entityTemplate = manager.CreateCarTemplate( type, templateName, mesh, record.maxSpeed,
+				                                            record.acceleration, record.turnSpeed );
+			}
+			else
+			{
+				entityTemplate = manager.CreateTemplate( type, templateName, mesh );
+			}
+		}
+		templates[templateIndex] = entityTemplate;
+
+		// The template must be the same class and have as many nodes as each entity record has
+		// matrices. Matrices of the template's entities follow each other, so the node count is
+		// the gap between them (or to the end of the array for the last entity)
+		templateMatches[templateIndex] = (entityTemplate->IsCarTemplate() == (record.isCar != 0));
+		allMatch = allMatch && templateMatches[templateIndex];
+		entityTemplate->ReserveInstances( entityTemplate->GetNumInstances() +
+		                                  numInstances[templateIndex] );
+	}
+	for (TUInt32 entity = 0; entity < m_Entities.size(); ++entity)
+	{
+		TUInt32 templateIndex = m_Entities[entity].templateIndex;
+		TUInt32 nextMatrix = (entity + 1 < m_Entities.size()) ? m_Entities[entity + 1].firstMatrix :
+		                     static_cast<TUInt32>(m_Matrices.size());
+		if (nextMatrix - m_Entities[entity].firstMatrix != templates[templateIndex]->GetNumNodes())
+		{
+			templateMatches[templateIndex] = false;
+			allMatch = false;
+		}
+	}
+
+	// Create the entities, then set their matrices and car state from the snapshot
+	manager.ReserveEntities( manager.NumEntities() + static_cast<TUInt32>(m_Entities.size()) );
+	for (TUInt32 entity = 0; entity < m_Entities.size(); ++entity)
+	{
+		const SEntityRecord& record = m_Entities[entity];
+		if (!templateMatches[record.templateIndex])
+		{
+			m_UIDs[entity] = SystemUID;
+			continue;
+		}
+
+		CEntityTemplate* entityTemplate = templates[record.templateIndex];
+		TNameID templateName = entityTemplate->GetNameID();
+		TEntityUID UID = record.isCar ? manager.CreateCar( templateName, nameIDs[record.name] ) :
+		                                manager.CreateEntity( templateName, nameIDs[record.name] );
+		m_UIDs[entity] = UID;
+
+		TUInt32 instance = manager.GetEntity( UID )->GetInstanceIndex();
+		const CMatrix4x4* matrices = &m_Matrices[record.firstMatrix];
+		copy( matrices, matrices + entityTemplate->GetNumNodes(),
+		      entityTemplate->RelMatrices( instance ) );
+		if (entityTemplate->IsCarTemplate())
+		{
+			CCarTemplate* carTemplate = static_cast<CCarTemplate*>(entityTemplate);
+			carTemplate->Speed( instance ) = record.speed;
+			carTemplate->State( instance ) = static_cast<CCarTemplate::EState>(record.state);
+			carTemplate->Timer( instance ) = record.timer;
+		}
+	}
+
+	return allMatch;
+}
+
+
+/////////////////////////////////////
+// Entity handles
+
+// Get the UIDs of the entities in the given list - those used when the list was added, or
+// the new UIDs if the snapshot has been restored
+void CSceneSnapshot::GetEntityList( TUInt32 list, vector<TEntityUID>* UIDs )
+{
+	UIDs->clear();
+	UIDs->reserve( m_ListStarts[list + 1] - m_ListStarts[list] );
+	for (TUInt32 entry = m_ListStarts[list]; entry < m_ListStarts[list + 1]; ++entry)
+	{
+		TEntityUID UID = m_UIDs[m_ListEntries[entry]];
+		if (UID != SystemUID)
+		{
+			UIDs->push_back( UID );
+		}
+	}
+}
+
+// Return the UID given by the last restore to the entity that had the given UID when the
+// snapshot was captured. Returns SystemUID if the entity wasn't in the snapshot
+TEntityUID CSceneSnapshot::GetRestoredUID( TEntityUID capturedUID )
+{
+	TUInt32 entityIndex;
+	if (!m_EntityIndexes.LookUpKey( capturedUID, &entityIndex ))
+	{
+		return SystemUID;
+	}
+	return m_UIDs[entityIndex];
+}
+
+
+/////////////////////////////////////
+// File access
+
+// Save the snapshot to a binary file, returns true on success
+bool CSceneSnapshot::Save( const string& fileName ) const
+{
+	ofstream file( fileName.c_str(), ios::out | ios::binary | ios::trunc );
+	if (!file)
+	{
+		return false;
+	}
+
+	SHeader header;
+	header.fileID = kFileID;
+	header.version = kFileVersion;
+	header.numNames = m_NumNames;
+	header.namesSize = static_cast<TUInt32>(m_Names.size());
+	header.numTemplates = static_cast<TUInt32>(m_Templates.size());
+	header.numEntities = static_cast<TUInt32>(m_Entities.size());
+	header.numMatrices = static_cast<TUInt32>(m_Matrices.size());
+	header.numLists = static_cast<TUInt32>(m_ListStarts.size());
+	header.numListEntries = static_cast<TUInt32>(m_ListEntries.size());
+
+	// Write the header then each array in a single block
+	file.write( reinterpret_cast<const char*>(&header), sizeof(header) );
+	file.write( &m_Names[0], m_Names.size() );
+	if (!m_Templates.empty())
+	{
+		file.write( reinterpret_cast<const char*>(&m_Templates[0]),
+		            m_Templates.size() * sizeof(STemplateRecord) );
+	}
+	if (!m_Entities.empty())
+	{
+		file.write( reinterpret_cast<const char*>(&m_Entities[0]),
+		            m_Entities.size() * sizeof(SEntityRecord) );
+	}
+	if (!m_Matrices.empty())
+	{
+		file.write( reinterpret_cast<const char*>(&m_Matrices[0]),
+		            m_Matrices.size() * sizeof(CMatrix4x4) );
+	}
+	file.write( reinterpret_cast<const char*>(&m_ListStarts[0]),
+	            m_ListStarts.size() * sizeof(TUInt32) );
+	if (!m_ListEntries.empty())
+	{
+		file.write( reinterpret_cast<const char*>(&m_ListEntries[0]),
+		            m_ListEntries.size() * sizeof(TUInt32) );
+	}
+
+	return !file.fail();
+}
+
+
+// Load a snapshot saved with Save, returns false if the file can't be read or is not a
+// snapshot of the current version
+bool CSceneSnapshot::Load( const string& fileName )
+{
+	// Read the whole file with a single read
+	ifstream file( fileName.c_str(), ios::in | ios::binary | ios::ate );
+	if (!file)
+	{
+		return false;
+	}
+	TUInt32 fileSize = static_cast<TUInt32>(file.tellg());
+	if (fileSize < sizeof(SHeader))
+	{
+		return false;
+	}
+	vector<char> buffer( fileSize );
+	file.seekg( 0 );
+	if (!file.read( &buffer[0], fileSize ))
+	{
+		return false;
+	}
+
+	// Check the header and that the file has exactly the arrays it describes
+	SHeader header;
+	memcpy( &header, &buffer[0], sizeof(header) );
+	if (header.fileID != kFileID || header.version != kFileVersion || header.numNames == 0 ||
+	    header.namesSize == 0 || header.numLists == 0)
+	{
+		return false;
+	}
+	TUInt64 expectedSize = sizeof(SHeader) + static_cast<TUInt64>(header.namesSize) +
+	                       static_cast<TUInt64>(header.numTemplates) * sizeof(STemplateRecord) +
+	                       static_cast<TUInt64>(header.numEntities) * sizeof(SEntityRecord) +
+	                       static_cast<TUInt64>(header.numMatrices) * sizeof(CMatrix4x4) +
+	                       static_cast<TUInt64>(header.numLists) * sizeof(TUInt32) +
+	                       static_cast<TUInt64>(header.numListEntries) * sizeof(TUInt32);
+	if (fileSize != expectedSize || buffer[sizeof(SHeader) + header.namesSize - 1] != 0)
+	{
+		return false;
+	}
+
+	// Size each array then copy its contents straight from the buffer
+	Clear();
+	const char* data = &buffer[sizeof(SHeader)];
+	m_NumNames = header.numNames;
+	m_Names.assign( data, data + header.namesSize );
+	data += header.namesSize;
+	m_Templates.resize( header.numTemplates );
+	if (header.numTemplates > 0)
+	{
+		memcpy( &m_Templates[0], data, header.numTemplates * sizeof(STemplateRecord) );
+		data += header.numTemplates * sizeof(STemplateRecord);
+	}
+	m_Entities.resize( header.numEntities );
+	if (header.numEntities > 0)
+	{
+		memcpy( &m_Entities[0], data, header.numEntities * sizeof(SEntityRecord) );
+		data += header.numEntities * sizeof(SEntityRecord);
+	}
+	m_Matrices.resize( header.numMatrices );
+	if (header.numMatrices > 0)
+	{
+		memcpy( &m_Matrices[0], data, header.numMatrices * sizeof(CMatrix4x4) );
+		data += header.numMatrices * sizeof(CMatrix4x4);
+	}
+	m_ListStarts.resize( header.numLists );
+	memcpy( &m_ListStarts[0], data, header.numLists * sizeof(TUInt32) );
+	data += header.numLists * sizeof(TUInt32);
+	m_ListEntries.resize( header.numListEntries );
+	if (header.numListEntries > 0)
+	{
+		memcpy( &m_ListEntries[0], data, header.numListEntries * sizeof(TUInt32) );
+	}
+
+	// Check the indexes and car states in the records are in range, so a damaged file can't cause
+	// a crash or restore a car to a state that doesn't exist
+	bool valid = (m_ListStarts[0] == 0 && m_ListStarts.back() == header.numListEntries);
+	for (TUInt32 list = 1; list < m_ListStarts.size(); ++list)
+	{
+		valid = valid && m_ListStarts[list - 1] <= m_ListStarts[list];
+	}
+	for (TUInt32 entry = 0; entry < header.numListEntries; ++entry)
+	{
+		valid = valid && m_ListEntries[entry] < header.numEntities;
+	}
+	for (TUInt32 templateIndex = 0; templateIndex < header.numTemplates; ++templateIndex)
+	{
+		const STemplateRecord& record = m_Templates[templateIndex];
+		valid = valid && record.type < m_NumNames && record.name < m_NumNames &&
+		        record.mesh < m_NumNames;
+	}
+	for (TUInt32 entity = 0; entity < header.numEntities; ++entity)
+	{
+		const SEntityRecord& record = m_Entities[entity];
+		TUInt32 nextMatrix = (entity + 1 < header.numEntities) ? m_Entities[entity + 1].firstMatrix :
+		                     header.numMatrices;
+		valid = valid && record.templateIndex < header.numTemplates && record.name < m_NumNames &&
+		        record.firstMatrix <= nextMatrix && nextMatrix <= header.numMatrices &&
+		        record.state < CCarTemplate::NumStates;
+	}
+	TUInt32 numNames = 0;
+	for (TUInt32 byte = 0; byte < m_Names.size(); ++byte)
+	{
+		numNames += (m_Names[byte] == 0);
+	}
+	if (!valid || numNames != m_NumNames)
+	{
+		Clear();
+		return false;
+	}
+
+	// Index the entities by captured UID for GetRestoredUID
+	m_UIDs.resize( header.numEntities );
+	for (TUInt32 entity = 0; entity < header.numEntities; ++entity)
+	{
+		m_UIDs[entity] = m_Entities[entity].capturedUID;
+		m_EntityIndexes.SetKeyValue( m_UIDs[entity], entity );
+	}
+	return true;
+}
+
+
+/////////////////////////////////////
+// Support functions
+
+// Clear the snapshot, leaving just the empty name
+void CSceneSnapshot::Clear()
+{
+	m_Names.assign( 1, 0 );
+	m_NumNames = 1;
+	m_NameIndexes.RemoveAllKeys();
+	m_NameIndexes.SetKeyValue( kNoName, 0 );
+
+	m_Templates.clear();
+	m_Entities.clear();
+	m_Matrices.clear();
+	m_ListStarts.assign( 1, 0 );
+	m_ListEntries.clear();
+	m_UIDs.clear();
+	m_EntityIndexes.RemoveAllKeys();
+}
+
+// Return the index of the given name (ID in EntityNames), adding it if necessary
+TUInt32 CSceneSnapshot::AddName( TNameID name )
+{
+	TUInt32 nameIndex;
+	if (!m_NameIndexes.LookUpKey( name, &nameIndex ))
+	{
+		const string& nameString = EntityNames.GetString( name );
+		m_Names.insert( m_Names.end(), nameString.c_str(), nameString.c_str() + nameString.size() + 1 );
+		nameIndex = m_NumNames++;
+		m_NameIndexes.SetKeyValue( name, nameIndex );
+	}
+	return nameIndex;
+}
+
+
+} // namespace gen
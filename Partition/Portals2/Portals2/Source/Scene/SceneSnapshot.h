@@ -0,0 +1,183 @@
+/*******************************************
+	SceneSnapshot.h
+
+	Binary snapshot of the entity manager's
+	templates and entities, for checkpoints
+	and fast scene loading
+********************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+#include "CFlatHashTable.h"
+#include "CMatrix4x4.h"
+#include "Entity.h"
+#include "EntityManager.h"
+
+namespace gen
+{
+
+// A scene snapshot holds the templates (names, meshes and car stats), the entities (template,
+// name, node matrices and car state) and any number of lists of entities, e.g. partition
+// membership. It is captured from an entity manager and restored into one, and can be saved
+// to and loaded from a binary file.
+//
+// Entities get new UIDs when a snapshot is restored, so the snapshot stores entity indexes in
+// place of UIDs. After a restore, the entity lists and GetRestoredUID give the new UIDs
+//
+// The file is a header followed by arrays of fixed size records. It is loaded with a single
+// read, then each array is copied out in one go - there is no per-entity parsing
+class CSceneSnapshot
+{
+/////////////////////////////////////
+//	Constructors/Destructors
+public:
+	// Constructor creates an empty snapshot
+	CSceneSnapshot();
+
+private:
+	// Prevent use of copy constructor and assignment operator (private and not defined)
+	CSceneSnapshot( const CSceneSnapshot& );
+	CSceneSnapshot& operator=( const CSceneSnapshot& );
+
+
+/////////////////////////////////////
+//	Public interface
+public:
+
+	/////////////////////////////////////
+	// Capture / Restore
+
+	// Capture all templates and entities from the given entity manager, replacing the current
+	// contents of the snapshot (including entity lists)
+	void Capture( CEntityManager& manager );
+
+	// Add a list of entities to the snapshot (e.g. those in a partition), after Capture.
+	// Entities that were not captured are left out. Returns the index of the list
+	TUInt32 AddEntityList( const vector<TEntityUID>& UIDs );
+
+	// Destroy all entities in the given manager and recreate them from the snapshot. Templates
+	// in the snapshot are reused if the manager has a template of the same name, otherwise they
+	// are created (loading the mesh). Returns false if an existing template doesn't match the
+	// snapshot (different class or number of nodes) - some entities will not have been created
+	bool Restore( CEntityManager& manager );
+
+
+	/////////////////////////////////////
+	// Entity handles
+
+	TUInt32 GetNumEntityLists()
+	{
+		return static_cast<TUInt32>(m_ListStarts.size()) - 1;
+	}
+
+	// Get the UIDs of the entities in the given list - those used when the list was added, or
+	// the new UIDs if the snapshot has been restored
+	void GetEntityList( TUInt32 list, vector<TEntityUID>* UIDs );
+
+	// Return the UID given by the last restore to the entity that had the given UID when the
+	// snapshot was captured. Returns SystemUID if the entity wasn't in the snapshot
+	TEntityUID GetRestoredUID( TEntityUID capturedUID );
+
+
+	/////////////////////////////////////
+	// File access
+
+	// Save the snapshot to a binary file, returns true on success
+	bool Save( const string& fileName ) const;
+
+	// Load a snapshot saved with Save, returns false if the file can't be read or is not a
+	// snapshot of the current version
+	bool Load( const string& fileName );
+
+
+/////////////////////////////////////
+//	Private interface
+private:
+
+	/////////////////////////////////////
+	// Types
+
+	// File identifier and version, increase the version whenever the records below change
+	static const TUInt32 kFileID = 0x50414e53; // "SNAP"
+	static const TUInt32 kFileVersion = 1;
+
+	// File header, gives the size of each array that follows it (in the order listed)
+	struct SHeader
+	{
+		TUInt32 fileID;
+		TUInt32 version;
+		TUInt32 numNames;       // Null terminated strings...
+		TUInt32 namesSize;      // ...taking this many bytes
+		TUInt32 numTemplates;   // STemplateRecord
+		TUInt32 numEntities;    // SEntityRecord
+		TUInt32 numMatrices;    // CMatrix4x4 - node matrices of all entities
+		TUInt32 numLists;       // TUInt32 - start of each entity list, plus end of the last
+		TUInt32 numListEntries; // TUInt32 - entity indexes in the lists
+	};
+
+	// Names are stored once each and referred to by index. Index 0 is the empty string
+	struct STemplateRecord
+	{
+		TUInt32  type;
+		TUInt32  name;
+		TUInt32  mesh;
+		TUInt32  isCar;
+		TFloat32 maxSpeed; // Car stats (if a car template)
+		TFloat32 acceleration;
+		TFloat32 turnSpeed;
+	};
+
+	struct SEntityRecord
+	{
+		TUInt32    templateIndex;
+		TUInt32    name;
+		TEntityUID capturedUID;
+		TUInt32    firstMatrix; // Index of first node matrix in the matrix array
+		TUInt32    isCar;       // Car entity rather than base entity
+		TFloat32   speed;       // Car instance data (if the template is a car template)
+		TUInt32    state;
+		TFloat32   timer;
+	};
+
+
+	/////////////////////////////////////
+	// Support functions
+
+	// Clear the snapshot, leaving just the empty name
+	void Clear();
+
+	// Return the index of the given name (ID in EntityNames), adding it if necessary
+	TUInt32 AddName( TNameID name );
+
+
+	/////////////////////////////////////
+	// Data
+
+	// Names, null terminated one after another
+	vector<char>    m_Names;
+	TUInt32         m_NumNames;
+
+	vector<STemplateRecord> m_Templates;
+	vector<SEntityRecord>   m_Entities;
+	vector<CMatrix4x4>      m_Matrices;
+
+	// Entity lists - list l is the entity indexes from m_ListEntries[m_ListStarts[l]] up to
+	// m_ListEntries[m_ListStarts[l + 1]]
+	vector<TUInt32> m_ListStarts;
+	vector<TUInt32> m_ListEntries;
+
+	// UIDs of the entities, as captured or as given by the last restore
+	vector<TEntityUID> m_UIDs;
+
+	// Index of each entity by captured UID, and name index by name ID (only used in Capture)
+	CFlatHashTable<TEntityUID, TUInt32> m_EntityIndexes;
+	CFlatHashTable<TNameID, TUInt32>    m_NameIndexes;
+};
+
+
+} // namespace gen
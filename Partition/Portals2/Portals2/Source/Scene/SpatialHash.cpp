@@ -0,0 +1,229 @@
+/*******************************************
+	SpatialHash.cpp
+
+	Uniform grid of entity positions, hashed
+	into a table, for proximity queries
+********************************************/
+
+#include "SpatialHash.h"
+#include "Hashers.h"
+
+namespace gen
+{
+
+/////////////////////////////////////
+// Constructors/Destructors
+
+// Constructor takes the cell size. Queries are fastest when the query radius is around the
+// cell size
+CSpatialHash::CSpatialHash( TFloat32 cellSize )
+{
+	m_CellSize = cellSize;
+	m_InvCellSize = 1.0f / cellSize;
+
+	// Start with an empty hash with a single bucket
+	m_BucketStarts.assign( 2, 0 );
+	m_BucketMask = 0;
+}
+
+
+/////////////////////////////////////
+// Building
+
+// Start rebuilding the hash with the given number of entities, then call AddEntity for each
+// and finally EndBuild. Memory is reused from the previous build where possible
+void CSpatialHash::BeginBuild( TUInt32 numEntities )
+{
+	m_NewEntities.clear();
+	m_NewBuckets.clear();
+	m_NewEntities.reserve( numEntities );
+	m_NewBuckets.reserve( numEntities );
+
+	// Use around two buckets per entity so most occupied cells have a bucket to themselves
+	TUInt32 numBuckets = 1;
+	while (numBuckets < numEntities * 2)
+	{
+		numBuckets *= 2;
+	}
+	m_BucketMask = numBuckets - 1;
+}
+
+void CSpatialHash::AddEntity( TEntityUID UID, TNameID templateType, const CVector3& position )
+{
+	SEntry entry;
+	entry.entity.UID = UID;
+	entry.entity.TemplateType = templateType;
+	entry.entity.Position = position;
+	entry.cellX = CellCoord( position.x );
+	entry.cellY = CellCoord( position.y );
+	entry.cellZ = CellCoord( position.z );
+	m_NewEntities.push_back( entry );
+	m_NewBuckets.push_back( Bucket( entry.cellX, entry.cellY, entry.cellZ ) );
+}
+
+// Sort the added entities by bucket (counting sort - linear in the number of entities)
+void CSpatialHash::EndBuild()
+{
+	// Count entities in each bucket, then convert counts to start positions
+	m_BucketStarts.assign( m_BucketMask + 2, 0 );
+	TUInt32 numEntities = static_cast<TUInt32>(m_NewEntities.size());
+	for (TUInt32 entity = 0; entity < numEntities; ++entity)
+	{
+		++m_BucketStarts[m_NewBuckets[entity] + 1];
+	}
+	for (TUInt32 bucket = 1; bucket < m_BucketStarts.size(); ++bucket)
+	{
+		m_BucketStarts[bucket] += m_BucketStarts[bucket - 1];
+	}
+
+	// Put each entity in the next space in its bucket. Bucket starts are advanced as entities
+	// are placed, ending at the start of the following bucket, so step them back afterwards
+	m_Entities.resize( numEntities );
+	for (TUInt32 entity = 0; entity < numEntities; ++entity)
+	{
+		m_Entities[m_BucketStarts[m_NewBuckets[entity]]++] = m_NewEntities[entity];
+	}
+	for (TUInt32 bucket = m_BucketMask + 1; bucket > 0; --bucket)
+	{
+		m_BucketStarts[bucket] = m_BucketStarts[bucket - 1];
+	}
+	m_BucketStarts[0] = 0;
+}
+
+
+/////////////////////////////////////
+// Queries
+
+// Find entities within the given distance of a point
+TUInt32 CSpatialHash::FindInRadius( const CVector3& centre, TFloat32 radius,
+                                    SSpatialEntity* results, TUInt32 maxResults ) const
+{
+	TUInt32 numResults = 0;
+	TFloat32 radiusSq = radius * radius;
+	auto visit = [&]( const SEntry& entry )
+	{
+		if (LengthSquared( entry.entity.Position - centre ) <= radiusSq)
+		{
+			results[numResults++] = entry.entity;
+		}
+		return numResults < maxResults;
+	};
+	if (maxResults > 0)
+	{
+		VisitCells( CellCoord( centre.x - radius ), CellCoord( centre.y - radius ),
+		            CellCoord( centre.z - radius ), CellCoord( centre.x + radius ),
+		            CellCoord( centre.y + radius ), CellCoord( centre.z + radius ), visit );
+	}
+	return numResults;
+}
+
+// Find entities inside the given axis-aligned box
+TUInt32 CSpatialHash::FindInBox( const CVector3& boxMin, const CVector3& boxMax,
+                                 SSpatialEntity* results, TUInt32 maxResults ) const
+{
+	TUInt32 numResults = 0;
+	auto visit = [&]( const SEntry& entry )
+	{
+		const CVector3& pos = entry.entity.Position;
+		if (pos.x >= boxMin.x && pos.y >= boxMin.y && pos.z >= boxMin.z &&
+		    pos.x <= boxMax.x && pos.y <= boxMax.y && pos.z <= boxMax.z)
+		{
+			results[numResults++] = entry.entity;
+		}
+		return numResults < maxResults;
+	};
+	if (maxResults > 0)
+	{
+		VisitCells( CellCoord( boxMin.x ), CellCoord( boxMin.y ), CellCoord( boxMin.z ),
+		            CellCoord( boxMax.x ), CellCoord( boxMax.y ), CellCoord( boxMax.z ), visit );
+	}
+	return numResults;
+}
+
+// Find the (up to) maxResults entities nearest to a point and no further than maxDistance,
+// nearest first. The given UID is skipped (e.g. the entity at the point), pass SystemUID
+// to skip none. maxResults is limited to kMaxNearest
+TUInt32 CSpatialHash::FindNearest( const CVector3& point, TFloat32 maxDistance,
+                                   TEntityUID skipUID, SSpatialEntity* results,
+                                   TUInt32 maxResults ) const
+{
+	maxResults = Min( maxResults, kMaxNearest );
+	if (maxResults == 0)
+	{
+		return 0;
+	}
+
+	// Keep the nearest entities found so far sorted by distance (insertion sort - the lists are
+	// short). An entity is only considered if it is nearer than the furthest kept so far
+	TFloat32 distancesSq[kMaxNearest];
+	TUInt32 numResults = 0;
+	TFloat32 maxDistanceSq = maxDistance * maxDistance;
+	auto visit = [&]( const SEntry& entry )
+	{
+		TFloat32 distanceSq = LengthSquared( entry.entity.Position - point );
+		if (distanceSq > maxDistanceSq || entry.entity.UID == skipUID ||
+		    (numResults == maxResults && distanceSq >= distancesSq[numResults - 1]))
+		{
+			return true;
+		}
+		TUInt32 insert = (numResults < maxResults) ? numResults++ : numResults - 1;
+		while (insert > 0 && distancesSq[insert - 1] > distanceSq)
+		{
+			distancesSq[insert] = distancesSq[insert - 1];
+			results[insert] = results[insert - 1];
+			--insert;
+		}
+		distancesSq[insert] = distanceSq;
+		results[insert] = entry.entity;
+		return true;
+	};
+
+	// Search shells of cells around the point's cell, one cell thicker each time. The point is
+	// inside the centre cell, so every cell outside shell n is at least n cells from it - stop
+	// when the nearest entities found are all closer than that
+	TInt32 pointX = CellCoord( point.x );
+	TInt32 pointY = CellCoord( point.y );
+	TInt32 pointZ = CellCoord( point.z );
+	TInt32 maxShell = static_cast<TInt32>(Min( maxDistance * m_InvCellSize, 65536.0f )) + 1;
+	TUInt32 numBuckets = m_BucketMask + 1;
+	for (TInt32 shell = 0; shell <= maxShell; ++shell)
+	{
+		// If the shell has more cells than there are buckets then just test every entity
+		TUInt32 shellSize = 2 * shell + 1;
+		if (shellSize * shellSize * shellSize > numBuckets)
+		{
+			numResults = 0;
+			for (TUInt32 entity = 0; entity < m_Entities.size(); ++entity)
+			{
+				visit( m_Entities[entity] );
+			}
+			return numResults;
+		}
+
+		// Visit the cells on the surface of the shell cube. Away from the x and y faces, only
+		// the first and last cells in z are on the surface
+		for (TInt32 cellX = pointX - shell; cellX <= pointX + shell; ++cellX)
+		{
+			bool xFace = (cellX == pointX - shell || cellX == pointX + shell);
+			for (TInt32 cellY = pointY - shell; cellY <= pointY + shell; ++cellY)
+			{
+				bool yFace = (cellY == pointY - shell || cellY == pointY + shell);
+				TInt32 stepZ = (xFace || yFace || shell == 0) ? 1 : 2 * shell;
+				for (TInt32 cellZ = pointZ - shell; cellZ <= pointZ + shell; cellZ += stepZ)
+				{
+					VisitCells( cellX, cellY, cellZ, cellX, cellY, cellZ, visit );
+				}
+			}
+		}
+
+		TFloat32 shellDistance = shell * m_CellSize;
+		if (numResults == maxResults && distancesSq[numResults - 1] <= shellDistance * shellDistance)
+		{
+			break;
+		}
+	}
+	return numResults;
+}
+
+
+} // namespace gen
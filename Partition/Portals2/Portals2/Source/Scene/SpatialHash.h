@@ -0,0 +1,216 @@
+/*******************************************
+	SpatialHash.h
+
+	Uniform grid of entity positions, hashed
+	into a table, for proximity queries
+********************************************/
+
+#pragma once
+
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+#include "CVector3.h"
+#include "Entity.h"
+#include "Hashers.h"
+
+namespace gen
+{
+
+// An entity found by a spatial hash query - its UID, template type (ID in EntityNames) and
+// position when the hash was built
+struct SSpatialEntity
+{
+	TEntityUID UID;
+	TNameID    TemplateType;
+	CVector3   Position;
+};
+
+
+// The spatial hash divides space into cubic cells and stores the entities in each cell. Cells
+// are hashed into a fixed number of buckets, so there is no limit on the extent of the scene.
+// The hash is rebuilt from all entity positions once per frame, then queries can be run
+// concurrently from any number of threads (they don't change the hash) until the next rebuild.
+// Query results are written to arrays supplied by the caller or passed to a visitor, nothing is
+// allocated
+class CSpatialHash
+{
+/////////////////////////////////////
+//	Constructors/Destructors
+public:
+	// Constructor takes the cell size. Queries are fastest when the query radius is around the
+	// cell size
+	CSpatialHash( TFloat32 cellSize );
+
+private:
+	// Prevent use of copy constructor and assignment operator (private and not defined)
+	CSpatialHash( const CSpatialHash& );
+	CSpatialHash& operator=( const CSpatialHash& );
+
+
+/////////////////////////////////////
+//	Public interface
+public:
+
+	/////////////////////////////////////
+	// Building
+
+	// Start rebuilding the hash with the given number of entities, then call AddEntity for each
+	// and finally EndBuild. Memory is reused from the previous build where possible
+	void BeginBuild( TUInt32 numEntities );
+	void AddEntity( TEntityUID UID, TNameID templateType, const CVector3& position );
+	void EndBuild();
+
+
+	/////////////////////////////////////
+	// Queries
+
+	// Each query writes up to maxResults entities to the results array and returns the number
+	// written. Entities are in no particular order, except for FindNearest
+
+	// Find entities within the given distance of a point
+	TUInt32 FindInRadius( const CVector3& centre, TFloat32 radius,
+	                      SSpatialEntity* results, TUInt32 maxResults ) const;
+
+	// Find entities inside the given axis-aligned box
+	TUInt32 FindInBox( const CVector3& boxMin, const CVector3& boxMax,
+	                   SSpatialEntity* results, TUInt32 maxResults ) const;
+
+	// Find the (up to) maxResults entities nearest to a point and no further than maxDistance,
+	// nearest first. The given UID is skipped (e.g. the entity at the point), pass SystemUID
+	// to skip none. maxResults is limited to kMaxNearest
+	TUInt32 FindNearest( const CVector3& point, TFloat32 maxDistance, TEntityUID skipUID,
+	                     SSpatialEntity* results, TUInt32 maxResults ) const;
+	static const TUInt32 kMaxNearest = 32;
+
+	// Call visit( entity ) for every entity within the given distance of a point, with no limit on
+	// the number found. Stops early if visit returns false
+	template <class TVisitor>
+	void VisitInRadius( const CVector3& centre, TFloat32 radius, TVisitor& visit ) const
+	{
+		TFloat32 radiusSq = radius * radius;
+		auto visitEntry = [&]( const SEntry& entry )
+		{
+			return LengthSquared( entry.entity.Position - centre ) > radiusSq ||
+			       visit( entry.entity );
+		};
+		VisitCells( CellCoord( centre.x - radius ), CellCoord( centre.y - radius ),
+		            CellCoord( centre.z - radius ), CellCoord( centre.x + radius ),
+		            CellCoord( centre.y + radius ), CellCoord( centre.z + radius ), visitEntry );
+	}
+
+	// Number of entities in the hash
+	TUInt32 GetNumEntities() const
+	{
+		return static_cast<TUInt32>(m_Entities.size());
+	}
+
+
+/////////////////////////////////////
+//	Private interface
+private:
+
+	/////////////////////////////////////
+	// Types
+
+	// Entity in the hash, with the cell that contains it (a bucket holds all cells that hash to
+	// it, so the cell must be checked to avoid finding entities twice)
+	struct SEntry
+	{
+		SSpatialEntity entity;
+		TInt32         cellX, cellY, cellZ;
+	};
+
+
+	/////////////////////////////////////
+	// Support functions
+
+	// Cell coordinate containing the given position coordinate
+	TInt32 CellCoord( TFloat32 coord ) const
+	{
+		return static_cast<TInt32>(Floor( coord * m_InvCellSize ));
+	}
+
+	// Bucket that the given cell hashes to. The coordinates are packed into one 64-bit key 21 bits
+	// apart and given the full MixHash64 - the HashFunctionBenchmark shows this spreads a block of
+	// cells as well as random, where the usual prime multiply and XOR clumps them into fewer
+	// buckets even after a full mix. Coordinates over 21 bits overlap, but every bit still reaches
+	// the mix
+	TUInt32 Bucket( TInt32 cellX, TInt32 cellY, TInt32 cellZ ) const
+	{
+		TUInt64 x = static_cast<TUInt32>(cellX);
+		TUInt64 y = static_cast<TUInt32>(cellY);
+		TUInt64 z = static_cast<TUInt32>(cellZ);
+		TUInt64 key = x ^ (y << 21 | y >> 43) ^ (z << 42 | z >> 22);
+		return MixHash64( key ) & m_BucketMask;
+	}
+
+	// Call visit( entry ) for every entity in the cells from minCell to maxCell inclusive.
+	// Returns false early if visit does
+	template <class TVisitor>
+	bool VisitCells( TInt32 minX, TInt32 minY, TInt32 minZ, TInt32 maxX, TInt32 maxY, TInt32 maxZ,
+	                 TVisitor& visit ) const
+	{
+		// If the range covers more cells than there are buckets, it is quicker to test every
+		// entity than to visit buckets several times
+		TUInt64 numCells = static_cast<TUInt64>(maxX - minX + 1) *
+		                   static_cast<TUInt64>(maxY - minY + 1) *
+		                   static_cast<TUInt64>(maxZ - minZ + 1);
+		if (numCells > m_BucketMask + 1)
+		{
+			for (TUInt32 entity = 0; entity < m_Entities.size(); ++entity)
+			{
+				const SEntry& entry = m_Entities[entity];
+				if (entry.cellX >= minX && entry.cellY >= minY && entry.cellZ >= minZ &&
+				    entry.cellX <= maxX && entry.cellY <= maxY && entry.cellZ <= maxZ)
+				{
+					if (!visit( entry )) return false;
+				}
+			}
+			return true;
+		}
+
+		for (TInt32 cellX = minX; cellX <= maxX; ++cellX)
+		{
+			for (TInt32 cellY = minY; cellY <= maxY; ++cellY)
+			{
+				for (TInt32 cellZ = minZ; cellZ <= maxZ; ++cellZ)
+				{
+					// Visit the entities in the cell's bucket that are actually in this cell
+					TUInt32 bucket = Bucket( cellX, cellY, cellZ );
+					for (TUInt32 entity = m_BucketStarts[bucket]; entity < m_BucketStarts[bucket + 1];
+					     ++entity)
+					{
+						const SEntry& entry = m_Entities[entity];
+						if (entry.cellX == cellX && entry.cellY == cellY && entry.cellZ == cellZ)
+						{
+							if (!visit( entry )) return false;
+						}
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+
+	/////////////////////////////////////
+	// Data
+
+	TFloat32 m_CellSize;
+	TFloat32 m_InvCellSize;
+
+	// Entities sorted by bucket. The entities in bucket b are from m_BucketStarts[b] up to
+	// m_BucketStarts[b + 1]. The number of buckets is a power of 2
+	vector<SEntry>  m_Entities;
+	vector<TUInt32> m_BucketStarts;
+	TUInt32         m_BucketMask;
+
+	// Entities added since BeginBuild, with their buckets - sorted into the above by EndBuild
+	vector<SEntry>  m_NewEntities;
+	vector<TUInt32> m_NewBuckets;
+};
+
+
+} // namespace gen
@@ -4,6 +4,7 @@
 using namespace tle;
 
 #include <CVector3.h>
+#include <CFixedTimestep.h>
 using namespace gen;
 
 // TODO: Given object's position and velocity, return acceleration needed to stay in orbit around a centre point
@@ -85,6 +86,10 @@ void main()
 		prevPosition = position;
 		OrbitMidpointMethod(position, velocity, centre, 1);
 	
+	// The orbit is updated 10 times a second whatever the frame rate, the sphere is drawn between updates
+	CFixedTimestep timestep( 1 / 10.0f, 4 );
+	CVector3 lastPosition = position; // Position before the last update
+
 	// The main game loop, repeat until engine is stopped
 	while (myEngine->IsRunning() && !myEngine->KeyHit( Key_Escape ))
 	{
@@ -93,15 +98,22 @@ void main()
 
 		
 		// Scene update
-		float updateTime = myEngine->Timer();
-		while (updateTime < 1 / 10.0f) updateTime += myEngine->Timer();
+		float frameTime = myEngine->Timer();
+		unsigned int numSteps = timestep.Update( frameTime );
+		float updateTime = timestep.GetStepTime();
 
 		// TODO: Call orbit method you wrote above to update object position, then set the orbiting model position
 		//
-		//OrbitMidpointMethod(position, velocity, centre, updateTime);
-		OrbitVerletMethod(position, centre, prevPosition, updateTime);
-
-		sphereOrbit->SetPosition(position.x, position.y, position.z);
+		for (unsigned int step = 0; step < numSteps; ++step)
+		{
+			lastPosition = position;
+			//OrbitMidpointMethod(position, velocity, centre, updateTime);
+			OrbitVerletMethod(position, centre, prevPosition, updateTime);
+		}
+
+		// Draw the sphere part way between the positions before and after the last update
+		CVector3 drawPosition = lastPosition + timestep.GetInterpolation() * (position - lastPosition);
+		sphereOrbit->SetPosition(drawPosition.x, drawPosition.y, drawPosition.z);
 	}
 
 	// Delete the 3D engine now we are finished with it
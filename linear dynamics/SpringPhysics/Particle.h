@@ -35,13 +35,21 @@ public:
 	////////////////////////////////////
 	// Properties, getters and setters
 
-	CVector3 GetPosition() { return m_Position; }
-	float    GetMass()     { return m_Mass; }
-	bool     IsPinned()    { return m_Pinned; }
+	CVector3 GetPosition();
+	float    GetMass();
+	bool     IsPinned();
+	unsigned int GetIndex() { return m_Index; } // Index of the particle in the spring system
 	
 	void SetPosition( CVector3& position );
 	void SetMass( float mass );
-	void Pin( bool isPinned ) { m_Pinned = isPinned; }
+	void Pin( bool isPinned );
+
+	// Position models (and attached springs) at the particle's current position in the spring system,
+	// or part way through the last step (see CSpringSystem::GetInterpolatedPosition)
+	void UpdateModel( float interpolation = 1.0f );
+
+	// Position the models were last placed at, may be between simulation steps
+	CVector3 GetModelPosition() { return m_ModelPosition; }
 
 	IModel* Model()       { return m_Model; }
 	IModel* Shadow()      { return m_Shadow; }
@@ -55,34 +63,19 @@ public:
 	list<CSpring*>& GetSprings() { return m_Springs; }
 
 
-	////////////////////////////////////
-	// Simulation
-
-	void InitSimulation();
-	void ResetSimulation();
-	void ApplyForces( float updateTime, CVector3 externalForces );
-
-
 private:
 
 	////////////////////////////////////
 	// Particle data
 
-	// Static data
-	CVector3 m_Position;
-	float    m_Mass;
-	bool     m_Pinned;   // A pinned particle cannot be moved
+	// Position, mass and simulation data are held in the spring system (see SpringSystem.h)
+	unsigned int m_Index;
 
 	list<CSpring*> m_Springs; // All the springs attached to this particle
 
 	IModel*  m_Model;
 	IModel*  m_Shadow;
-
-	// Simulation data
-	CVector3 m_InitialPosition; // When simulation ends, particle is reset to initial position
-	CVector3 m_Acceleration;
-	CVector3 m_Velocity;        // For Euler or mid-point method
-	CVector3 m_PrevPosition;    // For verlet method
+	CVector3 m_ModelPosition;
 };
 
 
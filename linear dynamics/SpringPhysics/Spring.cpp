@@ -6,11 +6,19 @@
 
 #include "Spring.h"
 #include "Particle.h"
+#include "SpringSystem.h"
 
 #include "CMatrix4x4.h"
 using namespace gen;
 
 
+/////////////////////////////
+// Static Data / Constants
+
+// Spring system holding the simulation data for all fully attached springs
+extern CSpringSystem SpringSystem;
+
+
 /////////////////////////////
 // Constructor / Destructor
 
@@ -21,6 +29,7 @@ CSpring::CSpring( IMesh* springMesh, IMesh* inertialMesh, CParticle* particle1,
 	m_Particle1 = particle1;
 	m_Particle2 = particle2;
 	m_TempTarget = CVector3::kOrigin;
+	m_Index = CSpringSystem::NO_INDEX;
 
 	m_Model = springMesh->CreateModel();
 	SetType( type );
@@ -41,6 +50,8 @@ CSpring::CSpring( IMesh* springMesh, IMesh* inertialMesh, CParticle* particle1,
 	{
 		m_InertialLength = 0.0f;
 	}
+
+	UpdateSystemSpring();
 }
 
 CSpring::~CSpring()
@@ -48,6 +59,8 @@ CSpring::~CSpring()
 	m_Model->GetMesh()->RemoveModel( m_Model );
 	if (m_Particle1) m_Particle1->RemoveSpring( this );
 	if (m_Particle2) m_Particle2->RemoveSpring( this );
+	m_Particle1 = m_Particle2 = NULL;
+	UpdateSystemSpring();
 }
 
 
@@ -57,12 +70,14 @@ CSpring::~CSpring()
 void CSpring::SetParticle1( CParticle* particle1 )
 {
 	m_Particle1 = particle1;
+	UpdateSystemSpring();
 	OrientateModel();
 }
 
 void CSpring::SetParticle2( CParticle* particle2 )
 {
 	m_Particle2 = particle2;
+	UpdateSystemSpring();
 	OrientateModel();
 }
 
@@ -75,6 +90,10 @@ void CSpring::SetTempTarget( CVector3& target )
 void CSpring::SetType( CSpring::ESpringType type )
 {
 	m_Type = type;
+	if (m_Index != CSpringSystem::NO_INDEX)
+	{
+		SpringSystem.SetSpringType( m_Index, static_cast<CSpringSystem::ESpringType>(m_Type) );
+	}
 	switch (type)
 	{
 		case Spring: 
@@ -95,6 +114,10 @@ void CSpring::SetType( CSpring::ESpringType type )
 void CSpring::SetCoefficient( float coefficient )
 {
 	m_SpringCoefficient = coefficient;
+	if (m_Index != CSpringSystem::NO_INDEX)
+	{
+		SpringSystem.SetSpringCoefficient( m_Index, m_SpringCoefficient );
+	}
 	OrientateModel();
 }
 
@@ -108,6 +131,10 @@ void CSpring::SetInertialLength( float length )
 	{
 		m_InertialLength = length;
 	}
+	if (m_Index != CSpringSystem::NO_INDEX)
+	{
+		SpringSystem.SetSpringInertialLength( m_Index, m_InertialLength );
+	}
 	OrientateModel();
 }
 
@@ -139,23 +166,23 @@ void CSpring::OrientateModel()
 		if (m_Particle2)
 		{
 			// Spring is fully attached
-			CMatrix4x4 springMat = MatrixFaceTarget( m_Particle1->GetPosition(), m_Particle2->GetPosition(), CVector3::kZAxis );
-			springMat.ScaleZ( Distance( m_Particle1->GetPosition(), m_Particle2->GetPosition() ) );
+			CMatrix4x4 springMat = MatrixFaceTarget( m_Particle1->GetModelPosition(), m_Particle2->GetModelPosition(), CVector3::kZAxis );
+			springMat.ScaleZ( Distance( m_Particle1->GetModelPosition(), m_Particle2->GetModelPosition() ) );
 			springMat.ScaleX( DEFAULT_SCALE );
 			m_Model->SetMatrix( &springMat.e00 );
 
 			// Draw inertial length model (at mid-point of spring) - width represents spring coefficient
 			if (m_InertialModel != 0)
 			{
-				springMat = MatrixFaceTarget( (m_Particle1->GetPosition() + m_Particle2->GetPosition()) * 0.5f,
-											   m_Particle2->GetPosition(), CVector3::kZAxis );
+				springMat = MatrixFaceTarget( (m_Particle1->GetModelPosition() + m_Particle2->GetModelPosition()) * 0.5f,
+											   m_Particle2->GetModelPosition(), CVector3::kZAxis );
 				springMat.ScaleZ( m_InertialLength );
 				springMat.ScaleX( m_SpringCoefficient );
 				m_InertialModel->SetMatrix( &springMat.e00 );
 			}			
 			
 			// Make string and elastic look "floppy" when short
-			float length = Distance( m_Particle1->GetPosition(), m_Particle2->GetPosition() );
+			float length = Distance( m_Particle1->GetModelPosition(), m_Particle2->GetModelPosition() );
 			if (length < m_InertialLength * FLOPPY_LENGTH) // "Floppy" at < certain proportion of normal length
 			{
 				if (m_Type == String) m_Model->SetSkin( "stringfloppy_tlxcutout.tga" ); 
@@ -170,8 +197,8 @@ void CSpring::OrientateModel()
 		}
 
 		// Spring is only attached at one end, attach other to temporary target
-		CMatrix4x4 springMat = MatrixFaceTarget( m_Particle1->GetPosition(), m_TempTarget, CVector3::kZAxis );
-		springMat.ScaleZ( Distance( m_Particle1->GetPosition(), m_TempTarget ) );
+		CMatrix4x4 springMat = MatrixFaceTarget( m_Particle1->GetModelPosition(), m_TempTarget, CVector3::kZAxis );
+		springMat.ScaleZ( Distance( m_Particle1->GetModelPosition(), m_TempTarget ) );
 		springMat.ScaleX( DEFAULT_SCALE );
 		m_Model->SetMatrix( &springMat.e00 );
 		if (m_InertialModel != 0)
@@ -192,68 +219,27 @@ void CSpring::OrientateModel()
 }
 
 
+
 ////////////////////////////////////
-// Simulation
+// Spring system
 
-// TODO: Return current force exerted by spring on given particle - based on how long it currently is compared to its inertial length
-// Look at the Spring.h & Particle.h files to see the available member data and methods
-CVector3 CSpring::CalculateForce( CParticle* particle )
+// Add the spring to the spring system if it's attached at both ends, or remove it if not - only fully attached springs are simulated
+void CSpring::UpdateSystemSpring()
 {
-	// Return zero force if spring not attached to given particle, or if given particle is pinned
-	//...
-	if (!particle || (particle != m_Particle1 && particle!= m_Particle2) || particle->IsPinned())
+	// Remove from spring system, the last spring in the system is moved to this spring's index
+	if (m_Index != CSpringSystem::NO_INDEX)
 	{
-		return CVector3::kZero;
+		SpringSystem.RemoveSpring( m_Index );
+		if (m_Index < SpringSystem.GetNumSprings())
+		{
+			SpringSystem.GetSpringView( m_Index )->m_Index = m_Index;
+		}
+		m_Index = CSpringSystem::NO_INDEX;
 	}
 
-	// Calculate strength of force based on current spring length and inertial length
-	float forceStrength;
-	//F = -k(L-E)
-	//float coefficient = GetCoefficient();
-	//float inertialLenght = GetInertialLength();
-	//float length = distance(m_Particle1, m_Particle2);
-
-	//forceStrength = -coefficient * (length - inertialLenght);
-
-	CVector3 springVec(m_Particle1->GetPosition(), m_Particle2->GetPosition());
-	float currLength = Length(springVec);
-	forceStrength = (currLength - m_InertialLength) * m_SpringCoefficient;
-
-	// Return force as vector - ensure direction is correct for the given particle. Length of vector should be force strength from above
-	//...
-
-	//CVector3 force = Normalise(m_Particle1->GetPosition() - m_Particle2->GetPosition());
-	//force = force * forceStrength;
-	CVector3 force = forceStrength * springVec / currLength;
-
-	if (particle == m_Particle1)
-	{
-		return force;
-	}
-	else
+	if (m_Particle1 && m_Particle2)
 	{
-		return -force;
+		m_Index = SpringSystem.AddSpring( m_Particle1->GetIndex(), m_Particle2->GetIndex(), m_SpringCoefficient, m_InertialLength,
+		                                  static_cast<CSpringSystem::ESpringType>(m_Type), this );
 	}
-
-}
-
-
-// TODO: Update position of the particles attached to this spring based on any constraints. The constraints used in this
-// system are: rods cannot change length (always = inertial length), and strings cannot become > inertial length
-void CSpring::ApplyConstraints()
-{
-	// No constraints on springs or elastic, so just return on those types
-	//...
-	if (m_Type == Spring || m_Type == Elastic) return;
-
-
-	// Calculate current length of spring, and difference between that and the inertial length.
-	// Return if we have a string that is shorter than the inertial length - no constraints in that case
-	//...
-
-
-	// Correct particle positions so the length is correct again. Refer to lecture notes
-	// Ensure that pinned particles are not moved
-	//...	
 }
- 
\ No newline at end of file
@@ -49,6 +49,7 @@ public:
 	ESpringType GetType()           { return m_Type; }
 	float       GetCoefficient()    { return m_SpringCoefficient; }
 	float       GetInertialLength() { return m_InertialLength; }
+	unsigned int GetIndex()         { return m_Index; } // Index of the spring in the spring system, NO_INDEX if not fully attached
 
 	void SetParticle1( CParticle* particle1 );
 	void SetParticle2( CParticle* particle2 );
@@ -68,18 +69,14 @@ public:
 	void OrientateModel();
 
 
-	////////////////////////////////////
-	// Simulation
-
-	// Return current force exerted by spring on given particle - based on how long it currently is compared to its inertial length
-	CVector3 CalculateForce( CParticle* particle );
+private:
 
-	// Update position of the particles attached to this spring based on any constraints. The constraints used in this
-	// system are: rods cannot change length (always = inertial length), and strings cannot become > inertial length
-	void ApplyConstraints();
+	////////////////////////////////////
+	// Spring system
 
+	// Add the spring to the spring system if it's attached at both ends, or remove it if not - only fully attached springs are simulated
+	void UpdateSystemSpring();
 
-private:
 
 	////////////////////////////////////
 	// Spring data
@@ -96,9 +93,10 @@ private:
 
 	CVector3    m_TempTarget; // Used to help position spring before it has been fully attached
 
-	// Simulation data
-	float       m_InertialLength;
-	float       m_SpringCoefficient;
+	// Simulation data - copied to the spring system when attached
+	float        m_InertialLength;
+	float        m_SpringCoefficient;
+	unsigned int m_Index;
 
 };
 
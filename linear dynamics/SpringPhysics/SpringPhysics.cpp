@@ -10,6 +10,9 @@ using namespace std;
 using namespace tle;
 
 #include "CVector3.h"
+#include "CThreadPool.h"
+#include "CFixedTimestep.h"
+#include "SpringSystem.h"
 #include "Particle.h"
 #include "Spring.h"
 #include "Support.h"
@@ -22,6 +25,21 @@ using namespace gen;
 
 const float DEFAULT_MASS = 2.0f;
 const float DEFAULT_COEFFICIENT = 40.0f;
+const float DAMPING = 0.2f; // Damping force per unit velocity - particles of default mass lose ~10% of their speed per second
+const int SOLVER_ITERATIONS = 4; // Times the rods and strings are solved each frame - more keeps long chains from stretching
+const float PARTICLE_RADIUS = 1.0f; // Collision radius of particles (size of a particle model of default mass)
+const float SLEEP_THRESHOLD = 0.2f; // Kinetic energy per unit mass below which groups of particles at rest stop being simulated
+
+// Simulation data for all particles and springs - the particle and spring objects below are views onto it
+CSpringSystem SpringSystem;
+
+// Threads used to solve the constraints
+CThreadPool* ThreadPool = 0;
+
+// The simulation is stepped at a fixed rate whatever the frame rate, models are drawn between steps
+const float SIMULATION_RATE = 120.0f; // Steps per second
+const int MAX_STEPS = 8; // Most steps in one frame - the simulation slows down rather than falling further behind
+CFixedTimestep Timestep( 1 / SIMULATION_RATE, MAX_STEPS );
 
 list<CParticle*> Particles;
 list<CSpring*> Springs;
@@ -240,46 +258,49 @@ list<CSpring*>::iterator PickSpring( int* nearestDist )
 // Simulation Control
 //------------------------------------------
 
-void StartSimulation()
+// Position particle models (and their springs) to match the spring system, or part way through the
+// last step (0 = start of the step, 1 = end)
+void UpdateParticleModels( float interpolation = 1.0f )
 {
 	list<CParticle*>::iterator itParticle = Particles.begin();
 	while (itParticle != Particles.end())
 	{
-		(*itParticle)->InitSimulation();
+		(*itParticle)->UpdateModel( interpolation );
 		++itParticle;
 	}
 }
 
+void StartSimulation()
+{
+	SpringSystem.SetIntegrator( CSpringSystem::Euler );
+	SpringSystem.SetDamping( DAMPING );
+	SpringSystem.SetNumIterations( SOLVER_ITERATIONS );
+	SpringSystem.SetParticleRadius( PARTICLE_RADIUS );
+	SpringSystem.SetSleepThreshold( SLEEP_THRESHOLD );
+	SpringSystem.InitSimulation();
+	Timestep.Reset();
+}
+
 void EndSimulation()
 {
-	list<CParticle*>::iterator itParticle = Particles.begin();
-	while (itParticle != Particles.end())
-	{
-		(*itParticle)->ResetSimulation();
-		++itParticle;
-	}
+	SpringSystem.ResetSimulation();
+	UpdateParticleModels();
 }
 
 void UpdateSimulation( float updateTime )
 {
 	const CVector3 gravity = CVector3(0, -98.0f, 0);
 
-	// Update particle positions based on forces from springs and external forces (e.g. gravity). Ignore constraints for now
-	list<CParticle*>::iterator itParticle = Particles.begin();
-	while (itParticle != Particles.end())
+	// Update particle positions based on forces from springs and gravity, then adjust them based on any
+	// constraints (e.g. rods cannot change length). Run as many fixed steps as fit in the frame time
+	unsigned int numSteps = Timestep.Update( updateTime );
+	for (unsigned int step = 0; step < numSteps; ++step)
 	{
-		CVector3 externalForces = (*itParticle)->GetMass() * gravity; // Particle mass * gravity acceleration = gravitation force on this particle
-		(*itParticle)->ApplyForces( updateTime, externalForces );
-		++itParticle;
+		SpringSystem.Step( Timestep.GetStepTime(), gravity );
 	}
 
-	// Adjust springs (and their attached particles) based on any constraints (e.g. rods cannot change length)
-	list<CSpring*>::iterator itSpring = Springs.begin();
-	while (itSpring != Springs.end())
-	{
-		(*itSpring)->ApplyConstraints();
-		++itSpring;
-	}
+	// Draw the particles between the last two steps, at the time left over
+	UpdateParticleModels( Timestep.GetInterpolation() );
 }
 
 
@@ -294,11 +315,16 @@ void main()
 	Engine->StartWindowed(1024, 768);
 	Engine->Timer();
 
+	// Solve constraints across all cores
+	ThreadPool = new CThreadPool();
+	SpringSystem.SetThreadPool( ThreadPool );
+
 	// Generic scene setup
 	Camera = Engine->CreateCamera( kManual, 0, 80, 0 );
 	Camera->SetNearClip( NearClip );
 	IMesh* floorMesh = Engine->LoadMesh( "Floor.x" );
 	IModel* floor = floorMesh->CreateModel(0, -0.1f, 0); // Slightly downwards to stop z-fighting shadows
+	SpringSystem.AddPlaneCollider( CVector3::kYAxis, 0.0f ); // Particles collide with the floor
 	SelectionMesh = Engine->LoadMesh( "Cube.x" );
 	ParticleMesh = Engine->LoadMesh( "Particle.x" );
 	ShadowMesh = Engine->LoadMesh( "Shadow.x" );
@@ -735,6 +761,8 @@ void main()
 		delete (*Particles.begin());
 		Particles.pop_front();
 	}
+	SpringSystem.SetThreadPool( 0 );
+	delete ThreadPool;
 
 	// Delete the 3D engine now we are finished with it
 	Engine->Delete();